@@ -252,6 +252,58 @@ static unsigned long get_target_addr(struct mcount_dynamic_info *mdi, unsigned l
 	return mdi->trampoline - (addr + CALL_INSN_SIZE);
 }
 
+/*
+ * Other threads can run the function while it's patched (--patch-async or
+ * by the agent).  Write the 5-byte instruction in a single 8-byte store if
+ * it's in a cache line as x86 guarantees atomicity of such (unaligned)
+ * accesses.  Otherwise it cannot be updated safely, so give up unless it's
+ * the only thread (at startup).  Returns false if not written.
+ */
+static bool write_insn5(struct mcount_dynamic_info *mdi, unsigned char *insn,
+			const unsigned char *new_insn)
+{
+	unsigned long offset = (unsigned long)insn & 63;
+	unsigned char *base;
+	union {
+		uint64_t word;
+		unsigned char bytes[8];
+	} patch;
+
+	if (offset + 8 <= 64)
+		base = insn;
+	else if (offset + 5 <= 64)
+		base = insn + 5 - 8;
+	else
+		base = NULL;
+
+	if (base == NULL) {
+		if (mdi->live_patch) {
+			pr_dbg3("skip %p as it crosses a cache line\n", insn);
+			return false;
+		}
+
+		/* hopefully we're not patching 'memcpy' itself */
+		memcpy(insn, new_insn, CALL_INSN_SIZE);
+		return true;
+	}
+
+	memcpy(patch.bytes, base, sizeof(patch));
+	memcpy(&patch.bytes[insn - base], new_insn, CALL_INSN_SIZE);
+
+	__atomic_store_n((uint64_t *)base, patch.word, __ATOMIC_RELAXED);
+	return true;
+}
+
+static bool write_call_insn(struct mcount_dynamic_info *mdi, unsigned char *insn,
+			    unsigned int target_addr)
+{
+	/* make a "call" insn with 4-byte offset */
+	unsigned char call_insn[CALL_INSN_SIZE] = { 0xe8 };
+
+	memcpy(&call_insn[1], &target_addr, sizeof(target_addr));
+	return write_insn5(mdi, insn, call_insn);
+}
+
 static int patch_fentry_code(struct mcount_dynamic_info *mdi, struct uftrace_symbol *sym)
 {
 	unsigned char *insn = (void *)sym->addr + mdi->map->start;
@@ -275,10 +327,8 @@ static int patch_fentry_code(struct mcount_dynamic_info *mdi, struct uftrace_sym
 	if (target_addr == 0)
 		return INSTRUMENT_SKIPPED;
 
-	/* make a "call" insn with 4-byte offset */
-	insn[0] = 0xe8;
-	/* hopefully we're not patching 'memcpy' itself */
-	memcpy(&insn[1], &target_addr, sizeof(target_addr));
+	if (!write_call_insn(mdi, insn, target_addr))
+		return INSTRUMENT_SKIPPED;
 
 	pr_dbg3("update %p for '%s' function dynamically to call __fentry__\n", insn, sym->name);
 
@@ -469,6 +519,29 @@ static void patch_code(struct mcount_dynamic_info *mdi, struct mcount_disasm_inf
 	__builtin___clear_cache(origin_code_addr, origin_code_addr + info->orig_size);
 }
 
+/*
+ * Use the prologue size from the patch plan instead of disassembling.
+ * The plan only has the size if the instructions don't need relocation.
+ */
+static int copy_plain_insns(struct mcount_dynamic_info *mdi, struct mcount_disasm_info *info)
+{
+	void *addr = (void *)info->addr;
+
+	if (mdi->plain_size < CALL_INSN_SIZE || mdi->plain_size > sizeof(info->insns))
+		return INSTRUMENT_FAILED;
+
+	if (!memcmp(addr, endbr64, sizeof(endbr64))) {
+		addr += sizeof(endbr64);
+		info->has_intel_cet = true;
+	}
+
+	memcpy(info->insns, addr, mdi->plain_size);
+	info->orig_size = mdi->plain_size;
+	info->copy_size = mdi->plain_size;
+
+	return INSTRUMENT_SUCCESS;
+}
+
 static int patch_normal_func(struct mcount_dynamic_info *mdi, struct uftrace_symbol *sym,
 			     struct mcount_disasm_engine *disasm)
 {
@@ -485,7 +558,11 @@ static int patch_normal_func(struct mcount_dynamic_info *mdi, struct uftrace_sym
 	unsigned call_offset = CALL_INSN_SIZE;
 	int state;
 
-	state = disasm_check_insns(disasm, mdi, &info);
+	if (mdi->plain_size)
+		state = copy_plain_insns(mdi, &info);
+	else
+		state = disasm_check_insns(disasm, mdi, &info);
+
 	if (state != INSTRUMENT_SUCCESS) {
 		pr_dbg3("  >> %s: %s\n", state == INSTRUMENT_FAILED ? "FAIL" : "SKIP", sym->name);
 		return state;
@@ -518,6 +595,9 @@ static int patch_normal_func(struct mcount_dynamic_info *mdi, struct uftrace_sym
 
 	patch_code(mdi, &info);
 
+	/* save the size for the patch plan if it can be copied as is */
+	mdi->plain_size = info.modified ? 0 : info.orig_size;
+
 	return INSTRUMENT_SUCCESS;
 }
 
@@ -554,6 +634,28 @@ static int unpatch_fentry_func(struct mcount_dynamic_info *mdi, struct uftrace_s
 	return unpatch_func((void *)sym_addr, sym->name);
 }
 
+/* restore the NOP of a function patched to call the trampoline */
+static int unpatch_fentry_code(struct mcount_dynamic_info *mdi, struct uftrace_symbol *sym)
+{
+	unsigned char nop5[] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+	unsigned char *insn = (void *)sym->addr + mdi->map->start;
+	unsigned int target_addr;
+
+	if (!memcmp(insn, endbr64, sizeof(endbr64)))
+		insn += sizeof(endbr64);
+
+	/* it might be a real call instruction */
+	memcpy(&target_addr, &insn[1], sizeof(target_addr));
+	if (insn[0] != 0xe8 || target_addr != get_target_addr(mdi, (unsigned long)insn))
+		return INSTRUMENT_SKIPPED;
+
+	if (!write_insn5(mdi, insn, nop5))
+		return INSTRUMENT_SKIPPED;
+
+	pr_dbg3("unpatch %p for '%s' function dynamically\n", insn, sym->name);
+	return INSTRUMENT_SUCCESS;
+}
+
 static int cmp_loc(const void *a, const void *b)
 {
 	const struct uftrace_symbol *sym = a;
@@ -630,6 +732,11 @@ int mcount_unpatch_func(struct mcount_dynamic_info *mdi, struct uftrace_symbol *
 		result = unpatch_mcount_func(mdi, sym);
 		break;
 
+	case DYNAMIC_FENTRY_NOP:
+	case DYNAMIC_PATCHABLE:
+		result = unpatch_fentry_code(mdi, sym);
+		break;
+
 	default:
 		break;
 	}
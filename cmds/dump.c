@@ -8,12 +8,14 @@
 #include "libtraceevent/event-parse.h"
 #include "libtraceevent/kbuffer.h"
 #include "uftrace.h"
+#include "utils/arrow.h"
 #include "utils/event.h"
 #include "utils/filter.h"
 #include "utils/fstack.h"
 #include "utils/graph.h"
 #include "utils/kernel.h"
 #include "utils/list.h"
+#include "utils/selfstat.h"
 #include "utils/utils.h"
 #include "version.h"
 
@@ -86,6 +88,24 @@ struct uftrace_mermaid_dump {
 	struct uftrace_dump_ops ops;
 };
 
+/* columns in the arrow output */
+enum arrow_dump_column {
+	ARROW_COL_TID,
+	ARROW_COL_TIMESTAMP,
+	ARROW_COL_DURATION,
+	ARROW_COL_DEPTH,
+	ARROW_COL_TYPE,
+	ARROW_COL_FUNCTION,
+	ARROW_COL_MODULE,
+	ARROW_COL_ARGS,
+};
+
+struct uftrace_arrow_dump {
+	struct uftrace_dump_ops ops;
+	struct arrow_writer *aw;
+	int ret;
+};
+
 static const char *rstack_type(struct uftrace_record *frs)
 {
 	return frs->type == UFTRACE_EXIT  ? "exit " :
@@ -541,7 +561,7 @@ static void dump_raw_header(struct uftrace_dump_ops *ops, struct uftrace_data *h
 	const char *info_str[] = { "EXE_NAME",	   "EXE_BUILD_ID", "EXIT_STATUS", "CMDLINE",
 				   "CPUINFO",	   "MEMINFO",	   "OSINFO",	  "TASKINFO",
 				   "USAGEINFO",	   "LOADINFO",	   "ARG_SPEC",	  "RECORD_DATE",
-				   "PATTERN_TYPE", "VERSION" };
+				   "PATTERN_TYPE", "VERSION",	   "OVERHEAD" };
 
 	pr_out("uftrace file header: magic         = ");
 	for (i = 0; i < UFTRACE_MAGIC_LEN; i++)
@@ -935,6 +955,30 @@ static void dump_chrome_task_rstack(struct uftrace_dump_ops *ops, struct uftrace
 		chrome->lost_event_cnt++;
 }
 
+/* show lock waits as slices with the duration */
+static void dump_chrome_task_event(struct uftrace_dump_ops *ops, struct uftrace_task_reader *task)
+{
+	struct uftrace_record *frs = task->rstack;
+	struct uftrace_chrome_dump *chrome = container_of(ops, typeof(*chrome), ops);
+	struct uftrace_lock_wait wait;
+
+	if (frs->addr != EVENT_ID_LOCK_WAIT)
+		return;
+
+	memcpy(&wait, task->args.data, sizeof(wait));
+
+	if (chrome->last_comma)
+		pr_out(",\n");
+	chrome->last_comma = true;
+
+	pr_out("{\"ts\":%" PRIu64 ".%03d,\"ph\":\"X\",\"dur\":%" PRIu64 ".%03d,"
+	       "\"pid\":%d,\"tid\":%d,\"name\":\"lock:wait\","
+	       "\"args\":{\"type\":\"%s\",\"lock\":\"%#" PRIx64 "\"}}",
+	       frs->time / 1000, (int)(frs->time % 1000), wait.wait / 1000,
+	       (int)(wait.wait % 1000), task->t->pid, task->tid,
+	       event_get_lock_type(wait.type), wait.lock);
+}
+
 static void dump_chrome_kernel_rstack(struct uftrace_dump_ops *ops,
 				      struct uftrace_kernel_reader *kernel, int cpu,
 				      struct uftrace_record *rec, char *name)
@@ -1375,6 +1419,140 @@ static void dump_mermaid_footer(struct uftrace_dump_ops *ops, struct uftrace_dat
 	pr_out("</html>\n");
 }
 
+/* arrow support */
+static void dump_arrow_header(struct uftrace_dump_ops *ops, struct uftrace_data *handle,
+			      struct uftrace_opts *opts)
+{
+	struct uftrace_arrow_dump *arrow = container_of(ops, typeof(*arrow), ops);
+	struct arrow_writer *aw = arrow->aw;
+
+	arrow_add_column(aw, "tid", ARROW_TYPE_INT32);
+	arrow_add_column(aw, "timestamp", ARROW_TYPE_UINT64);
+	arrow_add_column(aw, "duration", ARROW_TYPE_UINT64);
+	arrow_add_column(aw, "depth", ARROW_TYPE_INT32);
+	arrow_add_column(aw, "type", ARROW_TYPE_DICT);
+	arrow_add_column(aw, "function", ARROW_TYPE_DICT);
+	arrow_add_column(aw, "module", ARROW_TYPE_DICT);
+	if (show_args)
+		arrow_add_column(aw, "args", ARROW_TYPE_UTF8);
+
+	arrow->ret = arrow_write_schema(aw);
+}
+
+static const char *arrow_module_name(struct uftrace_task_reader *task, uint64_t addr)
+{
+	struct uftrace_session *s;
+	struct uftrace_mmap *map;
+
+	s = find_task_session(&task->h->sessions, task->t, task->rstack->time);
+	if (s == NULL)
+		return "[unknown]";
+
+	map = find_map(&s->sym_info, addr);
+	if (map == MAP_KERNEL)
+		return "[kernel]";
+	if (map)
+		return basename(map->libname);
+	return "[unknown]";
+}
+
+static void dump_arrow_record(struct uftrace_arrow_dump *arrow, struct uftrace_task_reader *task,
+			      const char *name, const char *module, const char *args)
+{
+	struct arrow_writer *aw = arrow->aw;
+	struct uftrace_record *frs = task->rstack;
+	struct uftrace_fstack *fstack;
+	uint64_t duration = 0;
+	int depth = frs->depth;
+
+	if (frs->type == UFTRACE_ENTRY || frs->type == UFTRACE_EXIT)
+		depth = task->display_depth;
+
+	if (frs->type == UFTRACE_EXIT) {
+		fstack = fstack_get(task, task->stack_count);
+		if (fstack)
+			duration = fstack->total_time;
+	}
+
+	arrow_set_int(aw, ARROW_COL_TID, task->tid);
+	arrow_set_int(aw, ARROW_COL_TIMESTAMP, frs->time);
+	arrow_set_int(aw, ARROW_COL_DURATION, duration);
+	arrow_set_int(aw, ARROW_COL_DEPTH, depth);
+	arrow_set_str(aw, ARROW_COL_TYPE, frs->type == UFTRACE_EXIT  ? "exit" :
+					  frs->type == UFTRACE_ENTRY ? "entry" :
+					  frs->type == UFTRACE_EVENT ? "event" :
+								       "lost");
+	arrow_set_str(aw, ARROW_COL_FUNCTION, name);
+	arrow_set_str(aw, ARROW_COL_MODULE, module);
+	if (show_args)
+		arrow_set_str(aw, ARROW_COL_ARGS, args);
+
+	if (arrow_next_row(aw) < 0)
+		arrow->ret = -1;
+}
+
+static void dump_arrow_task_rstack(struct uftrace_dump_ops *ops, struct uftrace_task_reader *task,
+				   char *name)
+{
+	struct uftrace_arrow_dump *arrow = container_of(ops, typeof(*arrow), ops);
+	struct uftrace_record *frs = task->rstack;
+	enum uftrace_argspec_string_bits str_mode = HAS_MORE;
+	char args[2048] = "";
+	const char *module;
+
+	/* schedule events are passed as functions */
+	if (frs->type == UFTRACE_EVENT)
+		module = "[event]";
+	else
+		module = arrow_module_name(task, frs->addr);
+
+	if (frs->more && show_args && frs->type != UFTRACE_EVENT) {
+		if (frs->type == UFTRACE_EXIT)
+			str_mode |= IS_RETVAL;
+		get_argspec_string(task, args, sizeof(args), str_mode);
+	}
+
+	dump_arrow_record(arrow, task, name, module, args);
+}
+
+static void dump_arrow_task_event(struct uftrace_dump_ops *ops, struct uftrace_task_reader *task)
+{
+	struct uftrace_arrow_dump *arrow = container_of(ops, typeof(*arrow), ops);
+	struct uftrace_record *frs = task->rstack;
+	char *name = event_get_name(task->h, frs->addr);
+	char *args = NULL;
+
+	if (frs->more && show_args)
+		args = event_get_data_str(frs->addr, task->args.data, false);
+
+	dump_arrow_record(arrow, task, name, "[event]", args);
+
+	free(args);
+	free(name);
+}
+
+static void dump_arrow_kernel_rstack(struct uftrace_dump_ops *ops,
+				     struct uftrace_kernel_reader *kernel, int cpu,
+				     struct uftrace_record *rec, char *name)
+{
+	struct uftrace_task_reader *task;
+
+	task = get_task_handle(kernel->handle, kernel->tids[cpu]);
+	dump_arrow_task_rstack(ops, task, name);
+}
+
+static void dump_arrow_footer(struct uftrace_dump_ops *ops, struct uftrace_data *handle,
+			      struct uftrace_opts *opts)
+{
+	struct uftrace_arrow_dump *arrow = container_of(ops, typeof(*arrow), ops);
+
+	if (arrow_writer_close(arrow->aw) < 0)
+		arrow->ret = -1;
+
+	if (arrow->ret < 0)
+		pr_warn("failed to write arrow data: %s\n", opts->arrow_file);
+}
+
 static void do_dump_file(struct uftrace_dump_ops *ops, struct uftrace_opts *opts,
 			 struct uftrace_data *handle)
 {
@@ -1612,94 +1790,136 @@ static void dump_replay_event(struct uftrace_dump_ops *ops, struct uftrace_task_
 	}
 }
 
-static void do_dump_replay(struct uftrace_dump_ops *ops, struct uftrace_opts *opts,
-			   struct uftrace_data *handle)
+static void dump_replay_record(struct uftrace_dump_ops *ops, struct uftrace_opts *opts,
+			       struct uftrace_task_reader *task, uint64_t *prev_time)
 {
-	uint64_t prev_time = 0;
-	struct uftrace_task_reader *task;
-	int i;
+	struct uftrace_record *frs = task->rstack;
 
-	ops->header(ops, handle, opts);
+	task->timestamp_last = frs->time;
 
-	while (!read_rstack(handle, &task) && !uftrace_done) {
-		struct uftrace_record *frs = task->rstack;
+	if (!check_task_rstack(task, opts))
+		return;
 
-		task->timestamp_last = frs->time;
+	if (*prev_time > frs->time)
+		call_if_nonull(ops->inverted_time, ops, task);
+	*prev_time = frs->time;
 
-		if (!check_task_rstack(task, opts))
-			continue;
+	if (task->rstack->type == UFTRACE_EVENT)
+		dump_replay_event(ops, task);
+	else
+		dump_replay_func(ops, task, opts);
 
-		if (prev_time > frs->time)
-			call_if_nonull(ops->inverted_time, ops, task);
-		prev_time = frs->time;
+	fstack_check_filter_done(task);
+}
 
-		if (task->rstack->type == UFTRACE_EVENT)
-			dump_replay_event(ops, task);
-		else
-			dump_replay_func(ops, task, opts);
+/* add duration of remaining functions */
+static void dump_replay_remaining(struct uftrace_dump_ops *ops, struct uftrace_opts *opts,
+				  struct uftrace_data *handle, struct uftrace_task_reader *task)
+{
+	uint64_t last_time;
 
-		fstack_check_filter_done(task);
-	}
+	if (task->stack_count == 0)
+		return;
 
-	/* add duration of remaining functions */
-	for (i = 0; i < handle->nr_tasks; i++) {
-		uint64_t last_time;
+	last_time = task->timestamp_last;
 
-		task = &handle->tasks[i];
+	if (handle->time_range.stop && handle->time_range.stop < last_time)
+		last_time = handle->time_range.stop;
 
-		if (task->stack_count == 0)
+	while (--task->stack_count >= 0) {
+		struct uftrace_fstack *fstack;
+		struct uftrace_session *fsess = handle->sessions.first;
+
+		fstack = fstack_get(task, task->stack_count);
+		if (fstack == NULL)
 			continue;
 
-		last_time = task->timestamp_last;
+		if (fstack->addr == 0)
+			continue;
 
-		if (handle->time_range.stop && handle->time_range.stop < last_time)
-			last_time = handle->time_range.stop;
+		if (fstack->total_time > last_time)
+			continue;
 
-		while (--task->stack_count >= 0) {
-			struct uftrace_fstack *fstack;
-			struct uftrace_session *fsess = handle->sessions.first;
+		fstack->total_time = last_time - fstack->total_time;
+		if (fstack->child_time > fstack->total_time)
+			fstack->total_time = fstack->child_time;
 
-			fstack = fstack_get(task, task->stack_count);
-			if (fstack == NULL)
-				continue;
+		if (task->stack_count > 0)
+			fstack[-1].child_time += fstack->total_time;
 
-			if (fstack->addr == 0)
-				continue;
+		/* make sure is_kernel_record() working correctly */
+		if (is_kernel_address(&fsess->sym_info, fstack->addr))
+			task->rstack = &task->kstack;
+		else
+			task->rstack = &task->ustack;
 
-			if (fstack->total_time > last_time)
-				continue;
+		task->rstack->time = last_time;
+		task->rstack->type = UFTRACE_EXIT;
+		task->rstack->addr = fstack->addr;
+		task->rstack->more = 0;
 
-			fstack->total_time = last_time - fstack->total_time;
-			if (fstack->child_time > fstack->total_time)
-				fstack->total_time = fstack->child_time;
+		if (!check_task_rstack(task, opts))
+			continue;
 
-			if (task->stack_count > 0)
-				fstack[-1].child_time += fstack->total_time;
+		if (task->rstack->type == UFTRACE_EVENT)
+			dump_replay_event(ops, task);
+		else
+			dump_replay_func(ops, task, opts);
 
-			/* make sure is_kernel_record() working correctly */
-			if (is_kernel_address(&fsess->sym_info, fstack->addr))
-				task->rstack = &task->kstack;
-			else
-				task->rstack = &task->ustack;
+		fstack_check_filter_done(task);
+	}
+}
 
-			task->rstack->time = last_time;
-			task->rstack->type = UFTRACE_EXIT;
-			task->rstack->addr = fstack->addr;
-			task->rstack->more = 0;
+/*
+ * The output of the flame graph doesn't depend on the order of tasks so
+ * it can read each task separately and release it (for --low-memory).
+ */
+static void do_dump_replay_task(struct uftrace_dump_ops *ops, struct uftrace_opts *opts,
+				struct uftrace_data *handle)
+{
+	struct uftrace_task_reader *task;
+	uint64_t prev_time;
+	int i;
 
-			if (!check_task_rstack(task, opts))
-				continue;
+	for (i = 0; i < handle->nr_tasks && !uftrace_done; i++) {
+		task = &handle->tasks[i];
+		prev_time = 0;
 
-			if (task->rstack->type == UFTRACE_EVENT)
-				dump_replay_event(ops, task);
-			else
-				dump_replay_func(ops, task, opts);
+		while (!read_task_rstack(handle, task) && !uftrace_done)
+			dump_replay_record(ops, opts, task, &prev_time);
 
-			fstack_check_filter_done(task);
-		}
+		dump_replay_remaining(ops, opts, handle, task);
+		release_task_handle(task);
+	}
+}
+
+static void do_dump_replay(struct uftrace_dump_ops *ops, struct uftrace_opts *opts,
+			   struct uftrace_data *handle)
+{
+	uint64_t prev_time = 0;
+	struct uftrace_task_reader *task;
+	int i;
+
+	ops->header(ops, handle, opts);
+
+	selfstat_begin(SELFSTAT_READ_RSTACK);
+
+	if (opts->flame_graph && handle->low_memory && can_read_task_rstack(handle)) {
+		do_dump_replay_task(ops, opts, handle);
+	}
+	else {
+		while (!read_rstack(handle, &task) && !uftrace_done)
+			dump_replay_record(ops, opts, task, &prev_time);
+
+		for (i = 0; i < handle->nr_tasks; i++)
+			dump_replay_remaining(ops, opts, handle, &handle->tasks[i]);
 	}
 
+	selfstat_end(SELFSTAT_READ_RSTACK);
+
+	selfstat_begin(SELFSTAT_OUTPUT);
 	ops->footer(ops, handle, opts);
+	selfstat_end(SELFSTAT_OUTPUT);
 }
 
 int command_dump(int argc, char *argv[], struct uftrace_opts *opts)
@@ -1723,6 +1943,7 @@ int command_dump(int argc, char *argv[], struct uftrace_opts *opts)
 			.ops = {
 				.header         = dump_chrome_header,
 				.task_rstack    = dump_chrome_task_rstack,
+				.task_event     = dump_chrome_task_event,
 				.kernel_func    = dump_chrome_kernel_rstack,
 				.perf_event     = dump_chrome_perf_event,
 				.footer         = dump_chrome_footer,
@@ -1785,6 +2006,25 @@ int command_dump(int argc, char *argv[], struct uftrace_opts *opts)
 
 		do_dump_replay(&dump.ops, opts, &handle);
 	}
+	else if (opts->arrow_file) {
+		struct uftrace_arrow_dump dump = {
+			.ops = {
+				.header         = dump_arrow_header,
+				.task_rstack    = dump_arrow_task_rstack,
+				.task_event     = dump_arrow_task_event,
+				.kernel_func    = dump_arrow_kernel_rstack,
+				.footer         = dump_arrow_footer,
+			},
+		};
+
+		dump.aw = arrow_writer_open(opts->arrow_file, ARROW_BATCH_ROWS);
+		if (dump.aw) {
+			do_dump_replay(&dump.ops, opts, &handle);
+			ret = dump.ret;
+		}
+		else
+			ret = -1;
+	}
 	else {
 		struct uftrace_raw_dump dump = {
 			.ops = {
@@ -1803,7 +2043,10 @@ int command_dump(int argc, char *argv[], struct uftrace_opts *opts)
 			},
 		};
 
+		/* raw dump reads each data file in turn */
+		selfstat_begin(SELFSTAT_READ_RSTACK);
 		do_dump_file(&dump.ops, opts, &handle);
+		selfstat_end(SELFSTAT_READ_RSTACK);
 	}
 
 	close_data_file(opts, &handle);
@@ -9,6 +9,7 @@
 #include "utils/filter.h"
 #include "utils/fstack.h"
 #include "utils/graph.h"
+#include "utils/selfstat.h"
 #include "utils/symbol.h"
 #include "utils/utils.h"
 
@@ -60,6 +61,31 @@ static void print_self_time(struct field_data *fd)
 	print_time_unit(d);
 }
 
+static void print_oncpu_time(struct field_data *fd)
+{
+	struct uftrace_graph_node *node = fd->arg;
+	uint64_t d = 0;
+
+	if (node->time > node->offcpu_time)
+		d = node->time - node->offcpu_time;
+
+	print_time_unit(d);
+}
+
+static void print_offcpu_time(struct field_data *fd)
+{
+	struct uftrace_graph_node *node = fd->arg;
+
+	print_time_unit(node->offcpu_time);
+}
+
+static void print_waits(struct field_data *fd)
+{
+	struct uftrace_graph_node *node = fd->arg;
+
+	pr_out("%10" PRIu64, node->nr_waits);
+}
+
 static void print_addr(struct field_data *fd)
 {
 	struct uftrace_graph_node *node = fd->arg;
@@ -105,6 +131,35 @@ static struct display_field field_addr = {
 	.list = LIST_HEAD_INIT(field_addr.list),
 };
 
+static struct display_field field_oncpu_time = {
+	.id = GRAPH_F_ONCPU_TIME,
+	.name = "oncpu-time",
+	.alias = "oncpu",
+	.header = "    ON-CPU",
+	.length = 10,
+	.print = print_oncpu_time,
+	.list = LIST_HEAD_INIT(field_oncpu_time.list),
+};
+
+static struct display_field field_offcpu_time = {
+	.id = GRAPH_F_OFFCPU_TIME,
+	.name = "offcpu-time",
+	.alias = "offcpu",
+	.header = "   OFF-CPU",
+	.length = 10,
+	.print = print_offcpu_time,
+	.list = LIST_HEAD_INIT(field_offcpu_time.list),
+};
+
+static struct display_field field_waits = {
+	.id = GRAPH_F_WAITS,
+	.name = "waits",
+	.header = "     WAITS",
+	.length = 10,
+	.print = print_waits,
+	.list = LIST_HEAD_INIT(field_waits.list),
+};
+
 static void print_task_total_time(struct field_data *fd)
 {
 	struct uftrace_task *node = fd->arg;
@@ -165,6 +220,9 @@ static struct display_field *field_table[] = {
 	&field_total_time,
 	&field_self_time,
 	&field_addr,
+	&field_oncpu_time,
+	&field_offcpu_time,
+	&field_waits,
 };
 
 /* index of this task table should be matched to display_field_id */
@@ -570,121 +628,154 @@ out:
 	symbol_putname(sym, name);
 }
 
-static void build_graph(struct uftrace_opts *opts, struct uftrace_data *handle, char *func)
+/* returns false if the data is broken */
+static bool add_graph_record(struct uftrace_opts *opts, struct uftrace_task_reader *task,
+			     uint64_t *prev_time, char *func)
 {
-	struct uftrace_task_reader *task;
-	struct session_graph *graph;
-	uint64_t prev_time = 0;
-	int i;
+	struct uftrace_record *frs = task->rstack;
+	uint64_t addr = frs->addr;
 
-	setup_graph_list(handle, opts, func);
+	if (!fstack_check_opts(task, opts))
+		return true;
 
-	while (!read_rstack(handle, &task) && !uftrace_done) {
-		struct uftrace_record *frs = task->rstack;
-		uint64_t addr = frs->addr;
+	if (!fstack_check_filter(task))
+		return true;
 
-		if (!fstack_check_opts(task, opts))
-			continue;
+	if (frs->type == UFTRACE_EVENT) {
+		if (frs->addr != EVENT_ID_PERF_SCHED_IN &&
+		    frs->addr != EVENT_ID_PERF_SCHED_OUT &&
+		    frs->addr != EVENT_ID_PERF_SCHED_OUT_PREEMPT)
+			return true;
+	}
 
-		if (!fstack_check_filter(task))
-			continue;
+	if (is_kernel_record(task, frs)) {
+		struct uftrace_session *fsess;
 
-		if (frs->type == UFTRACE_EVENT) {
-			if (frs->addr != EVENT_ID_PERF_SCHED_IN &&
-			    frs->addr != EVENT_ID_PERF_SCHED_OUT &&
-			    frs->addr != EVENT_ID_PERF_SCHED_OUT_PREEMPT)
-				continue;
-		}
+		fsess = task->h->sessions.first;
+		addr = get_kernel_address(&fsess->sym_info, addr);
+	}
 
-		if (is_kernel_record(task, frs)) {
-			struct uftrace_session *fsess;
+	if (frs->type == UFTRACE_LOST) {
+		struct task_graph *tg;
+		struct uftrace_session *fsess;
 
-			fsess = task->h->sessions.first;
-			addr = get_kernel_address(&fsess->sym_info, addr);
-		}
+		if (opts->kernel_skip_out && !task->user_stack_count)
+			return true;
 
-		if (frs->type == UFTRACE_LOST) {
-			struct task_graph *tg;
-			struct uftrace_session *fsess;
+		pr_dbg("*** LOST ***\n");
 
-			if (opts->kernel_skip_out && !task->user_stack_count)
-				continue;
+		/* add partial duration of kernel functions before LOST */
+		while (task->stack_count >= task->user_stack_count) {
+			struct uftrace_fstack *fstack;
 
-			pr_dbg("*** LOST ***\n");
+			fstack = fstack_get(task, task->stack_count);
 
-			/* add partial duration of kernel functions before LOST */
-			while (task->stack_count >= task->user_stack_count) {
-				struct uftrace_fstack *fstack;
+			if (fstack_enabled && fstack && fstack->valid &&
+			    !(fstack->flags & FSTACK_FL_NORECORD)) {
+				build_graph_node(opts, task, *prev_time, fstack->addr,
+						 UFTRACE_EXIT, func);
+			}
 
-				fstack = fstack_get(task, task->stack_count);
+			fstack_exit(task);
+			task->stack_count--;
+		}
 
-				if (fstack_enabled && fstack && fstack->valid &&
-				    !(fstack->flags & FSTACK_FL_NORECORD)) {
-					build_graph_node(opts, task, prev_time, fstack->addr,
-							 UFTRACE_EXIT, func);
-				}
+		/* force to find a session for kernel function */
+		fsess = task->h->sessions.first;
+		tg = get_task_graph(task, *prev_time, fsess->sym_info.kernel_base + 1);
+		tg->utg.lost = true;
 
-				fstack_exit(task);
-				task->stack_count--;
-			}
+		if (tg->enabled && is_kernel_address(&fsess->sym_info, tg->utg.node->addr))
+			pr_dbg("not returning to user after LOST\n");
 
-			/* force to find a session for kernel function */
-			fsess = task->h->sessions.first;
-			tg = get_task_graph(task, prev_time, fsess->sym_info.kernel_base + 1);
-			tg->utg.lost = true;
+		return true;
+	}
 
-			if (tg->enabled && is_kernel_address(&fsess->sym_info, tg->utg.node->addr))
-				pr_dbg("not returning to user after LOST\n");
+	if (*prev_time > frs->time) {
+		pr_warn("inverted time: broken data?\n");
+		return false;
+	}
+	*prev_time = frs->time;
 
-			continue;
-		}
+	build_graph_node(opts, task, frs->time, addr, frs->type, func);
+	fstack_check_filter_done(task);
+	return true;
+}
 
-		if (prev_time > frs->time) {
-			pr_warn("inverted time: broken data?\n");
-			return;
-		}
-		prev_time = frs->time;
+/* add duration of remaining functions */
+static void add_graph_remaining(struct uftrace_opts *opts, struct uftrace_data *handle,
+				struct uftrace_task_reader *task, char *func)
+{
+	uint64_t last_time;
+	struct uftrace_fstack *fstack;
 
-		build_graph_node(opts, task, frs->time, addr, frs->type, func);
-		fstack_check_filter_done(task);
-	}
+	if (task->stack_count == 0)
+		return;
 
-	/* add duration of remaining functions */
-	for (i = 0; i < handle->nr_tasks; i++) {
-		uint64_t last_time;
-		struct uftrace_fstack *fstack;
+	last_time = task->rstack->time;
 
-		task = &handle->tasks[i];
+	if (handle->time_range.stop)
+		last_time = handle->time_range.stop;
 
-		if (task->stack_count == 0)
+	while (--task->stack_count >= 0) {
+		fstack = fstack_get(task, task->stack_count);
+		if (fstack == NULL)
 			continue;
 
-		last_time = task->rstack->time;
+		if (fstack->addr == 0)
+			continue;
 
-		if (handle->time_range.stop)
-			last_time = handle->time_range.stop;
+		if (fstack->total_time > last_time)
+			continue;
 
-		while (--task->stack_count >= 0) {
-			fstack = fstack_get(task, task->stack_count);
-			if (fstack == NULL)
-				continue;
+		fstack->total_time = last_time - fstack->total_time;
+		if (fstack->child_time > fstack->total_time)
+			fstack->total_time = fstack->child_time;
 
-			if (fstack->addr == 0)
-				continue;
+		if (task->stack_count > 0) {
+			fstack[-1].child_time += fstack->total_time;
+			fstack[-1].blocked_time += fstack->blocked_time;
+			fstack[-1].preempt_time += fstack->preempt_time;
+			fstack[-1].nr_waits += fstack->nr_waits;
+		}
 
-			if (fstack->total_time > last_time)
-				continue;
+		build_graph_node(opts, task, last_time, fstack->addr, UFTRACE_EXIT, func);
+	}
+}
 
-			fstack->total_time = last_time - fstack->total_time;
-			if (fstack->child_time > fstack->total_time)
-				fstack->total_time = fstack->child_time;
+static void build_graph(struct uftrace_opts *opts, struct uftrace_data *handle, char *func)
+{
+	struct uftrace_task_reader *task;
+	struct session_graph *graph;
+	uint64_t prev_time = 0;
+	int i;
+
+	setup_graph_list(handle, opts, func);
 
-			if (task->stack_count > 0)
-				fstack[-1].child_time += fstack->total_time;
+	if (handle->low_memory && can_read_task_rstack(handle)) {
+		/* process each task separately and release it */
+		for (i = 0; i < handle->nr_tasks && !uftrace_done; i++) {
+			task = &handle->tasks[i];
+			prev_time = 0;
+
+			while (!read_task_rstack(handle, task) && !uftrace_done) {
+				if (!add_graph_record(opts, task, &prev_time, func))
+					return;
+			}
 
-			build_graph_node(opts, task, last_time, fstack->addr, UFTRACE_EXIT, func);
+			add_graph_remaining(opts, handle, task, func);
+			release_task_handle(task);
 		}
 	}
+	else {
+		while (!read_rstack(handle, &task) && !uftrace_done) {
+			if (!add_graph_record(opts, task, &prev_time, func))
+				return;
+		}
+
+		for (i = 0; i < handle->nr_tasks; i++)
+			add_graph_remaining(opts, handle, &handle->tasks[i], func);
+	}
 
 	if (!full_graph || uftrace_done)
 		return;
@@ -697,6 +788,8 @@ static void build_graph(struct uftrace_opts *opts, struct uftrace_data *handle,
 		list_for_each_entry(node, &graph->ug.root.head, list) {
 			graph->ug.root.time += node->time;
 			graph->ug.root.child_time += node->time;
+			graph->ug.root.offcpu_time += node->offcpu_time;
+			graph->ug.root.nr_waits += node->nr_waits;
 		}
 
 		graph = graph->next;
@@ -989,18 +1082,27 @@ int command_graph(int argc, char *argv[], struct uftrace_opts *opts)
 		pr_out(HTML_HEADER);
 
 	if (opts->show_task) {
+		selfstat_begin(SELFSTAT_READ_RSTACK);
 		graph_build_task(opts, &handle);
+		selfstat_end(SELFSTAT_READ_RSTACK);
+
+		selfstat_begin(SELFSTAT_OUTPUT);
 		graph_print_task(&handle, opts);
+		selfstat_end(SELFSTAT_OUTPUT);
 		goto out;
 	}
 
+	selfstat_begin(SELFSTAT_READ_RSTACK);
 	build_graph(opts, &handle, func);
+	selfstat_end(SELFSTAT_READ_RSTACK);
 
+	selfstat_begin(SELFSTAT_OUTPUT);
 	graph = graph_list;
 	while (graph && !uftrace_done) {
 		ret += print_graph(graph, opts);
 		graph = graph->next;
 	}
+	selfstat_end(SELFSTAT_OUTPUT);
 
 	if (!ret && !uftrace_done) {
 		pr_out("uftrace: cannot find graph for '%s'\n", func);
@@ -848,6 +848,38 @@ static int read_uftrace_version(void *arg)
 	return 0;
 }
 
+static int fill_overhead(void *arg)
+{
+	struct fill_handler_arg *fha = arg;
+
+	if (record_overhead.total == 0)
+		return -1;
+
+	dprintf(fha->fd, "overhead:%" PRIu64 " / %" PRIu64 "\n", record_overhead.total,
+		record_overhead.inner);
+	return 0;
+}
+
+static int read_overhead(void *arg)
+{
+	struct read_handler_arg *rha = arg;
+	struct uftrace_data *handle = rha->handle;
+	struct uftrace_info *info = &handle->info;
+	char *buf = rha->buf;
+
+	if (fgets(buf, sizeof(rha->buf), handle->fp) == NULL)
+		return -1;
+
+	if (strncmp(buf, "overhead:", 9))
+		return -1;
+
+	if (sscanf(&buf[9], "%" SCNu64 " / %" SCNu64, &info->overhead_total,
+		   &info->overhead_inner) != 2)
+		return -1;
+
+	return 0;
+}
+
 struct uftrace_info_handler {
 	enum uftrace_info_bits bit;
 	int (*handler)(void *arg);
@@ -880,6 +912,7 @@ void fill_uftrace_info(uint64_t *info_mask, int fd, struct uftrace_opts *opts, i
 		{ RECORD_DATE, fill_record_date },
 		{ PATTERN_TYPE, fill_pattern_type },
 		{ VERSION, fill_uftrace_version },
+		{ OVERHEAD, fill_overhead },
 	};
 
 	for (i = 0; i < ARRAY_SIZE(fill_handlers); i++) {
@@ -923,6 +956,7 @@ int read_uftrace_info(uint64_t info_mask, struct uftrace_data *handle)
 		{ RECORD_DATE, read_record_date },
 		{ PATTERN_TYPE, read_pattern_type },
 		{ VERSION, read_uftrace_version },
+		{ OVERHEAD, read_overhead },
 	};
 
 	memset(&handle->info, 0, sizeof(handle->info));
@@ -1031,9 +1065,10 @@ void process_uftrace_info(struct uftrace_data *handle, struct uftrace_opts *opts
 		int sz, len;
 		char *p;
 
-		/* ignore errors */
-		read_task_txt_file(&handle->sessions, opts->dirname, opts->dirname, false, false,
-				   false);
+		/* tasks are already loaded if it's called from TUI, ignore errors */
+		if (handle->sessions.first == NULL)
+			read_task_txt_file(&handle->sessions, opts->dirname, opts->dirname, false,
+					   false, false);
 
 		process(data, "# %-20s: %d\n", "number of tasks", nr);
 
@@ -1109,6 +1144,10 @@ void process_uftrace_info(struct uftrace_data *handle, struct uftrace_opts *opts
 	if (info_mask & RECORD_DATE)
 		process(data, fmt, "elapsed time", info->elapsed_time);
 
+	if (info_mask & OVERHEAD)
+		process(data, "# %-20s: %" PRIu64 " / %" PRIu64 " nsec (per call / inside)\n",
+			"trace overhead", info->overhead_total, info->overhead_inner);
+
 	if (info_mask & USAGEINFO) {
 		process(data, "# %-20s: %.3lf / %.3lf sec (sys / user)\n", "cpu time", info->stime,
 			info->utime);
@@ -1217,6 +1256,12 @@ int command_info(int argc, char *argv[], struct uftrace_opts *opts)
 		return -1;
 	}
 
+	if (opts->pack) {
+		ret = pack_data_files(opts->dirname);
+		pr_out("packed %d symbol files in %s\n", ret, opts->dirname);
+		goto out;
+	}
+
 	if (opts->print_symtab) {
 		struct uftrace_sym_info sinfo = {
 			.dirname = opts->dirname,
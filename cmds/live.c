@@ -8,9 +8,11 @@
 
 #include "libmcount/mcount.h"
 #include "uftrace.h"
+#include "utils/filter.h"
 #include "utils/fstack.h"
 #include "utils/kernel.h"
 #include "utils/socket.h"
+#include "utils/stream.h"
 #include "utils/utils.h"
 
 static char *tmp_dirname;
@@ -143,6 +145,9 @@ static void reset_live_opts(struct uftrace_opts *opts)
 	}
 
 others:
+	/* conditions are checked in record, just ignore them */
+	opts->skip_cond = true;
+
 	opts->depth = MCOUNT_DEFAULT_DEPTH;
 	opts->disabled = false;
 	opts->no_event = false;
@@ -203,8 +208,62 @@ static void setup_child_environ(struct uftrace_opts *opts)
 	free(libpath);
 }
 
+static void setup_stream(struct uftrace_opts *opts)
+{
+	if (opts->interval == 0)
+		opts->interval = STREAM_DEFAULT_WINDOW * NSEC_PER_MSEC;
+
+	/* the recorder cannot know the size of argument data */
+	if (opts->args || opts->retval || opts->auto_args) {
+		pr_warn("arguments and return values are ignored by --stream\n");
+		opts->args = NULL;
+		opts->retval = NULL;
+		opts->auto_args = false;
+	}
+
+	/* likewise, remove argN and retval actions in the triggers */
+	if (opts->trigger) {
+		char *trigger = uftrace_clear_trigger_args(opts->trigger);
+
+		if (trigger == NULL || strcmp(trigger, opts->trigger))
+			pr_warn("argument and return value triggers are ignored by --stream\n");
+
+		free(opts->trigger);
+		opts->trigger = trigger;
+	}
+
+	if (opts->report) {
+		pr_warn("--report is ignored by --stream\n");
+		opts->report = false;
+	}
+
+	if (opts->kernel) {
+		pr_warn("kernel tracing is not supported by --stream\n");
+		opts->kernel = false;
+	}
+
+	/* events are not shown, don't bother to record the default ones */
+	opts->no_event = true;
+	opts->no_sched = true;
+
+	stream_init(opts);
+	stream_enabled = true;
+}
+
+static int send_int_option(int sfd, enum uftrace_dopt dopt, int val)
+{
+	return socket_send_option(sfd, dopt, &val, sizeof(val)) < 0 ? -1 : 0;
+}
+
+static int send_rules(int sfd, enum uftrace_dopt dopt, char *rules)
+{
+	if (rules == NULL)
+		return 0;
+	return socket_send_string(sfd, dopt, rules);
+}
+
 /* Forward all client options to the agent */
-static int forward_options(struct uftrace_opts *opts)
+int forward_options(struct uftrace_opts *opts)
 {
 	int sfd;
 	struct sockaddr_un addr;
@@ -219,14 +278,39 @@ static int forward_options(struct uftrace_opts *opts)
 		goto socket_error;
 	}
 
+	if (opts->trace != TRACE_STATE_NONE)
+		ret |= send_int_option(sfd, UFTRACE_DOPT_TRACE, opts->trace == TRACE_STATE_ON);
+	if (opts->depth_set)
+		ret |= send_int_option(sfd, UFTRACE_DOPT_DEPTH, opts->depth);
+	if (opts->threshold_set &&
+	    socket_send_option(sfd, UFTRACE_DOPT_THRESHOLD, &opts->threshold,
+			       sizeof(opts->threshold)) < 0)
+		ret = -1;
+	if (opts->remove)
+		ret |= send_int_option(sfd, UFTRACE_DOPT_REMOVE, 1);
+
+	ret |= send_rules(sfd, UFTRACE_DOPT_FILTER, opts->filter);
+	ret |= send_rules(sfd, UFTRACE_DOPT_TRIGGER, opts->trigger);
+	ret |= send_rules(sfd, UFTRACE_DOPT_ARGUMENT, opts->args);
+	ret |= send_rules(sfd, UFTRACE_DOPT_RETVAL, opts->retval);
+	ret |= send_rules(sfd, UFTRACE_DOPT_PATCH, opts->patch);
+
+	if (ret < 0)
+		pr_warn("cannot send options to the agent\n");
+
+	/* the agent applies the options when the connection is closed */
 	if (socket_send_option(sfd, UFTRACE_DOPT_CLOSE, NULL, 0) == -1) {
 		pr_warn("cannot terminate agent connection\n");
 		ret = -1;
 	}
 	else {
-		enum uftrace_dopt ack;
-		if (read(sfd, &ack, sizeof(enum uftrace_dopt)) < 0 || ack != UFTRACE_DOPT_CLOSE)
+		enum uftrace_dopt ack = UFTRACE_DOPT_CLOSE;
+
+		if (read(sfd, &ack, sizeof(enum uftrace_dopt)) < 0 || ack != UFTRACE_DOPT_CLOSE) {
+			if (ack == UFTRACE_DOPT_ERROR)
+				pr_warn("agent could not apply some options\n");
 			ret = -1;
+		}
 	}
 
 socket_error:
@@ -291,6 +375,17 @@ int command_live(int argc, char *argv[], struct uftrace_opts *opts)
 	if (opts->pid)
 		return forward_options(opts);
 
+	/* print the records as they are recorded instead of replaying them */
+	if (opts->stream && !opts->nop) {
+		setup_stream(opts);
+		ret = command_record(argc, argv, opts);
+		stream_enabled = false;
+		stream_finish();
+
+		cleanup_tempdir();
+		return ret;
+	}
+
 	ret = command_record(argc, argv, opts);
 	if (!can_skip_replay(opts, ret)) {
 		int ret2;
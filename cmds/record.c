@@ -25,8 +25,11 @@
 #include "utils/kernel.h"
 #include "utils/list.h"
 #include "utils/perf.h"
+#include "utils/selfstat.h"
 #include "utils/shmem.h"
+#include "utils/stream.h"
 #include "utils/symbol.h"
+#include "utils/top.h"
 #include "utils/utils.h"
 
 #ifndef EFD_SEMAPHORE
@@ -44,6 +47,7 @@ static LIST_HEAD(shmem_need_unlink);
 
 struct buf_list {
 	struct list_head list;
+	uint64_t sid;
 	int tid;
 	void *shmem_buf;
 };
@@ -146,6 +150,27 @@ void put_libmcount_path(char *libpath)
 	free(libpath);
 }
 
+/* create the directory and its parents, if needed */
+static int create_cache_directory(const char *dirname)
+{
+	char *path = xstrdup(dirname);
+	char *p = path;
+	int ret = 0;
+
+	while (ret == 0 && (p = strchr(p + 1, '/')) != NULL) {
+		*p = '\0';
+		if (mkdir(path, 0755) < 0 && errno != EEXIST)
+			ret = -1;
+		*p = '/';
+	}
+
+	if (ret == 0 && mkdir(path, 0755) < 0 && errno != EEXIST)
+		ret = -1;
+
+	free(path);
+	return ret;
+}
+
 static void setup_child_environ(struct uftrace_opts *opts, int argc, char *argv[])
 {
 	char buf[PATH_MAX];
@@ -230,6 +255,24 @@ static void setup_child_environ(struct uftrace_opts *opts, int argc, char *argv[
 		setenv("UFTRACE_MIN_SIZE", buf, 1);
 	}
 
+	if (opts->patch && opts->patch_cache) {
+		if (create_cache_directory(opts->patch_cache) < 0)
+			pr_warn("cannot create patch cache directory: %s: %m\n", opts->patch_cache);
+		else
+			setenv("UFTRACE_PATCH_CACHE", opts->patch_cache, 1);
+	}
+
+	if (opts->symbol_cache) {
+		if (create_cache_directory(opts->symbol_cache) < 0)
+			pr_warn("cannot create symbol cache directory: %s: %m\n",
+				opts->symbol_cache);
+		else
+			setenv("UFTRACE_SYMBOL_CACHE", opts->symbol_cache, 1);
+	}
+
+	if (opts->patch && opts->patch_async)
+		setenv("UFTRACE_PATCH_ASYNC", "1", 1);
+
 	if (opts->event) {
 		char *event_str = uftrace_clear_kernel(opts->event);
 
@@ -286,6 +329,12 @@ static void setup_child_environ(struct uftrace_opts *opts, int argc, char *argv[
 		setenv("UFTRACE_BUFFER", buf, 1);
 	}
 
+	/* hand off buffers early to bound the delay of the stream output */
+	if (stream_enabled) {
+		snprintf(buf, sizeof(buf), "%" PRIu64, opts->interval / 2);
+		setenv("UFTRACE_FLUSH_TIME", buf, 1);
+	}
+
 	if (opts->logfile) {
 		snprintf(buf, sizeof(buf), "%d", fileno(logfp));
 		setenv("UFTRACE_LOGFD", buf, 1);
@@ -337,6 +386,16 @@ static void setup_child_environ(struct uftrace_opts *opts, int argc, char *argv[
 	if (opts->agent)
 		setenv("UFTRACE_AGENT", "1", 1);
 
+	if (opts->alloc_profile) {
+		snprintf(buf, sizeof(buf), "%lu", opts->alloc_sample);
+		setenv("UFTRACE_ALLOC_PROFILE", buf, 1);
+	}
+
+	if (opts->lock_profile) {
+		snprintf(buf, sizeof(buf), "%" PRIu64, opts->lock_threshold);
+		setenv("UFTRACE_LOCK_PROFILE", buf, 1);
+	}
+
 	if (argc > 0) {
 		char *args = NULL;
 		int i;
@@ -543,11 +602,21 @@ static void write_buffer(struct buf_list *buf, struct uftrace_opts *opts, int so
 {
 	struct mcount_shmem_buffer *shmbuf = buf->shmem_buf;
 
+	if (top_enabled)
+		top_add_buffer(buf->sid, buf->tid, shmbuf->data, shmbuf->size);
+	if (stream_enabled)
+		stream_add_buffer(buf->sid, buf->tid, shmbuf->data, shmbuf->size);
+
+	/* 'uftrace top' and 'live --stream' don't save the data unless --record is given */
+	if ((opts->mode == UFTRACE_MODE_TOP || stream_enabled) && !opts->record)
+		goto out;
+
 	if (!opts->host)
 		write_buffer_file(opts->dirname, buf);
 	else
 		send_trace_data(sock, buf->tid, shmbuf->data, shmbuf->size);
 
+out:
 	shmbuf->size = 0;
 }
 
@@ -798,7 +867,10 @@ static void copy_to_buffer(struct mcount_shmem_buffer *shm, char *sess_id)
 	}
 
 	buf->shmem_buf = shm;
-	parse_msg_id(sess_id, NULL, &buf->tid, NULL);
+	parse_msg_id(sess_id, &buf->sid, &buf->tid, NULL);
+
+	if (stream_enabled)
+		stream_queue_buffer(buf->sid, buf->tid);
 
 	pthread_mutex_lock(&write_list_lock);
 	/* check some writers work for this tid */
@@ -971,8 +1043,52 @@ static void flush_old_shmem(const char *dirname, int tid, int bufsize)
 	}
 }
 
+/*
+ * pass the records in the buffers being written to the stream output
+ * periodically.  Otherwise a task sleeping (or blocked) long would not
+ * show the records until it hands off the buffer.
+ */
+static void peek_shmem_buffers(struct uftrace_opts *opts)
+{
+	static uint64_t last_peek;
+	struct shmem_list *sl;
+	struct timespec ts;
+	uint64_t now;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+	if (now < last_peek + opts->interval / 2)
+		return;
+	last_peek = now;
+
+	list_for_each_entry(sl, &shmem_list_head, list) {
+		struct mcount_shmem_buffer *shmem_buf;
+		uint64_t sid;
+		int tid;
+		int fd;
+
+		fd = uftrace_shmem_open(sl->id, O_RDONLY, 0600);
+		if (fd < 0)
+			continue;
+
+		shmem_buf = mmap(NULL, opts->bufsize, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (shmem_buf == MAP_FAILED)
+			continue;
+
+		parse_msg_id(sl->id, &sid, &tid, NULL);
+		/* the size is updated after the record is written */
+		stream_peek_buffer(sid, tid, shmem_buf->data,
+				   __atomic_load_n(&shmem_buf->size, __ATOMIC_ACQUIRE));
+
+		munmap(shmem_buf, opts->bufsize);
+	}
+}
+
 static int shmem_lost_count;
 
+struct uftrace_msg_overhead record_overhead;
+
 struct tid_list {
 	struct list_head list;
 	int pid;
@@ -1077,6 +1193,10 @@ struct dlopen_list {
 
 static LIST_HEAD(dlopen_libs);
 
+/* argument specs added by the agent at runtime */
+static char *agent_argspec;
+static char *agent_retspec;
+
 static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 {
 	char buf[128];
@@ -1086,8 +1206,10 @@ static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 	struct uftrace_msg_task tmsg;
 	struct uftrace_msg_sess sess;
 	struct uftrace_msg_dlopen dmsg;
+	struct uftrace_msg_overhead omsg;
 	struct dlopen_list *dlib;
 	char *exename;
+	char *spec;
 	int lost;
 
 	if (read_all(pfd, &msg, sizeof(msg)) < 0)
@@ -1278,6 +1400,35 @@ static void read_record_mmap(int pfd, const char *dirname, int bufsize)
 		/* exename will be freed with the dlib */
 		break;
 
+	case UFTRACE_MSG_OVERHEAD:
+		if (msg.len < sizeof(omsg))
+			pr_err_ns("invalid message length\n");
+
+		if (read_all(pfd, &omsg, sizeof(omsg)) < 0)
+			pr_err("reading pipe failed");
+
+		pr_dbg2("MSG OVERHEAD: %" PRIu64 " / %" PRIu64 " nsec\n", omsg.total, omsg.inner);
+
+		/* use the first one, others are from child processes */
+		if (record_overhead.total == 0)
+			record_overhead = omsg;
+		break;
+
+	case UFTRACE_MSG_ARGSPEC:
+		spec = xmalloc(msg.len + 1);
+		if (read_all(pfd, spec, msg.len) < 0)
+			pr_err("reading pipe failed");
+		spec[msg.len] = '\0';
+
+		pr_dbg2("MSG ARGSPEC: %s\n", spec);
+
+		if (!strncmp(spec, "argspec:", 8))
+			agent_argspec = strjoin(agent_argspec, spec + 8, ";");
+		else if (!strncmp(spec, "retspec:", 8))
+			agent_retspec = strjoin(agent_retspec, spec + 8, ";");
+		free(spec);
+		break;
+
 	case UFTRACE_MSG_FINISH:
 		pr_dbg2("MSG FINISH\n");
 		finish_received = true;
@@ -1827,6 +1978,15 @@ out:
 		pr_err("cannot create an eventfd for writer thread");
 }
 
+/* the size of argument data is unknown without the filters */
+static bool has_arg_data(struct uftrace_opts *opts)
+{
+	if (opts->args || opts->retval || opts->auto_args)
+		return true;
+
+	return opts->trigger && (strstr(opts->trigger, "arg") || strstr(opts->trigger, "retval"));
+}
+
 static void start_tracing(struct writer_data *wd, struct uftrace_opts *opts, int ready_fd)
 {
 	int i, k;
@@ -1868,6 +2028,10 @@ static void start_tracing(struct writer_data *wd, struct uftrace_opts *opts, int
 		pthread_create(&wd->writers[i], NULL, writer_thread, warg);
 	}
 
+	/* 'uftrace top -p' can attach to the recording when the agent is used */
+	if (opts->agent && opts->mode != UFTRACE_MODE_TOP && !opts->nop && !has_arg_data(opts))
+		top_server_start(opts->dirname, wd->pid);
+
 	/* signal child that I'm ready */
 	if (write(ready_fd, &go, sizeof(go)) != (ssize_t)sizeof(go))
 		pr_err("signal to child failed");
@@ -1961,6 +2125,15 @@ static void finish_writers(struct writer_data *wd, struct uftrace_opts *opts)
 		return;
 	}
 
+	if (agent_argspec) {
+		opts->args = strjoin(opts->args, agent_argspec, ";");
+		free(agent_argspec);
+	}
+	if (agent_retspec) {
+		opts->retval = strjoin(opts->retval, agent_retspec, ";");
+		free(agent_retspec);
+	}
+
 	if (fill_file_header(opts, wd->status, &wd->usage, elapsed_time) < 0)
 		pr_err("cannot generate data file");
 
@@ -1976,6 +2149,10 @@ static void finish_writers(struct writer_data *wd, struct uftrace_opts *opts)
 
 	flush_shmem_list(opts->dirname, opts->bufsize);
 	record_remaining_buffer(opts, wd->sock);
+	top_server_stop();
+	if (stream_enabled)
+		stream_flush();
+	release_record_symtabs();
 	unlink_shmem_list();
 	free_tid_list();
 
@@ -2012,9 +2189,18 @@ static void write_symbol_files(struct writer_data *wd, struct uftrace_opts *opts
 	/* add build-id info map files */
 	update_session_maps(opts);
 
+	if (opts->symbol_store) {
+		if (create_cache_directory(opts->symbol_store) < 0)
+			pr_warn("cannot create symbol store: %s: %m\n", opts->symbol_store);
+		else
+			set_symbol_store_dir(opts->symbol_store);
+	}
+
 	if (opts->with_syms) {
 		copy_data_files(opts, ".sym");
 		copy_data_files(opts, ".dbg");
+		store_data_files(opts->dirname, ".sym");
+		store_data_files(opts->dirname, ".dbg");
 		goto after_save;
 	}
 
@@ -2041,7 +2227,12 @@ static void write_symbol_files(struct writer_data *wd, struct uftrace_opts *opts
 	save_module_symtabs(opts->dirname);
 	unload_module_symtabs();
 
+	/* debug files are saved by libmcount */
+	store_data_files(opts->dirname, ".dbg");
+
 after_save:
+	set_symbol_store_dir(NULL);
+
 	if (opts->host) {
 		int sock = wd->sock;
 
@@ -2098,6 +2289,7 @@ int do_main_loop(int ready, struct uftrace_opts *opts, int pid)
 	if (opts->sig_trigger)
 		pr_out("uftrace: install signal handlers to task %d\n", pid);
 
+	selfstat_begin(SELFSTAT_RECORD);
 	setup_writers(&wd, opts);
 	start_tracing(&wd, opts, ready);
 	close(ready);
@@ -2107,8 +2299,13 @@ int do_main_loop(int ready, struct uftrace_opts *opts, int pid)
 			.fd = wd.pipefd,
 			.events = POLLIN,
 		};
+		int timeout = 1000;
+
+		/* wake up to show records of idle tasks in time */
+		if (stream_enabled)
+			timeout = opts->interval / 2 / NSEC_PER_MSEC ?: 1;
 
-		ret = poll(&pollfd, 1, 1000);
+		ret = poll(&pollfd, 1, timeout);
 		if (ret < 0 && errno == EINTR)
 			continue;
 		if (ret < 0)
@@ -2117,14 +2314,20 @@ int do_main_loop(int ready, struct uftrace_opts *opts, int pid)
 		if (pollfd.revents & POLLIN)
 			read_record_mmap(wd.pipefd, opts->dirname, opts->bufsize);
 
+		if (stream_enabled)
+			peek_shmem_buffers(opts);
+
 		if (pollfd.revents & (POLLERR | POLLHUP))
 			break;
 	}
 
 	ret = stop_tracing(&wd, opts);
 	finish_writers(&wd, opts);
+	selfstat_end(SELFSTAT_RECORD);
 
+	selfstat_begin(SELFSTAT_SAVE_SYMTAB);
 	write_symbol_files(&wd, opts);
+	selfstat_end(SELFSTAT_SAVE_SYMTAB);
 	return ret;
 }
 
@@ -2242,6 +2445,10 @@ int command_record(int argc, char *argv[], struct uftrace_opts *opts)
 	int ret = -1;
 	char *channel = NULL;
 
+	/* send options to the agent of the running process */
+	if (opts->pid)
+		return forward_options(opts);
+
 	/* apply script-provided options */
 	if (opts->script_file)
 		parse_script_opt(opts);
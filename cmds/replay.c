@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdio_ext.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "uftrace.h"
 #include "utils/event.h"
@@ -11,6 +13,7 @@
 #include "utils/fstack.h"
 #include "utils/kernel.h"
 #include "utils/list.h"
+#include "utils/selfstat.h"
 #include "utils/symbol.h"
 #include "utils/utils.h"
 
@@ -23,6 +26,9 @@ static LIST_HEAD(output_fields);
 
 #define NO_TIME (void *)1 /* to suppress duration */
 
+/* stdio buffer size for output to a regular file */
+#define REPLAY_OUTPUT_BUFSIZE (1024 * 1024)
+
 static void print_duration(struct field_data *fd)
 {
 	struct uftrace_fstack *fstack = fd->fstack;
@@ -377,6 +383,68 @@ static void print_args(char **args, size_t *len, const char *fmt, ...)
 	*len -= x;
 }
 
+/* same as print_args(args, len, "%s", str) but avoids parsing format */
+static void print_str(char **args, size_t *len, const char *str)
+{
+	size_t x = strlen(str);
+
+	if (x >= *len) {
+		print_args(args, len, "%s", str);
+		return;
+	}
+
+	memcpy(*args, str, x + 1);
+	*args += x;
+	*len -= x;
+}
+
+/*
+ * same as print_args(args, len, "%#<lm><fmt>", val) for integer formats
+ * where lm is a length modifier for the given size (hh, h, none or ll).
+ */
+static void print_int_arg(char **args, size_t *len, char fmt, unsigned idx, uint64_t val)
+{
+	char buf[24];
+	char *p = buf + sizeof(buf);
+	unsigned bits = 8 << idx;
+	uint64_t mask = bits < 64 ? (1ULL << bits) - 1 : -1ULL;
+	bool neg = false;
+
+	val &= mask;
+	*--p = '\0';
+
+	if (fmt == 'x') {
+		bool zero = (val == 0);
+
+		do {
+			*--p = "0123456789abcdef"[val & 0xf];
+			val >>= 4;
+		} while (val);
+
+		/* '#' flag adds "0x" prefix for non-zero values */
+		if (!zero) {
+			*--p = 'x';
+			*--p = '0';
+		}
+	}
+	else {
+		if (fmt != 'u' && (val >> (bits - 1))) {
+			neg = true;
+			val = (~val + 1) & mask;
+		}
+
+		do {
+			*--p = '0' + val % 10;
+			val /= 10;
+		} while (val);
+
+		if (neg)
+			*--p = '-';
+	}
+
+	print_str(args, len, p);
+}
+
 void print_json_escaped_char(char **args, size_t *len, const char c)
 {
 	if (c == '\n')
@@ -446,9 +514,9 @@ void get_argspec_string(struct uftrace_task_reader *task, char *args, size_t len
 	ASSERT(arg_list && !list_empty(arg_list));
 
 	if (needs_paren)
-		print_args(&args, &len, "(");
+		print_str(&args, &len, "(");
 	else if (needs_assignment)
-		print_args(&args, &len, " = ");
+		print_str(&args, &len, " = ");
 
 	list_for_each_entry(spec, arg_list, list) {
 		char fmtstr[16];
@@ -462,7 +530,7 @@ void get_argspec_string(struct uftrace_task_reader *task, char *args, size_t len
 			continue;
 
 		if (i > 0)
-			print_args(&args, &len, ", ");
+			print_str(&args, &len, ", ");
 
 		memset(val.v, 0, sizeof(val));
 		fmt = ARG_SPEC_CHARS[spec->fmt];
@@ -570,11 +638,11 @@ void get_argspec_string(struct uftrace_task_reader *task, char *args, size_t len
 				print_args(&args, &len, "'");
 			}
 			else {
-				print_args(&args, &len, "%s", color_string);
+				print_str(&args, &len, color_string);
 				print_args(&args, &len, "'");
 				print_escaped_char(&args, &len, c);
 				print_args(&args, &len, "'");
-				print_args(&args, &len, "%s", color_reset);
+				print_str(&args, &len, color_reset);
 			}
 			size = 1;
 		}
@@ -616,7 +684,7 @@ void get_argspec_string(struct uftrace_task_reader *task, char *args, size_t len
 					print_args(&args, &len, "&amp;%s", sym->name);
 				else
 					print_args(&args, &len, "&%s", sym->name);
-				print_args(&args, &len, "%s", color_reset);
+				print_str(&args, &len, color_reset);
 			}
 			else if (val.p)
 				print_args(&args, &len, "%p", val.p);
@@ -655,7 +723,7 @@ void get_argspec_string(struct uftrace_task_reader *task, char *args, size_t len
 				print_args(&args, &len, "<ENUM>");
 			else
 				print_args(&args, &len, "%s", estr);
-			print_args(&args, &len, "%s", color_reset);
+			print_str(&args, &len, color_reset);
 			free(estr);
 		}
 		else if (spec->fmt == ARG_FMT_STRUCT) {
@@ -679,13 +747,11 @@ void get_argspec_string(struct uftrace_task_reader *task, char *args, size_t len
 				memcpy(val.v, data, spec->size);
 
 			ASSERT(idx < ARRAY_SIZE(len_mod));
-			lm = len_mod[idx];
 
-			snprintf(fmtstr, sizeof(fmtstr), "%%#%s%c", lm, fmt);
 			if (spec->size == 8)
-				print_args(&args, &len, fmtstr, val.ll);
+				print_int_arg(&args, &len, fmt, idx, val.ll);
 			else
-				print_args(&args, &len, fmtstr, val.i);
+				print_int_arg(&args, &len, fmt, idx, val.i);
 		}
 
 next:
@@ -701,7 +767,7 @@ next:
 	}
 
 	if (needs_paren) {
-		print_args(&args, &len, ")");
+		print_str(&args, &len, ")");
 	}
 	else {
 		if (needs_semi_colon)
@@ -1116,10 +1182,15 @@ int command_replay(int argc, char *argv[], struct uftrace_opts *opts)
 	uint64_t prev_time = 0;
 	struct uftrace_data handle;
 	struct uftrace_task_reader *task;
+	struct stat stbuf;
 
 	__fsetlocking(outfp, FSETLOCKING_BYCALLER);
 	__fsetlocking(logfp, FSETLOCKING_BYCALLER);
 
+	/* write large blocks only to a file, the pager should see it soon */
+	if (!debug && fstat(fileno(outfp), &stbuf) == 0 && S_ISREG(stbuf.st_mode))
+		setvbuf(outfp, NULL, _IOFBF, REPLAY_OUTPUT_BUFSIZE);
+
 	ret = open_data_file(opts, &handle);
 	if (ret < 0) {
 		pr_warn("cannot open record data: %s: %m\n", opts->dirname);
@@ -1141,6 +1212,8 @@ int command_replay(int argc, char *argv[], struct uftrace_opts *opts)
 		pr_out("\n");
 	}
 
+	/* it prints each record in the loop, so it includes the output */
+	selfstat_begin(SELFSTAT_READ_RSTACK);
 	while (read_rstack(&handle, &task) == 0 && !uftrace_done) {
 		struct uftrace_record *rstack = task->rstack;
 		uint64_t curr_time = rstack->time;
@@ -1167,11 +1240,14 @@ int command_replay(int argc, char *argv[], struct uftrace_opts *opts)
 		if (ret)
 			break;
 	}
+	selfstat_end(SELFSTAT_READ_RSTACK);
 
+	selfstat_begin(SELFSTAT_OUTPUT);
 	print_remaining_stack(opts, &handle);
 
 	if (format_mode == FORMAT_HTML)
 		pr_out(HTML_FOOTER);
+	selfstat_end(SELFSTAT_OUTPUT);
 
 	close_data_file(opts, &handle);
 
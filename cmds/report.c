@@ -1,12 +1,17 @@
+#include <glob.h>
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "uftrace.h"
+#include "utils/event.h"
 #include "utils/field.h"
 #include "utils/fstack.h"
 #include "utils/list.h"
 #include "utils/rbtree.h"
 #include "utils/report.h"
+#include "utils/selfstat.h"
 #include "utils/symbol.h"
 #include "utils/utils.h"
 
@@ -75,127 +80,158 @@ static void add_lost_fstack(struct rb_root *root, struct uftrace_task_reader *ta
 	}
 }
 
-static void add_remaining_fstack(struct uftrace_data *handle, struct rb_root *root,
-				 struct uftrace_opts *opts)
+static void add_task_remaining_fstack(struct uftrace_data *handle, struct rb_root *root,
+				      struct uftrace_task_reader *task, struct uftrace_opts *opts)
 {
-	struct uftrace_task_reader *task;
 	struct uftrace_fstack *fstack;
-	int i;
+	uint64_t last_time;
 
-	for (i = 0; i < handle->nr_tasks; i++) {
-		uint64_t last_time;
+	if (task->stack_count == 0)
+		return;
 
-		task = &handle->tasks[i];
+	last_time = task->rstack->time;
 
-		if (task->stack_count == 0)
-			continue;
+	if (handle->time_range.stop)
+		last_time = handle->time_range.stop;
 
-		last_time = task->rstack->time;
+	while (--task->stack_count >= 0) {
+		fstack = fstack_get(task, task->stack_count);
+		if (fstack == NULL)
+			continue;
 
-		if (handle->time_range.stop)
-			last_time = handle->time_range.stop;
+		if (fstack->total_time > last_time)
+			continue;
 
-		while (--task->stack_count >= 0) {
-			fstack = fstack_get(task, task->stack_count);
-			if (fstack == NULL)
-				continue;
+		fstack->total_time = last_time - fstack->total_time;
+		if (fstack->child_time > fstack->total_time)
+			fstack->total_time = fstack->child_time;
 
-			if (fstack->total_time > last_time)
-				continue;
+		if (task->stack_count > 0)
+			fstack[-1].child_time += fstack->total_time;
 
-			fstack->total_time = last_time - fstack->total_time;
-			if (fstack->child_time > fstack->total_time)
-				fstack->total_time = fstack->child_time;
+		if (fstack->addr == EVENT_ID_PERF_SCHED_IN)
+			insert_node(root, task, sched_sym.name, NULL);
+		else
+			find_insert_node(root, task, last_time, fstack->addr, opts->srcline);
+	}
+}
 
-			if (task->stack_count > 0)
-				fstack[-1].child_time += fstack->total_time;
+static void add_remaining_fstack(struct uftrace_data *handle, struct rb_root *root,
+				 struct uftrace_opts *opts)
+{
+	int i;
 
-			if (fstack->addr == EVENT_ID_PERF_SCHED_IN)
-				insert_node(root, task, sched_sym.name, NULL);
-			else
-				find_insert_node(root, task, last_time, fstack->addr,
-						 opts->srcline);
-		}
-	}
+	for (i = 0; i < handle->nr_tasks; i++)
+		add_task_remaining_fstack(handle, root, &handle->tasks[i], opts);
 }
 
-static void build_function_tree(struct uftrace_data *handle, struct rb_root *root,
-				struct uftrace_opts *opts)
+static void add_function_record(struct uftrace_data *handle, struct rb_root *root,
+				struct uftrace_task_reader *task, struct uftrace_opts *opts)
 {
 	struct uftrace_session_link *sessions = &handle->sessions;
+	struct uftrace_record *rstack = task->rstack;
 	struct uftrace_symbol *sym = NULL;
-	struct uftrace_record *rstack;
-	struct uftrace_task_reader *task;
 	uint64_t addr;
 
-	while (read_rstack(handle, &task) >= 0 && !uftrace_done) {
-		rstack = task->rstack;
+	if (rstack->type != UFTRACE_LOST)
+		task->timestamp_last = rstack->time;
 
-		if (rstack->type != UFTRACE_LOST)
-			task->timestamp_last = rstack->time;
+	if (!fstack_check_opts(task, opts))
+		return;
 
-		if (!fstack_check_opts(task, opts))
-			continue;
+	if (!fstack_check_filter(task))
+		return;
 
-		if (!fstack_check_filter(task))
-			continue;
+	if (rstack->type == UFTRACE_ENTRY) {
+		fstack_check_filter_done(task);
+		return;
+	}
 
-		if (rstack->type == UFTRACE_ENTRY) {
-			fstack_check_filter_done(task);
-			continue;
-		}
+	if (rstack->type == UFTRACE_EVENT) {
+		if (rstack->addr == EVENT_ID_PERF_SCHED_IN) {
+			char *name;
+			struct uftrace_fstack *fstack;
 
-		if (rstack->type == UFTRACE_EVENT) {
-			if (rstack->addr == EVENT_ID_PERF_SCHED_IN) {
-				char *name;
-				struct uftrace_fstack *fstack;
-
-				fstack = fstack_get(task, task->stack_count);
-				if (fstack == NULL)
-					continue;
-				if (fstack->addr == EVENT_ID_PERF_SCHED_OUT)
-					name = sched_sym.name;
-				else if (fstack->addr == EVENT_ID_PERF_SCHED_OUT_PREEMPT)
-					name = sched_preempt_sym.name;
-				else
-					continue;
-
-				insert_node(root, task, name, NULL);
-			}
-			continue;
-		}
+			fstack = fstack_get(task, task->stack_count);
+			if (fstack == NULL)
+				return;
+			if (fstack->addr == EVENT_ID_PERF_SCHED_OUT)
+				name = sched_sym.name;
+			else if (fstack->addr == EVENT_ID_PERF_SCHED_OUT_PREEMPT)
+				name = sched_preempt_sym.name;
+			else
+				return;
 
-		if (rstack->type == UFTRACE_LOST) {
-			/* add partial duration of functions before LOST */
-			add_lost_fstack(root, task, opts);
-			continue;
+			insert_node(root, task, name, NULL);
 		}
+		return;
+	}
 
-		/* rstack->type == UFTRACE_EXIT */
-		addr = rstack->addr;
-		if (is_kernel_record(task, rstack)) {
-			struct uftrace_session *fsess;
-
-			fsess = sessions->first;
-			addr = get_kernel_address(&fsess->sym_info, rstack->addr);
-		}
+	if (rstack->type == UFTRACE_LOST) {
+		/* add partial duration of functions before LOST */
+		add_lost_fstack(root, task, opts);
+		return;
+	}
 
-		/* skip it if --no-libcall is given */
-		sym = task_find_sym(sessions, task, rstack);
-		if (!opts->libcall && sym && sym->type == ST_PLT_FUNC) {
-			fstack_check_filter_done(task);
-			continue;
-		}
+	/* rstack->type == UFTRACE_EXIT */
+	addr = rstack->addr;
+	if (is_kernel_record(task, rstack)) {
+		struct uftrace_session *fsess;
 
-		find_insert_node(root, task, rstack->time, addr, opts->srcline);
+		fsess = sessions->first;
+		addr = get_kernel_address(&fsess->sym_info, rstack->addr);
+	}
 
+	/* skip it if --no-libcall is given */
+	sym = task_find_sym(sessions, task, rstack);
+	if (!opts->libcall && sym && sym->type == ST_PLT_FUNC) {
 		fstack_check_filter_done(task);
+		return;
 	}
 
-	if (uftrace_done)
-		return;
+	find_insert_node(root, task, rstack->time, addr, opts->srcline);
+
+	fstack_check_filter_done(task);
+}
 
-	add_remaining_fstack(handle, root, opts);
+/* process each task separately and release it (for --low-memory) */
+static void build_task_function_tree(struct uftrace_data *handle, struct rb_root *root,
+				     struct uftrace_opts *opts)
+{
+	struct uftrace_task_reader *task;
+	int i;
+
+	for (i = 0; i < handle->nr_tasks && !uftrace_done; i++) {
+		task = &handle->tasks[i];
+
+		while (read_task_rstack(handle, task) >= 0 && !uftrace_done)
+			add_function_record(handle, root, task, opts);
+
+		if (!uftrace_done)
+			add_task_remaining_fstack(handle, root, task, opts);
+		release_task_handle(task);
+	}
+}
+
+static void build_function_tree(struct uftrace_data *handle, struct rb_root *root,
+				struct uftrace_opts *opts)
+{
+	struct uftrace_task_reader *task;
+
+	selfstat_begin(SELFSTAT_READ_RSTACK);
+
+	if (handle->low_memory && can_read_task_rstack(handle)) {
+		build_task_function_tree(handle, root, opts);
+	}
+	else {
+		while (read_rstack(handle, &task) >= 0 && !uftrace_done)
+			add_function_record(handle, root, task, opts);
+
+		if (!uftrace_done)
+			add_remaining_fstack(handle, root, opts);
+	}
+
+	selfstat_end(SELFSTAT_READ_RSTACK);
 }
 
 static void print_and_delete(struct rb_root *root, bool sorted, void *arg,
@@ -215,6 +251,7 @@ static void print_and_delete(struct rb_root *root, bool sorted, void *arg,
 			node = rb_entry(n, typeof(*node), name_link);
 
 		print_func(node, arg, space);
+		report_free_hist(node);
 		free(node->name);
 		free(node);
 	}
@@ -258,12 +295,13 @@ static void report_functions(struct uftrace_data *handle, struct uftrace_opts *o
 	const int field_space = 2;
 
 	build_function_tree(handle, &name_root, opts);
-	report_calc_avg(&name_root);
-	report_sort_nodes(&name_root, &sort_root);
-
 	if (uftrace_done)
 		return;
 
+	selfstat_begin(SELFSTAT_OUTPUT);
+	report_calc_avg(&name_root);
+	report_sort_nodes(&name_root, &sort_root);
+
 	setup_report_field(&output_fields, opts, avg_mode);
 
 	print_header_align(&output_fields, "  ", "Function", field_space, ALIGN_RIGHT, false);
@@ -275,6 +313,7 @@ static void report_functions(struct uftrace_data *handle, struct uftrace_opts *o
 
 	print_line(&output_fields, field_space);
 	print_and_delete(&sort_root, true, NULL, print_function, field_space);
+	selfstat_end(SELFSTAT_OUTPUT);
 }
 
 static void add_remaining_task_fstack(struct uftrace_data *handle, struct rb_root *root)
@@ -373,6 +412,7 @@ static void report_task(struct uftrace_data *handle, struct uftrace_opts *opts)
 	char buf[10];
 	int field_space = 2;
 
+	selfstat_begin(SELFSTAT_READ_RSTACK);
 	while (read_rstack(handle, &task) >= 0 && !uftrace_done) {
 		rstack = task->rstack;
 		if (rstack->type == UFTRACE_ENTRY || rstack->type == UFTRACE_LOST)
@@ -406,10 +446,12 @@ static void report_task(struct uftrace_data *handle, struct uftrace_opts *opts)
 		snprintf(buf, sizeof(buf), "%d", task->tid);
 		insert_node(&task_tree, task, buf, NULL);
 	}
+	selfstat_end(SELFSTAT_READ_RSTACK);
 
 	if (uftrace_done)
 		return;
 
+	selfstat_begin(SELFSTAT_OUTPUT);
 	add_remaining_task_fstack(handle, &task_tree);
 	adjust_task_runtime(handle, &task_tree);
 	report_sort_tasks(handle, &task_tree, &sort_tree);
@@ -420,6 +462,430 @@ static void report_task(struct uftrace_data *handle, struct uftrace_opts *opts)
 
 	print_line(&output_fields, field_space);
 	print_and_delete(&sort_tree, true, handle, print_task, field_space);
+	selfstat_end(SELFSTAT_OUTPUT);
+}
+
+/* nodes for the heap allocation and lock contention profiles */
+#define PROFILE_MAX_VALS 5
+
+struct profile_node {
+	struct rb_node link;
+	char *name;
+	int type;
+	uint64_t val[PROFILE_MAX_VALS];
+};
+
+static int profile_sort_keys[PROFILE_MAX_VALS];
+static int profile_nr_sort_keys;
+
+static int setup_profile_sort(char *sort_keys, const char *const names[], int nr_names)
+{
+	struct strv keys = STRV_INIT;
+	char *k;
+	int i, j;
+
+	strv_split(&keys, sort_keys, ",");
+
+	profile_nr_sort_keys = 0;
+	strv_for_each(&keys, k, i) {
+		for (j = 0; j < nr_names; j++) {
+			if (!strcmp(k, names[j]))
+				break;
+		}
+		if (j == nr_names || profile_nr_sort_keys == PROFILE_MAX_VALS) {
+			strv_free(&keys);
+			return -1;
+		}
+		profile_sort_keys[profile_nr_sort_keys++] = j;
+	}
+
+	strv_free(&keys);
+	return 0;
+}
+
+static int cmp_profile_node(struct profile_node *a, struct profile_node *b)
+{
+	int i;
+
+	for (i = 0; i < profile_nr_sort_keys; i++) {
+		int k = profile_sort_keys[i];
+
+		if (a->val[k] != b->val[k])
+			return a->val[k] > b->val[k] ? -1 : 1;
+	}
+	return strcmp(a->name, b->name);
+}
+
+static struct profile_node *find_profile_node(struct rb_root *root, char *name)
+{
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &root->rb_node;
+	struct profile_node *node;
+	int cmp;
+
+	while (*p) {
+		parent = *p;
+		node = rb_entry(parent, struct profile_node, link);
+
+		cmp = strcmp(node->name, name);
+		if (cmp == 0)
+			return node;
+
+		if (cmp > 0)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	node = xzalloc(sizeof(*node));
+	node->name = xstrdup(name);
+
+	rb_link_node(&node->link, parent, p);
+	rb_insert_color(&node->link, root);
+	return node;
+}
+
+static void sort_profile_node(struct rb_root *root, struct profile_node *node)
+{
+	struct rb_node *parent = NULL;
+	struct rb_node **p = &root->rb_node;
+
+	while (*p) {
+		parent = *p;
+
+		if (cmp_profile_node(rb_entry(parent, struct profile_node, link), node) > 0)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&node->link, parent, p);
+	rb_insert_color(&node->link, root);
+}
+
+static void sort_profile_tree(struct rb_root *name_root, struct rb_root *sort_root)
+{
+	while (!RB_EMPTY_ROOT(name_root)) {
+		struct rb_node *n = rb_first(name_root);
+
+		rb_erase(n, name_root);
+		sort_profile_node(sort_root, rb_entry(n, struct profile_node, link));
+	}
+}
+
+enum alloc_sort_key {
+	ALLOC_SORT_COUNT,
+	ALLOC_SORT_BYTES,
+	ALLOC_SORT_FREED,
+	ALLOC_SORT_LIVE,
+	ALLOC_SORT_PEAK,
+	ALLOC_SORT_MAX,
+};
+
+static const char *const alloc_sort_names[] = {
+	"count", "bytes", "freed", "live", "peak",
+};
+
+/* read a summary file and add the allocation sites by function name */
+static void read_alloc_file(struct uftrace_data *handle, char *filename, struct rb_root *root,
+			    uint64_t *hist)
+{
+	struct uftrace_session *sess = NULL;
+	char sid[SESSION_ID_LEN + 1];
+	char *line = NULL;
+	size_t len = 0;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL) {
+		pr_dbg("cannot open %s: %m\n", filename);
+		return;
+	}
+
+	while (getline(&line, &len, fp) >= 0) {
+		struct uftrace_symbol *sym = NULL;
+		struct profile_node *node;
+		uint64_t addr, count, bytes, freed, peak;
+		char *symname;
+		char *pos;
+		int n = 0;
+
+		if (!strncmp(line, "PROC ", 5)) {
+			pos = strstr(line, " sid=");
+			if (pos && sscanf(pos, " sid=%16s", sid) == 1)
+				sess = get_session_from_sid(&handle->sessions, sid);
+			continue;
+		}
+
+		if (sscanf(line,
+			   "SITE addr=%" SCNx64 " count=%" SCNu64 " bytes=%" SCNu64
+			   " free=%*u freed=%" SCNu64 " peak=%" SCNu64 " hist=%n",
+			   &addr, &count, &bytes, &freed, &peak, &n) != 5 ||
+		    n == 0) {
+			pr_dbg("invalid alloc profile: %s", line);
+			continue;
+		}
+
+		if (sess) {
+			sym = find_symtabs(&sess->sym_info, addr);
+			if (sym == NULL)
+				sym = session_find_dlsym(sess, -1ULL, addr);
+		}
+
+		symname = symbol_getname(sym, addr);
+		node = find_profile_node(root, symname);
+		symbol_putname(sym, symname);
+
+		node->val[ALLOC_SORT_COUNT] += count;
+		node->val[ALLOC_SORT_BYTES] += bytes;
+		node->val[ALLOC_SORT_FREED] += freed;
+		node->val[ALLOC_SORT_LIVE] += bytes - freed;
+		/* peak of each site (and process) can be different */
+		node->val[ALLOC_SORT_PEAK] += peak;
+
+		/* the histogram looks like "2:10,3:5" */
+		pos = line + n;
+		while (*pos && *pos != '\n') {
+			unsigned long bucket = strtoul(pos, &pos, 10);
+
+			if (*pos++ != ':')
+				break;
+
+			count = strtoull(pos, &pos, 10);
+			if (bucket < UFTRACE_ALLOC_HIST_MAX)
+				hist[bucket] += count;
+
+			if (*pos == ',')
+				pos++;
+		}
+	}
+
+	free(line);
+	fclose(fp);
+}
+
+/**
+ * process_alloc_profile - read heap allocation profile and show the result
+ * @handle: uftrace data handle
+ * @opts: uftrace options
+ * @process: callback to print a line of the result
+ * @data: argument to @process
+ *
+ * This reads alloc-*.txt files in the data directory and calls @process
+ * for each line of the table sorted by the profile sort keys and the size
+ * histogram.  Returns -1 if there's no heap allocation profile.
+ */
+int process_alloc_profile(struct uftrace_data *handle, struct uftrace_opts *opts,
+			  void (*process)(void *data, const char *fmt, ...), void *data)
+{
+	struct rb_root name_root = RB_ROOT;
+	struct rb_root sort_root = RB_ROOT;
+	uint64_t hist[UFTRACE_ALLOC_HIST_MAX] = {};
+	char *pattern = NULL;
+	glob_t g;
+	size_t i;
+	int k;
+	const char line[] = "=================================================";
+
+	xasprintf(&pattern, "%s/alloc-*.txt", opts->dirname);
+	if (glob(pattern, 0, NULL, &g) != 0) {
+		free(pattern);
+		return -1;
+	}
+
+	for (i = 0; i < g.gl_pathc; i++)
+		read_alloc_file(handle, g.gl_pathv[i], &name_root, hist);
+
+	globfree(&g);
+	free(pattern);
+
+	/* the TUI doesn't have the --sort option */
+	if (profile_nr_sort_keys == 0)
+		setup_profile_sort("bytes", alloc_sort_names, ALLOC_SORT_MAX);
+
+	sort_profile_tree(&name_root, &sort_root);
+
+	process(data, "  %10s  %10s  %10s  %10s  %10s  %s\n", "Count", "Bytes", "Freed", "Live",
+		"Peak", "Function");
+	process(data, "  %.10s  %.10s  %.10s  %.10s  %.10s  %.*s\n", line, line, line, line, line,
+		maxlen, line);
+
+	while (!RB_EMPTY_ROOT(&sort_root)) {
+		struct rb_node *n = rb_first(&sort_root);
+		struct profile_node *node = rb_entry(n, struct profile_node, link);
+
+		rb_erase(n, &sort_root);
+
+		process(data,
+			"  %10" PRIu64 "  %10" PRIu64 "  %10" PRIu64 "  %10" PRIu64 "  %10" PRIu64
+			"  %s\n",
+			node->val[ALLOC_SORT_COUNT], node->val[ALLOC_SORT_BYTES],
+			node->val[ALLOC_SORT_FREED], node->val[ALLOC_SORT_LIVE],
+			node->val[ALLOC_SORT_PEAK], node->name);
+
+		free(node->name);
+		free(node);
+	}
+
+	process(data, "\n");
+	process(data, "  %10s  %s\n", "Count", "Size");
+	process(data, "  %.10s  %.*s\n", line, maxlen, line);
+
+	for (k = 0; k < UFTRACE_ALLOC_HIST_MAX; k++) {
+		char buf[32];
+
+		if (hist[k] == 0)
+			continue;
+
+		/* bucket N has sizes in [2^(N-1), 2^N) */
+		if (k <= 1)
+			snprintf(buf, sizeof(buf), "%d", k);
+		else if (k == UFTRACE_ALLOC_HIST_MAX - 1)
+			snprintf(buf, sizeof(buf), "%llu ~", 1ULL << (k - 1));
+		else
+			snprintf(buf, sizeof(buf), "%llu ~ %llu", 1ULL << (k - 1), (1ULL << k) - 1);
+
+		process(data, "  %10" PRIu64 "  %s\n", hist[k], buf);
+	}
+	return 0;
+}
+
+static void print_alloc(void *unused, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(outfp, fmt, ap);
+	va_end(ap);
+}
+
+static void report_alloc(struct uftrace_data *handle, struct uftrace_opts *opts)
+{
+	if (process_alloc_profile(handle, opts, print_alloc, NULL) < 0)
+		pr_warn("cannot find heap allocation profile: use --alloc-profile when recording\n");
+}
+
+enum lock_sort_key {
+	LOCK_SORT_WAITS,
+	LOCK_SORT_TOTAL,
+	LOCK_SORT_AVG,
+	LOCK_SORT_MAX_WAIT,
+	LOCK_SORT_MAX,
+};
+
+static const char *const lock_sort_names[] = {
+	"waits", "total", "avg", "max",
+};
+
+static void add_lock_wait(struct rb_root *root, char *name, int type, uint64_t wait)
+{
+	struct profile_node *node = find_profile_node(root, name);
+
+	node->type = type;
+	node->val[LOCK_SORT_WAITS]++;
+	node->val[LOCK_SORT_TOTAL] += wait;
+	if (node->val[LOCK_SORT_MAX_WAIT] < wait)
+		node->val[LOCK_SORT_MAX_WAIT] = wait;
+}
+
+static void print_lock_profile(struct rb_root *name_root, bool per_lock)
+{
+	struct rb_root sort_root = RB_ROOT;
+	struct rb_node *n;
+	int k;
+	const char line[] = "=================================================";
+
+	for (n = rb_first(name_root); n; n = rb_next(n)) {
+		struct profile_node *node = rb_entry(n, struct profile_node, link);
+
+		node->val[LOCK_SORT_AVG] = node->val[LOCK_SORT_TOTAL] / node->val[LOCK_SORT_WAITS];
+	}
+	sort_profile_tree(name_root, &sort_root);
+
+	pr_out("  %10s  %10s  %10s  %10s  ", "Waits", "Total", "Avg", "Max");
+	if (per_lock)
+		pr_out("%-6s  %s\n", "Type", "Lock");
+	else
+		pr_out("%s\n", "Function");
+
+	for (k = 0; k < LOCK_SORT_MAX; k++)
+		pr_out("  %.10s", line);
+	if (per_lock)
+		pr_out("  %.6s  %.18s\n", line, line);
+	else
+		pr_out("  %.*s\n", maxlen, line);
+
+	while (!RB_EMPTY_ROOT(&sort_root)) {
+		struct profile_node *node;
+
+		n = rb_first(&sort_root);
+		node = rb_entry(n, struct profile_node, link);
+		rb_erase(n, &sort_root);
+
+		pr_out("  %10" PRIu64, node->val[LOCK_SORT_WAITS]);
+		for (k = LOCK_SORT_TOTAL; k < LOCK_SORT_MAX; k++) {
+			pr_out("  ");
+			print_time_unit(node->val[k]);
+		}
+
+		if (per_lock)
+			pr_out("  %-6s  %s\n", event_get_lock_type(node->type), node->name);
+		else
+			pr_out("  %s\n", node->name);
+
+		free(node->name);
+		free(node);
+	}
+}
+
+static void report_lock(struct uftrace_data *handle, struct uftrace_opts *opts)
+{
+	struct rb_root lock_root = RB_ROOT;
+	struct rb_root caller_root = RB_ROOT;
+	struct uftrace_task_reader *task;
+	bool found = false;
+
+	selfstat_begin(SELFSTAT_READ_RSTACK);
+	while (read_rstack(handle, &task) >= 0 && !uftrace_done) {
+		struct uftrace_record *rstack = task->rstack;
+		struct uftrace_lock_wait wait;
+		struct uftrace_symbol *sym;
+		char *symname;
+		char buf[32];
+
+		if (rstack->type != UFTRACE_EVENT || rstack->addr != EVENT_ID_LOCK_WAIT)
+			continue;
+
+		if (!check_time_range(&handle->time_range, rstack->time))
+			continue;
+
+		memcpy(&wait, task->args.data, sizeof(wait));
+		found = true;
+
+		/* locks are identified by the address */
+		snprintf(buf, sizeof(buf), "%#" PRIx64, wait.lock);
+		add_lock_wait(&lock_root, buf, wait.type, wait.wait);
+
+		sym = task_find_sym_addr(&handle->sessions, task, rstack->time, wait.caller);
+		symname = symbol_getname(sym, wait.caller);
+		add_lock_wait(&caller_root, symname, wait.type, wait.wait);
+		symbol_putname(sym, symname);
+	}
+	selfstat_end(SELFSTAT_READ_RSTACK);
+
+	if (uftrace_done)
+		return;
+
+	if (!found) {
+		pr_warn("cannot find lock wait events: use --lock-profile when recording\n");
+		return;
+	}
+
+	selfstat_begin(SELFSTAT_OUTPUT);
+	print_lock_profile(&lock_root, true);
+	pr_out("\n");
+	print_lock_profile(&caller_root, false);
+	selfstat_end(SELFSTAT_OUTPUT);
 }
 
 struct diff_data {
@@ -462,6 +928,7 @@ static void report_diff(struct uftrace_data *handle, struct uftrace_opts *opts)
 	if (uftrace_done)
 		goto out;
 
+	selfstat_begin(SELFSTAT_OUTPUT);
 	pr_out("#\n");
 	pr_out("# uftrace diff\n");
 	pr_out("#  [%d] base: %s\t(from %s)\n", 0, handle->dirname, handle->info.cmdline);
@@ -479,6 +946,7 @@ static void report_diff(struct uftrace_data *handle, struct uftrace_opts *opts)
 
 	print_line(&output_fields, field_space);
 	print_and_delete(&diff_tree, true, NULL, print_function, field_space);
+	selfstat_end(SELFSTAT_OUTPUT);
 out:
 	destroy_diff_nodes(&base_tree, &pair_tree);
 	__close_data_file(&dummy_opts, &data.handle, false);
@@ -512,7 +980,17 @@ int command_report(int argc, char *argv[], struct uftrace_opts *opts)
 
 	fstack_setup_filters(opts, &handle);
 
-	if (opts->diff) {
+	if (opts->show_alloc) {
+		ret = setup_profile_sort(opts->sort_keys ?: "bytes", alloc_sort_names,
+					 ALLOC_SORT_MAX);
+		sort_keys = NULL;
+	}
+	else if (opts->show_lock) {
+		ret = setup_profile_sort(opts->sort_keys ?: "total", lock_sort_names,
+					 LOCK_SORT_MAX);
+		sort_keys = NULL;
+	}
+	else if (opts->diff) {
 		sort_keys = convert_sort_keys(opts->sort_keys, avg_mode);
 		ret = report_setup_diff(sort_keys);
 	}
@@ -527,6 +1005,10 @@ int command_report(int argc, char *argv[], struct uftrace_opts *opts)
 		sort_keys = convert_sort_keys(opts->sort_keys, avg_mode);
 		ret = report_setup_sort(sort_keys);
 	}
+
+	/* percentiles need to keep histogram of durations */
+	if (!opts->show_task && !opts->show_alloc && !opts->show_lock)
+		report_enable_hist(report_check_hist(sort_keys) || report_check_hist(opts->fields));
 	free(sort_keys);
 
 	if (ret < 0) {
@@ -540,7 +1022,11 @@ int command_report(int argc, char *argv[], struct uftrace_opts *opts)
 	if (format_mode == FORMAT_HTML)
 		pr_out(HTML_HEADER);
 
-	if (opts->show_task)
+	if (opts->show_alloc)
+		report_alloc(&handle, opts);
+	else if (opts->show_lock)
+		report_lock(&handle, opts);
+	else if (opts->show_task)
 		report_task(&handle, opts);
 	else if (opts->diff)
 		report_diff(&handle, opts);
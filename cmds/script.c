@@ -15,6 +15,7 @@
 #include "utils/filter.h"
 #include "utils/fstack.h"
 #include "utils/script.h"
+#include "utils/selfstat.h"
 #include "utils/symbol.h"
 #include "utils/utils.h"
 #include "version.h"
@@ -60,7 +61,7 @@ static int run_script_for_rstack(struct uftrace_data *handle, struct uftrace_tas
 		fstack = fstack_get(task, task->stack_count - 1);
 		fstack_update(UFTRACE_ENTRY, task, fstack);
 
-		if (!script_match_filter(symname))
+		if (!script_match_symbol(sym, symname))
 			goto out;
 
 		sc_ctx.tid = task->tid;
@@ -69,6 +70,12 @@ static int run_script_for_rstack(struct uftrace_data *handle, struct uftrace_tas
 		sc_ctx.address = rstack->addr;
 		sc_ctx.name = symname;
 
+		/* batch records don't carry arguments */
+		if (script_uftrace_batch) {
+			script_batch_add(&sc_ctx, SCRIPT_BATCH_ENTRY);
+			goto out;
+		}
+
 		if (tr.flags & TRIGGER_FL_ARGUMENT && opts->show_args) {
 			sc_ctx.argbuf = task->args.data;
 			sc_ctx.arglen = task->args.len;
@@ -90,7 +97,7 @@ static int run_script_for_rstack(struct uftrace_data *handle, struct uftrace_tas
 		if (fstack_enabled && fstack && !(fstack->flags & FSTACK_FL_NORECORD)) {
 			int depth = fstack_update(UFTRACE_EXIT, task, fstack);
 
-			if (!script_match_filter(symname)) {
+			if (!script_match_symbol(sym, symname)) {
 				fstack_exit(task);
 				goto out;
 			}
@@ -106,14 +113,18 @@ static int run_script_for_rstack(struct uftrace_data *handle, struct uftrace_tas
 			sc_ctx.address = rstack->addr;
 			sc_ctx.name = symname;
 
-			if (rstack->more && opts->show_args) {
-				sc_ctx.argbuf = task->args.data;
-				sc_ctx.arglen = task->args.len;
-				sc_ctx.argspec = task->args.args;
+			if (script_uftrace_batch)
+				script_batch_add(&sc_ctx, SCRIPT_BATCH_EXIT);
+			else {
+				if (rstack->more && opts->show_args) {
+					sc_ctx.argbuf = task->args.data;
+					sc_ctx.arglen = task->args.len;
+					sc_ctx.argspec = task->args.args;
+				}
+
+				/* script hooking for function exit */
+				script_uftrace_exit(&sc_ctx);
 			}
-
-			/* script hooking for function exit */
-			script_uftrace_exit(&sc_ctx);
 		}
 
 		fstack_exit(task);
@@ -127,9 +138,13 @@ static int run_script_for_rstack(struct uftrace_data *handle, struct uftrace_tas
 		};
 
 		sc_ctx.name = event_get_name(handle, rstack->addr);
-		sc_ctx.argbuf = event_get_data_str(rstack->addr, task->args.data, false);
 
-		script_uftrace_event(&sc_ctx);
+		if (script_uftrace_batch)
+			script_batch_add(&sc_ctx, SCRIPT_BATCH_EVENT);
+		else {
+			sc_ctx.argbuf = event_get_data_str(rstack->addr, task->args.data, false);
+			script_uftrace_event(&sc_ctx);
+		}
 
 		free(sc_ctx.name);
 		free(sc_ctx.argbuf);
@@ -143,6 +158,12 @@ out:
 	return 0;
 }
 
+static int setup_filter_cache(struct uftrace_session *s, void *arg)
+{
+	script_setup_filter_cache(&s->sym_info);
+	return 0;
+}
+
 int command_script(int argc, char *argv[], struct uftrace_opts *opts)
 {
 	int ret;
@@ -201,6 +222,11 @@ int command_script(int argc, char *argv[], struct uftrace_opts *opts)
 		goto out;
 	}
 
+	/* check script filters for each symbol in advance */
+	walk_sessions(&handle.sessions, setup_filter_cache, NULL);
+
+	/* it includes the time running the script functions */
+	selfstat_begin(SELFSTAT_READ_RSTACK);
 	while (read_rstack(&handle, &task) == 0 && !uftrace_done) {
 		if (!fstack_check_opts(task, opts))
 			continue;
@@ -211,6 +237,10 @@ int command_script(int argc, char *argv[], struct uftrace_opts *opts)
 			break;
 	}
 
+	/* pass remaining records before calling uftrace_end() */
+	script_batch_flush();
+	selfstat_end(SELFSTAT_READ_RSTACK);
+
 	/* dtor for script support */
 	script_uftrace_end();
 out:
@@ -0,0 +1,236 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "uftrace.h"
+#include "utils/filter.h"
+#include "utils/socket.h"
+#include "utils/top.h"
+#include "utils/utils.h"
+
+static char *tmp_dirname;
+static void cleanup_tempdir(void)
+{
+	if (!tmp_dirname)
+		return;
+
+	remove_directory(tmp_dirname);
+	tmp_dirname = NULL;
+}
+
+struct top_display {
+	pthread_t thread;
+	struct top_view view;
+	volatile bool done;
+};
+
+static int setup_view(struct top_view *view, struct uftrace_opts *opts)
+{
+	if (top_parse_sort(opts->sort_keys, &view->sort) < 0) {
+		pr_use("invalid sort key: %s\n", opts->sort_keys);
+		return -1;
+	}
+
+	view->flags = opts->show_task ? TOP_VIEW_TASK : 0;
+	view->rows = 0;
+	view->interval = (opts->interval ?: TOP_DEFAULT_INTERVAL * NSEC_PER_MSEC) / NSEC_PER_MSEC;
+	return 0;
+}
+
+/* number of rows to fit in the terminal (without the header) */
+static int get_term_rows(void)
+{
+	struct winsize ws;
+
+	if (ioctl(fileno(outfp), TIOCGWINSZ, &ws) < 0 || ws.ws_row < 4)
+		return 0;
+
+	return ws.ws_row - 3;
+}
+
+static void refresh_screen(const char *text)
+{
+	/* move cursor to home and clear the screen */
+	pr_out("\033[H\033[2J");
+	pr_out("%s", text);
+	fflush(outfp);
+}
+
+/* returns false if it should stop */
+static bool wait_interval(unsigned msec, volatile bool *done)
+{
+	while (msec && !uftrace_done && !*done) {
+		unsigned ms = msec > 100 ? 100 : msec;
+
+		usleep(ms * 1000);
+		msec -= ms;
+	}
+	return !uftrace_done && !*done;
+}
+
+static void *display_thread(void *arg)
+{
+	struct top_display *td = arg;
+	sigset_t sigset;
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *fp;
+
+	pthread_setname_np(pthread_self(), "TopDisplay");
+
+	/* let the main thread handle signals */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+	while (wait_interval(td->view.interval, &td->done)) {
+		td->view.rows = get_term_rows();
+
+		fp = open_memstream(&buf, &len);
+		if (fp == NULL)
+			break;
+
+		top_print(fp, &td->view);
+		fclose(fp);
+		top_rotate();
+
+		refresh_screen(buf);
+		free(buf);
+		buf = NULL;
+	}
+	return NULL;
+}
+
+static int run_top(int argc, char *argv[], struct uftrace_opts *opts)
+{
+#define TOP_NAME "uftrace-top-XXXXXX"
+	char template[32] = "/tmp/" TOP_NAME;
+	struct top_display td = {};
+	bool tty = isatty(fileno(outfp));
+	int ret;
+
+	if (setup_view(&td.view, opts) < 0)
+		return -1;
+
+	if (opts->keep_pid) {
+		pr_warn("--keep-pid is not supported by top\n");
+		opts->keep_pid = false;
+	}
+
+	/* the recorder cannot know the size of argument data */
+	if (opts->args || opts->retval || opts->auto_args) {
+		pr_warn("arguments and return values are ignored by top\n");
+		opts->args = NULL;
+		opts->retval = NULL;
+		opts->auto_args = false;
+	}
+
+	/* likewise, remove argN and retval actions in the triggers */
+	if (opts->trigger) {
+		char *trigger = uftrace_clear_trigger_args(opts->trigger);
+
+		if (trigger == NULL || strcmp(trigger, opts->trigger))
+			pr_warn("argument and return value triggers are ignored by top\n");
+
+		free(opts->trigger);
+		opts->trigger = trigger;
+	}
+
+	if (!opts->record) {
+		if (mkdtemp(template) == NULL) {
+			/* can't reuse first template because it was trashed by mkdtemp */
+			strcpy(template, TOP_NAME);
+
+			if (mkdtemp(template) == NULL)
+				pr_err("cannot create temp directory");
+		}
+
+		/* command_record() will create it again */
+		rmdir(template);
+
+		tmp_dirname = template;
+		atexit(cleanup_tempdir);
+
+		opts->dirname = tmp_dirname;
+	}
+
+	top_init(opts->dirname, opts->tid);
+	top_enabled = true;
+
+	/* show the stats only at the end if it's not a terminal */
+	if (tty)
+		pthread_create(&td.thread, NULL, display_thread, &td);
+
+	ret = command_record(argc, argv, opts);
+
+	if (tty) {
+		td.done = true;
+		pthread_join(td.thread, NULL);
+		pr_out("\033[H\033[2J");
+	}
+
+	top_enabled = false;
+
+	td.view.flags |= TOP_VIEW_WHOLE;
+	td.view.rows = 0;
+	top_print(outfp, &td.view);
+
+	top_finish();
+	cleanup_tempdir();
+	return ret;
+}
+
+static int attach_top(struct uftrace_opts *opts)
+{
+	struct sockaddr_un addr;
+	struct top_view view;
+	bool tty = isatty(fileno(outfp));
+	bool done = false;
+	char *text;
+	int sfd;
+
+	if (setup_view(&view, opts) < 0)
+		return -1;
+
+	sfd = socket_create_top(&addr, opts->pid);
+	if (sfd < 0)
+		return -1;
+
+	if (socket_connect(sfd, &addr) < 0) {
+		pr_warn("is the process recorded with --agent?\n");
+		close(sfd);
+		return -1;
+	}
+
+	/* the recorder starts collecting the stats after connected */
+	while (wait_interval(view.interval, &done)) {
+		view.rows = tty ? get_term_rows() : 0;
+
+		text = top_request(sfd, &view);
+		if (text == NULL) {
+			pr_out("uftrace: recording of %d is finished\n", opts->pid);
+			break;
+		}
+
+		if (tty)
+			refresh_screen(text);
+		else
+			pr_out("%s\n", text);
+		free(text);
+	}
+
+	close(sfd);
+	return 0;
+}
+
+int command_top(int argc, char *argv[], struct uftrace_opts *opts)
+{
+	if (opts->pid)
+		return attach_top(opts);
+
+	return run_top(argc, argv, opts);
+}
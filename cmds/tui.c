@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -19,6 +20,7 @@
 #include "utils/list.h"
 #include "utils/rbtree.h"
 #include "utils/report.h"
+#include "utils/selfstat.h"
 #include "utils/utils.h"
 #include "version.h"
 
@@ -39,6 +41,8 @@
 
 static bool tui_finished;
 static bool tui_debug;
+/* progress of the data loading in percent, or -1 if it's done */
+static int tui_progress = -1;
 
 struct tui_graph_node {
 	struct uftrace_graph_node n;
@@ -125,12 +129,14 @@ static LIST_HEAD(report_output_fields);
 static struct tui_report tui_report;
 static struct tui_graph partial_graph;
 static struct tui_list tui_info;
+static struct tui_list tui_alloc;
 static struct tui_list tui_session;
 static char *tui_search;
 
 static const struct tui_window_ops graph_ops;
 static const struct tui_window_ops report_ops;
 static const struct tui_window_ops info_ops;
+static const struct tui_window_ops alloc_ops;
 static const struct tui_window_ops session_ops;
 
 static void tui_window_move_down(struct tui_window *win);
@@ -139,6 +145,7 @@ static void tui_window_move_down(struct tui_window *win);
 #define FIELD_SEP " :"
 
 #define POS_SIZE 5
+#define LOADING_SIZE 14
 
 #define C_NORMAL 0
 #define C_HEADER 1
@@ -157,6 +164,7 @@ static const char *help[] = {
 	"r             Show uftrace report for this function",
 	"s             Sort by the next column in report",
 	"I             Show uftrace info",
+	"A             Show heap allocation profile",
 	"S             Change session",
 	"O             Open editor",
 	"c/e           Collapse/Expand direct children graph",
@@ -174,19 +182,20 @@ static const char *help[] = {
 	"q             Quit",
 };
 
-#define NUM_GRAPH_FIELD 3
+#define NUM_GRAPH_FIELD 6
 
 static const char *graph_field_names[NUM_GRAPH_FIELD] = {
-	"TOTAL TIME",
-	"SELF TIME",
-	"ADDRESS",
+	"TOTAL TIME", "SELF TIME", "ADDRESS", "ON-CPU", "OFF-CPU", "WAITS",
 };
 
-#define NUM_REPORT_FIELD 10
+#define NUM_REPORT_FIELD 25
 
 static const char *report_field_names[NUM_REPORT_FIELD] = {
 	"TOTAL TIME", "TOTAL AVG", "TOTAL MIN", "TOTAL MAX", "SELF TIME",
 	"SELF AVG",   "SELF MIN",  "SELF MAX",	"CALL",	     "SIZE",
+	"TOTAL STD",  "TOTAL P50", "TOTAL P90", "TOTAL P99", "TOTAL P999",
+	"SELF STD",   "SELF P50",  "SELF P90",	"SELF P99",  "SELF P999",
+	"ON-CPU",     "OFF-CPU",   "BLOCKED",	"PREEMPTED", "WAITS",
 };
 
 static const char *field_help[] = {
@@ -204,8 +213,11 @@ enum tui_mode {
 };
 
 static char *report_sort_key[] = {
-	OPT_SORT_KEYS, "total_avg", "total_min", "total_max", "self",
-	"self_avg",    "self_min",  "self_max",	 "call",      "size",
+	OPT_SORT_KEYS,	"total_avg", "total_min", "total_max", "self",
+	"self_avg",	"self_min",  "self_max",  "call",      "size",
+	"total_stddev", "total_p50", "total_p90", "total_p99", "total_p999",
+	"self_stddev",	"self_p50",  "self_p90",  "self_p99",  "self_p999",
+	"oncpu",	"offcpu",    "blocked",	  "preempt",   "waits",
 };
 
 static char *selected_report_sort_key[NUM_REPORT_FIELD];
@@ -281,6 +293,31 @@ static void print_graph_self(struct field_data *fd)
 	print_time(d);
 }
 
+static void print_graph_oncpu(struct field_data *fd)
+{
+	struct uftrace_graph_node *node = fd->arg;
+	uint64_t d = 0;
+
+	if (node->time > node->offcpu_time)
+		d = node->time - node->offcpu_time;
+
+	print_time(d);
+}
+
+static void print_graph_offcpu(struct field_data *fd)
+{
+	struct uftrace_graph_node *node = fd->arg;
+
+	print_time(node->offcpu_time);
+}
+
+static void print_graph_waits(struct field_data *fd)
+{
+	struct uftrace_graph_node *node = fd->arg;
+
+	printw("%10" PRIu64, node->nr_waits);
+}
+
 static void print_graph_addr(struct field_data *fd)
 {
 	struct uftrace_graph_node *node = fd->arg;
@@ -326,11 +363,43 @@ static struct display_field graph_field_addr = {
 	.list = LIST_HEAD_INIT(graph_field_addr.list),
 };
 
+static struct display_field graph_field_oncpu = {
+	.id = GRAPH_F_ONCPU_TIME,
+	.name = "oncpu-time",
+	.alias = "oncpu",
+	.header = "    ON-CPU",
+	.length = 10,
+	.print = print_graph_oncpu,
+	.list = LIST_HEAD_INIT(graph_field_oncpu.list),
+};
+
+static struct display_field graph_field_offcpu = {
+	.id = GRAPH_F_OFFCPU_TIME,
+	.name = "offcpu-time",
+	.alias = "offcpu",
+	.header = "   OFF-CPU",
+	.length = 10,
+	.print = print_graph_offcpu,
+	.list = LIST_HEAD_INIT(graph_field_offcpu.list),
+};
+
+static struct display_field graph_field_waits = {
+	.id = GRAPH_F_WAITS,
+	.name = "waits",
+	.header = "     WAITS",
+	.length = 10,
+	.print = print_graph_waits,
+	.list = LIST_HEAD_INIT(graph_field_waits.list),
+};
+
 /* index of this table should be matched to display_field_id */
 static struct display_field *graph_field_table[] = {
 	&graph_field_total,
 	&graph_field_self,
 	&graph_field_addr,
+	&graph_field_oncpu,
+	&graph_field_offcpu,
+	&graph_field_waits,
 };
 
 /* clang-format off */
@@ -375,6 +444,21 @@ REPORT_FIELD_TIME(REPORT_F_SELF_TIME_MIN, self-min, self.min, self_min, "SELF MI
 REPORT_FIELD_TIME(REPORT_F_SELF_TIME_MAX, self-max, self.max, self_max, "SELF MAX");
 REPORT_FIELD_UINT(REPORT_F_CALL, call, call, call, "CALL");
 REPORT_FIELD_UINT(REPORT_F_SIZE, size, size, size, "SIZE");
+REPORT_FIELD_TIME(REPORT_F_TOTAL_TIME_STDDEV, total-stddev, total.stddev, total_stddev, "TOTAL STD");
+REPORT_FIELD_TIME(REPORT_F_TOTAL_TIME_P50, total-p50, total.p50, total_p50, "TOTAL P50");
+REPORT_FIELD_TIME(REPORT_F_TOTAL_TIME_P90, total-p90, total.p90, total_p90, "TOTAL P90");
+REPORT_FIELD_TIME(REPORT_F_TOTAL_TIME_P99, total-p99, total.p99, total_p99, "TOTAL P99");
+REPORT_FIELD_TIME(REPORT_F_TOTAL_TIME_P999, total-p999, total.p999, total_p999, "TOTAL P999");
+REPORT_FIELD_TIME(REPORT_F_SELF_TIME_STDDEV, self-stddev, self.stddev, self_stddev, "SELF STD");
+REPORT_FIELD_TIME(REPORT_F_SELF_TIME_P50, self-p50, self.p50, self_p50, "SELF P50");
+REPORT_FIELD_TIME(REPORT_F_SELF_TIME_P90, self-p90, self.p90, self_p90, "SELF P90");
+REPORT_FIELD_TIME(REPORT_F_SELF_TIME_P99, self-p99, self.p99, self_p99, "SELF P99");
+REPORT_FIELD_TIME(REPORT_F_SELF_TIME_P999, self-p999, self.p999, self_p999, "SELF P999");
+REPORT_FIELD_TIME(REPORT_F_ONCPU_TIME, oncpu, oncpu, oncpu, "ON-CPU");
+REPORT_FIELD_TIME(REPORT_F_OFFCPU_TIME, offcpu, offcpu, offcpu, "OFF-CPU");
+REPORT_FIELD_TIME(REPORT_F_BLOCKED_TIME, blocked, blocked, blocked, "BLOCKED");
+REPORT_FIELD_TIME(REPORT_F_PREEMPT_TIME, preempt, preempt, preempt, "PREEMPTED");
+REPORT_FIELD_UINT(REPORT_F_WAITS, waits, waits, waits, "WAITS");
 
 /* clang-format on */
 
@@ -382,7 +466,12 @@ static struct display_field *report_field_table[] = {
 	&report_field_total,	 &report_field_total_avg, &report_field_total_min,
 	&report_field_total_max, &report_field_self,	  &report_field_self_avg,
 	&report_field_self_min,	 &report_field_self_max,  &report_field_call,
-	&report_field_size,
+	&report_field_size,	 &report_field_total_stddev, &report_field_total_p50,
+	&report_field_total_p90, &report_field_total_p99, &report_field_total_p999,
+	&report_field_self_stddev, &report_field_self_p50, &report_field_self_p90,
+	&report_field_self_p99,	 &report_field_self_p999, &report_field_oncpu,
+	&report_field_offcpu,	 &report_field_blocked,	  &report_field_preempt,
+	&report_field_waits,
 };
 
 static void setup_default_graph_field(struct list_head *fields, struct uftrace_opts *opts,
@@ -429,6 +518,8 @@ static void tui_setup(struct uftrace_data *handle, struct uftrace_opts *opts)
 	walk_sessions(&handle->sessions, create_data, NULL);
 
 	tui_report.name_tree = RB_ROOT;
+	/* report fields can be changed at runtime, always keep percentiles */
+	report_enable_hist(true);
 
 	if (opts->report) {
 		setup_field(&report_output_fields, opts, setup_default_report_field,
@@ -689,6 +780,8 @@ static void copy_graph_node(struct uftrace_graph_node *dst, struct uftrace_graph
 		node->n.addr = child->addr;
 		node->n.time += child->time;
 		node->n.child_time += child->child_time;
+		node->n.offcpu_time += child->offcpu_time;
+		node->n.nr_waits += child->nr_waits;
 		node->n.nr_calls += child->nr_calls;
 
 		copy_graph_node(&node->n, child);
@@ -724,21 +817,32 @@ static void tui_window_init(struct tui_window *win, const struct tui_window_ops
 	win->last_index = tui_last_index(win);
 }
 
+/* top (root) is an artificial node, fill the info */
+static void update_graph_root(struct tui_graph *graph)
+{
+	struct uftrace_graph_node *top = &graph->ug.root;
+	struct uftrace_graph_node *node;
+
+	top->name = basename(graph->ug.sess->exename);
+	top->nr_calls = 1;
+	top->time = top->child_time = 0;
+	top->offcpu_time = 0;
+	top->nr_waits = 0;
+
+	list_for_each_entry(node, &graph->ug.root.head, list) {
+		top->time += node->time;
+		top->child_time += node->time;
+		top->offcpu_time += node->offcpu_time;
+		top->nr_waits += node->nr_waits;
+	}
+}
+
 static struct tui_graph *tui_graph_init(struct uftrace_opts *opts)
 {
 	struct tui_graph *graph;
-	struct uftrace_graph_node *top, *node;
 
 	list_for_each_entry(graph, &tui_graph_list, list) {
-		/* top (root) is an artificial node, fill the info */
-		top = &graph->ug.root;
-		top->name = basename(graph->ug.sess->exename);
-		top->nr_calls = 1;
-
-		list_for_each_entry(node, &graph->ug.root.head, list) {
-			top->time += node->time;
-			top->child_time += node->time;
-		}
+		update_graph_root(graph);
 
 		tui_window_init(&graph->win, &graph_ops);
 
@@ -798,6 +902,8 @@ static void build_partial_graph(struct tui_report_node *root_node, struct tui_gr
 
 	root->n.time = 0;
 	root->n.child_time = 0;
+	root->n.offcpu_time = 0;
+	root->n.nr_waits = 0;
 	root->n.nr_calls = 0;
 
 	/* special node */
@@ -819,6 +925,8 @@ static void build_partial_graph(struct tui_report_node *root_node, struct tui_gr
 			tmp->n.addr = parent->n.addr;
 			tmp->n.time = node->n.time;
 			tmp->n.child_time = node->n.child_time;
+			tmp->n.offcpu_time = node->n.offcpu_time;
+			tmp->n.nr_waits = node->n.nr_waits;
 			tmp->n.nr_calls = node->n.nr_calls;
 
 			/* fold backtrace at the first child */
@@ -845,6 +953,8 @@ static void build_partial_graph(struct tui_report_node *root_node, struct tui_gr
 		root->n.addr = node->n.addr;
 		root->n.time += node->n.time;
 		root->n.child_time += node->n.child_time;
+		root->n.offcpu_time += node->n.offcpu_time;
+		root->n.nr_waits += node->n.nr_waits;
 		root->n.nr_calls += node->n.nr_calls;
 
 		copy_graph_node(&root->n, &node->n);
@@ -1158,6 +1268,13 @@ static void win_footer(struct tui_window *win, char *msg)
 
 	memset(footer, BLANK, sizeof(footer));
 	memcpy(footer, msg, COLS < msg_len ? COLS : msg_len);
+	if (tui_progress >= 0 && pos_start - LOADING_SIZE > msg_len) {
+		char loading[32];
+		int len;
+
+		len = snprintf(loading, sizeof(loading), "loading %3d%%", tui_progress);
+		memcpy(footer + pos_start - LOADING_SIZE, loading, len);
+	}
 	if (pos_start > msg_len)
 		snprintf(footer + pos_start, POS_SIZE, "%3d%%", win_pos_percent(win));
 
@@ -1752,6 +1869,60 @@ static const struct tui_window_ops info_ops = {
 	.display = win_display_info,
 };
 
+/* per-window operations for heap allocation profile window */
+static struct tui_list *tui_alloc_init(struct uftrace_opts *opts, struct uftrace_data *handle)
+{
+	INIT_LIST_HEAD(&tui_alloc.head);
+	if (process_alloc_profile(handle, opts, build_info_node, &tui_alloc) < 0)
+		build_info_node(&tui_alloc, "  no heap allocation profile: use --alloc-profile when recording\n");
+
+	tui_window_init(&tui_alloc.win, &alloc_ops);
+
+	return &tui_alloc;
+}
+
+static void tui_alloc_finish(void)
+{
+	struct tui_list_node *node, *tmp;
+
+	list_for_each_entry_safe(node, tmp, &tui_alloc.head, list) {
+		list_del(&node->list);
+		free(node->data);
+		free(node);
+	}
+}
+
+static void win_header_alloc(struct tui_window *win, struct uftrace_data *handle)
+{
+	printw("%-*.*s", COLS, COLS, "uftrace heap allocation profile");
+}
+
+static void win_footer_alloc(struct tui_window *win, struct uftrace_data *handle)
+{
+	win_footer(win, "heap allocations by function (sorted by bytes)");
+}
+
+static bool win_search_alloc(struct tui_window *win, void *node, char *str)
+{
+	struct tui_list_node *curr = node;
+
+	return strstr(curr->data, str);
+}
+
+static const struct tui_window_ops alloc_ops = {
+	.prev = win_prev_list,
+	.next = win_next_list,
+	.top = win_top_list,
+	.parent = win_parent_no,
+	.sibling_prev = win_sibling_prev_no,
+	.sibling_next = win_sibling_next_no,
+	.needs_blank = win_needs_blank_no,
+	.header = win_header_alloc,
+	.footer = win_footer_alloc,
+	.display = win_display_info,
+	.search = win_search_alloc,
+};
+
 #define TUI_SESS_REPORT 1
 #define TUI_SESS_INFO 2
 #define TUI_SESS_HELP 3
@@ -2705,7 +2876,178 @@ static inline void cancel_search(void)
 	tui_search = NULL;
 }
 
-static void tui_main_loop(struct uftrace_opts *opts, struct uftrace_data *handle)
+/* number of records to process in a loading step */
+#define TUI_LOADING_STEP 65536
+
+struct tui_loading {
+	uint64_t *size;
+	uint64_t total;
+	bool done;
+};
+
+static void setup_loading_progress(struct tui_loading *load, struct uftrace_data *handle)
+{
+	struct stat stbuf;
+	int i;
+
+	load->size = xcalloc(handle->nr_tasks, sizeof(*load->size));
+	load->total = 0;
+	load->done = false;
+
+	for (i = 0; i < handle->nr_tasks; i++) {
+		struct uftrace_task_reader *task = &handle->tasks[i];
+		char *filename;
+
+		if (task->done)
+			continue;
+
+		/* the data file is not opened yet */
+		xasprintf(&filename, "%s/%d.dat", handle->dirname, task->tid);
+		if (stat(filename, &stbuf) == 0) {
+			load->size[i] = stbuf.st_size;
+			load->total += stbuf.st_size;
+		}
+		free(filename);
+	}
+}
+
+/* returns the progress of reading task data files in percent */
+static int get_loading_progress(struct tui_loading *load, struct uftrace_data *handle)
+{
+	uint64_t curr = 0;
+	int i;
+
+	if (load->total == 0)
+		return 100;
+
+	for (i = 0; i < handle->nr_tasks; i++) {
+		struct uftrace_task_reader *task = &handle->tasks[i];
+
+		if (task->done)
+			curr += load->size[i];
+		else if (task->fp)
+			curr += ftello(task->fp);
+		else
+			curr += task->offset;
+	}
+
+	if (curr > load->total)
+		curr = load->total;
+
+	return curr * 100 / load->total;
+}
+
+static void display_loading_msg(void)
+{
+	char *tuimsg = "Building graph for TUI...";
+	int row, col;
+
+	getmaxyx(stdscr, row, col);
+	mvprintw(row / 2, (col - strlen(tuimsg)) / 2, "%s", tuimsg);
+	refresh();
+}
+
+/* read the next records and build the graph, returns true when it's done */
+static bool tui_load_step(struct tui_loading *load, struct uftrace_opts *opts,
+			  struct uftrace_data *handle)
+{
+	struct uftrace_task_reader *task;
+	unsigned long nr_rec = 0;
+
+	if (load->done)
+		return true;
+
+	selfstat_begin(SELFSTAT_READ_RSTACK);
+	while (nr_rec++ < TUI_LOADING_STEP) {
+		if (read_rstack(handle, &task) != 0 || uftrace_done) {
+			load->done = true;
+			break;
+		}
+
+		if (!fstack_check_opts(task, opts))
+			continue;
+
+		if (!fstack_check_filter(task))
+			continue;
+
+		if (build_tui_node(task, task->rstack, opts)) {
+			load->done = true;
+			break;
+		}
+
+		fstack_check_filter_done(task);
+	}
+
+	if (load->done) {
+		add_remaining_node(opts, handle);
+		tui_progress = -1;
+	}
+	else {
+		tui_progress = get_loading_progress(load, handle);
+	}
+	selfstat_end(SELFSTAT_READ_RSTACK);
+
+	return load->done;
+}
+
+/* update the window for the new data while keeping the current node */
+static void tui_window_reload(struct tui_window *win)
+{
+	void *target = win->curr;
+	int offset = win->curr_index - win->top_index;
+	void *node;
+
+	tui_window_move_home(win);
+
+	while (win->curr != target) {
+		if (win->ops->next(win, win->curr, false) == NULL) {
+			/* cannot find the node, just go to the first one */
+			tui_window_move_home(win);
+			break;
+		}
+		tui_window_move_down(win);
+	}
+
+	/* keep the position of the current node in the screen */
+	while (win->curr_index - win->top_index > offset) {
+		node = win->ops->next(win, win->top, true);
+		win->top_index++;
+
+		if (win->ops->needs_blank(win, win->top, node))
+			win->top_index++;
+
+		win->top = node;
+	}
+
+	win->last_index = tui_last_index(win);
+
+	win->search_count = -1;
+	tui_window_search_count(win);
+}
+
+/* load more data and update the windows with it */
+static void tui_load_more(struct tui_loading *load, struct uftrace_opts *opts,
+			  struct uftrace_data *handle)
+{
+	struct tui_graph *graph;
+
+	if (tui_load_step(load, opts, handle)) {
+		/* no more data, wait for user input */
+		nodelay(stdscr, false);
+	}
+
+	list_for_each_entry(graph, &tui_graph_list, list) {
+		update_graph_root(graph);
+		tui_window_reload(&graph->win);
+	}
+
+	report_calc_avg(&tui_report.name_tree);
+	report_sort_nodes(&tui_report.name_tree, &tui_report.sort_tree);
+	tui_window_reload(&tui_report.win);
+}
+
+static void tui_main_loop(struct uftrace_opts *opts, struct uftrace_data *handle,
+			  struct tui_loading *load)
 {
 	int key = 0;
 	bool full_redraw = true;
@@ -2713,6 +3055,7 @@ static void tui_main_loop(struct uftrace_opts *opts, struct uftrace_data *handle
 	struct tui_report *report;
 	struct tui_list *info;
 	struct tui_list *session;
+	struct tui_list *alloc;
 	struct tui_window *win;
 	void *old_top;
 	enum tui_mode tui_mode;
@@ -2720,8 +3063,10 @@ static void tui_main_loop(struct uftrace_opts *opts, struct uftrace_data *handle
 
 	graph = tui_graph_init(opts);
 	report = tui_report_init(opts);
-	info = tui_info_init(opts, handle);
+	/* it was initialized before loading the data */
+	info = &tui_info;
 	session = tui_session_init(opts);
+	alloc = tui_alloc_init(opts, handle);
 
 	/* start with graph only if there's one session */
 	if (opts->report) {
@@ -2891,6 +3236,13 @@ static void tui_main_loop(struct uftrace_opts *opts, struct uftrace_data *handle
 				tui_mode = TUI_MODE_OTHER;
 			}
 			break;
+		case 'A':
+			if (tui_window_change(win, &alloc->win)) {
+				win = &alloc->win;
+				full_redraw = true;
+				tui_mode = TUI_MODE_OTHER;
+			}
+			break;
 		case 'S':
 			if (tui_window_change(win, &session->win)) {
 				win = &session->win;
@@ -2992,30 +3344,37 @@ static void tui_main_loop(struct uftrace_opts *opts, struct uftrace_data *handle
 
 		move(LINES - 1, COLS - 1);
 		key = getch();
+
+		/* getch() doesn't block while loading, keep loading until a key is pressed */
+		while (key == ERR && !load->done) {
+			tui_load_more(load, opts, handle);
+
+			/* erase() avoids flickering unlike clear() */
+			erase();
+			tui_window_display(win, true, handle);
+			refresh();
+
+			win->old = win->curr;
+			old_top = win->top;
+
+			move(LINES - 1, COLS - 1);
+			key = getch();
+		}
 	}
 
 out:
 	tui_graph_finish();
 	tui_report_finish();
 	tui_info_finish();
+	tui_alloc_finish();
 	tui_session_finish();
 }
 
-static void display_loading_msg(void)
-{
-	char *tuimsg = "Building graph for TUI...";
-	int row, col;
-
-	getmaxyx(stdscr, row, col);
-	mvprintw(row / 2, (col - strlen(tuimsg)) / 2, "%s", tuimsg);
-	refresh();
-}
-
 int command_tui(int argc, char *argv[], struct uftrace_opts *opts)
 {
 	int ret;
 	struct uftrace_data handle;
-	struct uftrace_task_reader *task;
+	struct tui_loading load;
 
 	ret = open_data_file(opts, &handle);
 	if (ret < 0) {
@@ -3038,26 +3397,23 @@ int command_tui(int argc, char *argv[], struct uftrace_opts *opts)
 	/* Print a message before main screen is launched. */
 	display_loading_msg();
 
-	fstack_setup_filters(opts, &handle);
-
-	while (read_rstack(&handle, &task) == 0 && !uftrace_done) {
-		struct uftrace_record *rec = task->rstack;
-
-		if (!fstack_check_opts(task, opts))
-			continue;
+	/* it rewinds the perf data so should be done before reading it */
+	tui_info_init(opts, &handle);
 
-		if (!fstack_check_filter(task))
-			continue;
+	fstack_setup_filters(opts, &handle);
+	setup_loading_progress(&load, &handle);
 
-		ret = build_tui_node(task, rec, opts);
-		if (ret)
+	/* show the partial result as soon as it has a function */
+	while (!tui_load_step(&load, opts, &handle)) {
+		if (!RB_EMPTY_ROOT(&tui_report.name_tree))
 			break;
-
-		fstack_check_filter_done(task);
 	}
-	add_remaining_node(opts, &handle);
 
-	tui_main_loop(opts, &handle);
+	/* the rest will be loaded in the main loop */
+	nodelay(stdscr, !load.done);
+
+	tui_main_loop(opts, &handle, &load);
+	free(load.size);
 
 	close_data_file(opts, &handle);
 
@@ -0,0 +1,474 @@
+/*
+ * heap allocation profiler in libmcount
+ *
+ * The malloc family functions are wrapped (see wrap.c) and allocations are
+ * aggregated in the process by the calling function, or by the call site
+ * if it's not traced.  It keeps the number of allocations, total and freed
+ * bytes, the peak of live bytes and a histogram of allocation sizes.  The
+ * result is saved in a summary file in the data directory at exit so that
+ * each allocation doesn't need to be recorded.  Optionally every N-th
+ * allocation can be saved as an 'alloc:sample' event in the trace data.
+ *
+ * Released under the GPL v2.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT "alloc"
+#define PR_DOMAIN DBG_WRAP
+
+#include "libmcount/internal.h"
+#include "libmcount/mcount.h"
+#include "utils/event.h"
+#include "utils/hashmap.h"
+#include "utils/utils.h"
+
+struct alloc_site {
+	unsigned long addr;
+	uint64_t count;
+	uint64_t bytes;
+	uint64_t nr_free;
+	uint64_t freed;
+	uint64_t live;
+	uint64_t peak;
+	uint64_t hist[UFTRACE_ALLOC_HIST_MAX];
+};
+
+/* saved in the chunk table directly to avoid allocation for each chunk */
+struct alloc_chunk {
+	void *ptr;
+	size_t size;
+	struct alloc_site *site;
+};
+
+/*
+ * Allocation functions can be called by many threads at the same time.
+ * To reduce the contention, the chunks are kept in a number of hash tables
+ * (selected by the address) with a lock for each.  Sites are found in a
+ * per-thread cache first, and updated with atomic operations.
+ */
+#define ALLOC_NR_SHARD 64
+#define ALLOC_SITE_CACHE 64
+
+struct alloc_chunk_table {
+	pthread_mutex_t lock;
+	/* open addressing with linear probing */
+	struct alloc_chunk *chunks;
+	unsigned long size;
+	unsigned long nr;
+} __align(64);
+
+struct alloc_site_table {
+	pthread_mutex_t lock;
+	Hashmap *sites;
+} __align(64);
+
+/* checked by the wrappers before calling the functions below */
+bool mcount_alloc_profile;
+
+/* save every N-th allocation as an event (0 means no sample) */
+static unsigned long alloc_sample;
+static unsigned long alloc_nr_sample;
+
+static char *alloc_dirname;
+static struct alloc_chunk_table alloc_chunks[ALLOC_NR_SHARD];
+static struct alloc_site_table alloc_sites[ALLOC_NR_SHARD];
+static uint64_t alloc_live;
+static uint64_t alloc_peak;
+
+/* allocations during the bookkeeping should be ignored */
+static TLS bool alloc_busy;
+
+/* sites used recently by this thread */
+static TLS struct alloc_site *alloc_site_cache[ALLOC_SITE_CACHE];
+
+static unsigned long alloc_hash(unsigned long key)
+{
+	return ((uint64_t)key * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+/* bucket N has sizes in [2^(N-1), 2^N) and bucket 0 is for zero size */
+static int alloc_hist_bucket(size_t size)
+{
+	int bucket = 0;
+
+	while (size && bucket < UFTRACE_ALLOC_HIST_MAX - 1) {
+		size >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+static void update_peak(uint64_t *peak, uint64_t live)
+{
+	uint64_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+	while (old < live) {
+		if (__atomic_compare_exchange_n(peak, &old, live, true, __ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+			break;
+	}
+}
+
+static void save_alloc_sample(struct mcount_thread_data *mtdp, void *ptr, size_t size)
+{
+	struct uftrace_alloc_sample sample = {
+		.size = size,
+		.addr = (unsigned long)ptr,
+	};
+	struct mcount_event *event;
+
+	if (check_thread_data(mtdp) || mtdp->nr_events >= MAX_EVENT)
+		return;
+
+	event = &mtdp->event[mtdp->nr_events++];
+	event->id = EVENT_ID_ALLOC_SAMPLE;
+	event->time = mcount_gettime();
+	event->dsize = sizeof(sample);
+	event->idx = ASYNC_IDX;
+
+	memcpy(event->data, &sample, sizeof(sample));
+}
+
+static struct alloc_site *get_alloc_site(unsigned long addr)
+{
+	unsigned long hash = alloc_hash(addr);
+	struct alloc_site **cache = &alloc_site_cache[hash % ALLOC_SITE_CACHE];
+	struct alloc_site_table *tbl;
+	struct alloc_site *site = *cache;
+
+	if (site && site->addr == addr)
+		return site;
+
+	tbl = &alloc_sites[hash % ALLOC_NR_SHARD];
+
+	pthread_mutex_lock(&tbl->lock);
+	site = hashmap_get(tbl->sites, (void *)addr);
+	if (site == NULL) {
+		site = xzalloc(sizeof(*site));
+		site->addr = addr;
+		hashmap_put(tbl->sites, (void *)addr, site);
+	}
+	pthread_mutex_unlock(&tbl->lock);
+
+	/* sites are not freed until exit */
+	*cache = site;
+	return site;
+}
+
+static struct alloc_chunk_table *get_chunk_table(void *ptr)
+{
+	/* use upper bits as lower bits are used for the index in the table */
+	return &alloc_chunks[(alloc_hash((unsigned long)ptr) >> 24) % ALLOC_NR_SHARD];
+}
+
+/* returns the slot for @ptr, or an empty slot if not found */
+static struct alloc_chunk *find_chunk_slot(struct alloc_chunk_table *tbl, void *ptr)
+{
+	unsigned long mask = tbl->size - 1;
+	unsigned long idx = alloc_hash((unsigned long)ptr) & mask;
+
+	while (tbl->chunks[idx].ptr != NULL && tbl->chunks[idx].ptr != ptr)
+		idx = (idx + 1) & mask;
+
+	return &tbl->chunks[idx];
+}
+
+static void grow_chunk_table(struct alloc_chunk_table *tbl)
+{
+	struct alloc_chunk *old = tbl->chunks;
+	unsigned long old_size = tbl->size;
+	unsigned long i;
+
+	tbl->size = old_size ? old_size * 2 : 256;
+	tbl->chunks = xcalloc(tbl->size, sizeof(*tbl->chunks));
+
+	for (i = 0; i < old_size; i++) {
+		if (old[i].ptr)
+			*find_chunk_slot(tbl, old[i].ptr) = old[i];
+	}
+	free(old);
+}
+
+/* should be called with the table lock held, returns false if not found */
+static bool remove_chunk(struct alloc_chunk_table *tbl, void *ptr, struct alloc_chunk *chunk)
+{
+	unsigned long mask = tbl->size - 1;
+	unsigned long idx, next, home;
+	struct alloc_chunk *slot;
+
+	if (tbl->nr == 0)
+		return false;
+
+	slot = find_chunk_slot(tbl, ptr);
+	if (slot->ptr == NULL)
+		return false;
+
+	*chunk = *slot;
+
+	/* move the following entries back to fill the hole */
+	idx = slot - tbl->chunks;
+	next = (idx + 1) & mask;
+	while (tbl->chunks[next].ptr != NULL) {
+		home = alloc_hash((unsigned long)tbl->chunks[next].ptr) & mask;
+
+		/* move it if the hole is between its home and current slot */
+		if (((next - home) & mask) >= ((next - idx) & mask)) {
+			tbl->chunks[idx] = tbl->chunks[next];
+			idx = next;
+		}
+		next = (next + 1) & mask;
+	}
+	tbl->chunks[idx].ptr = NULL;
+	tbl->nr--;
+	return true;
+}
+
+static void release_chunk(struct alloc_chunk *chunk)
+{
+	struct alloc_site *site = chunk->site;
+
+	__atomic_add_fetch(&site->nr_free, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&site->freed, chunk->size, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&site->live, chunk->size, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&alloc_live, chunk->size, __ATOMIC_RELAXED);
+}
+
+void mcount_alloc_record(void *ptr, size_t size, unsigned long callsite)
+{
+	struct mcount_thread_data *mtdp;
+	struct alloc_site *site;
+	struct alloc_chunk_table *tbl;
+	struct alloc_chunk *slot;
+	struct alloc_chunk old = {};
+	unsigned long addr;
+
+	if (ptr == NULL || alloc_busy)
+		return;
+
+	/*
+	 * ignore internal allocations in libmcount.  Note that it should
+	 * check mtd directly as it's not set to the thread data during
+	 * mcount_prepare() and mcount_startup().
+	 */
+	if (mtd.recursion_marker)
+		return;
+
+	alloc_busy = true;
+	mtdp = get_thread_data();
+	addr = mcount_find_caller(mtdp, callsite);
+
+	site = get_alloc_site(addr);
+	__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&site->bytes, size, __ATOMIC_RELAXED);
+	update_peak(&site->peak, __atomic_add_fetch(&site->live, size, __ATOMIC_RELAXED));
+	__atomic_add_fetch(&site->hist[alloc_hist_bucket(size)], 1, __ATOMIC_RELAXED);
+	update_peak(&alloc_peak, __atomic_add_fetch(&alloc_live, size, __ATOMIC_RELAXED));
+
+	tbl = get_chunk_table(ptr);
+	pthread_mutex_lock(&tbl->lock);
+
+	if ((tbl->nr + 1) * 2 > tbl->size)
+		grow_chunk_table(tbl);
+
+	slot = find_chunk_slot(tbl, ptr);
+	/* it might miss the free (e.g. from a different allocator) */
+	if (slot->ptr)
+		old = *slot;
+	else
+		tbl->nr++;
+
+	slot->ptr = ptr;
+	slot->size = size;
+	slot->site = site;
+
+	pthread_mutex_unlock(&tbl->lock);
+
+	if (old.ptr)
+		release_chunk(&old);
+
+	if (alloc_sample &&
+	    __atomic_add_fetch(&alloc_nr_sample, 1, __ATOMIC_RELAXED) % alloc_sample == 0)
+		save_alloc_sample(mtdp, ptr, size);
+
+	alloc_busy = false;
+}
+
+/* returns size of the chunk, or 0 if it's not found */
+size_t mcount_alloc_release(void *ptr)
+{
+	struct alloc_chunk_table *tbl;
+	struct alloc_chunk chunk;
+	size_t size = 0;
+
+	if (ptr == NULL || alloc_busy)
+		return 0;
+
+	alloc_busy = true;
+
+	tbl = get_chunk_table(ptr);
+	pthread_mutex_lock(&tbl->lock);
+	if (remove_chunk(tbl, ptr, &chunk)) {
+		release_chunk(&chunk);
+		size = chunk.size;
+	}
+	pthread_mutex_unlock(&tbl->lock);
+
+	alloc_busy = false;
+	return size;
+}
+
+static bool write_alloc_site(void *key, void *value, void *arg)
+{
+	struct alloc_site *site = value;
+	FILE *fp = arg;
+	char *sep = "";
+	int i;
+
+	/* reset by fork */
+	if (site->count == 0)
+		return true;
+
+	fprintf(fp,
+		"SITE addr=%#lx count=%" PRIu64 " bytes=%" PRIu64 " free=%" PRIu64
+		" freed=%" PRIu64 " peak=%" PRIu64 " hist=",
+		site->addr, site->count, site->bytes, site->nr_free, site->freed, site->peak);
+
+	for (i = 0; i < UFTRACE_ALLOC_HIST_MAX; i++) {
+		if (site->hist[i] == 0)
+			continue;
+
+		fprintf(fp, "%s%d:%" PRIu64, sep, i, site->hist[i]);
+		sep = ",";
+	}
+	fputc('\n', fp);
+	return true;
+}
+
+static bool reset_alloc_site(void *key, void *value, void *arg)
+{
+	struct alloc_site *site = value;
+	unsigned long addr = site->addr;
+
+	memset(site, 0, sizeof(*site));
+	site->addr = addr;
+	return true;
+}
+
+static void lock_alloc_tables(void)
+{
+	int i;
+
+	for (i = 0; i < ALLOC_NR_SHARD; i++) {
+		pthread_mutex_lock(&alloc_sites[i].lock);
+		pthread_mutex_lock(&alloc_chunks[i].lock);
+	}
+}
+
+static void unlock_alloc_tables(void)
+{
+	int i;
+
+	for (i = 0; i < ALLOC_NR_SHARD; i++) {
+		pthread_mutex_unlock(&alloc_chunks[i].lock);
+		pthread_mutex_unlock(&alloc_sites[i].lock);
+	}
+}
+
+static void alloc_atfork_prepare(void)
+{
+	/* other fork handlers might call malloc */
+	alloc_busy = true;
+	lock_alloc_tables();
+}
+
+static void alloc_atfork_parent(void)
+{
+	unlock_alloc_tables();
+	alloc_busy = false;
+}
+
+static void alloc_atfork_child(void)
+{
+	int i;
+
+	/* the child process would write its own summary */
+	for (i = 0; i < ALLOC_NR_SHARD; i++) {
+		struct alloc_chunk_table *tbl = &alloc_chunks[i];
+
+		pthread_mutex_init(&alloc_sites[i].lock, NULL);
+		hashmap_for_each(alloc_sites[i].sites, reset_alloc_site, NULL);
+
+		pthread_mutex_init(&tbl->lock, NULL);
+		if (tbl->size)
+			memset(tbl->chunks, 0, tbl->size * sizeof(*tbl->chunks));
+		tbl->nr = 0;
+	}
+
+	alloc_live = alloc_peak = 0;
+	alloc_nr_sample = 0;
+	alloc_busy = false;
+}
+
+void mcount_alloc_init(const char *dirname, const char *alloc_str)
+{
+	int i;
+
+	alloc_sample = strtoul(alloc_str, NULL, 0);
+	alloc_dirname = xstrdup(dirname);
+
+	for (i = 0; i < ALLOC_NR_SHARD; i++) {
+		pthread_mutex_init(&alloc_sites[i].lock, NULL);
+		alloc_sites[i].sites = hashmap_create(16, hashmap_ptr_hash, hashmap_ptr_equals);
+		pthread_mutex_init(&alloc_chunks[i].lock, NULL);
+	}
+
+	pthread_atfork(alloc_atfork_prepare, alloc_atfork_parent, alloc_atfork_child);
+
+	pr_dbg("heap allocation profile enabled (sample: %lu)\n", alloc_sample);
+	mcount_alloc_profile = true;
+}
+
+void mcount_alloc_finish(void)
+{
+	char *filename = NULL;
+	FILE *fp;
+	int i;
+
+	if (!mcount_alloc_profile)
+		return;
+
+	alloc_busy = true;
+	lock_alloc_tables();
+
+	/* other threads might still call malloc, just pass them through */
+	mcount_alloc_profile = false;
+
+	xasprintf(&filename, "%s/" UFTRACE_ALLOC_FILE, alloc_dirname, getpid());
+
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		pr_dbg("cannot create alloc profile: %s: %m\n", filename);
+		goto out;
+	}
+
+	fprintf(fp, "PROC pid=%d sid=%.*s live=%" PRIu64 " peak=%" PRIu64 " sample=%lu\n",
+		getpid(), SESSION_ID_LEN, mcount_session_name(), alloc_live, alloc_peak,
+		alloc_sample);
+	for (i = 0; i < ALLOC_NR_SHARD; i++)
+		hashmap_for_each(alloc_sites[i].sites, write_alloc_site, fp);
+	fclose(fp);
+
+	pr_dbg("saved heap allocation profile: %s\n", filename);
+
+out:
+	unlock_alloc_tables();
+	free(filename);
+	alloc_busy = false;
+}
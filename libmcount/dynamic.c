@@ -12,10 +12,17 @@
  * -. find original code from hashmap
  * -. unpatch function
  */
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <link.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /* This should be defined before #include "utils.h" */
 #define PR_FMT "dynamic"
@@ -32,6 +39,8 @@
 #include "utils/utils.h"
 
 static struct mcount_dynamic_info *mdinfo;
+/* protects the mdinfo list, it's kept after the patch for the agent */
+static pthread_mutex_t mdinfo_lock = PTHREAD_MUTEX_INITIALIZER;
 static struct mcount_dynamic_stats {
 	int total;
 	int failed;
@@ -60,6 +69,10 @@ static unsigned min_size;
 /* disassembly engine for dynamic code patch (for capstone) */
 static struct mcount_disasm_engine disasm;
 
+/* directory to save patch plans, and the key of the current patch options */
+static char *patch_cache_dir;
+static char *patch_plan_key;
+
 static struct mcount_orig_insn *create_code(struct Hashmap *map, unsigned long addr)
 {
 	struct mcount_orig_insn *entry;
@@ -354,11 +367,24 @@ struct mcount_dynamic_info *setup_trampoline(struct uftrace_mmap *map)
 
 static LIST_HEAD(patterns);
 
+/* functions for triggers are patched in dlopen() even with --patch-async */
+static LIST_HEAD(sync_patterns);
+
+enum patch_scope {
+	PATCH_ALL,
+	PATCH_SYNC, /* functions in sync_patterns only */
+	PATCH_ASYNC, /* functions not in sync_patterns */
+};
+
+static enum patch_scope patch_scope = PATCH_ALL;
+
 struct patt_list {
 	struct list_head list;
 	struct uftrace_pattern patt;
 	char *module;
 	bool positive;
+	/* whether it's applied to the current module */
+	bool selected;
 };
 
 static bool match_pattern_module(char *pathname)
@@ -384,17 +410,32 @@ static bool match_pattern_module(char *pathname)
 	return ret;
 }
 
-static bool match_pattern_list(struct uftrace_mmap *map, char *soname, char *sym_name)
+/* check the module once instead of doing it for each symbol */
+static bool select_pattern_list(struct list_head *head, struct uftrace_mmap *map, char *soname)
 {
 	struct patt_list *pl;
-	bool ret = false;
 	char *libname = basename(map->libname);
+	bool selected = false;
 
-	list_for_each_entry(pl, &patterns, list) {
+	list_for_each_entry(pl, head, list) {
 		int len = strlen(pl->module);
 
-		if (strncmp(libname, pl->module, len) &&
-		    (!soname || strncmp(soname, pl->module, len)))
+		pl->selected = !strncmp(libname, pl->module, len) ||
+			       (soname && !strncmp(soname, pl->module, len));
+		selected |= pl->selected;
+	}
+
+	return selected;
+}
+
+static bool match_selected_patterns(char *sym_name)
+{
+	struct patt_list *pl;
+	bool ret = false;
+
+	/* the last matching pattern decides it */
+	list_for_each_entry(pl, &patterns, list) {
+		if (!pl->selected || ret == pl->positive)
 			continue;
 
 		if (match_filter_pattern(&pl->patt, sym_name))
@@ -404,7 +445,9 @@ static bool match_pattern_list(struct uftrace_mmap *map, char *soname, char *sym
 	return ret;
 }
 
-static void parse_pattern_list(char *patch_funcs, char *def_mod, enum uftrace_pattern_type ptype)
+/* returns true if all patterns are negative */
+static bool add_pattern_list(struct list_head *head, char *patch_funcs, char *def_mod,
+			     enum uftrace_pattern_type ptype)
 {
 	struct strv funcs = STRV_INIT;
 	char *name;
@@ -436,11 +479,19 @@ static void parse_pattern_list(char *patch_funcs, char *def_mod, enum uftrace_pa
 		}
 
 		init_filter_pattern(ptype, &pl->patt, name);
-		list_add_tail(&pl->list, &patterns);
+		list_add_tail(&pl->list, head);
 	}
 
+	strv_free(&funcs);
+	return all_negative;
+}
+
+static void parse_pattern_list(char *patch_funcs, char *def_mod, enum uftrace_pattern_type ptype)
+{
+	struct patt_list *pl;
+
 	/* prepend match-all pattern, if all patterns are negative */
-	if (all_negative) {
+	if (add_pattern_list(&patterns, patch_funcs, def_mod, ptype)) {
 		pl = xzalloc(sizeof(*pl));
 		pl->positive = true;
 		pl->module = xstrdup(def_mod);
@@ -452,15 +503,13 @@ static void parse_pattern_list(char *patch_funcs, char *def_mod, enum uftrace_pa
 
 		list_add(&pl->list, &patterns);
 	}
-
-	strv_free(&funcs);
 }
 
-static void release_pattern_list(void)
+static void release_pattern_list(struct list_head *head)
 {
 	struct patt_list *pl, *tmp;
 
-	list_for_each_entry_safe(pl, tmp, &patterns, list) {
+	list_for_each_entry_safe(pl, tmp, head, list) {
 		list_del(&pl->list);
 		free_filter_pattern(&pl->patt);
 		free(pl->module);
@@ -468,8 +517,291 @@ static void release_pattern_list(void)
 	}
 }
 
-static bool skip_sym(struct uftrace_symbol *sym, struct mcount_dynamic_info *mdi,
-		     struct uftrace_mmap *map, char *soname)
+/*
+ * PATCH PLAN CACHE
+ *
+ * Matching patterns against all symbols and disassembling the prologue of
+ * each function takes long for big binaries.  The patch plan saves the
+ * result of a module (identified by the build-id) for the given patch
+ * options so that later runs can skip them.  The plan has an entry for
+ * each matched (or unpatched) symbol with the action and the size of the
+ * prologue which can be copied without any modification.  Functions need
+ * to relocate instructions are disassembled again.
+ */
+#define PATCH_PLAN_MAGIC "UFTPLAN"
+#define PATCH_PLAN_VERSION 1
+#define PATCH_PLAN_NOSYM UINT32_MAX
+
+enum patch_plan_action {
+	PLAN_PATCH,
+	PLAN_FAILED,
+	PLAN_SKIPPED,
+	PLAN_UNPATCH,
+};
+
+struct patch_plan_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t type;
+	uint32_t nr_sym;
+	uint32_t nr_entry;
+	uint32_t key_len;
+	uint32_t unused;
+};
+
+struct patch_plan_entry {
+	uint64_t addr;
+	uint32_t idx;
+	uint8_t action;
+	uint8_t size;
+	uint16_t unused;
+};
+
+struct patch_plan {
+	struct patch_plan_entry *entry;
+	unsigned nr_entry;
+	unsigned nr_alloc;
+};
+
+static char *get_patch_plan_name(struct uftrace_mmap *map)
+{
+	char *filename = NULL;
+	uhash_t hash;
+
+	if (patch_cache_dir == NULL || map->build_id[0] == '\0')
+		return NULL;
+
+	hash = hashmap_hash(patch_plan_key, strlen(patch_plan_key));
+	xasprintf(&filename, "%s/%s-%016llx.plan", patch_cache_dir, map->build_id,
+		  (unsigned long long)hash);
+	return filename;
+}
+
+static void add_plan_entry(struct patch_plan *plan, struct uftrace_symtab *symtab,
+			   struct uftrace_symbol *sym, int action, unsigned size)
+{
+	struct patch_plan_entry *entry;
+
+	if (plan->nr_entry == plan->nr_alloc) {
+		plan->nr_alloc = plan->nr_alloc ? plan->nr_alloc * 2 : 256;
+		plan->entry = xrealloc(plan->entry, plan->nr_alloc * sizeof(*plan->entry));
+	}
+
+	entry = &plan->entry[plan->nr_entry++];
+	memset(entry, 0, sizeof(*entry));
+
+	entry->addr = sym->addr;
+	entry->action = action;
+	entry->size = size;
+
+	/* fake symbols for patchable function entries */
+	if (sym >= symtab->sym && sym < symtab->sym + symtab->nr_sym)
+		entry->idx = sym - symtab->sym;
+	else
+		entry->idx = PATCH_PLAN_NOSYM;
+}
+
+static void free_patch_plan(struct patch_plan *plan)
+{
+	free(plan->entry);
+	free(plan);
+}
+
+static bool check_patch_plan(struct patch_plan *plan, struct uftrace_symtab *symtab)
+{
+	unsigned i;
+
+	for (i = 0; i < plan->nr_entry; i++) {
+		struct patch_plan_entry *entry = &plan->entry[i];
+
+		if (entry->action > PLAN_UNPATCH)
+			return false;
+		if (entry->idx == PATCH_PLAN_NOSYM)
+			continue;
+		if (entry->idx >= symtab->nr_sym || symtab->sym[entry->idx].addr != entry->addr)
+			return false;
+	}
+	return true;
+}
+
+static struct patch_plan *load_patch_plan(struct mcount_dynamic_info *mdi,
+					  struct uftrace_mmap *map)
+{
+	struct uftrace_symtab *symtab = &map->mod->symtab;
+	struct patch_plan_header hdr;
+	struct patch_plan *plan = NULL;
+	struct stat stbuf;
+	char *filename;
+	char *key = NULL;
+	int fd;
+
+	filename = get_patch_plan_name(map);
+	if (filename == NULL)
+		return NULL;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		goto out;
+
+	if (read_all(fd, &hdr, sizeof(hdr)) < 0)
+		goto out;
+
+	if (memcmp(hdr.magic, PATCH_PLAN_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != PATCH_PLAN_VERSION || hdr.type != mdi->type ||
+	    hdr.nr_sym != symtab->nr_sym || hdr.key_len != strlen(patch_plan_key))
+		goto out;
+
+	/* don't trust the number of entries in a broken file */
+	if (fstat(fd, &stbuf) < 0 ||
+	    stbuf.st_size != (off_t)(sizeof(hdr) + hdr.key_len +
+				     (uint64_t)hdr.nr_entry * sizeof(*plan->entry))) {
+		pr_dbg("invalid patch plan size: %s\n", filename);
+		goto out;
+	}
+
+	key = xmalloc(hdr.key_len);
+	if (read_all(fd, key, hdr.key_len) < 0 || memcmp(key, patch_plan_key, hdr.key_len))
+		goto out;
+
+	plan = xzalloc(sizeof(*plan));
+	plan->nr_entry = plan->nr_alloc = hdr.nr_entry;
+	plan->entry = xmalloc(hdr.nr_entry * sizeof(*plan->entry));
+
+	if (read_all(fd, plan->entry, hdr.nr_entry * sizeof(*plan->entry)) < 0 ||
+	    !check_patch_plan(plan, symtab)) {
+		pr_dbg("invalid patch plan: %s\n", filename);
+		free_patch_plan(plan);
+		plan = NULL;
+		goto out;
+	}
+
+	pr_dbg("use patch plan for %s: %u entries\n", basename(map->libname), plan->nr_entry);
+
+out:
+	if (fd >= 0)
+		close(fd);
+	free(key);
+	free(filename);
+	return plan;
+}
+
+static void save_patch_plan(struct mcount_dynamic_info *mdi)
+{
+	struct uftrace_symtab *symtab = &mdi->map->mod->symtab;
+	struct patch_plan *plan = mdi->plan;
+	struct patch_plan_header hdr = {
+		.magic = PATCH_PLAN_MAGIC,
+		.version = PATCH_PLAN_VERSION,
+		.type = mdi->type,
+		.nr_sym = symtab->nr_sym,
+		.nr_entry = plan->nr_entry,
+		.key_len = strlen(patch_plan_key),
+	};
+	struct dynamic_bad_symbol *badsym;
+	char *filename;
+	char *tmpname = NULL;
+	unsigned i;
+	int fd;
+
+	/* bad symbols will be reverted, save them as failed */
+	list_for_each_entry(badsym, &mdi->bad_syms, list) {
+		for (i = 0; i < plan->nr_entry; i++) {
+			if (plan->entry[i].idx != (uint32_t)(badsym->sym - symtab->sym))
+				continue;
+
+			plan->entry[i].action = PLAN_FAILED;
+			plan->entry[i].size = 0;
+		}
+	}
+
+	filename = get_patch_plan_name(mdi->map);
+	if (filename == NULL)
+		return;
+
+	/* other processes might use the same plan, replace it atomically */
+	xasprintf(&tmpname, "%s.%d", filename, getpid());
+
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		pr_dbg("cannot create patch plan: %s: %m\n", tmpname);
+		goto out;
+	}
+
+	if (write_all(fd, &hdr, sizeof(hdr)) < 0 ||
+	    write_all(fd, patch_plan_key, hdr.key_len) < 0 ||
+	    write_all(fd, plan->entry, plan->nr_entry * sizeof(*plan->entry)) < 0) {
+		pr_dbg("cannot write patch plan: %m\n");
+		close(fd);
+		unlink(tmpname);
+		goto out;
+	}
+	close(fd);
+
+	if (rename(tmpname, filename) < 0) {
+		pr_dbg("cannot save patch plan: %s: %m\n", filename);
+		unlink(tmpname);
+	}
+	else {
+		pr_dbg("saved patch plan for %s: %u entries\n", basename(mdi->map->libname),
+		       plan->nr_entry);
+	}
+
+out:
+	free(tmpname);
+	free(filename);
+}
+
+/* save the new plan before reverting bad symbols */
+static void finish_patch_plan(struct mcount_dynamic_info *mdi)
+{
+	if (mdi->plan == NULL)
+		return;
+
+	save_patch_plan(mdi);
+	free_patch_plan(mdi->plan);
+	mdi->plan = NULL;
+}
+
+/* use the function part of triggers (before '@') */
+static void parse_sync_patterns(char *trigger_str, enum uftrace_pattern_type ptype)
+{
+	struct strv triggers = STRV_INIT;
+	struct patt_list *pl;
+	char *name;
+	int i;
+
+	strv_split(&triggers, trigger_str, ";");
+
+	strv_for_each(&triggers, name, i) {
+		char *pos = strchr(name, '@');
+
+		if (pos)
+			*pos = '\0';
+		if (*name == '\0')
+			continue;
+
+		pl = xzalloc(sizeof(*pl));
+		pl->positive = true;
+		init_filter_pattern(ptype, &pl->patt, name);
+		list_add_tail(&pl->list, &sync_patterns);
+	}
+
+	strv_free(&triggers);
+}
+
+static bool match_sync_patterns(char *sym_name)
+{
+	struct patt_list *pl;
+
+	list_for_each_entry(pl, &sync_patterns, list) {
+		if (match_filter_pattern(&pl->patt, sym_name))
+			return true;
+	}
+	return false;
+}
+
+/* it should be called after select_pattern_list() for the module */
+static bool skip_sym(struct uftrace_symbol *sym, struct mcount_dynamic_info *mdi)
 {
 	/* skip special startup (csu) functions */
 	const char *csu_skip_syms[] = {
@@ -487,30 +819,50 @@ static bool skip_sym(struct uftrace_symbol *sym, struct mcount_dynamic_info *mdi
 	if (sym->type != ST_LOCAL_FUNC && sym->type != ST_GLOBAL_FUNC && sym->type != ST_WEAK_FUNC)
 		return true;
 
-	if (!match_pattern_list(map, soname, sym->name)) {
-		if (mcount_unpatch_func(mdi, sym, &disasm) == 0)
+	if (!match_selected_patterns(sym->name)) {
+		if (mcount_unpatch_func(mdi, sym, &disasm) == 0) {
 			stats.unpatch++;
+
+			if (mdi->plan)
+				add_plan_entry(mdi->plan, &mdi->map->mod->symtab, sym, PLAN_UNPATCH,
+					       0);
+		}
 		return true;
 	}
 
+	if (patch_scope != PATCH_ALL && match_sync_patterns(sym->name) != (patch_scope == PATCH_SYNC))
+		return true;
+
 	return false;
 }
 
 static void mcount_patch_func_with_stats(struct mcount_dynamic_info *mdi,
-					 struct uftrace_symbol *sym)
+					 struct uftrace_symbol *sym, unsigned plain_size)
 {
+	int action = PLAN_PATCH;
+
+	/* arch code might update it for the plan */
+	mdi->plain_size = plain_size;
+
 	switch (mcount_patch_func(mdi, sym, &disasm, min_size)) {
 	case INSTRUMENT_FAILED:
 		stats.failed++;
+		action = PLAN_FAILED;
 		break;
 	case INSTRUMENT_SKIPPED:
 		stats.skipped++;
+		action = PLAN_SKIPPED;
 		break;
 	case INSTRUMENT_SUCCESS:
 	default:
 		break;
 	}
 	stats.total++;
+
+	if (mdi->plan) {
+		add_plan_entry(mdi->plan, &mdi->map->mod->symtab, sym, action,
+			       action == PLAN_PATCH ? mdi->plain_size : 0);
+	}
 }
 
 static void patch_patchable_func_matched(struct mcount_dynamic_info *mdi, struct uftrace_mmap *map)
@@ -527,6 +879,7 @@ static void patch_patchable_func_matched(struct mcount_dynamic_info *mdi, struct
 	char *soname = get_soname(map->libname);
 
 	symtab = &map->mod->symtab;
+	select_pattern_list(&patterns, map, soname);
 
 	/*
 	 * If __patchable_function_entries is found, then apply patching
@@ -537,17 +890,21 @@ static void patch_patchable_func_matched(struct mcount_dynamic_info *mdi, struct
 		struct uftrace_symbol *searched_sym = find_sym(symtab, rel_addr);
 
 		if (searched_sym == NULL) {
+			/* no trigger for unknown functions */
+			if (patch_scope == PATCH_SYNC)
+				continue;
+
 			sym = &fake_sym;
 			sym->addr = rel_addr;
 			snprintf(sym->name, sizeof(namebuf), "<%lx>", patchable_loc[i]);
 		}
 		else {
 			sym = searched_sym;
-			if (skip_sym(sym, mdi, map, soname))
+			if (skip_sym(sym, mdi))
 				continue;
 		}
 
-		mcount_patch_func_with_stats(mdi, sym);
+		mcount_patch_func_with_stats(mdi, sym, 0);
 	}
 
 	free(soname);
@@ -562,15 +919,16 @@ static void patch_normal_func_matched(struct mcount_dynamic_info *mdi, struct uf
 	char *soname = get_soname(map->libname);
 
 	symtab = &map->mod->symtab;
+	select_pattern_list(&patterns, map, soname);
 
 	for (i = 0; i < symtab->nr_sym; i++) {
 		sym = &symtab->sym[i];
 
-		if (skip_sym(sym, mdi, map, soname))
+		if (skip_sym(sym, mdi))
 			continue;
 
 		found = true;
-		mcount_patch_func_with_stats(mdi, sym);
+		mcount_patch_func_with_stats(mdi, sym, 0);
 	}
 
 	if (!found)
@@ -579,8 +937,73 @@ static void patch_normal_func_matched(struct mcount_dynamic_info *mdi, struct uf
 	free(soname);
 }
 
+static void apply_patch_plan(struct mcount_dynamic_info *mdi, struct uftrace_mmap *map,
+			     struct patch_plan *plan)
+{
+	struct uftrace_symtab *symtab = &map->mod->symtab;
+	struct uftrace_symbol *sym;
+	char namebuf[BUFSIZ];
+	struct uftrace_symbol fake_sym = {
+		.size = UINT_MAX,
+		.name = namebuf,
+	};
+	bool found = false;
+	unsigned i;
+
+	for (i = 0; i < plan->nr_entry; i++) {
+		struct patch_plan_entry *entry = &plan->entry[i];
+
+		if (entry->idx == PATCH_PLAN_NOSYM) {
+			sym = &fake_sym;
+			sym->addr = entry->addr;
+			snprintf(sym->name, sizeof(namebuf), "<%lx>", (unsigned long)entry->addr);
+		}
+		else {
+			sym = &symtab->sym[entry->idx];
+		}
+
+		switch (entry->action) {
+		case PLAN_PATCH:
+			mcount_patch_func_with_stats(mdi, sym, entry->size);
+			break;
+		case PLAN_FAILED:
+			stats.failed++;
+			stats.total++;
+			break;
+		case PLAN_SKIPPED:
+			stats.skipped++;
+			stats.total++;
+			break;
+		case PLAN_UNPATCH:
+			if (mcount_unpatch_func(mdi, sym, &disasm) == 0)
+				stats.unpatch++;
+			continue;
+		}
+		found = true;
+	}
+
+	if (!found && mdi->type != DYNAMIC_PATCHABLE)
+		stats.nomatch++;
+}
+
 static void patch_func_matched(struct mcount_dynamic_info *mdi, struct uftrace_mmap *map)
 {
+	struct patch_plan *plan;
+
+	/* the plan has the result of all functions */
+	if (patch_scope == PATCH_ALL) {
+		plan = load_patch_plan(mdi, map);
+		if (plan) {
+			apply_patch_plan(mdi, map, plan);
+			free_patch_plan(plan);
+			return;
+		}
+
+		/* record the result for the next run */
+		if (patch_cache_dir && map->build_id[0])
+			mdi->plan = xzalloc(sizeof(*mdi->plan));
+	}
+
 	/*
 	 * In some cases, the __patchable_function_entries section can be
 	 * removed.  For example, -Wl,--gc-sections strips this section.
@@ -633,16 +1056,244 @@ static void freeze_dynamic_update(void)
 	while (mdi) {
 		tmp = mdi->next;
 
+		finish_patch_plan(mdi);
 		mcount_arch_dynamic_recover(mdi, &disasm);
 		mcount_cleanup_trampoline(mdi);
-		free(mdi);
 
+		/* keep the mdi as the agent can patch the module later */
 		mdi = tmp;
 	}
 
 	mcount_freeze_code();
 }
 
+static void add_mdinfo(struct mcount_dynamic_info *mdi)
+{
+	pthread_mutex_lock(&mdinfo_lock);
+	mdi->next = mdinfo;
+	mdinfo = mdi;
+	pthread_mutex_unlock(&mdinfo_lock);
+}
+
+/*
+ * Other threads might run the functions during the patch.  It's ok to
+ * replace a (NOP) instruction at once but full dynamic patching and XRay
+ * need to modify multiple instructions in the prologue.
+ */
+static bool can_patch_live(struct mcount_dynamic_info *mdi)
+{
+	return mdi->type == DYNAMIC_FENTRY_NOP || mdi->type == DYNAMIC_PATCHABLE;
+}
+
+/* it should be called with patch_lock held (if async) */
+static void patch_dlopen_module(struct uftrace_sym_info *sinfo, struct mcount_dynamic_info *mdi,
+				bool background)
+{
+	struct uftrace_mmap *map = mdi->map;
+
+	if (map->mod == NULL) {
+		map->mod = load_module_symtab(sinfo, map->libname, map->build_id);
+		mcount_arch_find_module(mdi, &map->mod->symtab);
+	}
+
+	if (mdi->trampoline == 0 && mcount_setup_trampoline(mdi) < 0) {
+		pr_dbg("setup trampoline to %s failed\n", map->libname);
+		free(mdi);
+		return;
+	}
+
+	mdi->live_patch = background;
+
+	if (background && !can_patch_live(mdi))
+		pr_warn("cannot patch %s in background, use triggers for the functions\n",
+			basename(map->libname));
+	else
+		patch_func_matched(mdi, map);
+
+	finish_patch_plan(mdi);
+	mcount_arch_dynamic_recover(mdi, &disasm);
+	mcount_cleanup_trampoline(mdi);
+	add_mdinfo(mdi);
+
+	mcount_freeze_code();
+}
+
+/*
+ * ASYNC PATCHING (--patch-async)
+ *
+ * Loading symbols and patching functions of a dlopen-ed module is done by
+ * a background thread so that dlopen() returns quickly.  Functions are
+ * traced once they're patched.  Functions for triggers are patched before
+ * dlopen() returns since they might be needed immediately.
+ */
+struct patch_job {
+	struct list_head list;
+	struct uftrace_sym_info *sinfo;
+	struct mcount_dynamic_info *mdi;
+};
+
+static bool patch_async;
+static bool patch_worker_running;
+static bool patch_worker_stop;
+static pthread_t patch_worker;
+static LIST_HEAD(patch_jobs);
+
+/* protects the job list */
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+/* protects the dynamic patch states like code map, patterns and stats */
+static pthread_mutex_t patch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *(*real_dlopen)(const char *filename, int flags);
+
+static void *patch_worker_main(void *arg)
+{
+	struct patch_job *job;
+	sigset_t sigset;
+	void *handle;
+
+	/* do not run signal handlers of the target */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+	pthread_mutex_lock(&job_lock);
+	while (true) {
+		while (list_empty(&patch_jobs) && !patch_worker_stop)
+			pthread_cond_wait(&job_cond, &job_lock);
+
+		if (patch_worker_stop)
+			break;
+
+		job = list_first_entry(&patch_jobs, struct patch_job, list);
+		list_del(&job->list);
+		pthread_mutex_unlock(&job_lock);
+
+		/* keep the module loaded during the patch, it might be closed already */
+		handle = real_dlopen(job->mdi->map->libname, RTLD_LAZY | RTLD_NOLOAD);
+		if (handle) {
+			pthread_mutex_lock(&patch_lock);
+			patch_scope = list_empty(&sync_patterns) ? PATCH_ALL : PATCH_ASYNC;
+			patch_dlopen_module(job->sinfo, job->mdi, true);
+			patch_scope = PATCH_ALL;
+			pthread_mutex_unlock(&patch_lock);
+
+			dlclose(handle);
+		}
+		else {
+			pr_dbg("skip patching closed module: %s\n", job->mdi->map->libname);
+			free(job->mdi);
+		}
+		free(job);
+
+		pthread_mutex_lock(&job_lock);
+	}
+	pthread_mutex_unlock(&job_lock);
+
+	return NULL;
+}
+
+/* it should be called with job_lock held */
+static void start_patch_worker(void)
+{
+	if (real_dlopen == NULL)
+		real_dlopen = dlsym(RTLD_NEXT, "dlopen");
+
+	errno = pthread_create(&patch_worker, NULL, patch_worker_main, NULL);
+	if (errno != 0) {
+		pr_warn("cannot start patch worker: %m\n");
+		return;
+	}
+	patch_worker_running = true;
+}
+
+static void stop_patch_worker(void)
+{
+	struct patch_job *job, *tmp;
+
+	pthread_mutex_lock(&job_lock);
+	patch_worker_stop = true;
+	pthread_cond_signal(&job_cond);
+	pthread_mutex_unlock(&job_lock);
+
+	if (patch_worker_running)
+		pthread_join(patch_worker, NULL);
+	patch_worker_running = false;
+
+	list_for_each_entry_safe(job, tmp, &patch_jobs, list) {
+		list_del(&job->list);
+		free(job->mdi);
+		free(job);
+	}
+}
+
+static void queue_patch_job(struct uftrace_sym_info *sinfo, struct mcount_dynamic_info *mdi)
+{
+	struct patch_job *job;
+
+	if (!list_empty(&sync_patterns)) {
+		pthread_mutex_lock(&patch_lock);
+
+		patch_scope = PATCH_SYNC;
+		mdi->map->mod = load_module_symtab(sinfo, mdi->map->libname, mdi->map->build_id);
+		mcount_arch_find_module(mdi, &mdi->map->mod->symtab);
+
+		/* the trampoline will be released by the worker */
+		if (mcount_setup_trampoline(mdi) == 0)
+			patch_func_matched(mdi, mdi->map);
+		else
+			mdi->trampoline = 0;
+		patch_scope = PATCH_ALL;
+
+		pthread_mutex_unlock(&patch_lock);
+	}
+
+	job = xmalloc(sizeof(*job));
+	job->sinfo = sinfo;
+	job->mdi = mdi;
+
+	pthread_mutex_lock(&job_lock);
+	if (!patch_worker_running)
+		start_patch_worker();
+
+	if (patch_worker_running) {
+		list_add_tail(&job->list, &patch_jobs);
+		pthread_cond_signal(&job_cond);
+		job = NULL;
+	}
+	pthread_mutex_unlock(&job_lock);
+
+	/* do it synchronously if the worker is not available */
+	if (job) {
+		free(job);
+		patch_dlopen_module(sinfo, mdi, false);
+	}
+}
+
+/* make sure the locks are usable in the child */
+static void patch_atfork_prepare(void)
+{
+	pthread_mutex_lock(&job_lock);
+	pthread_mutex_lock(&patch_lock);
+}
+
+static void patch_atfork_parent(void)
+{
+	pthread_mutex_unlock(&patch_lock);
+	pthread_mutex_unlock(&job_lock);
+}
+
+static void patch_atfork_child(void)
+{
+	pthread_mutex_unlock(&patch_lock);
+
+	/* the worker is gone, start a new one for the remaining jobs */
+	patch_worker_running = false;
+	if (!list_empty(&patch_jobs))
+		start_patch_worker();
+
+	pthread_mutex_unlock(&job_lock);
+}
+
 /* do not use floating-point in libmcount */
 static int calc_percent(int n, int total, int *rem)
 {
@@ -667,6 +1318,25 @@ int mcount_dynamic_update(struct uftrace_sym_info *sinfo, char *patch_funcs,
 	if (size_filter != NULL)
 		min_size = strtoul(size_filter, NULL, 0);
 
+	if (getenv("UFTRACE_PATCH_ASYNC")) {
+		char *trigger_str = getenv("UFTRACE_TRIGGER");
+
+		patch_async = true;
+		if (trigger_str) {
+			trigger_str = xstrdup(trigger_str);
+			parse_sync_patterns(trigger_str, ptype);
+			free(trigger_str);
+		}
+		pthread_atfork(patch_atfork_prepare, patch_atfork_parent, patch_atfork_child);
+	}
+
+	patch_cache_dir = getenv("UFTRACE_PATCH_CACHE");
+	if (patch_cache_dir) {
+		/* the plan is valid only for the same options */
+		xasprintf(&patch_plan_key, "%s:%d:%u:%s", patch_funcs, ptype, min_size,
+			  basename(sinfo->exec_map->libname));
+	}
+
 	ret = do_dynamic_update(sinfo, patch_funcs, ptype);
 
 	if (stats.total && stats.failed) {
@@ -699,7 +1369,7 @@ void mcount_dynamic_dlopen(struct uftrace_sym_info *sinfo, struct dl_phdr_info *
 
 	mdi = create_mdi(info);
 
-	map = xmalloc(sizeof(*map) + strlen(pathname) + 1);
+	map = xzalloc(sizeof(*map) + strlen(pathname) + 1);
 	map->start = info->dlpi_addr;
 	map->end = map->start + mdi->text_size;
 	map->len = strlen(pathname);
@@ -708,31 +1378,188 @@ void mcount_dynamic_dlopen(struct uftrace_sym_info *sinfo, struct dl_phdr_info *
 	mcount_memcpy1(map->prot, "r-xp", 4);
 	read_build_id(pathname, map->build_id, sizeof(map->build_id));
 
+	/* other threads can see the map (without symbols) from now on */
 	map->next = sinfo->maps;
-	sinfo->maps = map;
+	__atomic_store_n(&sinfo->maps, map, __ATOMIC_RELEASE);
 	mdi->map = map;
 
-	map->mod = load_module_symtab(sinfo, map->libname, map->build_id);
-	mcount_arch_find_module(mdi, &map->mod->symtab);
+	if (patch_async)
+		queue_patch_job(sinfo, mdi);
+	else
+		patch_dlopen_module(sinfo, mdi, false);
+}
 
-	if (mcount_setup_trampoline(mdi) < 0) {
-		pr_dbg("setup trampoline to %s failed\n", map->libname);
-		free(mdi);
+/*
+ * RUNTIME PATCHING (by the agent)
+ *
+ * The agent can patch or unpatch (with '!') functions while the program is
+ * running.  Unlike the -P option, a pattern only affects the matching
+ * functions and others are not changed.  As other threads might run the
+ * functions at the same time, only a single instruction is updated so it
+ * cannot patch functions without a patchable entry (DYNAMIC_NONE) or XRay.
+ */
+struct agent_patch_data {
+	struct uftrace_sym_info *sinfo;
+	struct list_head *patterns;
+	int matched;
+	int patched;
+	int unpatched;
+};
+
+static struct mcount_dynamic_info *find_mdinfo(struct uftrace_mmap *map)
+{
+	struct mcount_dynamic_info *mdi;
+
+	pthread_mutex_lock(&mdinfo_lock);
+	for (mdi = mdinfo; mdi != NULL; mdi = mdi->next) {
+		if (mdi->map == map)
+			break;
+	}
+	pthread_mutex_unlock(&mdinfo_lock);
+
+	return mdi;
+}
+
+/* returns 1 to patch, -1 to unpatch, or 0 if no pattern matches */
+static int match_agent_patterns(struct list_head *head, char *sym_name)
+{
+	struct patt_list *pl;
+	int ret = 0;
+
+	/* the last matching pattern decides it */
+	list_for_each_entry(pl, head, list) {
+		if (pl->selected && match_filter_pattern(&pl->patt, sym_name))
+			ret = pl->positive ? 1 : -1;
+	}
+
+	return ret;
+}
+
+static void agent_patch_module(struct agent_patch_data *apd, struct mcount_dynamic_info *mdi)
+{
+	struct uftrace_symtab *symtab = &mdi->map->mod->symtab;
+	unsigned i;
+
+	if (mdi->trampoline == 0) {
+		if (mcount_setup_trampoline(mdi) < 0) {
+			mdi->trampoline = 0;
+			return;
+		}
+	}
+	else if (mprotect(PAGE_ADDR(mdi->text_addr), PAGE_LEN(mdi->text_addr, mdi->text_size),
+			  PROT_READ | PROT_WRITE | PROT_EXEC) < 0) {
+		pr_dbg("cannot update text of %s: %m\n", basename(mdi->map->libname));
 		return;
 	}
 
-	patch_func_matched(mdi, map);
+	for (i = 0; i < symtab->nr_sym; i++) {
+		struct uftrace_symbol *sym = &symtab->sym[i];
+
+		if (sym->type != ST_LOCAL_FUNC && sym->type != ST_GLOBAL_FUNC &&
+		    sym->type != ST_WEAK_FUNC)
+			continue;
+
+		switch (match_agent_patterns(apd->patterns, sym->name)) {
+		case 1:
+			apd->matched++;
+			if (mcount_patch_func(mdi, sym, &disasm, min_size) == INSTRUMENT_SUCCESS)
+				apd->patched++;
+			break;
+		case -1:
+			apd->matched++;
+			if (mcount_unpatch_func(mdi, sym, &disasm) == INSTRUMENT_SUCCESS)
+				apd->unpatched++;
+			break;
+		default:
+			break;
+		}
+	}
 
-	mcount_arch_dynamic_recover(mdi, &disasm);
 	mcount_cleanup_trampoline(mdi);
-	free(mdi);
+}
 
-	mcount_freeze_code();
+/* callback for dl_iterate_phdr() to patch modules currently loaded */
+static int agent_patch_phdr(struct dl_phdr_info *info, size_t sz, void *data)
+{
+	struct agent_patch_data *apd = data;
+	struct mcount_dynamic_info *mdi;
+	struct uftrace_mmap *map;
+	char *soname;
+	bool selected;
+
+	mdi = create_mdi(info);
+	map = find_map(apd->sinfo, mdi->base_addr);
+	if (map == NULL || map->mod == NULL) {
+		free(mdi);
+		return 0;
+	}
+
+	soname = get_soname(map->libname);
+	selected = select_pattern_list(apd->patterns, map, soname);
+	free(soname);
+
+	if (!selected) {
+		free(mdi);
+		return 0;
+	}
+
+	/* reuse the trampoline if it's patched already */
+	if (find_mdinfo(map)) {
+		free(mdi);
+		mdi = find_mdinfo(map);
+	}
+	else {
+		mdi->map = map;
+		mcount_arch_find_module(mdi, &map->mod->symtab);
+		add_mdinfo(mdi);
+	}
+
+	if (!can_patch_live(mdi)) {
+		pr_warn("cannot patch %s at runtime, it needs patchable function entries\n",
+			basename(map->libname));
+		return 0;
+	}
+
+	mdi->live_patch = true;
+
+	agent_patch_module(apd, mdi);
+	return 0;
+}
+
+/* patch or unpatch (with '!') functions in @patch_funcs, returns -1 if none matched */
+int mcount_dynamic_agent_update(struct uftrace_sym_info *sinfo, char *patch_funcs,
+				enum uftrace_pattern_type ptype)
+{
+	LIST_HEAD(agent_patterns);
+	struct agent_patch_data apd = {
+		.sinfo = sinfo,
+		.patterns = &agent_patterns,
+	};
+
+	add_pattern_list(&agent_patterns, patch_funcs, basename(sinfo->exec_map->libname), ptype);
+
+	/* don't race with the patch worker */
+	pthread_mutex_lock(&patch_lock);
+	dl_iterate_phdr(agent_patch_phdr, &apd);
+	pthread_mutex_unlock(&patch_lock);
+
+	release_pattern_list(&agent_patterns);
+
+	pr_dbg("agent patched %d and unpatched %d functions\n", apd.patched, apd.unpatched);
+	return apd.matched ? 0 : -1;
 }
 
 void mcount_dynamic_finish(void)
 {
-	release_pattern_list();
+	if (patch_async)
+		stop_patch_worker();
+	release_pattern_list(&sync_patterns);
+
+	free(patch_plan_key);
+	patch_plan_key = NULL;
+	patch_cache_dir = NULL;
+
+	release_pattern_list(&patterns);
 	mcount_disasm_finish(&disasm);
 }
 
@@ -792,6 +1619,12 @@ void mcount_free_badsym(struct mcount_dynamic_info *mdi)
 }
 
 #ifdef UNIT_TEST
+static bool match_pattern_list(struct uftrace_mmap *map, char *soname, char *sym_name)
+{
+	select_pattern_list(&patterns, map, soname);
+	return match_selected_patterns(sym_name);
+}
+
 TEST_CASE(dynamic_find_code)
 {
 	struct mcount_disasm_info info1 = {
@@ -850,7 +1683,7 @@ TEST_CASE(dynamic_pattern_list)
 	TEST_EQ(match_pattern_list(main_map, NULL, "def"), false);
 	TEST_EQ(match_pattern_list(other_map, NULL, "xyz"), false);
 
-	release_pattern_list();
+	release_pattern_list(&patterns);
 
 	pr_dbg("check negative regex match with default module\n");
 	parse_pattern_list("!^a", "main", PATT_REGEX);
@@ -859,7 +1692,7 @@ TEST_CASE(dynamic_pattern_list)
 	TEST_EQ(match_pattern_list(main_map, NULL, "def"), true);
 	TEST_EQ(match_pattern_list(other_map, NULL, "xyz"), false);
 
-	release_pattern_list();
+	release_pattern_list(&patterns);
 
 	pr_dbg("check wildcard match with other module\n");
 	parse_pattern_list("*@other", "main", PATT_GLOB);
@@ -868,7 +1701,7 @@ TEST_CASE(dynamic_pattern_list)
 	TEST_EQ(match_pattern_list(main_map, NULL, "def"), false);
 	TEST_EQ(match_pattern_list(other_map, NULL, "xyz"), true);
 
-	release_pattern_list();
+	release_pattern_list(&patterns);
 
 	free(main_map);
 	free(other_map);
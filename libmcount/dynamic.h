@@ -45,6 +45,8 @@ __maybe_unused static const char *mdi_type_names[] = {
 	"none", "pg", "fentry", "fentry-nop", "xray", "fpatchable",
 };
 
+struct patch_plan;
+
 struct mcount_dynamic_info {
 	struct mcount_dynamic_info *next;
 	struct uftrace_mmap *map;
@@ -56,6 +58,11 @@ struct mcount_dynamic_info {
 	enum mcount_dynamic_type type;
 	void *patch_target;
 	unsigned nr_patch_target;
+	/* size of the prologue copied as is (in and out), see patch_func_matched() */
+	unsigned plain_size;
+	struct patch_plan *plan;
+	/* other threads might run the code being patched */
+	bool live_patch;
 };
 
 struct mcount_disasm_engine {
@@ -79,6 +86,8 @@ int mcount_dynamic_update(struct uftrace_sym_info *sinfo, char *patch_funcs,
 			  enum uftrace_pattern_type ptype);
 void mcount_dynamic_dlopen(struct uftrace_sym_info *sinfo, struct dl_phdr_info *info, char *path);
 void mcount_dynamic_finish(void);
+int mcount_dynamic_agent_update(struct uftrace_sym_info *sinfo, char *patch_funcs,
+				enum uftrace_pattern_type ptype);
 
 struct mcount_orig_insn {
 	struct rb_node node;
@@ -55,6 +55,10 @@ struct filter_control {
 	uint64_t saved_time;
 	unsigned size;
 	unsigned saved_size;
+	/* global settings applied to this thread (updated by the agent) */
+	unsigned gen;
+	int global_depth;
+	uint64_t global_time;
 };
 #else
 struct filter_control {};
@@ -174,11 +178,13 @@ void __mcount_guard_recursion(struct mcount_thread_data *mtdp);
 void __mcount_unguard_recursion(struct mcount_thread_data *mtdp);
 bool mcount_guard_recursion(struct mcount_thread_data *mtdp);
 void mcount_unguard_recursion(struct mcount_thread_data *mtdp);
+unsigned long mcount_find_caller(struct mcount_thread_data *mtdp, unsigned long callsite);
 
 extern uint64_t mcount_threshold; /* nsec */
 extern unsigned mcount_minsize;
 extern pthread_key_t mtd_key;
 extern int shmem_bufsize;
+extern uint64_t shmem_flush_time;
 extern int pfd;
 extern char *mcount_exename;
 extern int page_size_in_kb;
@@ -317,9 +323,11 @@ enum plthook_special_action {
 	PLT_FL_DLSYM = 1U << 7,
 };
 
-struct plthook_special_func {
-	unsigned idx;
+/* precomputed info for each PLT function (indexed by dynsym index) */
+struct plthook_slot {
 	unsigned flags; /* enum plthook_special_action */
+	/* filter (and triggers) of the function, if any */
+	struct uftrace_filter *filter;
 };
 
 struct plthook_skip_symbol {
@@ -344,9 +352,8 @@ struct plthook_data {
 	unsigned long *pltgot_ptr;
 	/* original address of each function (resolved by dynamic linker) */
 	unsigned long *resolved_addr;
-	/* array of function that needs special care (see above) */
-	struct plthook_special_func *special_funcs;
-	int nr_special;
+	/* special flags and filter of each function (see above) */
+	struct plthook_slot *slots;
 	/* architecture-specific info */
 	void *arch;
 };
@@ -364,6 +371,7 @@ extern const struct plthook_skip_symbol plt_skip_syms[];
 extern size_t plt_skip_nr;
 
 struct uftrace_trigger;
+struct uftrace_trigger_cond;
 struct uftrace_arg_spec;
 struct mcount_regs;
 
@@ -390,7 +398,16 @@ extern void mcount_arch_get_retval(struct mcount_arg_context *ctx, struct uftrac
 
 extern enum filter_result mcount_entry_filter_check(struct mcount_thread_data *mtdp,
 						    unsigned long child,
-						    struct uftrace_trigger *tr);
+						    struct uftrace_trigger *tr,
+						    struct mcount_regs *regs,
+						    unsigned long *parent_loc);
+extern struct uftrace_filter *mcount_find_filter(unsigned long addr);
+extern enum filter_result mcount_entry_filter_match(struct mcount_thread_data *mtdp,
+						    unsigned long child,
+						    struct uftrace_filter *filter,
+						    struct uftrace_trigger *tr,
+						    struct mcount_regs *regs,
+						    unsigned long *parent_loc);
 extern void mcount_entry_filter_record(struct mcount_thread_data *mtdp,
 				       struct mcount_ret_stack *rstack, struct uftrace_trigger *tr,
 				       struct mcount_regs *regs);
@@ -398,6 +415,7 @@ extern void mcount_exit_filter_record(struct mcount_thread_data *mtdp,
 				      struct mcount_ret_stack *rstack, long *retval);
 extern int record_trace_data(struct mcount_thread_data *mtdp, struct mcount_ret_stack *mrstack,
 			     long *retval);
+extern void record_async_events(struct mcount_thread_data *mtdp);
 extern struct uftrace_mmap *new_map(const char *path, uint64_t start, uint64_t end,
 				    const char *prot);
 extern void record_proc_maps(char *dirname, const char *sess_id, struct uftrace_sym_info *sinfo);
@@ -409,6 +427,8 @@ extern const char *uftrace_basename(const char *pathname);
 extern void save_argument(struct mcount_thread_data *mtdp, struct mcount_ret_stack *rstack,
 			  struct list_head *args_spec, struct mcount_regs *regs);
 void save_retval(struct mcount_thread_data *mtdp, struct mcount_ret_stack *rstack, long *retval);
+bool check_trigger_cond(struct mcount_thread_data *mtdp, struct uftrace_trigger_cond *cond,
+			struct mcount_regs *regs, unsigned long *stack_base);
 void save_trigger_read(struct mcount_thread_data *mtdp, struct mcount_ret_stack *rstack,
 		       enum trigger_read_type type, bool diff);
 #endif /* DISABLE_MCOUNT_FILTER */
@@ -439,6 +459,17 @@ int mcount_arch_enable_event(struct mcount_event_info *mei);
 
 void mcount_hook_functions(void);
 
+extern bool mcount_alloc_profile;
+void mcount_alloc_init(const char *dirname, const char *alloc_str);
+void mcount_alloc_finish(void);
+void mcount_alloc_record(void *ptr, size_t size, unsigned long callsite);
+size_t mcount_alloc_release(void *ptr);
+
+extern bool mcount_lock_profile;
+void mcount_lock_init(const char *lock_str);
+bool mcount_lock_check(void);
+void mcount_lock_record(void *lock, int type, uint64_t start, unsigned long callsite);
+
 int read_pmu_event(struct mcount_thread_data *mtdp, enum uftrace_event_id id, void *buf);
 void release_pmu_event(struct mcount_thread_data *mtdp, enum uftrace_event_id id);
 void finish_pmu_event(struct mcount_thread_data *mtdp);
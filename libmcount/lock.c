@@ -0,0 +1,95 @@
+/*
+ * lock contention profiler in libmcount
+ *
+ * The pthread lock functions and sem_wait() are wrapped (see wrap.c) and
+ * they try to get the lock without blocking first.  Only when it fails,
+ * the time to get the lock is measured and saved as a 'lock:wait' event
+ * with the address of the lock and the calling function.  Waits shorter
+ * than the given threshold are ignored.
+ *
+ * Released under the GPL v2.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT "lock"
+#define PR_DOMAIN DBG_WRAP
+
+#include "libmcount/internal.h"
+#include "libmcount/mcount.h"
+#include "utils/event.h"
+#include "utils/utils.h"
+
+/* checked by the wrappers before calling the functions below */
+bool mcount_lock_profile;
+
+/* minimum waiting time to record (in nsec) */
+static uint64_t lock_threshold;
+
+/*
+ * returns false if it's called by libmcount itself (with the recursion
+ * guard) or the thread is not traced.  The wrappers check it before
+ * measuring the time so that internal locks are not timed at all.
+ */
+bool mcount_lock_check(void)
+{
+	struct mcount_thread_data *mtdp = get_thread_data();
+
+	if (unlikely(check_thread_data(mtdp)))
+		return false;
+
+	return !mtdp->recursion_marker;
+}
+
+void mcount_lock_record(void *lock, int type, uint64_t start, unsigned long callsite)
+{
+	struct mcount_thread_data *mtdp;
+	struct mcount_event *event;
+	struct uftrace_lock_wait wait = {
+		.lock = (unsigned long)lock,
+		.wait = mcount_gettime() - start,
+		.type = type,
+	};
+
+	if (wait.wait < lock_threshold)
+		return;
+
+	mtdp = get_thread_data();
+	if (unlikely(check_thread_data(mtdp)))
+		return;
+
+	/* ignore internal locks in libmcount */
+	if (!mcount_guard_recursion(mtdp))
+		return;
+
+	wait.caller = mcount_find_caller(mtdp, callsite);
+
+	/* it might have many waits without function records */
+	if (mtdp->nr_events >= MAX_EVENT)
+		record_async_events(mtdp);
+
+	if (mtdp->nr_events < MAX_EVENT) {
+		event = &mtdp->event[mtdp->nr_events++];
+		event->id = EVENT_ID_LOCK_WAIT;
+		event->time = start;
+		event->dsize = sizeof(wait);
+		event->idx = ASYNC_IDX;
+
+		memcpy(event->data, &wait, sizeof(wait));
+	}
+
+	mcount_unguard_recursion(mtdp);
+}
+
+void mcount_lock_init(const char *lock_str)
+{
+	lock_threshold = strtoull(lock_str, NULL, 0);
+
+	pr_dbg("lock contention profile enabled (threshold: %" PRIu64 " nsec)\n",
+	       lock_threshold);
+	mcount_lock_profile = true;
+}
@@ -46,6 +46,9 @@ struct uftrace_sym_info mcount_sym_info = {
 /* size of shmem buffer to save uftrace_record */
 int shmem_bufsize = SHMEM_BUFFER_SIZE;
 
+/* hand off shmem buffer having older records than this (in nsec) */
+uint64_t shmem_flush_time;
+
 /* recover return address of parent automatically */
 bool mcount_auto_recover = ARCH_SUPPORT_AUTO_RECOVER;
 
@@ -79,21 +82,42 @@ static int __maybe_unused mcount_depth = MCOUNT_DEFAULT_DEPTH;
 /* boolean flag to turn on/off recording */
 static bool __maybe_unused mcount_enabled = true;
 
-/* function filtering mode - inclusive or exclusive */
-static enum filter_mode __maybe_unused mcount_filter_mode = FILTER_MODE_NONE;
+/* generation of global filter settings, incremented by the agent */
+static unsigned __maybe_unused mcount_filter_gen;
+
+/*
+ * Filter rules built from the options.  The agent builds new rules and
+ * replaces the pointer so that other threads see either old or new rules
+ * without a lock.  Old rules are kept (in the retired list) until exit as
+ * other threads might still use them (e.g. argument specs of functions not
+ * returned yet).  So the number of updates is limited to bound the memory.
+ */
+#define MCOUNT_MAX_RULE_UPDATES 64
+struct mcount_filter_rules {
+	/* tree of trigger actions */
+	struct rb_root root;
+	/* function filtering mode - inclusive or exclusive */
+	enum filter_mode filter_mode;
+	/* location filtering mode - inclusive or exclusive */
+	enum filter_mode loc_mode;
+	/* whether caller filter is activated */
+	bool has_caller;
+	struct mcount_filter_rules *retired;
+};
+
+static struct mcount_filter_rules __maybe_unused mcount_initial_rules = {
+	.root = RB_ROOT,
+};
 
-/* location filtering mode - inclusive or exclusive */
-static enum filter_mode __maybe_unused mcount_loc_mode = FILTER_MODE_NONE;
+/* current filter rules, use mcount_get_rules() to access */
+static struct mcount_filter_rules __maybe_unused *mcount_rules = &mcount_initial_rules;
 
-/* tree of trigger actions */
-static struct rb_root __maybe_unused mcount_triggers = RB_ROOT;
+/* number of rules in the retired list */
+static unsigned __maybe_unused mcount_nr_retired;
 
 /* bitmask of active watch points */
 static unsigned long __maybe_unused mcount_watchpoints;
 
-/* whether caller filter is activated */
-static bool __maybe_unused mcount_has_caller;
-
 /* address of function will be called when a function returns */
 unsigned long mcount_return_fn;
 
@@ -106,6 +130,12 @@ static pthread_t agent;
 /* state flag for the agent */
 static bool agent_run = false;
 
+/* pattern type for the rules from the agent */
+static enum uftrace_pattern_type agent_patt_type;
+
+/* max length of a string option from the client */
+#define AGENT_MAX_STRLEN (64 * 1024)
+
 __weak void dynamic_return(void)
 {
 }
@@ -129,6 +159,22 @@ static void mcount_filter_finish(void)
 	finish_debug_info(&mcount_sym_info);
 }
 
+static int mcount_update_rules(enum uftrace_dopt dopt, char *rules, bool remove)
+{
+	return -1;
+}
+
+static void mcount_publish_rules(void)
+{
+}
+
+static int mcount_update_filter(int depth, uint64_t threshold)
+{
+	/* only time filter is supported */
+	mcount_threshold = threshold;
+	return depth == mcount_depth ? 0 : -1;
+}
+
 #else
 
 /* be careful: this can be called from signal handler */
@@ -364,6 +410,78 @@ static void mcount_signal_finish(void)
 	}
 }
 
+/* rule strings to build the filter rules, the agent can update them */
+static struct {
+	struct strv filter;
+	struct strv trigger;
+	struct strv argument;
+	struct strv retval;
+	char *caller;
+	char *location;
+	bool auto_args;
+	bool debug_info;
+} mcount_rule_strs;
+
+static struct uftrace_filter_setting mcount_filter_setting;
+
+/* whether the auto-args is set up for argument/return value rules */
+static bool mcount_auto_args_ready;
+
+static inline struct mcount_filter_rules *mcount_get_rules(void)
+{
+	return __atomic_load_n(&mcount_rules, __ATOMIC_ACQUIRE);
+}
+
+static void build_filter_rules(struct mcount_filter_rules *rules)
+{
+	struct uftrace_filter_setting *setting = &mcount_filter_setting;
+	char *filter_str = strv_join(&mcount_rule_strs.filter, ";");
+	char *trigger_str = strv_join(&mcount_rule_strs.trigger, ";");
+	char *argument_str = strv_join(&mcount_rule_strs.argument, ";");
+	char *retval_str = strv_join(&mcount_rule_strs.retval, ";");
+
+	setting->auto_args = false;
+
+	uftrace_setup_filter(filter_str, &mcount_sym_info, &rules->root, &rules->filter_mode,
+			     setting);
+	uftrace_setup_trigger(trigger_str, &mcount_sym_info, &rules->root, &rules->filter_mode,
+			      setting);
+	uftrace_setup_argument(argument_str, &mcount_sym_info, &rules->root, setting);
+	uftrace_setup_retval(retval_str, &mcount_sym_info, &rules->root, setting);
+
+	if (mcount_rule_strs.debug_info) {
+		uftrace_setup_loc_filter(mcount_rule_strs.location, &mcount_sym_info, &rules->root,
+					 &rules->loc_mode, setting);
+	}
+
+	if (mcount_rule_strs.caller) {
+		uftrace_setup_caller_filter(mcount_rule_strs.caller, &mcount_sym_info, &rules->root,
+					    setting);
+	}
+
+	/* there might be caller triggers, count it separately */
+	if (uftrace_count_filter(&rules->root, TRIGGER_FL_CALLER) != 0)
+		rules->has_caller = true;
+
+	if (mcount_rule_strs.auto_args) {
+		char *autoarg = ".";
+		char *autoret = ".";
+
+		if (setting->ptype == PATT_GLOB)
+			autoarg = autoret = "*";
+
+		setting->auto_args = true;
+
+		uftrace_setup_argument(autoarg, &mcount_sym_info, &rules->root, setting);
+		uftrace_setup_retval(autoret, &mcount_sym_info, &rules->root, setting);
+	}
+
+	free(filter_str);
+	free(trigger_str);
+	free(argument_str);
+	free(retval_str);
+}
+
 static void mcount_filter_init(enum uftrace_pattern_type ptype, bool force)
 {
 	char *filter_str = getenv("UFTRACE_FILTER");
@@ -380,6 +498,7 @@ static void mcount_filter_init(enum uftrace_pattern_type ptype, bool force)
 		.allow_kernel = false,
 		.lp64 = host_is_lp64(),
 		.arch = host_cpu_arch(),
+		.allow_cond = true,
 	};
 	bool needs_debug_info = false;
 
@@ -391,6 +510,7 @@ static void mcount_filter_init(enum uftrace_pattern_type ptype, bool force)
 	if (argument_str || retval_str || autoargs_str ||
 	    (trigger_str && (strstr(trigger_str, "arg") || strstr(trigger_str, "retval")))) {
 		setup_auto_args(&filter_setting);
+		mcount_auto_args_ready = true;
 		needs_debug_info = true;
 	}
 
@@ -404,50 +524,125 @@ static void mcount_filter_init(enum uftrace_pattern_type ptype, bool force)
 		save_debug_info(&mcount_sym_info, mcount_sym_info.dirname);
 	}
 
-	uftrace_setup_filter(filter_str, &mcount_sym_info, &mcount_triggers, &mcount_filter_mode,
-			     &filter_setting);
-	uftrace_setup_trigger(trigger_str, &mcount_sym_info, &mcount_triggers, &mcount_filter_mode,
-			      &filter_setting);
-	uftrace_setup_argument(argument_str, &mcount_sym_info, &mcount_triggers, &filter_setting);
-	uftrace_setup_retval(retval_str, &mcount_sym_info, &mcount_triggers, &filter_setting);
+	if (filter_str)
+		strv_split(&mcount_rule_strs.filter, filter_str, ";");
+	if (trigger_str)
+		strv_split(&mcount_rule_strs.trigger, trigger_str, ";");
+	if (argument_str)
+		strv_split(&mcount_rule_strs.argument, argument_str, ";");
+	if (retval_str)
+		strv_split(&mcount_rule_strs.retval, retval_str, ";");
+	if (caller_str)
+		mcount_rule_strs.caller = xstrdup(caller_str);
+	if (loc_str)
+		mcount_rule_strs.location = xstrdup(loc_str);
+	mcount_rule_strs.auto_args = !!autoargs_str;
+	mcount_rule_strs.debug_info = needs_debug_info;
+	mcount_filter_setting = filter_setting;
+
+	build_filter_rules(&mcount_initial_rules);
 
-	if (needs_debug_info) {
-		uftrace_setup_loc_filter(loc_str, &mcount_sym_info, &mcount_triggers,
-					 &mcount_loc_mode, &filter_setting);
-	}
+	if (getenv("UFTRACE_DEPTH"))
+		mcount_depth = strtol(getenv("UFTRACE_DEPTH"), NULL, 0);
+
+	if (getenv("UFTRACE_DISABLED"))
+		mcount_enabled = false;
+}
 
-	if (caller_str) {
-		uftrace_setup_caller_filter(caller_str, &mcount_sym_info, &mcount_triggers,
-					    &filter_setting);
+/* add (or remove) @rules to (or from) @strv, returns true if changed */
+static bool update_rule_strs(struct strv *strv, char *rules, bool remove)
+{
+	struct strv new_rules = STRV_INIT;
+	bool changed = false;
+	char *rule;
+	int i, k;
+
+	strv_split(&new_rules, rules, ";");
+
+	strv_for_each(&new_rules, rule, i) {
+		for (k = 0; k < strv->nr; k++) {
+			if (!strcmp(strv->p[k], rule))
+				break;
+		}
+
+		if (remove && k < strv->nr) {
+			free(strv->p[k]);
+			memmove(&strv->p[k], &strv->p[k + 1], (strv->nr - k) * sizeof(*strv->p));
+			strv->nr--;
+			changed = true;
+		}
+		else if (!remove && k == strv->nr) {
+			strv_append(strv, rule);
+			changed = true;
+		}
 	}
 
-	/* there might be caller triggers, count it separately */
-	if (uftrace_count_filter(&mcount_triggers, TRIGGER_FL_CALLER) != 0)
-		mcount_has_caller = true;
+	strv_free(&new_rules);
+	return changed;
+}
 
-	if (autoargs_str) {
-		char *autoarg = ".";
-		char *autoret = ".";
+/* called by the agent to update the rules, returns 1 if changed */
+static int mcount_update_rules(enum uftrace_dopt dopt, char *rules, bool remove)
+{
+	if (mcount_nr_retired >= MCOUNT_MAX_RULE_UPDATES) {
+		pr_warn("too many updates of the rules, restart the program to change them\n");
+		return -1;
+	}
 
-		if (ptype == PATT_GLOB)
-			autoarg = autoret = "*";
+	switch (dopt) {
+	case UFTRACE_DOPT_FILTER:
+		return update_rule_strs(&mcount_rule_strs.filter, rules, remove);
+	case UFTRACE_DOPT_TRIGGER:
+		return update_rule_strs(&mcount_rule_strs.trigger, rules, remove);
+	case UFTRACE_DOPT_ARGUMENT:
+		return update_rule_strs(&mcount_rule_strs.argument, rules, remove);
+	case UFTRACE_DOPT_RETVAL:
+		return update_rule_strs(&mcount_rule_strs.retval, rules, remove);
+	default:
+		return -1;
+	}
+}
+
+/* build new filter rules and replace the current one */
+static void mcount_publish_rules(void)
+{
+	struct mcount_filter_rules *rules = xzalloc(sizeof(*rules));
 
-		filter_setting.auto_args = true;
+	rules->root = RB_ROOT;
 
-		uftrace_setup_argument(autoarg, &mcount_sym_info, &mcount_triggers,
-				       &filter_setting);
-		uftrace_setup_retval(autoret, &mcount_sym_info, &mcount_triggers, &filter_setting);
+	if (!mcount_auto_args_ready &&
+	    (mcount_rule_strs.argument.nr || mcount_rule_strs.retval.nr ||
+	     mcount_rule_strs.trigger.nr)) {
+		setup_auto_args(&mcount_filter_setting);
+		mcount_auto_args_ready = true;
 	}
 
-	if (getenv("UFTRACE_DEPTH"))
-		mcount_depth = strtol(getenv("UFTRACE_DEPTH"), NULL, 0);
+	build_filter_rules(rules);
 
-	if (getenv("UFTRACE_DISABLED"))
-		mcount_enabled = false;
+	/* only the agent updates the rules */
+	rules->retired = mcount_rules;
+	mcount_nr_retired++;
+	__atomic_store_n(&mcount_rules, rules, __ATOMIC_RELEASE);
+
+	pr_dbg("agent updated filter rules\n");
+}
+
+/* called by the agent to update the global depth and time filter */
+static int mcount_update_filter(int depth, uint64_t threshold)
+{
+	mcount_depth = depth;
+	mcount_threshold = threshold;
+
+	/* threads will update their filter state at the next function entry */
+	__atomic_add_fetch(&mcount_filter_gen, 1, __ATOMIC_RELEASE);
+	return 0;
 }
 
 static void mcount_filter_setup(struct mcount_thread_data *mtdp)
 {
+	mtdp->filter.gen = __atomic_load_n(&mcount_filter_gen, __ATOMIC_ACQUIRE);
+	mtdp->filter.global_depth = mcount_depth;
+	mtdp->filter.global_time = mcount_threshold;
 	mtdp->filter.depth = mcount_depth;
 	mtdp->filter.time = mcount_threshold;
 	mtdp->filter.size = mcount_min_size;
@@ -465,8 +660,29 @@ static void mcount_filter_release(struct mcount_thread_data *mtdp)
 
 static void mcount_filter_finish(void)
 {
-	uftrace_cleanup_filter(&mcount_triggers);
+	struct mcount_filter_rules *rules = mcount_rules;
+
+	while (rules) {
+		struct mcount_filter_rules *retired = rules->retired;
+
+		uftrace_cleanup_filter(&rules->root);
+		if (rules != &mcount_initial_rules)
+			free(rules);
+		rules = retired;
+	}
+	mcount_rules = &mcount_initial_rules;
+	mcount_nr_retired = 0;
+
+	strv_free(&mcount_rule_strs.filter);
+	strv_free(&mcount_rule_strs.trigger);
+	strv_free(&mcount_rule_strs.argument);
+	strv_free(&mcount_rule_strs.retval);
+	free(mcount_rule_strs.caller);
+	free(mcount_rule_strs.location);
+	mcount_rule_strs.caller = mcount_rule_strs.location = NULL;
+
 	finish_auto_args();
+	mcount_auto_args_ready = false;
 
 	finish_debug_info(&mcount_sym_info);
 
@@ -661,6 +877,28 @@ void mcount_unguard_recursion(struct mcount_thread_data *mtdp)
 		mtd_dtor(mtdp);
 }
 
+/* find the innermost traced function except library calls */
+unsigned long mcount_find_caller(struct mcount_thread_data *mtdp, unsigned long callsite)
+{
+	int idx;
+
+	if (check_thread_data(mtdp))
+		return callsite;
+
+	/* cygprof_entry() increases the idx beyond rstack max */
+	idx = mtdp->idx;
+	if (idx > mcount_rstack_max)
+		idx = mcount_rstack_max;
+
+	for (idx--; idx >= 0; idx--) {
+		struct mcount_ret_stack *rstack = &mtdp->rstack[idx];
+
+		if (rstack->dyn_idx == MCOUNT_INVALID_DYNIDX)
+			return rstack->child_ip;
+	}
+	return callsite;
+}
+
 static struct sigaction old_sigact[2];
 
 static const struct {
@@ -851,22 +1089,86 @@ static void mcount_save_filter(struct mcount_thread_data *mtdp)
 	mtdp->filter.saved_size = mtdp->filter.size;
 }
 
-/* update filter state from trigger result */
-enum filter_result mcount_entry_filter_check(struct mcount_thread_data *mtdp, unsigned long child,
-					     struct uftrace_trigger *tr)
+static uint16_t adjust_filter_depth(int depth, int delta)
 {
+	depth += delta;
+	if (depth < 0)
+		depth = 0;
+	if (depth > UINT16_MAX)
+		depth = UINT16_MAX;
+	return depth;
+}
+
+/*
+ * The agent changed the global depth or time filter.  Update the current
+ * and saved filter state of the thread so that it applies to the functions
+ * already in the rstack as well.
+ */
+static void mcount_sync_filter(struct mcount_thread_data *mtdp, unsigned gen)
+{
+	int depth = mcount_depth;
+	uint64_t time = mcount_threshold;
+	int delta = depth - mtdp->filter.global_depth;
+	int i;
+
+	mtdp->filter.depth = adjust_filter_depth(mtdp->filter.depth, delta);
+	if (mtdp->filter.time == mtdp->filter.global_time)
+		mtdp->filter.time = time;
+
+	for (i = 0; i < mtdp->idx; i++) {
+		struct mcount_ret_stack *rstack = &mtdp->rstack[i];
+
+		rstack->filter_depth = adjust_filter_depth(rstack->filter_depth, delta);
+		if (rstack->filter_time == mtdp->filter.global_time)
+			rstack->filter_time = time;
+	}
+
+	mtdp->filter.gen = gen;
+	mtdp->filter.global_depth = depth;
+	mtdp->filter.global_time = time;
+}
+
+/*
+ * update filter state from trigger result.
+ * @lookup is false if the caller found the @filter of @child already.
+ */
+static inline enum filter_result entry_filter_check(struct mcount_thread_data *mtdp,
+						   unsigned long child, bool lookup,
+						   struct uftrace_filter *filter,
+						   struct uftrace_trigger *tr,
+						   struct mcount_regs *regs,
+						   unsigned long *parent_loc)
+{
+	struct mcount_filter_rules *rules;
+	unsigned gen;
+
 	pr_dbg3("<%d> enter %lx\n", mtdp->idx, child);
 
 	if (mcount_check_rstack(mtdp))
 		return FILTER_RSTACK;
 
+	gen = __atomic_load_n(&mcount_filter_gen, __ATOMIC_ACQUIRE);
+	if (unlikely(gen != mtdp->filter.gen))
+		mcount_sync_filter(mtdp, gen);
+
 	mcount_save_filter(mtdp);
 
 	/* already filtered by notrace option */
 	if (mtdp->filter.out_count > 0)
 		return FILTER_OUT;
 
-	uftrace_match_filter(child, &mcount_triggers, tr);
+	rules = mcount_get_rules();
+
+	/* the @filter is valid only for the initial rules */
+	if (lookup || rules != &mcount_initial_rules)
+		uftrace_match_filter(child, &rules->root, tr);
+	else if (filter)
+		*tr = filter->trigger;
+
+	/* ignore the triggers (but -A/-R) if the arguments don't match the condition */
+	if (unlikely(tr->flags & TRIGGER_FL_COND) &&
+	    !check_trigger_cond(mtdp, tr->cond, regs, parent_loc))
+		tr->flags &= TRIGGER_FL_ARGUMENT | TRIGGER_FL_RETVAL;
 
 	pr_dbg3(" tr->flags: %x, filter mode: %d, count: %d/%d, depth: %d\n", tr->flags, tr->fmode,
 		mtdp->filter.in_count, mtdp->filter.out_count, mtdp->filter.depth);
@@ -882,7 +1184,7 @@ enum filter_result mcount_entry_filter_check(struct mcount_thread_data *mtdp, un
 	}
 	else {
 		/* not matched by filter */
-		if (mcount_filter_mode == FILTER_MODE_IN && mtdp->filter.in_count == 0)
+		if (rules->filter_mode == FILTER_MODE_IN && mtdp->filter.in_count == 0)
 			return FILTER_OUT;
 	}
 
@@ -891,7 +1193,7 @@ enum filter_result mcount_entry_filter_check(struct mcount_thread_data *mtdp, un
 			return FILTER_OUT;
 	}
 	else {
-		if (mcount_loc_mode == FILTER_MODE_IN)
+		if (rules->loc_mode == FILTER_MODE_IN)
 			return FILTER_OUT;
 	}
 
@@ -925,11 +1227,35 @@ enum filter_result mcount_entry_filter_check(struct mcount_thread_data *mtdp, un
 	return FILTER_IN;
 }
 
+enum filter_result mcount_entry_filter_check(struct mcount_thread_data *mtdp, unsigned long child,
+					     struct uftrace_trigger *tr, struct mcount_regs *regs,
+					     unsigned long *parent_loc)
+{
+	return entry_filter_check(mtdp, child, true, NULL, tr, regs, parent_loc);
+}
+
+/* returns the filter of the function at @addr, for mcount_entry_filter_match() */
+struct uftrace_filter *mcount_find_filter(unsigned long addr)
+{
+	struct uftrace_trigger tr;
+
+	return uftrace_match_filter(addr, &mcount_get_rules()->root, &tr);
+}
+
+/* same as mcount_entry_filter_check() but uses the @filter found already */
+enum filter_result mcount_entry_filter_match(struct mcount_thread_data *mtdp, unsigned long child,
+					     struct uftrace_filter *filter,
+					     struct uftrace_trigger *tr, struct mcount_regs *regs,
+					     unsigned long *parent_loc)
+{
+	return entry_filter_check(mtdp, child, false, filter, tr, regs, parent_loc);
+}
+
 static int script_save_context(struct script_context *sc_ctx, struct mcount_thread_data *mtdp,
-			       struct mcount_ret_stack *rstack, char *symname, bool has_arg_retval,
-			       struct list_head *pargs)
+			       struct mcount_ret_stack *rstack, struct uftrace_symbol *sym,
+			       char *symname, bool has_arg_retval, struct list_head *pargs)
 {
-	if (!script_match_filter(symname))
+	if (!script_match_symbol(sym, symname))
 		return -1;
 
 	sc_ctx->tid = mcount_gettid(mtdp);
@@ -963,8 +1289,8 @@ static void script_hook_entry(struct mcount_thread_data *mtdp, struct mcount_ret
 	struct uftrace_symbol *sym = find_symtabs(&mcount_sym_info, entry_addr);
 	char *symname = symbol_getname(sym, entry_addr);
 
-	if (script_save_context(&sc_ctx, mtdp, rstack, symname, tr->flags & TRIGGER_FL_ARGUMENT,
-				tr->pargs) < 0)
+	if (script_save_context(&sc_ctx, mtdp, rstack, sym, symname,
+				tr->flags & TRIGGER_FL_ARGUMENT, tr->pargs) < 0)
 		goto skip;
 
 	/* accessing argument in script might change arch-context */
@@ -983,8 +1309,8 @@ static void script_hook_exit(struct mcount_thread_data *mtdp, struct mcount_ret_
 	struct uftrace_symbol *sym = find_symtabs(&mcount_sym_info, entry_addr);
 	char *symname = symbol_getname(sym, entry_addr);
 
-	if (script_save_context(&sc_ctx, mtdp, rstack, symname, rstack->flags & MCOUNT_FL_RETVAL,
-				rstack->pargs) < 0)
+	if (script_save_context(&sc_ctx, mtdp, rstack, sym, symname,
+				rstack->flags & MCOUNT_FL_RETVAL, rstack->pargs) < 0)
 		goto skip;
 
 	/* accessing argument in script might change arch-context */
@@ -1001,7 +1327,7 @@ void mcount_entry_filter_record(struct mcount_thread_data *mtdp, struct mcount_r
 				struct uftrace_trigger *tr, struct mcount_regs *regs)
 {
 	if (mtdp->filter.out_count > 0 ||
-	    (mtdp->filter.in_count == 0 && mcount_filter_mode == FILTER_MODE_IN) ||
+	    (mtdp->filter.in_count == 0 && mcount_get_rules()->filter_mode == FILTER_MODE_IN) ||
 	    (mtdp->filter.size > 0 &&
 	     mcount_getsize(&mcount_sym_info, rstack->child_ip) < mtdp->filter.size))
 		rstack->flags |= MCOUNT_FL_NORECORD;
@@ -1144,7 +1470,7 @@ void mcount_exit_filter_record(struct mcount_thread_data *mtdp, struct mcount_re
 			struct uftrace_trigger tr;
 
 			/* there's a possibility of overwriting by return value */
-			uftrace_match_filter(rstack->child_ip, &mcount_triggers, &tr);
+			uftrace_match_filter(rstack->child_ip, &mcount_get_rules()->root, &tr);
 			save_trigger_read(mtdp, rstack, tr.read, true);
 		}
 
@@ -1152,7 +1478,7 @@ void mcount_exit_filter_record(struct mcount_thread_data *mtdp, struct mcount_re
 			save_watchpoint(mtdp, rstack, mcount_watchpoints);
 
 		if (((rstack->end_time - rstack->start_time > time_filter) &&
-		     (!mcount_has_caller || rstack->flags & MCOUNT_FL_CALLER)) ||
+		     (!mcount_get_rules()->has_caller || rstack->flags & MCOUNT_FL_CALLER)) ||
 		    rstack->flags & (MCOUNT_FL_WRITTEN | MCOUNT_FL_TRACE)) {
 			if (record_trace_data(mtdp, rstack, retval) < 0)
 				pr_err("error during record");
@@ -1187,7 +1513,8 @@ void mcount_exit_filter_record(struct mcount_thread_data *mtdp, struct mcount_re
 
 #else /* DISABLE_MCOUNT_FILTER */
 enum filter_result mcount_entry_filter_check(struct mcount_thread_data *mtdp, unsigned long child,
-					     struct uftrace_trigger *tr)
+					     struct uftrace_trigger *tr, struct mcount_regs *regs,
+					     unsigned long *parent_loc)
 {
 	if (mcount_check_rstack(mtdp))
 		return FILTER_RSTACK;
@@ -1198,6 +1525,19 @@ enum filter_result mcount_entry_filter_check(struct mcount_thread_data *mtdp, un
 	return FILTER_IN;
 }
 
+struct uftrace_filter *mcount_find_filter(unsigned long addr)
+{
+	return NULL;
+}
+
+enum filter_result mcount_entry_filter_match(struct mcount_thread_data *mtdp, unsigned long child,
+					     struct uftrace_filter *filter,
+					     struct uftrace_trigger *tr, struct mcount_regs *regs,
+					     unsigned long *parent_loc)
+{
+	return mcount_entry_filter_check(mtdp, child, tr, regs, parent_loc);
+}
+
 void mcount_entry_filter_record(struct mcount_thread_data *mtdp, struct mcount_ret_stack *rstack,
 				struct uftrace_trigger *tr, struct mcount_regs *regs)
 {
@@ -1309,7 +1649,7 @@ static int __mcount_entry(unsigned long *parent_loc, unsigned long child, struct
 	}
 
 	tr.flags = 0;
-	filtered = mcount_entry_filter_check(mtdp, child, &tr);
+	filtered = mcount_entry_filter_check(mtdp, child, &tr, regs, parent_loc);
 	if (filtered != FILTER_IN) {
 		mcount_unguard_recursion(mtdp);
 		return -1;
@@ -1450,7 +1790,7 @@ static int __cygprof_entry(unsigned long parent, unsigned long child)
 			return -1;
 	}
 
-	filtered = mcount_entry_filter_check(mtdp, child, &tr);
+	filtered = mcount_entry_filter_check(mtdp, child, &tr, NULL, NULL);
 
 	if (unlikely(mtdp->in_exception)) {
 		unsigned long *frame_ptr;
@@ -1583,7 +1923,7 @@ static void _xray_entry(unsigned long parent, unsigned long child, struct mcount
 			return;
 	}
 
-	filtered = mcount_entry_filter_check(mtdp, child, &tr);
+	filtered = mcount_entry_filter_check(mtdp, child, &tr, regs, NULL);
 
 	if (unlikely(mtdp->in_exception)) {
 		unsigned long *frame_ptr;
@@ -1754,6 +2094,8 @@ static void mcount_script_init(enum uftrace_pattern_type patt_type)
 
 	if (script_init(&info, patt_type) < 0)
 		script_str = NULL;
+	else
+		script_setup_filter_cache(&mcount_sym_info);
 
 	strv_free(&info.cmds);
 }
@@ -1796,6 +2138,40 @@ static void agent_fini(struct sockaddr_un *addr, int sfd)
 	socket_unlink(addr);
 }
 
+/* read a string value of the option from the client */
+static char *agent_read_string(int cfd)
+{
+	char *str;
+	int len;
+
+	if (read_all(cfd, &len, sizeof(len)) < 0 || len <= 0 || len > AGENT_MAX_STRLEN)
+		return NULL;
+
+	str = xmalloc(len);
+	if (read_all(cfd, str, len) < 0) {
+		free(str);
+		return NULL;
+	}
+	str[len - 1] = '\0';
+	return str;
+}
+
+/* let the recorder save the new argument spec for replay */
+static void agent_send_argspec(enum uftrace_dopt dopt, char *spec)
+{
+	char *msg = NULL;
+
+	if (dopt == UFTRACE_DOPT_ARGUMENT)
+		xasprintf(&msg, "argspec:%s", spec);
+	else if (dopt == UFTRACE_DOPT_RETVAL)
+		xasprintf(&msg, "retspec:%s", spec);
+	else
+		return;
+
+	uftrace_send_message(UFTRACE_MSG_ARGSPEC, msg, strlen(msg));
+	free(msg);
+}
+
 /* Agent routine, applying instructions from the CLI. */
 void *agent_apply_commands(void *arg)
 {
@@ -1813,6 +2189,18 @@ void *agent_apply_commands(void *arg)
 	pr_dbg("agent started on socket %s\n", addr.sun_path);
 
 	while (agent_run) {
+		/* changes are applied at once when the client closes the connection */
+		bool remove = false;
+		bool failed = false;
+		bool rules_changed = false;
+		bool filter_changed = false;
+		int trace = -1;
+		int depth = mcount_depth;
+		uint64_t threshold = mcount_threshold;
+		char *str;
+		int val;
+		int ret;
+
 		cfd = socket_accept(sfd);
 		if (cfd == -1) {
 			pr_warn("error accepting socket connection\n");
@@ -1822,16 +2210,83 @@ void *agent_apply_commands(void *arg)
 
 		close_connection = false;
 		while (!close_connection) {
-			if (read(cfd, &dopt, sizeof(enum uftrace_dopt)) == -1) {
-				pr_warn("error reading option\n", errno);
+			if (read_all(cfd, &dopt, sizeof(enum uftrace_dopt)) < 0) {
+				pr_warn("error reading option\n");
 				break;
 			}
 
 			switch (dopt) {
 			case UFTRACE_DOPT_CLOSE:
 				close_connection = true;
-				if (agent_run)
-					socket_send_option(cfd, UFTRACE_DOPT_CLOSE, NULL, 0);
+				if (rules_changed)
+					mcount_publish_rules();
+				if (filter_changed && mcount_update_filter(depth, threshold) < 0)
+					failed = true;
+				if (trace >= 0) {
+					pr_dbg("agent turns tracing %s\n", trace ? "on" : "off");
+					mcount_enabled = trace;
+				}
+				if (agent_run) {
+					socket_send_option(cfd, failed ? UFTRACE_DOPT_ERROR : UFTRACE_DOPT_CLOSE,
+							   NULL, 0);
+				}
+				break;
+
+			case UFTRACE_DOPT_TRACE:
+			case UFTRACE_DOPT_DEPTH:
+			case UFTRACE_DOPT_REMOVE:
+				if (read_all(cfd, &val, sizeof(val)) < 0) {
+					close_connection = true;
+					break;
+				}
+
+				if (dopt == UFTRACE_DOPT_TRACE)
+					trace = val;
+				else if (dopt == UFTRACE_DOPT_DEPTH) {
+					depth = val;
+					filter_changed = true;
+				}
+				else {
+					remove = val;
+				}
+				break;
+
+			case UFTRACE_DOPT_THRESHOLD:
+				if (read_all(cfd, &threshold, sizeof(threshold)) < 0) {
+					close_connection = true;
+					break;
+				}
+				filter_changed = true;
+				break;
+
+			case UFTRACE_DOPT_FILTER:
+			case UFTRACE_DOPT_TRIGGER:
+			case UFTRACE_DOPT_ARGUMENT:
+			case UFTRACE_DOPT_RETVAL:
+			case UFTRACE_DOPT_PATCH:
+				str = agent_read_string(cfd);
+				if (str == NULL) {
+					pr_warn("error reading option value\n");
+					close_connection = true;
+					break;
+				}
+
+				if (dopt == UFTRACE_DOPT_PATCH) {
+					ret = mcount_dynamic_agent_update(&mcount_sym_info, str,
+									  agent_patt_type);
+				}
+				else {
+					pr_dbg("agent %s rules: %s\n", remove ? "removes" : "adds", str);
+					ret = mcount_update_rules(dopt, str, remove);
+					if (ret > 0)
+						rules_changed = true;
+					if (ret > 0 && !remove)
+						agent_send_argspec(dopt, str);
+				}
+
+				if (ret < 0)
+					failed = true;
+				free(str);
 				break;
 
 			default:
@@ -1850,8 +2305,9 @@ void *agent_apply_commands(void *arg)
 	return 0;
 }
 
-static void agent_spawn()
+static void agent_spawn(enum uftrace_pattern_type patt_type)
 {
+	agent_patt_type = patt_type;
 	errno = pthread_create(&agent, NULL, &agent_apply_commands, NULL);
 	if (errno != 0)
 		pr_warn("cannot start agent: %s\n", strerror((errno)));
@@ -1893,12 +2349,108 @@ error:
 	agent_fini(&addr, sfd);
 }
 
+/* number of dummy function calls in a round of calibration */
+#define CALIBRATE_CALLS 200
+#define CALIBRATE_ROUNDS 5
+
+/*
+ * Measure the cost of tracing a function call by calling the entry and exit
+ * handlers for a dummy function.  The records are written to a private
+ * buffer so that the recorder doesn't see them.  The thread data is reset
+ * afterwards and will be prepared again when the first function is called.
+ * Note that it doesn't include the cost of the arch-specific trampolines.
+ */
+static void mcount_calibrate(void)
+{
+	struct mcount_thread_data *mtdp = &mtd;
+	struct mcount_shmem_buffer *buffer[1];
+	struct uftrace_msg_overhead omsg = {
+		.total = -1ULL,
+	};
+	size_t bufsize = CALIBRATE_CALLS * 2 * sizeof(struct uftrace_record);
+	unsigned long child = (unsigned long)mcount_calibrate;
+	unsigned long parent_loc;
+	long retval = 0;
+	int i, k;
+
+	/* these would send the records or need real function contexts */
+	if (!mcount_enabled || mcount_estimate_return || shmem_flush_time || pfd < 0)
+		return;
+	if (SCRIPT_ENABLED && script_str)
+		return;
+	if ((size_t)shmem_bufsize < sizeof(*buffer[0]) + bufsize)
+		return;
+
+	buffer[0] = xmalloc(shmem_bufsize);
+
+	mcount_filter_setup(mtdp);
+	mcount_watch_setup(mtdp);
+	mtdp->rstack = xmalloc(mcount_rstack_max * sizeof(*mtdp->rstack));
+	mtdp->shmem.buffer = buffer;
+	mtdp->shmem.nr_buf = 1;
+	mtdp->shmem.curr = 0;
+	pthread_setspecific(mtd_key, mtdp);
+
+#ifndef DISABLE_MCOUNT_FILTER
+	/* pretend it's called in a function matched by -F */
+	mtdp->filter.in_count++;
+#endif
+
+	for (k = 0; k < CALIBRATE_ROUNDS; k++) {
+		struct mcount_ret_stack *rstack = &mtdp->rstack[0];
+		uint64_t start, total, inner = 0;
+
+		buffer[0]->size = 0;
+		buffer[0]->flag = SHMEM_FL_RECORDING;
+
+		/* it's called with the recursion marker set, allow the handlers only */
+		mtdp->recursion_marker = false;
+
+		start = mcount_gettime();
+		for (i = 0; i < CALIBRATE_CALLS; i++) {
+			parent_loc = child;
+			if (mcount_entry(&parent_loc, child, NULL) < 0) {
+				mtdp->recursion_marker = true;
+				goto out;
+			}
+
+			mcount_exit(&retval);
+			inner += rstack->end_time - rstack->start_time;
+		}
+		total = (mcount_gettime() - start) / CALIBRATE_CALLS;
+		mtdp->recursion_marker = true;
+
+		/* use the minimum to exclude interrupts and such */
+		if (total < omsg.total) {
+			omsg.total = total;
+			omsg.inner = inner / CALIBRATE_CALLS;
+		}
+	}
+
+	pr_dbg("tracing overhead: %" PRIu64 " nsec per call (%" PRIu64 " nsec inside)\n",
+	       omsg.total, omsg.inner);
+	uftrace_send_message(UFTRACE_MSG_OVERHEAD, &omsg, sizeof(omsg));
+
+out:
+	pthread_setspecific(mtd_key, NULL);
+	memset(&mtdp->shmem, 0, sizeof(mtdp->shmem));
+	mcount_filter_release(mtdp);
+	mcount_watch_release(mtdp);
+	free(mtdp->rstack);
+	mtdp->rstack = NULL;
+	mtdp->idx = 0;
+	mtdp->record_idx = 0;
+	memset(&mtdp->filter, 0, sizeof(mtdp->filter));
+	free(buffer[0]);
+}
+
 static __used void mcount_startup(void)
 {
 	char *pipefd_str;
 	char *logfd_str;
 	char *debug_str;
 	char *bufsize_str;
+	char *flush_str;
 	char *maxstack_str;
 	char *threshold_str;
 	char *minsize_str;
@@ -2003,6 +2555,10 @@ static __used void mcount_startup(void)
 	if (bufsize_str)
 		shmem_bufsize = strtol(bufsize_str, NULL, 0);
 
+	flush_str = getenv("UFTRACE_FLUSH_TIME");
+	if (flush_str)
+		shmem_flush_time = strtoull(flush_str, NULL, 0);
+
 	mcount_exename = read_exename();
 	mcount_sym_info.dirname = dirname;
 	mcount_sym_info.symdir = symdir_str ?: dirname;
@@ -2011,6 +2567,9 @@ static __used void mcount_startup(void)
 	if (symdir_str)
 		mcount_sym_info.flags |= SYMTAB_FL_USE_SYMFILE | SYMTAB_FL_SYMS_DIR;
 
+	/* share symbol tables with other processes */
+	set_symtab_cache_dir(getenv("UFTRACE_SYMBOL_CACHE"));
+
 	record_proc_maps(dirname, mcount_session_name(), &mcount_sym_info);
 
 	if (pattern_str)
@@ -2054,7 +2613,13 @@ static __used void mcount_startup(void)
 		setup_clock_id(clock_str);
 
 	if (getenv("UFTRACE_AGENT"))
-		agent_spawn();
+		agent_spawn(patt_type);
+
+	if (getenv("UFTRACE_ALLOC_PROFILE"))
+		mcount_alloc_init(dirname, getenv("UFTRACE_ALLOC_PROFILE"));
+
+	if (getenv("UFTRACE_LOCK_PROFILE"))
+		mcount_lock_init(getenv("UFTRACE_LOCK_PROFILE"));
 
 	pthread_atfork(atfork_prepare_handler, NULL, atfork_child_handler);
 
@@ -2068,6 +2633,7 @@ static __used void mcount_startup(void)
 	pr_dbg("mcount setup done\n");
 
 	mcount_global_flags &= ~MCOUNT_GFL_SETUP;
+	mcount_calibrate();
 	mtd.recursion_marker = false;
 }
 
@@ -2075,6 +2641,7 @@ static void mcount_cleanup(void)
 {
 	agent_kill();
 	mcount_finish();
+	mcount_alloc_finish();
 	destroy_dynsym_indexes();
 	mcount_dynamic_finish();
 
@@ -2096,6 +2663,7 @@ static void mcount_cleanup(void)
 	script_str = NULL;
 
 	unload_module_symtabs();
+	set_symtab_cache_dir(NULL);
 
 	pr_dbg("exit from libmcount\n");
 }
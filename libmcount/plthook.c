@@ -249,8 +249,7 @@ static int find_got(struct uftrace_elf_data *elf, struct uftrace_elf_iter *iter,
 	load_elf_dynsymtab(&pd->dsymtab, elf, pd->base_addr, 0);
 
 	pd->resolved_addr = xcalloc(pd->dsymtab.nr_sym, sizeof(long));
-	pd->special_funcs = NULL;
-	pd->nr_special = 0;
+	pd->slots = NULL;
 
 	mcount_arch_plthook_setup(pd, elf);
 	list_add_tail(&pd->list, &plthook_modules);
@@ -373,28 +372,6 @@ static const char *resolve_syms[] = {
 	"execvpe", "fexecve", "posix_spawn", "posix_spawnp", "pthread_exit",
 };
 
-static void add_special_func(struct plthook_data *pd, unsigned idx, unsigned flags)
-{
-	int i;
-	struct plthook_special_func *func;
-
-	for (i = 0; i < pd->nr_special; i++) {
-		func = &pd->special_funcs[i];
-
-		if (func->idx == idx) {
-			func->flags |= flags;
-			return;
-		}
-	}
-
-	pd->special_funcs = xrealloc(pd->special_funcs, (pd->nr_special + 1) * sizeof(*func));
-
-	func = &pd->special_funcs[pd->nr_special++];
-
-	func->idx = idx;
-	func->flags = flags;
-}
-
 static void build_special_funcs(struct plthook_data *pd, const char *syms[], unsigned nr_sym,
 				unsigned flag)
 {
@@ -403,35 +380,23 @@ static void build_special_funcs(struct plthook_data *pd, const char *syms[], uns
 
 	build_dynsym_idxlist(&pd->dsymtab, &idxlist, syms, nr_sym);
 	for (i = 0; i < idxlist.count; i++)
-		add_special_func(pd, idxlist.idx[i], flag);
+		pd->slots[idxlist.idx[i]].flags |= flag;
 	destroy_dynsym_idxlist(&idxlist);
 }
 
-static int idxsort(const void *a, const void *b)
-{
-	const struct plthook_special_func *func_a = a;
-	const struct plthook_special_func *func_b = b;
-
-	if (func_a->idx > func_b->idx)
-		return 1;
-	if (func_a->idx < func_b->idx)
-		return -1;
-	return 0;
-}
-
-static int idxfind(const void *a, const void *b)
+/*
+ * It builds a flat array of PLT functions so that plthook_entry() can
+ * find the special flags and filters of the function by index directly.
+ * The filters are looked up in the initial rules.  If the rules are
+ * replaced later (by the agent), entry_filter_check() doesn't trust
+ * the slot->filter and looks up the function in the active rules.
+ */
+void setup_dynsym_indexes(struct plthook_data *pd)
 {
-	unsigned idx = (unsigned long)a;
-	const struct plthook_special_func *func = b;
-
-	if (func->idx == idx)
-		return 0;
+	size_t i;
 
-	return (idx > func->idx) ? 1 : -1;
-}
+	pd->slots = xcalloc(pd->dsymtab.nr_sym, sizeof(*pd->slots));
 
-void setup_dynsym_indexes(struct plthook_data *pd)
-{
 	build_special_funcs(pd, skip_syms, ARRAY_SIZE(skip_syms), PLT_FL_SKIP);
 	build_special_funcs(pd, longjmp_syms, ARRAY_SIZE(longjmp_syms), PLT_FL_LONGJMP);
 	build_special_funcs(pd, setjmp_syms, ARRAY_SIZE(setjmp_syms), PLT_FL_SETJMP);
@@ -441,8 +406,8 @@ void setup_dynsym_indexes(struct plthook_data *pd)
 	build_special_funcs(pd, except_syms, ARRAY_SIZE(except_syms), PLT_FL_EXCEPT);
 	build_special_funcs(pd, resolve_syms, ARRAY_SIZE(resolve_syms), PLT_FL_RESOLVE);
 
-	/* built all table, now sorting */
-	qsort(pd->special_funcs, pd->nr_special, sizeof(*pd->special_funcs), idxsort);
+	for (i = 0; i < pd->dsymtab.nr_sym; i++)
+		pd->slots[i].filter = mcount_find_filter(pd->dsymtab.sym[i].addr);
 }
 
 void destroy_dynsym_indexes(void)
@@ -452,9 +417,8 @@ void destroy_dynsym_indexes(void)
 	pr_dbg2("destroy plthook special function index\n");
 
 	list_for_each_entry(pd, &plthook_modules, list) {
-		free(pd->special_funcs);
-		pd->special_funcs = NULL;
-		pd->nr_special = 0;
+		free(pd->slots);
+		pd->slots = NULL;
 	}
 }
 
@@ -735,7 +699,7 @@ static unsigned long __plthook_entry(unsigned long *ret_addr, unsigned long chil
 	bool recursion = true;
 	enum filter_result filtered;
 	struct plthook_data *pd;
-	struct plthook_special_func *func;
+	struct plthook_slot *slot;
 	unsigned long special_flag = 0;
 	unsigned long real_addr = 0;
 	struct uftrace_trigger tr;
@@ -768,33 +732,34 @@ static unsigned long __plthook_entry(unsigned long *ret_addr, unsigned long chil
 
 	recursion = false;
 
-	func = bsearch((void *)child_idx, pd->special_funcs, pd->nr_special, sizeof(*func),
-		       idxfind);
-	if (func)
-		special_flag |= func->flags;
+	if (unlikely(child_idx >= pd->dsymtab.nr_sym)) {
+		pr_dbg("invalid function idx found! (idx: %lu/%zu, module: %s)\n", child_idx,
+		       pd->dsymtab.nr_sym, pd->mod_name);
+		mcount_unguard_recursion(mtdp);
+		return 0;
+	}
+
+	/* slots are released at exit, but other threads can still come here */
+	if (unlikely(pd->slots == NULL))
+		goto out;
+
+	slot = &pd->slots[child_idx];
+	special_flag = slot->flags;
 
 	if (unlikely(special_flag & PLT_FL_SKIP))
 		goto out;
 
-	if (likely(child_idx < pd->dsymtab.nr_sym)) {
-		sym = &pd->dsymtab.sym[child_idx];
+	sym = &pd->dsymtab.sym[child_idx];
 
-		if (dbg_domain[DBG_PLTHOOK] >= 3) {
-			char *symname = demangle(sym->name);
+	if (dbg_domain[DBG_PLTHOOK] >= 3) {
+		char *symname = demangle(sym->name);
 
-			pr_dbg3("[idx: %4d] enter %" PRIx64 ": %s@plt (mod: %lx)\n", (int)child_idx,
-				sym->addr, symname, module_id);
-			free(symname);
-		}
-	}
-	else {
-		pr_dbg("invalid function idx found! (idx: %lu/%zu, module: %s)\n", child_idx,
-		       pd->dsymtab.nr_sym, pd->mod_name);
-		mcount_unguard_recursion(mtdp);
-		return 0;
+		pr_dbg3("[idx: %4d] enter %" PRIx64 ": %s@plt (mod: %lx)\n", (int)child_idx,
+			sym->addr, symname, module_id);
+		free(symname);
 	}
 
-	filtered = mcount_entry_filter_check(mtdp, sym->addr, &tr);
+	filtered = mcount_entry_filter_match(mtdp, sym->addr, slot->filter, &tr, regs, ret_addr);
 	if (filtered != FILTER_IN) {
 		/*
 		 * Skip recording but still hook the return address,
@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <pthread.h>
 #include <sched.h>
 #include <stdio.h>
@@ -555,6 +556,106 @@ void save_retval(struct mcount_thread_data *mtdp, struct mcount_ret_stack *rstac
 	*(uint32_t *)argbuf = size;
 }
 
+static bool check_int_cond(struct mcount_arg_context *ctx, struct uftrace_cond_insn *insn)
+{
+	unsigned bits = insn->spec.size * 8;
+	uint64_t uval = ctx->val.i;
+	int64_t sval;
+
+	if (bits == 0)
+		return false;
+
+	if (bits < 64)
+		uval &= (1ULL << bits) - 1;
+
+	/* sign-extend the value to compare */
+	sval = uval;
+	if (bits < 64 && (uval & (1ULL << (bits - 1))))
+		sval = uval | ~((1ULL << bits) - 1);
+	if (insn->is_signed)
+		uval = sval;
+
+	switch (insn->op) {
+	case COND_OP_EQ:
+		return uval == insn->val;
+	case COND_OP_NE:
+		return uval != insn->val;
+	case COND_OP_AND:
+		return (uval & insn->val) != 0;
+	case COND_OP_LT:
+		return insn->is_signed ? sval < (int64_t)insn->val : uval < insn->val;
+	case COND_OP_LE:
+		return insn->is_signed ? sval <= (int64_t)insn->val : uval <= insn->val;
+	case COND_OP_GT:
+		return insn->is_signed ? sval > (int64_t)insn->val : uval > insn->val;
+	case COND_OP_GE:
+		return insn->is_signed ? sval >= (int64_t)insn->val : uval >= insn->val;
+	default:
+		return false;
+	}
+}
+
+static bool check_str_cond(struct mcount_arg_context *ctx, struct uftrace_cond_insn *insn)
+{
+	char *str = ctx->val.p;
+	char buf[ARG_STR_MAX + 1];
+	bool match;
+	int i;
+
+	if (str == NULL || !check_mem_region(ctx, (unsigned long)str))
+		return false;
+
+	/* copy it manually not to clobber the (floating-point) registers */
+	for (i = 0; i < ARG_STR_MAX; i++) {
+		buf[i] = str[i];
+		if (buf[i] == '\0')
+			break;
+	}
+	buf[i] = '\0';
+
+	mcount_save_arch_context(ctx->arch);
+	if (insn->op == COND_OP_MATCH)
+		match = !fnmatch(insn->str, buf, 0);
+	else
+		match = !strcmp(insn->str, buf);
+	mcount_restore_arch_context(ctx->arch);
+
+	return insn->op == COND_OP_NE ? !match : match;
+}
+
+/* returns true if the arguments satisfy all the conditions */
+bool check_trigger_cond(struct mcount_thread_data *mtdp, struct uftrace_trigger_cond *cond,
+			struct mcount_regs *regs, unsigned long *stack_base)
+{
+	struct mcount_arg_context ctx;
+	int i;
+
+	/* arguments are not available (e.g. -finstrument-functions) */
+	if (regs == NULL)
+		return false;
+
+	mcount_memset4(&ctx, 0, sizeof(ctx));
+	ctx.regs = regs;
+	ctx.stack_base = stack_base;
+	ctx.regions = &mtdp->mem_regions;
+	ctx.arch = &mtdp->arch;
+
+	for (i = 0; i < cond->nr_insn; i++) {
+		struct uftrace_cond_insn *insn = &cond->insn[i];
+
+		mcount_arch_get_arg(&ctx, &insn->spec);
+
+		if (insn->spec.fmt == ARG_FMT_STR) {
+			if (!check_str_cond(&ctx, insn))
+				return false;
+		}
+		else if (!check_int_cond(&ctx, insn)) {
+			return false;
+		}
+	}
+	return true;
+}
+
 static int save_proc_statm(void *ctx, void *buf)
 {
 	FILE *fp;
@@ -842,6 +943,24 @@ get_buffer:
 	return curr_buf;
 }
 
+/* hand off the current buffer if it has records older than the flush time */
+static void check_shmem_flush(struct mcount_thread_data *mtdp, uint64_t timestamp)
+{
+	struct mcount_shmem *shmem = &mtdp->shmem;
+	struct mcount_shmem_buffer *curr_buf;
+
+	if (shmem->curr == -1 || shmem->buffer == NULL || shmem->done)
+		return;
+
+	curr_buf = shmem->buffer[shmem->curr];
+	/* every record starts with the timestamp */
+	if (curr_buf->size == 0 || timestamp < *(uint64_t *)curr_buf->data + shmem_flush_time)
+		return;
+
+	finish_shmem_buffer(mtdp, shmem->curr);
+	get_new_shmem_buffer(mtdp);
+}
+
 static int record_event(struct mcount_thread_data *mtdp, struct mcount_event *event)
 {
 	struct mcount_shmem_buffer *curr_buf;
@@ -878,7 +997,8 @@ static int record_event(struct mcount_thread_data *mtdp, struct mcount_event *ev
 		memcpy(ptr + 2, event->data, data_size);
 	}
 
-	curr_buf->size += size;
+	/* publish the record after it's written, see cmds/record.c::peek_shmem_buffers() */
+	__atomic_store_n(&curr_buf->size, curr_buf->size + size, __ATOMIC_RELEASE);
 
 	return 0;
 }
@@ -937,6 +1057,9 @@ static int record_ret_stack(struct mcount_thread_data *mtdp, enum uftrace_record
 			size += *(unsigned *)argbuf;
 	}
 
+	if (unlikely(shmem_flush_time))
+		check_shmem_flush(mtdp, timestamp);
+
 	curr_buf = get_shmem_buffer(mtdp, size);
 	if (curr_buf == NULL)
 		return mtdp->shmem.done ? 0 : -1;
@@ -965,7 +1088,7 @@ static int record_ret_stack(struct mcount_thread_data *mtdp, enum uftrace_record
 	buf[1] = rec;
 #endif
 
-	curr_buf->size += sizeof(*frstack);
+	__atomic_store_n(&curr_buf->size, curr_buf->size + sizeof(*frstack), __ATOMIC_RELEASE);
 	mrstack->flags |= MCOUNT_FL_WRITTEN;
 
 	if (argbuf) {
@@ -1087,6 +1210,23 @@ int record_trace_data(struct mcount_thread_data *mtdp, struct mcount_ret_stack *
 	return 0;
 }
 
+/* write pending async events to make room for new events */
+void record_async_events(struct mcount_thread_data *mtdp)
+{
+	/* parent functions should be written before the events */
+	if (mtdp->idx > 0)
+		record_trace_data(mtdp, &mtdp->rstack[mtdp->idx - 1], NULL);
+
+	while (mtdp->nr_events && mtdp->event[0].idx == ASYNC_IDX) {
+		if (record_event(mtdp, &mtdp->event[0]) < 0)
+			break;
+
+		mtdp->nr_events--;
+		mcount_memcpy4(&mtdp->event[0], &mtdp->event[1],
+			       sizeof(*mtdp->event) * mtdp->nr_events);
+	}
+}
+
 static void write_map(FILE *out, struct uftrace_mmap *map, unsigned char major, unsigned char minor,
 		      uint32_t ino, uint64_t off)
 {
@@ -1,6 +1,8 @@
 #include <dlfcn.h>
+#include <errno.h>
 #include <link.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <spawn.h>
 #include <string.h>
 #include <sys/uio.h>
@@ -14,6 +16,7 @@
 #include "libmcount/internal.h"
 #include "libmcount/mcount.h"
 #include "utils/compiler.h"
+#include "utils/event.h"
 #include "utils/utils.h"
 
 extern struct uftrace_sym_info mcount_sym_info;
@@ -189,6 +192,8 @@ static char **collect_uftrace_envp(void)
 		ENV(DIR),
 		ENV(KERNEL_PID_UPDATE),
 		ENV(PATTERN),
+		ENV(ALLOC_PROFILE),
+		ENV(LOCK_PROFILE),
 		/* not uftrace-specific, but necessary to run */
 		"LD_PRELOAD",
 		"LD_LIBRARY_PATH",
@@ -571,6 +576,335 @@ __visible_default int fexecve(int fd, char *const argv[], char *const envp[])
 	return real_fexecve(fd, argv, new_envp);
 }
 
+#ifndef UNIT_TEST
+/*
+ * heap allocation functions for --alloc-profile (see alloc.c).  They're
+ * interposed always and just call the real functions without the option.
+ */
+static void *(*real_malloc)(size_t size);
+static void *(*real_calloc)(size_t nmemb, size_t size);
+static void *(*real_realloc)(void *ptr, size_t size);
+static void (*real_free)(void *ptr);
+static int (*real_posix_memalign)(void **ptr, size_t align, size_t size);
+static void *(*real_aligned_alloc)(size_t align, size_t size);
+static void *(*real_memalign)(size_t align, size_t size);
+
+/*
+ * dlsym() might call calloc() before the real functions are found.
+ * Give it a static buffer which is never freed.
+ */
+static char alloc_bootstrap_buf[4096] __align(16);
+static unsigned long alloc_bootstrap_size;
+static TLS bool alloc_hooking;
+
+static bool is_bootstrap_alloc(void *ptr)
+{
+	char *p = ptr;
+
+	return alloc_bootstrap_buf <= p && p < alloc_bootstrap_buf + sizeof(alloc_bootstrap_buf);
+}
+
+static void *alloc_bootstrap(size_t size)
+{
+	unsigned long offset;
+
+	if (size > sizeof(alloc_bootstrap_buf))
+		goto nomem;
+
+	size = ALIGN(size, 16);
+	offset = __sync_fetch_and_add(&alloc_bootstrap_size, size);
+	if (offset + size > sizeof(alloc_bootstrap_buf))
+		goto nomem;
+
+	return alloc_bootstrap_buf + offset;
+
+nomem:
+	errno = ENOMEM;
+	return NULL;
+}
+
+/* returns false if it's called during the dlsym() */
+static bool mcount_hook_alloc_functions(void)
+{
+	if (alloc_hooking)
+		return false;
+
+	alloc_hooking = true;
+	real_malloc = dlsym(RTLD_NEXT, "malloc");
+	real_calloc = dlsym(RTLD_NEXT, "calloc");
+	real_realloc = dlsym(RTLD_NEXT, "realloc");
+	real_free = dlsym(RTLD_NEXT, "free");
+	real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+	real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+	real_memalign = dlsym(RTLD_NEXT, "memalign");
+	alloc_hooking = false;
+	return true;
+}
+
+#define ALLOC_CALLSITE() ((unsigned long)__builtin_return_address(0))
+
+__visible_default void *malloc(size_t size)
+{
+	void *ptr;
+
+	if (unlikely(real_malloc == NULL) && !mcount_hook_alloc_functions())
+		return alloc_bootstrap(size);
+
+	ptr = real_malloc(size);
+
+	if (unlikely(mcount_alloc_profile))
+		mcount_alloc_record(ptr, size, ALLOC_CALLSITE());
+	return ptr;
+}
+
+__visible_default void *calloc(size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	/* the bootstrap buffer is zero-initialized */
+	if (unlikely(real_calloc == NULL) && !mcount_hook_alloc_functions()) {
+		if (size && nmemb > SIZE_MAX / size) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		return alloc_bootstrap(nmemb * size);
+	}
+
+	ptr = real_calloc(nmemb, size);
+
+	if (unlikely(mcount_alloc_profile))
+		mcount_alloc_record(ptr, nmemb * size, ALLOC_CALLSITE());
+	return ptr;
+}
+
+__visible_default void *realloc(void *ptr, size_t size)
+{
+	void *newptr;
+	size_t old_size = 0;
+
+	if (unlikely(real_realloc == NULL) && !mcount_hook_alloc_functions())
+		return NULL;
+
+	if (unlikely(is_bootstrap_alloc(ptr))) {
+		size_t avail = alloc_bootstrap_buf + sizeof(alloc_bootstrap_buf) - (char *)ptr;
+
+		newptr = real_malloc(size);
+		if (newptr)
+			memcpy(newptr, ptr, size < avail ? size : avail);
+		return newptr;
+	}
+
+	/* release it first since other thread can get the same address */
+	if (unlikely(mcount_alloc_profile))
+		old_size = mcount_alloc_release(ptr);
+
+	newptr = real_realloc(ptr, size);
+
+	if (unlikely(mcount_alloc_profile)) {
+		if (newptr)
+			mcount_alloc_record(newptr, size, ALLOC_CALLSITE());
+		else if (size && old_size) /* the old one is still valid */
+			mcount_alloc_record(ptr, old_size, ALLOC_CALLSITE());
+	}
+	return newptr;
+}
+
+__visible_default void free(void *ptr)
+{
+	if (unlikely(is_bootstrap_alloc(ptr)))
+		return;
+
+	if (unlikely(real_free == NULL) && !mcount_hook_alloc_functions())
+		return;
+
+	if (unlikely(mcount_alloc_profile))
+		mcount_alloc_release(ptr);
+
+	real_free(ptr);
+}
+
+__visible_default int posix_memalign(void **ptr, size_t align, size_t size)
+{
+	int ret;
+
+	if (unlikely(real_posix_memalign == NULL) && !mcount_hook_alloc_functions())
+		return ENOMEM;
+
+	ret = real_posix_memalign(ptr, align, size);
+
+	if (unlikely(mcount_alloc_profile) && ret == 0)
+		mcount_alloc_record(*ptr, size, ALLOC_CALLSITE());
+	return ret;
+}
+
+__visible_default void *aligned_alloc(size_t align, size_t size)
+{
+	void *ptr;
+
+	if (unlikely(real_aligned_alloc == NULL) && !mcount_hook_alloc_functions())
+		return NULL;
+
+	ptr = real_aligned_alloc(align, size);
+
+	if (unlikely(mcount_alloc_profile))
+		mcount_alloc_record(ptr, size, ALLOC_CALLSITE());
+	return ptr;
+}
+
+__visible_default void *memalign(size_t align, size_t size)
+{
+	void *ptr;
+
+	if (unlikely(real_memalign == NULL) && !mcount_hook_alloc_functions())
+		return NULL;
+
+	ptr = real_memalign(align, size);
+
+	if (unlikely(mcount_alloc_profile))
+		mcount_alloc_record(ptr, size, ALLOC_CALLSITE());
+	return ptr;
+}
+
+/*
+ * lock functions for --lock-profile (see lock.c)
+ */
+static int (*real_pthread_mutex_lock)(pthread_mutex_t *mutex);
+static int (*real_pthread_mutex_trylock)(pthread_mutex_t *mutex);
+static int (*real_pthread_rwlock_rdlock)(pthread_rwlock_t *rwlock);
+static int (*real_pthread_rwlock_tryrdlock)(pthread_rwlock_t *rwlock);
+static int (*real_pthread_rwlock_wrlock)(pthread_rwlock_t *rwlock);
+static int (*real_pthread_rwlock_trywrlock)(pthread_rwlock_t *rwlock);
+static int (*real_pthread_cond_wait)(pthread_cond_t *cond, pthread_mutex_t *mutex);
+static int (*real_sem_wait)(sem_t *sem);
+static int (*real_sem_trywait)(sem_t *sem);
+
+static void mcount_hook_lock_functions(void)
+{
+	real_pthread_mutex_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+	real_pthread_mutex_trylock = dlsym(RTLD_NEXT, "pthread_mutex_trylock");
+	real_pthread_rwlock_rdlock = dlsym(RTLD_NEXT, "pthread_rwlock_rdlock");
+	real_pthread_rwlock_tryrdlock = dlsym(RTLD_NEXT, "pthread_rwlock_tryrdlock");
+	real_pthread_rwlock_wrlock = dlsym(RTLD_NEXT, "pthread_rwlock_wrlock");
+	real_pthread_rwlock_trywrlock = dlsym(RTLD_NEXT, "pthread_rwlock_trywrlock");
+	real_sem_wait = dlsym(RTLD_NEXT, "sem_wait");
+	real_sem_trywait = dlsym(RTLD_NEXT, "sem_trywait");
+
+	/* the old version has a different ABI (pthread_cond_t) */
+	real_pthread_cond_wait = dlvsym(RTLD_NEXT, "pthread_cond_wait", "GLIBC_2.3.2");
+	if (real_pthread_cond_wait == NULL)
+		real_pthread_cond_wait = dlsym(RTLD_NEXT, "pthread_cond_wait");
+}
+
+#define LOCK_CALLSITE() ((unsigned long)__builtin_return_address(0))
+
+__visible_default int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+	uint64_t start;
+	int ret;
+
+	if (unlikely(real_pthread_mutex_lock == NULL))
+		mcount_hook_lock_functions();
+
+	if (likely(!mcount_lock_profile) || !mcount_lock_check())
+		return real_pthread_mutex_lock(mutex);
+
+	/* it's not contended if it can get the lock immediately */
+	ret = real_pthread_mutex_trylock(mutex);
+	if (ret != EBUSY)
+		return ret;
+
+	start = mcount_gettime();
+	ret = real_pthread_mutex_lock(mutex);
+	if (ret == 0)
+		mcount_lock_record(mutex, UFTRACE_LOCK_MUTEX, start, LOCK_CALLSITE());
+	return ret;
+}
+
+__visible_default int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
+{
+	uint64_t start;
+	int ret;
+
+	if (unlikely(real_pthread_rwlock_rdlock == NULL))
+		mcount_hook_lock_functions();
+
+	if (likely(!mcount_lock_profile) || !mcount_lock_check())
+		return real_pthread_rwlock_rdlock(rwlock);
+
+	ret = real_pthread_rwlock_tryrdlock(rwlock);
+	if (ret != EBUSY)
+		return ret;
+
+	start = mcount_gettime();
+	ret = real_pthread_rwlock_rdlock(rwlock);
+	if (ret == 0)
+		mcount_lock_record(rwlock, UFTRACE_LOCK_RDLOCK, start, LOCK_CALLSITE());
+	return ret;
+}
+
+__visible_default int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
+{
+	uint64_t start;
+	int ret;
+
+	if (unlikely(real_pthread_rwlock_wrlock == NULL))
+		mcount_hook_lock_functions();
+
+	if (likely(!mcount_lock_profile) || !mcount_lock_check())
+		return real_pthread_rwlock_wrlock(rwlock);
+
+	ret = real_pthread_rwlock_trywrlock(rwlock);
+	if (ret != EBUSY)
+		return ret;
+
+	start = mcount_gettime();
+	ret = real_pthread_rwlock_wrlock(rwlock);
+	if (ret == 0)
+		mcount_lock_record(rwlock, UFTRACE_LOCK_WRLOCK, start, LOCK_CALLSITE());
+	return ret;
+}
+
+__visible_default int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	uint64_t start;
+	int ret;
+
+	if (unlikely(real_pthread_cond_wait == NULL))
+		mcount_hook_lock_functions();
+
+	if (likely(!mcount_lock_profile) || !mcount_lock_check())
+		return real_pthread_cond_wait(cond, mutex);
+
+	/* there's no fast path, it always waits for a signal */
+	start = mcount_gettime();
+	ret = real_pthread_cond_wait(cond, mutex);
+	if (ret == 0)
+		mcount_lock_record(cond, UFTRACE_LOCK_COND, start, LOCK_CALLSITE());
+	return ret;
+}
+
+__visible_default int sem_wait(sem_t *sem)
+{
+	uint64_t start;
+	int ret;
+
+	if (unlikely(real_sem_wait == NULL))
+		mcount_hook_lock_functions();
+
+	if (likely(!mcount_lock_profile) || !mcount_lock_check())
+		return real_sem_wait(sem);
+
+	if (real_sem_trywait(sem) == 0)
+		return 0;
+
+	start = mcount_gettime();
+	ret = real_sem_wait(sem);
+	if (ret == 0)
+		mcount_lock_record(sem, UFTRACE_LOCK_SEM, start, LOCK_CALLSITE());
+	return ret;
+}
+#endif /* UNIT_TEST */
+
 #ifdef UNIT_TEST
 
 TEST_CASE(mcount_wrap_dlopen)
@@ -1,4 +1,28 @@
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+enum bench_workload {
+	WL_LOOP,
+	WL_RECURSION,
+	WL_ARGS,
+	WL_LIBCALL,
+	WL_SPAWN,
+	WL_FORK,
+};
+
+static const char *workload_names[] = {
+	"loop", "recursion", "args", "libcall", "spawn", "fork",
+};
+
+static enum bench_workload workload = WL_LOOP;
+static int nr_threads = 1;
+static int depth = 10;
+static int loop = 1000000;
+static char *progname;
 
 int foo(volatile int *ptr)
 {
@@ -30,19 +54,184 @@ int bench(int count)
 	return result;
 }
 
+int recurse(volatile int *ptr, int n)
+{
+	if (n <= 1)
+		return foo(ptr);
+
+	return recurse(ptr, n - 1) + 1;
+}
+
+/* the number of calls is (almost) same as bench() */
+int bench_recursion(int count)
+{
+	volatile int result = 0;
+
+	for (int i = 0; i < count; i += depth)
+		recurse(&result, depth);
+	return result;
+}
+
+long add(long a, long b)
+{
+	return a + b;
+}
+
+int length(const char *str)
+{
+	return strlen(str);
+}
+
+int bench_args(int count)
+{
+	long result = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (i % 2 == 0)
+			result = add(result, i);
+		else
+			result += length("uftrace");
+	}
+	return result;
+}
+
+int bench_libcall(int count)
+{
+	const char *nums[] = { "1", "22", "333", "4444" };
+	char buf[16];
+	long result = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (i % 2 == 0)
+			result += strtol(nums[i % 4], NULL, 0);
+		else
+			result += snprintf(buf, sizeof(buf), "%d", i);
+	}
+	return result;
+}
+
+static void *spawn_thread(void *arg)
+{
+	volatile int result = 0;
+
+	foo(&result);
+	return arg;
+}
+
+int bench_spawn(int count)
+{
+	pthread_t th;
+
+	for (int i = 0; i < count; i++) {
+		pthread_create(&th, NULL, spawn_thread, NULL);
+		pthread_join(th, NULL);
+	}
+	return count;
+}
+
+int bench_fork(int count)
+{
+	for (int i = 0; i < count; i++) {
+		pid_t pid = fork();
+
+		if (pid == 0) {
+			execl(progname, progname, "-w", "loop", "1", "100", NULL);
+			_exit(1);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	return count;
+}
+
+static int run_workload(void)
+{
+	switch (workload) {
+	case WL_LOOP:
+		return bench(loop);
+	case WL_RECURSION:
+		return bench_recursion(loop);
+	case WL_ARGS:
+		return bench_args(loop);
+	case WL_LIBCALL:
+		return bench_libcall(loop);
+	case WL_SPAWN:
+		return bench_spawn(loop);
+	case WL_FORK:
+		return bench_fork(loop);
+	}
+	return 0;
+}
+
+static void *worker(void *arg)
+{
+	long n = (long)arg;
+	long result = 0;
+
+	for (long i = 0; i < n; i++)
+		result += run_workload();
+
+	return (void *)result;
+}
+
+static void usage(void)
+{
+	printf("Usage: bench [-w WORKLOAD] [-t THREADS] [-d DEPTH] [N [LOOP]]\n");
+	printf("  WORKLOAD: loop (default), recursion, args, libcall, spawn, fork\n");
+	exit(1);
+}
+
 int main(int argc, char *argv[])
 {
-	int n = 1;
-	int loop = 1000000;
-	int result = 0;
+	pthread_t *threads;
+	long n = 1;
+	long result = 0;
+	void *ret;
+	int opt;
+	size_t i;
+
+	progname = argv[0];
+
+	while ((opt = getopt(argc, argv, "w:t:d:h")) != -1) {
+		switch (opt) {
+		case 'w':
+			for (i = 0; i < sizeof(workload_names) / sizeof(workload_names[0]); i++) {
+				if (!strcmp(optarg, workload_names[i]))
+					break;
+			}
+			if (i == sizeof(workload_names) / sizeof(workload_names[0]))
+				usage();
+			workload = i;
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
 
-	if (argc > 1)
-		n = atoi(argv[1]);
-	if (argc > 2)
-		loop = atoi(argv[2]);
+	if (optind < argc)
+		n = atoi(argv[optind]);
+	if (optind + 1 < argc)
+		loop = atoi(argv[optind + 1]);
 
-	for (int i = 0; i < n; i++)
-		result += bench(loop);
+	if (nr_threads < 1 || depth < 1)
+		usage();
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	for (int t = 1; t < nr_threads; t++)
+		pthread_create(&threads[t], NULL, worker, (void *)n);
+
+	result = (long)worker((void *)n);
+
+	for (int t = 1; t < nr_threads; t++) {
+		pthread_join(threads[t], &ret);
+		result += (long)ret;
+	}
+	free(threads);
 
 	return result ? 0 : 1;
 }
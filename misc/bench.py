@@ -0,0 +1,307 @@
+#!/usr/bin/env python3
+#
+# Benchmark suite for recording and analysis of uftrace
+#
+# It runs a set of record workloads (using misc/bench.c) and analysis
+# commands on synthetic traces, and prints the results in JSON.  The
+# result can be saved and used as a baseline of a later run to check
+# performance regressions.
+#
+# Released under the GPL v2.
+#
+
+from __future__ import print_function
+
+import argparse
+import fcntl
+import json
+import os
+import platform
+import resource
+import select
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import termios
+import time
+
+UFTRACE = '../uftrace'
+LIBMCOUNT = '../libmcount'
+PROG = './bench'
+
+# name: (bench options, uftrace record options)
+RECORD_CASES = {
+    'loop':      ('-w loop 1 {size}', ''),
+    'thread':    ('-w loop -t {threads} 1 {size}', ''),
+    'recursion': ('-w recursion -d {depth} 1 {size}', ''),
+    'args':      ('-w args 1 {size}', '-A add@arg1/i64,arg2/i64 -R add@retval/i64 -A length@arg1/s'),
+    'auto-args': ('-w libcall 1 {size}', '-a'),
+    'libcall':   ('-w libcall 1 {size}', ''),
+    'dynamic':   ('-w loop 1 {size}', '-P .'),
+    'spawn':     ('-w spawn 1 {count}', ''),
+    'fork':      ('-w fork 1 {count}', ''),
+}
+
+# name: uftrace options (to be run on the synthetic trace)
+ANALYSIS_CASES = {
+    'replay':      'replay',
+    'report':      'report',
+    'report-task': 'report --task',
+    'graph':       'graph',
+    'dump':        'dump',
+    'dump-chrome': 'dump --chrome',
+    'dump-flame':  'dump --flame-graph',
+    'tui':         'tui',
+}
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description='Run uftrace benchmark suite')
+    parser.add_argument('-u', '--uftrace', default=UFTRACE,
+                        help='path of uftrace binary (default: %(default)s)')
+    parser.add_argument('-L', '--libmcount-path', default=LIBMCOUNT,
+                        help='path of libmcount libraries (default: %(default)s)')
+    parser.add_argument('-p', '--prog', default=PROG,
+                        help='path of bench program (default: %(default)s)')
+    parser.add_argument('-c', '--compiler', default=os.environ.get('CC', 'gcc'),
+                        help='compiler for the -P test program (default: %(default)s)')
+    parser.add_argument('-s', '--size', type=int, default=1000000,
+                        help='number of function calls per thread (default: %(default)s)')
+    parser.add_argument('-t', '--threads', type=int, default=4,
+                        help='number of threads (default: %(default)s)')
+    parser.add_argument('-d', '--depth', type=int, default=20,
+                        help='call depth of recursion (default: %(default)s)')
+    parser.add_argument('-n', '--count', type=int, default=200,
+                        help='number of short-lived threads/processes (default: %(default)s)')
+    parser.add_argument('-r', '--repeat', type=int, default=3,
+                        help='repeat each case and use the minimum (default: %(default)s)')
+    parser.add_argument('-k', '--case', action='append', default=[],
+                        help='only run cases matching this (like record/loop)')
+    parser.add_argument('-o', '--output', help='save the result to the file')
+    parser.add_argument('-b', '--baseline', help='compare the result with the baseline file')
+    parser.add_argument('-T', '--threshold', type=float, default=10.0,
+                        help='regression threshold in percent (default: %(default)s)')
+    parser.add_argument('-v', '--verbose', action='store_true', help='show commands')
+    return parser.parse_args()
+
+
+def selected(opts, name):
+    if not opts.case:
+        return True
+    return any(c in name for c in opts.case)
+
+
+def child_usage():
+    ru = resource.getrusage(resource.RUSAGE_CHILDREN)
+    return (ru.ru_utime, ru.ru_stime)
+
+
+def run_cmd(opts, cmd, tty=False):
+    """ run the command and return (elapsed, user, system) time in seconds """
+    if opts.verbose:
+        print('#', ' '.join(cmd), file=sys.stderr)
+
+    usage = child_usage()
+    start = time.monotonic()
+
+    if tty:
+        ret = run_in_pty(cmd)
+    else:
+        with open(os.devnull, 'w') as null:
+            ret = subprocess.call(cmd, stdout=null, stderr=null)
+
+    elapsed = time.monotonic() - start
+    after = child_usage()
+
+    if ret != 0:
+        return None
+    return (elapsed, after[0] - usage[0], after[1] - usage[1])
+
+
+def run_in_pty(cmd):
+    """ run a TUI command and quit it as soon as it shows the main screen """
+    master, slave = os.openpty()
+    fcntl.ioctl(slave, termios.TIOCSWINSZ, struct.pack('HHHH', 50, 160, 0, 0))
+    env = dict(os.environ, TERM='xterm')
+    proc = subprocess.Popen(cmd, stdin=slave, stdout=slave, stderr=slave, env=env)
+    os.close(slave)
+
+    # the TUI shows the main screen while it's still loading the data,
+    # so this measures the time to the first screen, not the full loading
+    output = b''
+    while proc.poll() is None:
+        try:
+            if b'FUNCTION' in output:
+                os.write(master, b'q')
+            ready, _, _ = select.select([master], [], [], 0.01)
+            if ready:
+                output = output[-256:] + os.read(master, 65536)
+        except OSError:
+            pass
+
+    os.close(master)
+    return proc.returncode
+
+
+def measure(opts, cmd, tty=False, cleanup=None):
+    best = None
+    for _ in range(opts.repeat):
+        if cleanup:
+            cleanup()
+        res = run_cmd(opts, cmd, tty)
+        if res is None:
+            return None
+        if best is None or res[0] < best[0]:
+            best = res
+
+    return {'time': round(best[0], 6), 'user': round(best[1], 6), 'sys': round(best[2], 6)}
+
+
+def data_size(dirname):
+    total = 0
+    for root, _, files in os.walk(dirname):
+        for f in files:
+            total += os.path.getsize(os.path.join(root, f))
+    return total
+
+
+def build_dynamic_prog(opts, tmpdir):
+    """ build the bench program with patchable function entries for -P """
+    src = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'bench.c')
+    prog = os.path.join(tmpdir, 'bench-dynamic')
+    cmd = [opts.compiler, '-O0', '-fpatchable-function-entry=5', '-o', prog, src, '-pthread']
+
+    with open(os.devnull, 'w') as null:
+        if subprocess.call(cmd, stdout=null, stderr=null) != 0:
+            return None
+    return prog
+
+
+def uftrace_cmd(opts, subcmd, dirname, options):
+    cmd = [opts.uftrace, subcmd, '-d', dirname]
+    if subcmd == 'record':
+        cmd += ['--libmcount-path=' + opts.libmcount_path]
+    return cmd + options.split()
+
+
+def run_record(opts, tmpdir, results):
+    params = {'size': opts.size, 'threads': opts.threads,
+              'depth': opts.depth, 'count': opts.count}
+    dirname = os.path.join(tmpdir, 'record.data')
+    dyn_prog = None
+
+    def cleanup():
+        shutil.rmtree(dirname, ignore_errors=True)
+
+    for name, (args, uopts) in RECORD_CASES.items():
+        case = 'record/' + name
+        if not selected(opts, case):
+            continue
+
+        prog = opts.prog
+        if name == 'dynamic':
+            dyn_prog = dyn_prog or build_dynamic_prog(opts, tmpdir)
+            if dyn_prog is None:
+                print('skip %s: cannot build the program' % case, file=sys.stderr)
+                continue
+            prog = dyn_prog
+
+        target = [prog] + args.format(**params).split()
+        base = measure(opts, target)
+        res = measure(opts, uftrace_cmd(opts, 'record', dirname, uopts) + target,
+                      cleanup=cleanup)
+        if res is None or base is None:
+            print('skip %s: failed to run' % case, file=sys.stderr)
+            continue
+
+        res['baseline'] = base['time']
+        res['overhead'] = round(res['time'] / base['time'], 3) if base['time'] else 0
+        res['size'] = data_size(dirname)
+        results[case] = res
+        cleanup()
+
+
+def run_analysis(opts, tmpdir, results):
+    names = ['analysis/' + n for n in ANALYSIS_CASES]
+    if not any(selected(opts, n) for n in names):
+        return
+
+    # synthetic trace with the given thread count and depth
+    dirname = os.path.join(tmpdir, 'analysis.data')
+    target = [opts.prog, '-w', 'recursion', '-t', str(opts.threads),
+              '-d', str(opts.depth), '1', str(opts.size)]
+    if run_cmd(opts, uftrace_cmd(opts, 'record', dirname, '') + target) is None:
+        print('skip analysis: failed to record', file=sys.stderr)
+        return
+
+    for name, cmd in ANALYSIS_CASES.items():
+        case = 'analysis/' + name
+        if not selected(opts, case):
+            continue
+
+        subcmd, _, options = cmd.partition(' ')
+        res = measure(opts, uftrace_cmd(opts, subcmd, dirname, options), tty=(subcmd == 'tui'))
+        if res is None:
+            print('skip %s: failed to run' % case, file=sys.stderr)
+            continue
+        results[case] = res
+
+
+def compare(opts, result):
+    """ print the difference from the baseline and return number of regressions """
+    with open(opts.baseline) as f:
+        baseline = json.load(f)
+
+    regressions = 0
+    print('%-24s %12s %12s %9s' % ('Case', 'Baseline', 'Current', 'Diff'), file=sys.stderr)
+    for case, res in sorted(result['results'].items()):
+        old = baseline.get('results', {}).get(case)
+        if old is None or not old['time']:
+            continue
+
+        diff = (res['time'] - old['time']) * 100.0 / old['time']
+        mark = ''
+        if diff > opts.threshold:
+            mark = '  REGRESSION'
+            regressions += 1
+        print('%-24s %10.3f s %10.3f s %+8.2f%%%s' %
+              (case, old['time'], res['time'], diff, mark), file=sys.stderr)
+
+    return regressions
+
+
+def main():
+    opts = parse_args()
+    results = {}
+    tmpdir = tempfile.mkdtemp(prefix='uftrace-bench-')
+
+    try:
+        run_record(opts, tmpdir, results)
+        run_analysis(opts, tmpdir, results)
+    finally:
+        shutil.rmtree(tmpdir, ignore_errors=True)
+
+    result = {
+        'date': time.strftime('%Y-%m-%dT%H:%M:%S'),
+        'host': platform.node(),
+        'machine': platform.machine(),
+        'params': {'size': opts.size, 'threads': opts.threads, 'depth': opts.depth,
+                   'count': opts.count, 'repeat': opts.repeat},
+        'results': results,
+    }
+
+    text = json.dumps(result, indent=2, sort_keys=True)
+    print(text)
+    if opts.output:
+        with open(opts.output, 'w') as f:
+            f.write(text + '\n')
+
+    if opts.baseline and compare(opts, result) > 0:
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
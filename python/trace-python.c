@@ -6,6 +6,9 @@
  * Released under the GPL v2.
  */
 #include <Python.h>
+#if PY_VERSION_HEX < 0x03090000
+#include <frameobject.h>
+#endif
 
 #include <fcntl.h>
 #include <stdint.h>
@@ -28,6 +31,12 @@ static PyObject *uftrace_func __attribute__((unused));
 /* RB tree of python_symbol to map code object to address */
 static struct rb_root code_tree = RB_ROOT;
 
+/* code objects can keep the address in the extra field (since python 3.6) */
+#if PY_VERSION_HEX >= 0x03060000
+#define HAVE_CODE_EXTRA
+static Py_ssize_t code_extra_index = -1;
+#endif
+
 /* initial size of the symbol table and unit size for increment */
 #define UFTRACE_PYTHON_SYMTAB_SIZE (1 * 1024 * 1024)
 
@@ -81,9 +90,14 @@ static void (*cygprof_exit)(unsigned long child, unsigned long parent);
 /* main trace function to be called from python interpreter */
 static PyObject *uftrace_trace_python(PyObject *self, PyObject *args);
 
+/* install the native profile function to the interpreter */
+static PyObject *uftrace_setprofile(PyObject *self, PyObject *unused);
+
 static __attribute__((used)) PyMethodDef uftrace_py_methods[] = {
 	{ "trace", uftrace_trace_python, METH_VARARGS,
 	  PyDoc_STR("trace python function with uftrace.") },
+	{ "setprofile", uftrace_setprofile, METH_NOARGS,
+	  PyDoc_STR("set native profile function to trace python functions with uftrace.") },
 	{ NULL, NULL, 0, NULL },
 };
 
@@ -366,6 +380,11 @@ PyMODINIT_FUNC PyInit_uftrace_python(void)
 
 	skip_first_frame = true;
 
+#ifdef HAVE_CODE_EXTRA
+	/* the extra field has just an address, nothing to free */
+	code_extra_index = _PyEval_RequestCodeExtraIndex(NULL);
+#endif
+
 	init_uftrace();
 	return m;
 }
@@ -472,32 +491,33 @@ static char *get_c_funcname(PyObject *frame, PyObject *code)
 	return func_name;
 }
 
-static unsigned long convert_function_addr(PyObject *frame, PyObject *args, bool is_pyfunc)
+static PyObject *get_frame_code(PyFrameObject *frame)
+{
+#if PY_VERSION_HEX >= 0x03090000
+	PyCodeObject *code = PyFrame_GetCode(frame);
+
+	/* the frame still has a reference */
+	Py_DECREF(code);
+	return (PyObject *)code;
+#else
+	return (PyObject *)frame->f_code;
+#endif
+}
+
+static unsigned long find_code_addr(PyObject *frame, PyObject *code, bool is_pyfunc)
 {
 	struct rb_node *parent = NULL;
 	struct rb_node **p = &code_tree.rb_node;
 	struct uftrace_python_symbol *iter, *new;
-	PyObject *code;
 	char *func_name;
 
-	code = PyObject_GetAttrString(frame, "f_code");
-	if (code == NULL)
-		return 0;
-
-	if (!is_pyfunc) {
-		code = args;
-		Py_INCREF(code);
-	}
-
 	while (*p) {
 		parent = *p;
 		iter = rb_entry(parent, struct uftrace_python_symbol, node);
 
 		/* just compare pointers of the code object */
-		if (iter->code == code) {
-			Py_DECREF(code);
+		if (iter->code == code)
 			return iter->addr;
-		}
 
 		if (iter->code < code)
 			p = &parent->rb_left;
@@ -519,6 +539,7 @@ static unsigned long convert_function_addr(PyObject *frame, PyObject *args, bool
 	free(func_name);
 
 	/* keep the refcount of the code object to keep it alive */
+	Py_INCREF(code);
 
 	rb_link_node(&new->node, parent, p);
 	rb_insert_color(&new->node, &code_tree);
@@ -527,38 +548,108 @@ static unsigned long convert_function_addr(PyObject *frame, PyObject *args, bool
 }
 
 /*
- * This is the actual trace function to be called for each python event.
+ * The code argument is a code object for python functions, or a C function
+ * object for builtins.  Python code objects save the address in the extra
+ * field so that it doesn't need to search the tree.  It's released together
+ * with the code object so no need to keep the reference.
  */
-static PyObject *uftrace_trace_python(PyObject *self, PyObject *args)
+static unsigned long convert_function_addr(PyObject *frame, PyObject *code, bool is_pyfunc)
 {
-	PyObject *frame, *args_tuple;
-	static PyObject *first_frame;
-	const char *event;
+#ifdef HAVE_CODE_EXTRA
+	if (is_pyfunc && code_extra_index >= 0) {
+		void *extra = NULL;
+		unsigned long addr;
+		char *func_name;
 
-	if (!PyArg_ParseTuple(args, "OsO", &frame, &event, &args_tuple))
-		Py_RETURN_NONE;
+		if (_PyCode_GetExtra(code, code_extra_index, &extra) < 0)
+			return 0;
+		if (extra)
+			return (unsigned long)extra;
+
+		func_name = get_python_funcname(frame, code);
+		if (func_name == NULL)
+			return 0;
+
+		addr = get_new_sym_addr(func_name, true);
+		free(func_name);
+
+		_PyCode_SetExtra(code, code_extra_index, (void *)addr);
+		return addr;
+	}
+#endif
+	return find_code_addr(frame, code, is_pyfunc);
+}
+
+/*
+ * This is the native profile function called by the interpreter for each
+ * python event.  It gets the event as an integer and the frame object
+ * directly so it doesn't need to parse arguments.
+ */
+static int uftrace_profile(PyObject *obj, PyFrameObject *frame, int what, PyObject *arg)
+{
+	static PyFrameObject *first_frame;
+	unsigned long addr;
 
 	if (first_frame == NULL)
 		first_frame = frame;
 	/* skip the first frame: builtins.exec() */
 	if (skip_first_frame && frame == first_frame)
-		Py_RETURN_NONE;
-
-	if (!strcmp(event, "call") || !strcmp(event, "c_call")) {
-		unsigned long addr;
-		bool is_pyfunc = !strcmp(event, "call");
+		return 0;
 
-		addr = convert_function_addr(frame, args_tuple, is_pyfunc);
+	switch (what) {
+	case PyTrace_CALL:
+		addr = convert_function_addr((PyObject *)frame, get_frame_code(frame), true);
 		cygprof_enter(addr, 0);
-	}
-	else if (!strcmp(event, "return") || !strcmp(event, "c_return")) {
-		cygprof_exit(0, 0);
-	}
-	else if (!strcmp(event, "c_exception")) {
-		/* C code exception doesn't generate c_return */
+		break;
+	case PyTrace_C_CALL:
+		addr = convert_function_addr((PyObject *)frame, arg, false);
+		cygprof_enter(addr, 0);
+		break;
+	case PyTrace_RETURN:
+	case PyTrace_C_RETURN:
+	/* C code exception doesn't generate c_return */
+	case PyTrace_C_EXCEPTION:
 		cygprof_exit(0, 0);
+		break;
+	default:
+		break;
 	}
+	return 0;
+}
+
+static PyObject *uftrace_setprofile(PyObject *self, PyObject *unused)
+{
+	PyEval_SetProfile(uftrace_profile, NULL);
+	Py_RETURN_NONE;
+}
+
+/*
+ * This is the trace function to be called from python (sys.setprofile).
+ * It's kept for compatibility; uftrace_setprofile() is much faster.
+ */
+static PyObject *uftrace_trace_python(PyObject *self, PyObject *args)
+{
+	PyObject *frame, *args_tuple;
+	const char *event;
+	int what;
 
+	if (!PyArg_ParseTuple(args, "OsO", &frame, &event, &args_tuple))
+		Py_RETURN_NONE;
+
+	if (!strcmp(event, "call"))
+		what = PyTrace_CALL;
+	else if (!strcmp(event, "c_call"))
+		what = PyTrace_C_CALL;
+	else if (!strcmp(event, "return"))
+		what = PyTrace_RETURN;
+	else if (!strcmp(event, "c_return"))
+		what = PyTrace_C_RETURN;
+	else if (!strcmp(event, "c_exception"))
+		what = PyTrace_C_EXCEPTION;
+	else
+		return get_trace_function();
+
+	uftrace_profile(self, (PyFrameObject *)frame, what, args_tuple);
 	return get_trace_function();
 }
 
@@ -580,10 +671,18 @@ static PyObject *uftrace_trace_python(PyObject *self, PyObject *args)
 	/* just to suppress compiler warnings */
 	skip_first_frame = false;
 	code_tree = code_tree;
+#ifdef HAVE_CODE_EXTRA
+	code_extra_index = code_extra_index;
+#endif
 
 	return NULL;
 }
 
+static PyObject *uftrace_setprofile(PyObject *self, PyObject *unused)
+{
+	return NULL;
+}
+
 TEST_CASE(python_symtab)
 {
 	char buf[32];
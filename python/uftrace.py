@@ -19,6 +19,6 @@ else:
             continue
 
 code = open(sys.argv[0]).read()
-sys.setprofile(uftrace_python.trace)
+uftrace_python.setprofile()
 exec(code)
 sys.setprofile(None)
@@ -0,0 +1,36 @@
+--
+-- batch.lua : count function calls and total time using uftrace_batch()
+--
+--  $ uftrace script -S scripts/batch.lua
+--
+local ENTRY = 0
+local EXIT = 1
+
+local calls = {}
+local total = {}
+
+function uftrace_batch(batch)
+    local names = batch['names']
+    local recs = batch['records']
+
+    -- records is a FFI array indexed from 0
+    for i = 0, batch['count'] - 1 do
+        local name = names[recs[i].name_id]
+        if recs[i].type == ENTRY then
+            calls[name] = (calls[name] or 0) + 1
+        elseif recs[i].type == EXIT then
+            total[name] = (total[name] or 0) + tonumber(recs[i].duration)
+        end
+    end
+end
+
+function uftrace_end()
+    local list = {}
+    for name in pairs(calls) do
+        table.insert(list, name)
+    end
+    table.sort(list)
+    for _, name in ipairs(list) do
+        print(string.format('%-20s %6d', name, calls[name]))
+    end
+end
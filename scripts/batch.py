@@ -0,0 +1,30 @@
+#
+# batch.py : count function calls and total time using uftrace_batch()
+#
+#  $ uftrace script -S scripts/batch.py
+#
+import struct
+
+ENTRY = 0
+EXIT = 1
+
+calls = {}
+total = {}
+
+def uftrace_batch(batch):
+    names = batch["names"]
+    fmt = batch["format"]
+    size = struct.calcsize(fmt)
+    recs = batch["records"]
+
+    for i in range(batch["count"]):
+        (ts, dur, addr, tid, depth, rtype, name_id) = struct.unpack_from(fmt, recs, i * size)
+        name = names[name_id]
+        if rtype == ENTRY:
+            calls[name] = calls.get(name, 0) + 1
+        elif rtype == EXIT:
+            total[name] = total.get(name, 0) + dur
+
+def uftrace_end():
+    for name in sorted(calls):
+        print("%-20s %6d" % (name, calls[name]))
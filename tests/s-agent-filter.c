@@ -0,0 +1,26 @@
+/*
+ *  This is a test to change the filters through the agent.
+ */
+
+#include <stdio.h>
+
+int foo(int n)
+{
+	return n + 1;
+}
+
+int bar(int n)
+{
+	return foo(n) * 2;
+}
+
+int main(int argc, char *argv[])
+{
+	int n = 0;
+
+	/* call the functions for each character */
+	while (getchar() != EOF)
+		n = bar(n);
+
+	return n > 0 ? 0 : 1;
+}
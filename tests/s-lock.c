@@ -0,0 +1,57 @@
+#include <pthread.h>
+#include <unistd.h>
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static volatile int step;
+
+static void wait_step(int n)
+{
+	while (step < n)
+		continue;
+}
+
+static void *holder(void *arg)
+{
+	pthread_mutex_lock(&mutex);
+	pthread_rwlock_wrlock(&rwlock);
+	step = 1;
+
+	/* release the lock after the main thread tries to get it */
+	wait_step(2);
+	usleep(50 * 1000);
+	pthread_mutex_unlock(&mutex);
+
+	wait_step(3);
+	usleep(50 * 1000);
+	pthread_rwlock_unlock(&rwlock);
+	return NULL;
+}
+
+static void lock_mutex(void)
+{
+	pthread_mutex_lock(&mutex);
+	pthread_mutex_unlock(&mutex);
+}
+
+static void lock_read(void)
+{
+	pthread_rwlock_rdlock(&rwlock);
+	pthread_rwlock_unlock(&rwlock);
+}
+
+int main(void)
+{
+	pthread_t th;
+
+	pthread_create(&th, NULL, holder, NULL);
+
+	wait_step(1);
+	step = 2;
+	lock_mutex();
+	step = 3;
+	lock_read();
+
+	pthread_join(th, NULL);
+	return 0;
+}
@@ -0,0 +1,46 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'sort', """
+       Calls   Total std   Total p99  Function
+  ==========  ==========  ==========  ====================
+           1               11.173 ms  main
+           1               10.467 ms  bar
+           1               10.297 ms  usleep
+           2    0.291 us  103.939 us  foo
+           6    0.714 us   34.815 us  loop
+           1                0.763 us  __monstartup
+           1                0.299 us  __cxa_atexit
+""")
+
+    def prepare(self):
+        self.subcmd = 'record'
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'report'
+        self.option = '-f call,total-p99,total-stddev -s total_p99'
+
+    def sort(self, output):
+        """ This function post-processes output of the test to be compared .
+            It ignores blank and comment (#) lines and remaining functions.  """
+        result = []
+        for ln in output.split('\n'):
+            if ln.strip() == '':
+                continue
+            line = ln.split()
+            if line[0] == 'Calls':
+                continue
+            if line[0].startswith('='):
+                continue
+            # A report line consists of following data
+            # [0]     [1]          [2]   [3]       [4]   [5]
+            # called  stddev_time  unit  p99_time  unit  function
+            if line[-1].startswith('__'):
+                continue
+            result.append('%s %s' % (line[0], line[-1]))
+
+        return '\n'.join(result)
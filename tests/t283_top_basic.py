@@ -0,0 +1,36 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+# total: 0.0 sec, 1 task(s), 5 call(s), 5000.0 calls/sec
+  Total time   Self time       Calls     Calls/s   Total avg   Total p99  Function
+  ==========  ==========  ==========  ==========  ==========  ==========  ====================
+    1.577 us    0.210 us           1      5000.0    1.577 us    1.577 us  main
+    1.367 us    0.205 us           1      5000.0    1.367 us    1.367 us  a
+    1.162 us    0.431 us           1      5000.0    1.162 us    1.162 us  b
+    0.731 us    0.311 us           1      5000.0    0.731 us    0.731 us  c
+    0.420 us    0.420 us           1      5000.0    0.420 us    0.420 us  getpid
+""")
+
+    def setup(self):
+        self.subcmd = 'top'
+
+    def sort(self, output):
+        """ This function post-processes output of the test to be compared.
+            It ignores header lines and shows calls and function names only. """
+        result = []
+        for ln in output.split('\n'):
+            line = ln.split()
+            if len(line) == 0 or line[0] == '#' or line[0] == 'Total':
+                continue
+            if line[0].startswith('='):
+                continue
+            # [0] total [2] self [4] calls [5] rate [6] avg [8] p99 [10] function
+            if line[-1].startswith('__'):
+                continue
+            result.append('%s %s' % (line[4], line[-1]))
+
+        return '\n'.join(sorted(result))
@@ -0,0 +1,23 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+# DURATION     TID     FUNCTION
+   0.508 us [ 32537] | __monstartup();
+   0.187 us [ 32537] | __cxa_atexit();
+            [ 32537] | main() {
+            [ 32537] |   a() {
+            [ 32537] |     b() {
+            [ 32537] |       c() {
+   0.385 us [ 32537] |         getpid();
+   0.776 us [ 32537] |       } /* c */
+   1.105 us [ 32537] |     } /* b */
+   1.351 us [ 32537] |   } /* a */
+   1.706 us [ 32537] | } /* main */
+""")
+
+    def setup(self):
+        self.option = '--stream'
@@ -0,0 +1,27 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'fork', """
+  Total time   Self time       Calls  Function
+  ==========  ==========  ==========  ====================================
+   10.126 us    0.549 us           2  a
+    9.577 us    0.576 us           2  b
+    9.001 us    1.520 us           2  c
+  609.148 us  361.005 us           2  fork
+    7.481 us    7.481 us           2  getpid
+    1.233 ms   24.570 us           2  main
+    0.926 us    0.926 us           1  __cxa_atexit
+    1.723 us    1.723 us           1  __monstartup
+  612.051 us   26.644 us           1  wait
+""", sort='report')
+
+    def prepare(self):
+        self.subcmd = 'record'
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'report'
+        self.option = '--low-memory -s call,func'
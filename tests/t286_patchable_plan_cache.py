@@ -0,0 +1,50 @@
+#!/usr/bin/env python
+
+import glob
+
+from runtest import TestBase
+
+CACHE = 'patch-cache'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+# DURATION     TID     FUNCTION
+            [ 54963] | main() {
+            [ 54963] |   a() {
+   1.297 us [ 54963] |     c();
+   4.376 us [ 54963] |   } /* a */
+   5.484 us [ 54963] | } /* main */
+""")
+
+    def build(self, name, cflags='', ldflags=''):
+        cflags = self.strip_tracing_flags(cflags)
+
+        # add patchable function entry option
+        machine = TestBase.get_machine(self)
+        if machine == 'x86_64':
+            cflags += ' -fpatchable-function-entry=5'
+        elif machine == 'aarch64':
+            cflags += ' -fpatchable-function-entry=2'
+
+        return TestBase.build(self, name, cflags, ldflags)
+
+    def prerun(self, timeout):
+        if not TestBase.check_arch_full_dynamic_support(self):
+            return TestBase.TEST_SKIP
+        return TestBase.prerun(self, timeout)
+
+    def prepare(self):
+        # save the patch plan, and the test will use it
+        self.subcmd = 'record'
+        self.option = '-P . -U b --no-libcall --patch-cache=' + CACHE
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'live'
+        self.option = '-P . -U b --no-libcall --patch-cache=' + CACHE
+
+    def postrun(self, ret):
+        if len(glob.glob(CACHE + '/*.plan')) != 1:
+            return TestBase.TEST_DIFF_RESULT
+        return ret
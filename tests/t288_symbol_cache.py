@@ -0,0 +1,37 @@
+#!/usr/bin/env python
+
+import glob
+
+from runtest import TestBase
+
+CACHE = 'symbol-cache'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+# DURATION     TID     FUNCTION
+            [ 28141] | main() {
+            [ 28141] |   a() {
+            [ 28141] |     b() {
+            [ 28141] |       c() {
+   0.753 us [ 28141] |         getpid();
+   1.430 us [ 28141] |       } /* c */
+   1.915 us [ 28141] |     } /* b */
+   2.405 us [ 28141] |   } /* a */
+   3.005 us [ 28141] | } /* main */
+""")
+
+    def prepare(self):
+        # save the symbol tables, and the test will use them
+        self.subcmd = 'record'
+        self.option = '--symbol-cache=' + CACHE
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'live'
+        self.option = '--symbol-cache=' + CACHE
+
+    def postrun(self, ret):
+        if len(glob.glob(CACHE + '/*.symtab')) == 0:
+            return TestBase.TEST_DIFF_RESULT
+        return ret
@@ -0,0 +1,41 @@
+#!/usr/bin/env python
+
+import glob
+import os
+
+from runtest import TestBase
+
+STORE = 'symbol-store'
+TDIR = 'uftrace.data'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+# DURATION     TID     FUNCTION
+            [ 28141] | main() {
+            [ 28141] |   a() {
+            [ 28141] |     b() {
+            [ 28141] |       c() {
+   0.753 us [ 28141] |         getpid();
+   1.430 us [ 28141] |       } /* c */
+   1.915 us [ 28141] |     } /* b */
+   2.405 us [ 28141] |   } /* a */
+   3.005 us [ 28141] | } /* main */
+""")
+
+    def prepare(self):
+        self.subcmd = 'record'
+        self.option = '--symbol-store=' + STORE
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'replay'
+        self.option = ''
+
+    def postrun(self, ret):
+        symfiles = glob.glob(TDIR + '/*.sym')
+        if len(symfiles) == 0 or not all(os.path.islink(f) for f in symfiles):
+            return TestBase.TEST_DIFF_RESULT
+        if len(glob.glob(STORE + '/*.sym')) == 0:
+            return TestBase.TEST_DIFF_RESULT
+        return ret
@@ -0,0 +1,60 @@
+#!/usr/bin/env python
+
+import subprocess as sp
+from time import sleep
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'agent-filter', """
+# DURATION     TID     FUNCTION
+            [ 28141] | main() {
+  50.164 ms [ 28141] |   getchar();
+            [ 28141] |   bar() {
+   0.215 us [ 28141] |     foo();
+   1.032 us [ 28141] |   } /* bar */
+  51.376 ms [ 28141] |   getchar();
+   0.344 us [ 28141] |   bar();
+  51.420 ms [ 28141] |   getchar();
+            [ 28141] |   bar() {
+   0.187 us [ 28141] |     foo();
+   0.703 us [ 28141] |   } /* bar */
+  50.998 ms [ 28141] |   getchar();
+ 204.385 ms [ 28141] | } /* main */
+""")
+
+    def prerun(self, timeout):
+        self.subcmd = 'record'
+        self.option = '--keep-pid -g'
+        self.exearg = 't-' + self.name
+        record_cmd  = self.runcmd()
+        self.pr_debug("prerun command: " + record_cmd)
+        record_p = sp.Popen(record_cmd.split(), stdin=sp.PIPE, stdout=sp.PIPE, stderr=sp.PIPE)
+
+        sleep(.05)              # time for the agent to start
+
+        client_ret = 0
+        for opts in ['-N foo', '--remove -N foo']:
+            record_p.stdin.write(b'x')
+            record_p.stdin.flush()
+            sleep(.05)          # time for the target to call the functions
+
+            self.subcmd = 'live'
+            self.option = '-p %d %s' % (record_p.pid, opts)
+            self.exearg = ''
+            client_cmd = self.runcmd()
+            self.pr_debug('prerun command: ' + client_cmd)
+            client_ret |= sp.call(client_cmd.split())
+
+        record_p.communicate(b"x") # target waits for a char to end
+        record_p.wait()
+
+        if client_ret != 0:
+            return TestBase.TEST_NONZERO_RETURN
+        return TestBase.TEST_SUCCESS
+
+    def setup(self):
+        self.subcmd = 'replay'
+        self.option = ''
+        self.exearg = ''
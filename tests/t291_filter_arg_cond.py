@@ -0,0 +1,21 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'exp-int', result="""
+# DURATION    TID     FUNCTION
+   0.371 ms [18270] | int_add(-1, 2);
+   0.118 ms [18270] | int_sub(1, 2);
+""", sort='simple')
+
+    def build(self, name, cflags='', ldflags=''):
+        # cygprof doesn't support arguments now
+        if cflags.find('-finstrument-functions') >= 0:
+            return TestBase.TEST_SKIP
+
+        return TestBase.build(self, name, cflags, ldflags)
+
+    def setup(self):
+        self.option = '-A "^int_@arg1/i8,arg2/i16" -F "^int_@if=arg2/i16>=2,if=arg2/i16<4"'
@@ -0,0 +1,34 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'allocfree', """
+       Count       Bytes       Freed        Live        Peak  Function
+  ==========  ==========  ==========  ==========  ==========  ====================
+           1           1           1           0           1  alloc5
+
+       Count  Size
+  ==========  ====================
+           1  1
+""")
+
+    def prepare(self):
+        self.subcmd = 'record'
+        self.option = '--alloc-profile'
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'report'
+        self.option = '--alloc'
+
+    def sort(self, output):
+        """ This function post-processes output of the test to be compared .
+            It ignores allocations not from the test program itself.  """
+        result = []
+        for ln in output.split('\n'):
+            line = ln.split()
+            if len(line) == 6 and line[5].startswith('alloc'):
+                result.append(ln)
+        return '\n'.join(result)
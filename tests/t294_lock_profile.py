@@ -0,0 +1,38 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'lock', ldflags='-pthread', result="""
+       Waits       Total         Avg         Max  Type    Lock
+  ==========  ==========  ==========  ==========  ======  ==================
+           1   50.067 ms   50.067 ms   50.067 ms  mutex   0x55d5c2e8f040
+           1   50.082 ms   50.082 ms   50.082 ms  rdlock  0x55d5c2e8f080
+
+       Waits       Total         Avg         Max  Function
+  ==========  ==========  ==========  ==========  ====================
+           1   50.067 ms   50.067 ms   50.067 ms  lock_mutex
+           1   50.082 ms   50.082 ms   50.082 ms  lock_read
+""")
+
+    def prepare(self):
+        self.subcmd = 'record'
+        self.option = '--lock-profile'
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'report'
+        self.option = '--lock'
+
+    def sort(self, output):
+        """ This function post-processes output of the test to be compared .
+            It ignores times and addresses which can be changed.  """
+        result = []
+        for ln in output.split('\n'):
+            line = ln.split()
+            if len(line) == 9 and line[7] in ['mutex', 'rdlock']:
+                result.append('%s %s' % (line[0], line[7]))
+            elif len(line) == 8 and line[7].startswith('lock_'):
+                result.append('%s %s' % (line[0], line[7]))
+        return '\n'.join(sorted(result))
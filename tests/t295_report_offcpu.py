@@ -0,0 +1,49 @@
+#!/usr/bin/env python
+
+import subprocess as sp
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'sort', serial=True, result="""
+     Blocked  Function
+  ==========  ====================================
+   10.088 ms  main
+   10.088 ms  bar
+   10.088 ms  usleep
+   10.088 ms  linux:schedule
+              foo
+              loop
+""")
+
+    def prerun(self, timeout):
+        if not TestBase.check_dependency(self, 'perf_context_switch'):
+            return TestBase.TEST_SKIP
+        if not TestBase.check_perf_paranoid(self):
+            return TestBase.TEST_SKIP
+
+        self.subcmd = 'record'
+        self.option = '-E linux:schedule'
+        record_cmd = TestBase.runcmd(self)
+        self.pr_debug('prerun command: ' + record_cmd)
+        sp.call(record_cmd.split())
+        return TestBase.TEST_SUCCESS
+
+    def setup(self):
+        self.subcmd = 'report'
+        self.option = '-E linux:schedule -f blocked -s blocked'
+
+    def runcmd(self):
+        cmd = TestBase.runcmd(self)
+        return cmd.replace('--no-event', '')
+
+    def sort(self, output):
+        """ This function post-processes output of the test to be compared .
+            It only keeps functions blocked by the context switch.  """
+        result = []
+        for ln in output.split('\n'):
+            line = ln.split()
+            if len(line) == 3 and line[1] != 'Function' and not line[2].startswith('__'):
+                result.append(line[2])
+        return '\n'.join(sorted(result))
@@ -0,0 +1,38 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'lock', ldflags='-pthread', result="""
+       Waits       Total         Avg         Max  Type    Lock
+  ==========  ==========  ==========  ==========  ======  ==================
+           1   50.067 ms   50.067 ms   50.067 ms  mutex   0x55d5c2e8f040
+           1   50.082 ms   50.082 ms   50.082 ms  rdlock  0x55d5c2e8f080
+
+       Waits       Total         Avg         Max  Function
+  ==========  ==========  ==========  ==========  ====================
+           2  100.149 ms   50.074 ms   50.082 ms  main
+""")
+
+    def prepare(self):
+        # the lock functions are called deeper than the max stack
+        self.subcmd = 'record'
+        self.option = '--lock-profile --max-stack=1'
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'report'
+        self.option = '--lock'
+
+    def sort(self, output):
+        """ This function post-processes output of the test to be compared .
+            It ignores times and addresses which can be changed.  """
+        result = []
+        for ln in output.split('\n'):
+            line = ln.split()
+            if len(line) == 9 and line[7] in ['mutex', 'rdlock']:
+                result.append('%s %s' % (line[0], line[7]))
+            elif len(line) == 8 and line[7] == 'main':
+                result.append('%s %s' % (line[0], line[7]))
+        return '\n'.join(sorted(result))
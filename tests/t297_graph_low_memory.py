@@ -0,0 +1,33 @@
+#!/usr/bin/env python
+
+from runtest import TestBase
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'fork', result="""
+# Function Call Graph for 'main' (session: 0e5eed9b7b5eedcb)
+=============== BACKTRACE ===============
+ backtrace #0: hit 1, time 619.605 us
+   [0] main (0x5563accd0264)
+
+========== FUNCTION CALL GRAPH ==========
+# TOTAL TIME   FUNCTION
+  619.605 us : (1) main
+  155.676 us :  +-(1) fork
+             :  |
+  444.336 us :  +-(1) wait
+             :  |
+    1.818 us :  +-(1) a
+    1.535 us :    (1) b
+    1.287 us :    (1) c
+    0.864 us :    (1) getpid
+""", sort='graph')
+
+    def prepare(self):
+        self.subcmd = 'record'
+        return self.runcmd()
+
+    def setup(self):
+        self.subcmd = 'graph'
+        self.option = '--low-memory'
+        self.exearg = 'main'
@@ -0,0 +1,88 @@
+#!/usr/bin/env python
+
+import struct
+import subprocess as sp
+
+from runtest import TestBase
+
+TDIR='xxx'
+
+class TestCase(TestBase):
+    def __init__(self):
+        TestBase.__init__(self, 'abc', """
+magic: ARROW1
+fields: tid timestamp duration depth type function module args
+rows: 10
+""")
+
+    def prerun(self, timeout):
+        record_cmd = '%s record -d %s -F main %s %s %s' \
+                        % (TestBase.uftrace_cmd, TDIR, TestBase.default_opt, self.p_flag, 't-' + self.name)
+        sp.call(record_cmd.split())
+        return TestBase.TEST_SUCCESS
+
+    def runcmd(self):
+        # the output is binary, convert it to hex to check it in sort()
+        return '%s dump -d %s --arrow=- | od -An -v -tx1' % (TestBase.uftrace_cmd, TDIR)
+
+    def post(self, ret):
+        sp.call(['rm', '-rf', TDIR])
+        return ret
+
+    def sort(self, output):
+        """ This function parses the Arrow IPC file in the hex dump and
+            shows the magic, the schema fields and the number of rows.  """
+        try:
+            data = bytes.fromhex(output)
+        except ValueError:
+            return output.strip()  # expected result
+
+        def u16(pos):
+            return struct.unpack_from('<H', data, pos)[0]
+
+        def u32(pos):
+            return struct.unpack_from('<I', data, pos)[0]
+
+        def table(pos):
+            return pos + u32(pos)
+
+        def field(tbl, idx):
+            vtable = tbl - struct.unpack_from('<i', data, tbl)[0]
+            if 4 + idx * 2 >= u16(vtable):
+                return 0
+            off = u16(vtable + 4 + idx * 2)
+            return tbl + off if off else 0
+
+        def string(pos):
+            pos = table(pos)
+            return data[pos + 4:pos + 4 + u32(pos)].decode()
+
+        if len(data) < 16 or data[:6] != b'ARROW1' or data[-6:] != b'ARROW1':
+            return 'invalid magic'
+
+        result = ['magic: ARROW1']
+        rows = 0
+        pos = 8
+        while pos + 8 <= len(data) and u32(pos) == 0xffffffff:
+            meta_len = u32(pos + 4)
+            if meta_len == 0:
+                break
+            msg = table(pos + 8)
+            header_type = data[field(msg, 1)]
+            header = table(field(msg, 2))
+            body_len = struct.unpack_from('<q', data, field(msg, 3))[0] if field(msg, 3) else 0
+
+            if header_type == 1:  # Schema
+                vec = table(field(header, 1))
+                names = []
+                for i in range(u32(vec)):
+                    fld = table(vec + 4 + i * 4)
+                    names.append(string(field(fld, 0)))
+                result.append('fields: ' + ' '.join(names))
+            elif header_type == 3:  # RecordBatch
+                rows += struct.unpack_from('<q', data, field(header, 0))[0]
+
+            pos += 8 + meta_len + body_len
+
+        result.append('rows: %d' % rows)
+        return '\n'.join(result)
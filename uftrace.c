@@ -32,6 +32,7 @@
 
 #include "uftrace.h"
 #include "utils/script.h"
+#include "utils/selfstat.h"
 #include "utils/utils.h"
 #include "version.h"
 
@@ -105,6 +106,23 @@ enum uftrace_short_options {
 	OPT_mermaid,
 	OPT_library_path,
 	OPT_loc_filter,
+	OPT_arrow,
+	OPT_interval,
+	OPT_stream,
+	OPT_low_memory,
+	OPT_compensate,
+	OPT_self_stat,
+	OPT_patch_cache,
+	OPT_patch_async,
+	OPT_symbol_cache,
+	OPT_symbol_store,
+	OPT_pack,
+	OPT_trace,
+	OPT_remove,
+	OPT_alloc,
+	OPT_alloc_profile,
+	OPT_lock,
+	OPT_lock_profile,
 };
 
 /* clang-format off */
@@ -124,20 +142,25 @@ __used static const char uftrace_usage[] =
 "   graph           Show function call graph in the trace data\n"
 "   script          Run a script for recorded trace data\n"
 "   tui             Show text user interface for graph and report\n"
+"   top             Show live function statistics of a running program\n"
 "\n";
 
 __used static const char uftrace_help[] =
 " OPTION:\n"
+"      --alloc                Show heap allocation profile instead\n"
+"      --alloc-profile[=N]    Profile heap allocations (and sample every N-th)\n"
 "      --avg-self             Show average/min/max of self function time\n"
 "      --avg-total            Show average/min/max of total function time\n"
 "  -a, --auto-args            Show arguments and return value of known functions\n"
 "  -A, --argument=FUNC@arg[,arg,...]\n"
 "                             Show function arguments\n"
+"      --arrow=FILE           Dump recorded data to FILE in Apache Arrow format\n"
 "  -b, --buffer=SIZE          Size of tracing buffer (default: "
 	stringify(SHMEM_BUFFER_SIZE_KB) "K)\n"
 "      --chrome               Dump recorded data in chrome trace format\n"
 "      --clock                Set clock source for timestamp (default: mono)\n"
 "      --color=SET            Use color for output: yes, no, auto (default: auto)\n"
+"      --compensate           Subtract tracing overhead from function durations\n"
 "      --column-offset=DEPTH  Offset of each column (default: "
 	stringify(OPT_COLUMN_OFFSET) ")\n"
 "      --column-view          Print tasks in separate columns\n"
@@ -163,6 +186,8 @@ __used static const char uftrace_help[] =
 "  -g  --agent                Start an agent in mcount to listen to commands\n"
 "      --graphviz             Dump recorded data in DOT format\n"
 "  -H, --hide=FUNC            Hide FUNCs from trace\n"
+"      --interval=TIME        Refresh interval of top (default: 1s)\n"
+"                             or reorder window of live --stream (default: 100ms)\n"
 "      --host=HOST            Send trace data to HOST instead of write to file\n"
 "  -k, --kernel               Trace kernel functions also (if supported)\n"
 "      --keep-pid             Keep same pid during execution of traced program\n"
@@ -173,7 +198,10 @@ __used static const char uftrace_help[] =
 "  -K, --kernel-depth=DEPTH   Trace kernel functions within DEPTH\n"
 "      --libmcount-single     Use single thread version of libmcount\n"
 "      --list-event           List available events\n"
+"      --lock                 Show lock contention profile instead\n"
+"      --lock-profile[=TIME]  Profile lock waits (longer than TIME)\n"
 "      --logfile=FILE         Save log messages to this file\n"
+"      --low-memory           Read each task separately to reduce memory usage\n"
 "  -l, --nest-libcall         Show nested library calls\n"
 "      --libname              Show libname name with symbol name\n"
 "      --libmcount-path=PATH  Load libmcount libraries from this PATH\n"
@@ -196,11 +224,15 @@ __used static const char uftrace_help[] =
 "      --num-thread=NUM       Create NUM recorder threads\n"
 "  -N, --notrace=FUNC         Don't trace those FUNCs\n"
 "      --opt-file=FILE        Read command-line options from FILE\n"
+"      --pack                 Copy symbol files from the symbol store into data\n"
 "  -p  --pid=PID              PID of an interactive mcount instance\n"
 "      --port=PORT            Use PORT for network connection (default: "
 	stringify(UFTRACE_RECV_PORT) ")\n"
 "  -P, --patch=FUNC           Apply dynamic patching for FUNCs\n"
+"      --patch-cache[=DIR]    Save and reuse dynamic patch results in DIR\n"
+"      --patch-async          Patch dlopen-ed modules in background\n"
 "      --record               Record a new trace data before running command\n"
+"      --remove               Remove the given rules from the agent (with -p)\n"
 "      --report               Show live report\n"
 "      --rt-prio=PRIO         Record with real-time (FIFO) priority\n"
 "  -r, --time-range=TIME~TIME Show output within the TIME(timestamp or elapsed time)\n"
@@ -209,9 +241,14 @@ __used static const char uftrace_help[] =
 "                             data received\n"
 "  -R, --retval=FUNC@retval   Show function return value\n"
 "      --sample-time=TIME     Show flame graph with this sampling time\n"
+"      --self-stat[=FMT]      Show time/memory usage of uftrace itself\n"
+"                             (FMT: text, json)\n"
 "      --signal=SIG@act[,act,...]   Trigger action on those SIGnal\n"
 "      --sort-column=INDEX    Sort diff report on column INDEX (default: 2)\n"
 "      --srcline              Enable recording source line info\n"
+"      --stream               Print live output while recording\n"
+"      --symbol-cache[=DIR]   Share symbol tables of modules using cache in DIR\n"
+"      --symbol-store[=DIR]   Save symbol files once in DIR and link to them\n"
 "      --symbols              Print symbol tables\n"
 "  -s, --sort=KEY[,KEY,...]   Sort reported functions by KEYs (default: "
 	stringify(OPT_SORT_COLUMN) ")\n"
@@ -221,6 +258,7 @@ __used static const char uftrace_help[] =
 "      --task-newline         Interleave a newline when task is changed\n"
 "      --tid=TID[,TID,...]    Only replay those tasks\n"
 "      --time                 Print time information\n"
+"      --trace=STATE          Turn tracing of the agent on or off (with -p)\n"
 "  -T, --trigger=FUNC@act[,act,...]\n"
 "                             Trigger action on those FUNCs\n"
 "  -U, --unpatch=FUNC         Don't apply dynamic patching for FUNCs\n"
@@ -245,6 +283,7 @@ static const char uftrace_shopts[] =
 
 #define REQ_ARG(name, shopt) { #name, required_argument, 0, shopt }
 #define NO_ARG(name, shopt)  { #name, no_argument, 0, shopt }
+#define OPT_ARG(name, shopt) { #name, optional_argument, 0, shopt }
 
 static const struct option uftrace_options[] = {
 	REQ_ARG(libmcount-path, OPT_libmcount_path),
@@ -295,7 +334,24 @@ static const struct option uftrace_options[] = {
 	NO_ARG(graphviz, OPT_graphviz),
 	NO_ARG(flame-graph, OPT_flame_graph),
 	NO_ARG(mermaid, OPT_mermaid),
+	REQ_ARG(arrow, OPT_arrow),
 	REQ_ARG(sample-time, OPT_sample_time),
+	REQ_ARG(interval, OPT_interval),
+	NO_ARG(stream, OPT_stream),
+	NO_ARG(low-memory, OPT_low_memory),
+	NO_ARG(compensate, OPT_compensate),
+	OPT_ARG(self-stat, OPT_self_stat),
+	OPT_ARG(patch-cache, OPT_patch_cache),
+	OPT_ARG(symbol-cache, OPT_symbol_cache),
+	OPT_ARG(symbol-store, OPT_symbol_store),
+	NO_ARG(pack, OPT_pack),
+	REQ_ARG(trace, OPT_trace),
+	NO_ARG(remove, OPT_remove),
+	NO_ARG(alloc, OPT_alloc),
+	OPT_ARG(alloc-profile, OPT_alloc_profile),
+	NO_ARG(lock, OPT_lock),
+	OPT_ARG(lock-profile, OPT_lock_profile),
+	NO_ARG(patch-async, OPT_patch_async),
 	REQ_ARG(diff, OPT_diff),
 	REQ_ARG(format, OPT_format),
 	REQ_ARG(sort-column, OPT_sort_column),
@@ -575,6 +631,25 @@ static bool is_libmcount_directory(const char *path)
 	return ret;
 }
 
+/*
+ * Returns the default directory for cache or data files of the user.  It
+ * doesn't fall back to a shared directory like /tmp since other users can
+ * put files there.
+ */
+static char *get_user_dir(const char *xdg_env, const char *home_dir, const char *name)
+{
+	char *dir = NULL;
+
+	if (getenv(xdg_env))
+		xasprintf(&dir, "%s/%s", getenv(xdg_env), name);
+	else if (getenv("HOME"))
+		xasprintf(&dir, "%s/%s/%s", getenv("HOME"), home_dir, name);
+	else
+		pr_warn("cannot find default directory for %s: $HOME is not set\n", name);
+
+	return dir;
+}
+
 static int parse_option(struct uftrace_opts *opts, int key, char *arg)
 {
 	char *pos;
@@ -598,6 +673,9 @@ static int parse_option(struct uftrace_opts *opts, int key, char *arg)
 			pr_use("invalid depth given: %s (ignoring..)\n", arg);
 			opts->depth = OPT_DEPTH_DEFAULT;
 		}
+		else {
+			opts->depth_set = true;
+		}
 		break;
 
 	case 'C':
@@ -681,6 +759,7 @@ static int parse_option(struct uftrace_opts *opts, int key, char *arg)
 		strv_append(&default_opts, arg);
 
 		opts->threshold = parse_time(arg, 3);
+		opts->threshold_set = true;
 		if (opts->range.start || opts->range.stop) {
 			pr_use("--time-range cannot be used with --time-filter\n");
 			opts->range.start = opts->range.stop = 0;
@@ -992,6 +1071,14 @@ static int parse_option(struct uftrace_opts *opts, int key, char *arg)
 		opts->sample_time = parse_time(arg, 9);
 		break;
 
+	case OPT_interval:
+		opts->interval = parse_time(arg, 9);
+		if (opts->interval < NSEC_PER_MSEC) {
+			pr_use("invalid interval: %s\n", arg);
+			return -1;
+		}
+		break;
+
 	case OPT_list_event:
 		opts->list_event = true;
 		break;
@@ -1020,6 +1107,88 @@ static int parse_option(struct uftrace_opts *opts, int key, char *arg)
 		opts->record = true;
 		break;
 
+	case OPT_stream:
+		opts->stream = true;
+		break;
+
+	case OPT_low_memory:
+		opts->low_memory = true;
+		break;
+
+	case OPT_compensate:
+		opts->compensate = true;
+		break;
+
+	case OPT_self_stat:
+		opts->self_stat = arg ?: "text";
+		break;
+
+	case OPT_patch_cache:
+		free(opts->patch_cache);
+		if (arg)
+			opts->patch_cache = xstrdup(arg);
+		else
+			opts->patch_cache = get_user_dir("XDG_CACHE_HOME", ".cache", "uftrace");
+		break;
+
+	case OPT_patch_async:
+		opts->patch_async = true;
+		break;
+
+	case OPT_symbol_cache:
+		free(opts->symbol_cache);
+		if (arg)
+			opts->symbol_cache = xstrdup(arg);
+		else
+			opts->symbol_cache = get_user_dir("XDG_CACHE_HOME", ".cache", "uftrace");
+		break;
+
+	case OPT_symbol_store:
+		free(opts->symbol_store);
+		if (arg)
+			opts->symbol_store = xstrdup(arg);
+		else
+			opts->symbol_store = get_user_dir("XDG_DATA_HOME", ".local/share",
+							  "uftrace/symbols");
+		break;
+
+	case OPT_pack:
+		opts->pack = true;
+		break;
+
+	case OPT_alloc:
+		opts->show_alloc = true;
+		break;
+
+	case OPT_alloc_profile:
+		opts->alloc_profile = true;
+		if (arg)
+			opts->alloc_sample = strtoul(arg, NULL, 0);
+		break;
+
+	case OPT_lock:
+		opts->show_lock = true;
+		break;
+
+	case OPT_lock_profile:
+		opts->lock_profile = true;
+		if (arg)
+			opts->lock_threshold = parse_time(arg, 3);
+		break;
+
+	case OPT_trace:
+		if (!strcmp(arg, "on"))
+			opts->trace = TRACE_STATE_ON;
+		else if (!strcmp(arg, "off"))
+			opts->trace = TRACE_STATE_OFF;
+		else
+			pr_use("invalid trace state: %s (ignoring..)\n", arg);
+		break;
+
+	case OPT_remove:
+		opts->remove = true;
+		break;
+
 	case OPT_no_args:
 		opts->show_args = false;
 		break;
@@ -1074,6 +1243,10 @@ static int parse_option(struct uftrace_opts *opts, int key, char *arg)
 		opts->clock = arg;
 		break;
 
+	case OPT_arrow:
+		opts->arrow_file = arg;
+		break;
+
 	case OPT_mermaid:
 		opts->mermaid = true;
 		break;
@@ -1106,6 +1279,8 @@ static void update_subcmd(struct uftrace_opts *opts, char *cmd)
 		opts->mode = UFTRACE_MODE_SCRIPT;
 	else if (!strcmp(cmd, "tui"))
 		opts->mode = UFTRACE_MODE_TUI;
+	else if (!strcmp(cmd, "top"))
+		opts->mode = UFTRACE_MODE_TOP;
 	else
 		opts->mode = UFTRACE_MODE_INVALID;
 }
@@ -1294,6 +1469,9 @@ static void free_opts(struct uftrace_opts *opts)
 	free(opts->tid);
 	free(opts->event);
 	free(opts->patch);
+	free(opts->patch_cache);
+	free(opts->symbol_cache);
+	free(opts->symbol_store);
 	free(opts->caller);
 	free(opts->watch);
 	free(opts->hide);
@@ -1343,7 +1521,7 @@ __used static void apply_default_opts(int *argc, char ***argv, struct uftrace_op
 
 	/* default.opts is only for analysis commands */
 	if (opts->mode == UFTRACE_MODE_RECORD || opts->mode == UFTRACE_MODE_LIVE ||
-	    opts->mode == UFTRACE_MODE_RECV)
+	    opts->mode == UFTRACE_MODE_RECV || opts->mode == UFTRACE_MODE_TOP)
 		return;
 
 	/* this is not to override user given time-filter by default opts */
@@ -1422,6 +1600,7 @@ int main(int argc, char *argv[])
 		switch (opts.mode) {
 		case UFTRACE_MODE_RECORD:
 		case UFTRACE_MODE_LIVE:
+		case UFTRACE_MODE_TOP:
 		case UFTRACE_MODE_INVALID:
 			pr_out(uftrace_usage);
 			pr_out(uftrace_footer);
@@ -1465,7 +1644,7 @@ int main(int argc, char *argv[])
 	opts.range.event_skip_out = opts.event_skip_out;
 
 	if (opts.mode == UFTRACE_MODE_RECORD || opts.mode == UFTRACE_MODE_RECV ||
-	    opts.mode == UFTRACE_MODE_TUI)
+	    opts.mode == UFTRACE_MODE_TUI || opts.mode == UFTRACE_MODE_TOP)
 		opts.use_pager = false;
 	if (opts.nop)
 		opts.use_pager = false;
@@ -1493,6 +1672,12 @@ int main(int argc, char *argv[])
 	argc -= opts.idx;
 	argv += opts.idx;
 
+	if (opts.self_stat && selfstat_setup(opts.self_stat) < 0)
+		pr_use("invalid self-stat format: %s (ignoring...)\n", opts.self_stat);
+
+	if (opts.symbol_cache)
+		set_symtab_cache_dir(opts.symbol_cache);
+
 	switch (opts.mode) {
 	case UFTRACE_MODE_RECORD:
 		ret = command_record(argc, argv, &opts);
@@ -1524,6 +1709,9 @@ int main(int argc, char *argv[])
 	case UFTRACE_MODE_TUI:
 		ret = command_tui(argc, argv, &opts);
 		break;
+	case UFTRACE_MODE_TOP:
+		ret = command_top(argc, argv, &opts);
+		break;
 	case UFTRACE_MODE_INVALID:
 		ret = 1;
 		break;
@@ -1531,6 +1719,8 @@ int main(int argc, char *argv[])
 
 	wait_for_pager();
 
+	selfstat_print(logfp);
+
 	if (opts.logfile)
 		fclose(logfp);
 
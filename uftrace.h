@@ -22,6 +22,10 @@
 
 #define UFTRACE_RECV_PORT 8090
 
+/* heap allocation profile of each process (see --alloc-profile) */
+#define UFTRACE_ALLOC_FILE "alloc-%d.txt"
+#define UFTRACE_ALLOC_HIST_MAX 32
+
 /* default option values */
 #define OPT_RSTACK_MAX 65535
 #define OPT_RSTACK_DEFAULT 1024
@@ -97,6 +101,7 @@ enum uftrace_info_bits {
 	RECORD_DATE_BIT,
 	PATTERN_TYPE_BIT,
 	VERSION_BIT,
+	OVERHEAD_BIT,
 
 	INFO_BIT_MAX,
 
@@ -115,6 +120,7 @@ enum uftrace_info_bits {
 	RECORD_DATE = (1U << RECORD_DATE_BIT),
 	PATTERN_TYPE = (1U << PATTERN_TYPE_BIT),
 	VERSION = (1U << VERSION_BIT),
+	OVERHEAD = (1U << OVERHEAD_BIT),
 };
 
 struct uftrace_info {
@@ -153,6 +159,8 @@ struct uftrace_info {
 	float load15;
 	enum uftrace_pattern_type patt_type;
 	char *uftrace_version;
+	uint64_t overhead_total;
+	uint64_t overhead_inner;
 };
 
 enum {
@@ -192,6 +200,10 @@ struct uftrace_data {
 	struct uftrace_extern_reader *extn;
 	struct uftrace_task_reader *tasks;
 	struct uftrace_session_link sessions;
+	/* LRU list of task readers which have an open data file */
+	struct list_head task_files;
+	int nr_task_files;
+	int max_task_files;
 	int nr_tasks;
 	int nr_perf;
 	int last_perf_idx;
@@ -200,6 +212,8 @@ struct uftrace_data {
 	bool needs_bit_swap;
 	bool perf_event_processed;
 	bool caller_filter;
+	bool low_memory;
+	bool compensate;
 	uint64_t time_filter;
 	unsigned size_filter;
 	struct uftrace_time_range time_range;
@@ -219,6 +233,7 @@ bool data_is_lp64(struct uftrace_data *handle);
 #define UFTRACE_MODE_GRAPH 8
 #define UFTRACE_MODE_SCRIPT 9
 #define UFTRACE_MODE_TUI 10
+#define UFTRACE_MODE_TOP 11
 
 #define UFTRACE_MODE_DEFAULT UFTRACE_MODE_LIVE
 
@@ -250,6 +265,7 @@ struct uftrace_opts {
 	char *loc_filter;
 	char *with_syms;
 	char *clock;
+	char *arrow_file;
 	int mode;
 	int idx;
 	int depth;
@@ -263,10 +279,14 @@ struct uftrace_opts {
 	int rt_prio;
 	int size_filter;
 	int pid;
+	int trace;
 	unsigned long bufsize;
 	unsigned long kernel_bufsize;
+	unsigned long alloc_sample;
 	uint64_t threshold;
 	uint64_t sample_time;
+	uint64_t interval;
+	uint64_t lock_threshold;
 	bool flat;
 	bool libcall;
 	bool print_symtab;
@@ -308,6 +328,23 @@ struct uftrace_opts {
 	bool estimate_return;
 	bool mermaid;
 	bool agent;
+	bool stream;
+	bool low_memory;
+	bool compensate;
+	bool patch_async;
+	bool pack;
+	bool remove;
+	bool depth_set;
+	bool threshold_set;
+	bool alloc_profile;
+	bool show_alloc;
+	bool lock_profile;
+	bool show_lock;
+	bool skip_cond;
+	char *self_stat;
+	char *patch_cache;
+	char *symbol_cache;
+	char *symbol_store;
 	struct uftrace_time_range range;
 	enum uftrace_pattern_type patt_type;
 };
@@ -324,6 +361,7 @@ void parse_script_opt(struct uftrace_opts *opts);
 int command_record(int argc, char *argv[], struct uftrace_opts *opts);
 int command_replay(int argc, char *argv[], struct uftrace_opts *opts);
 int command_live(int argc, char *argv[], struct uftrace_opts *opts);
+int forward_options(struct uftrace_opts *opts);
 int command_report(int argc, char *argv[], struct uftrace_opts *opts);
 int command_info(int argc, char *argv[], struct uftrace_opts *opts);
 int command_recv(int argc, char *argv[], struct uftrace_opts *opts);
@@ -331,6 +369,7 @@ int command_dump(int argc, char *argv[], struct uftrace_opts *opts);
 int command_graph(int argc, char *argv[], struct uftrace_opts *opts);
 int command_script(int argc, char *argv[], struct uftrace_opts *opts);
 int command_tui(int argc, char *argv[], struct uftrace_opts *opts);
+int command_top(int argc, char *argv[], struct uftrace_opts *opts);
 
 extern volatile bool uftrace_done;
 
@@ -408,6 +447,8 @@ enum uftrace_msg_type {
 	UFTRACE_MSG_LOST,
 	UFTRACE_MSG_DLOPEN,
 	UFTRACE_MSG_FINISH,
+	UFTRACE_MSG_OVERHEAD,
+	UFTRACE_MSG_ARGSPEC,
 
 	UFTRACE_MSG_SEND_START = 100,
 	UFTRACE_MSG_SEND_DIR_NAME,
@@ -422,6 +463,23 @@ enum uftrace_msg_type {
 /* Dynamic options sent by the client to the agent */
 enum uftrace_dopt {
 	UFTRACE_DOPT_CLOSE, /* Close the connection with the client */
+	UFTRACE_DOPT_TRACE, /* Turn tracing on or off */
+	UFTRACE_DOPT_DEPTH, /* Set the default filter depth */
+	UFTRACE_DOPT_THRESHOLD, /* Set the time threshold */
+	UFTRACE_DOPT_REMOVE, /* Remove (or add) the following rules */
+	UFTRACE_DOPT_FILTER, /* Filter rules (string) */
+	UFTRACE_DOPT_TRIGGER, /* Trigger rules (string) */
+	UFTRACE_DOPT_ARGUMENT, /* Argument rules (string) */
+	UFTRACE_DOPT_RETVAL, /* Return value rules (string) */
+	UFTRACE_DOPT_PATCH, /* Functions to patch or unpatch (string) */
+	UFTRACE_DOPT_ERROR, /* Sent back if some options are not applied */
+};
+
+/* Tracing state requested by the client (--trace) */
+enum uftrace_trace_state {
+	TRACE_STATE_NONE,
+	TRACE_STATE_ON,
+	TRACE_STATE_OFF,
 };
 
 /* msg format for communicating by pipe */
@@ -446,6 +504,12 @@ struct uftrace_msg_sess {
 	char exename[];
 };
 
+/* calibrated cost of tracing a function call (in nsec) */
+struct uftrace_msg_overhead {
+	uint64_t total; /* entry + exit */
+	uint64_t inner; /* part of it included in the function's duration */
+};
+
 struct uftrace_msg_dlopen {
 	struct uftrace_msg_task task;
 	uint64_t base_addr;
@@ -467,6 +531,8 @@ struct uftrace_task *find_task(struct uftrace_session_link *sess, int tid);
 void read_session_map(char *dirname, struct uftrace_sym_info *sinfo, char *sid);
 void delete_session_map(struct uftrace_sym_info *sinfo);
 void update_session_map(const char *filename);
+struct uftrace_sym_info *get_record_symtabs(const char *dirname, uint64_t sid);
+void release_record_symtabs(void);
 struct uftrace_session *get_session_from_sid(struct uftrace_session_link *sess, char sid[]);
 void session_add_dlopen(struct uftrace_session *sess, uint64_t timestamp, unsigned long base_addr,
 			const char *libname);
@@ -572,6 +638,9 @@ static inline bool has_event_data(struct uftrace_data *handle)
 
 struct rusage;
 
+/* overhead calibrated by libmcount during record (zero if not available) */
+extern struct uftrace_msg_overhead record_overhead;
+
 int fill_file_header(struct uftrace_opts *opts, int status, struct rusage *rusage,
 		     char *elapsed_time);
 void fill_uftrace_info(uint64_t *info_mask, int fd, struct uftrace_opts *opts, int status,
@@ -581,6 +650,9 @@ void process_uftrace_info(struct uftrace_data *handle, struct uftrace_opts *opts
 			  void (*process)(void *data, const char *fmt, ...), void *data);
 void clear_uftrace_info(struct uftrace_info *info);
 
+int process_alloc_profile(struct uftrace_data *handle, struct uftrace_opts *opts,
+			  void (*process)(void *data, const char *fmt, ...), void *data);
+
 int arch_fill_cpuinfo_model(int fd);
 
 enum uftrace_event_id {
@@ -599,6 +671,8 @@ enum uftrace_event_id {
 	EVENT_ID_READ_PMU_BRANCH,
 	EVENT_ID_DIFF_PMU_BRANCH,
 	EVENT_ID_WATCH_CPU,
+	EVENT_ID_ALLOC_SAMPLE,
+	EVENT_ID_LOCK_WAIT,
 
 	/* supported perf events */
 	EVENT_ID_PERF = 200000U,
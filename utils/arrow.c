@@ -0,0 +1,902 @@
+/*
+ * Apache Arrow IPC file writer
+ *
+ * This writes the Arrow IPC file format (a.k.a. Feather V2) without any
+ * external library.  The metadata is encoded in FlatBuffers by a small
+ * builder below which only supports what's needed for the format.
+ *
+ * The file consists of a schema message, dictionary batches and record
+ * batches followed by a footer.  Strings in dictionary columns are sent
+ * as delta dictionary batches right before the record batch using them
+ * so the data can be read as a stream too.
+ *
+ * Released under the GPL v2.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT "arrow"
+
+#include "utils/arrow.h"
+#include "utils/hashmap.h"
+#include "utils/utils.h"
+
+#define ARROW_MAGIC "ARROW1"
+#define ARROW_CONTINUATION 0xffffffffU
+
+/* values in Schema.fbs and Message.fbs */
+#define ARROW_METADATA_V5 4
+
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_DICTIONARY_BATCH 2
+#define ARROW_HEADER_RECORD_BATCH 3
+
+#define ARROW_TYPE_ID_INT 2
+#define ARROW_TYPE_ID_UTF8 5
+
+/*
+ * Minimal FlatBuffers builder.  Unlike the official one, it writes data
+ * from the front and patches offsets later.  So a table should be added
+ * before its children (strings, vectors and sub-tables) since offsets in
+ * FlatBuffers should point forward.  The vtable follows the table.
+ */
+struct fb_builder {
+	char *buf;
+	size_t len;
+	size_t alloc;
+};
+
+#define FB_MAX_FIELDS 8
+
+struct fb_table {
+	size_t pos;
+	int nr_fields;
+	uint16_t field[FB_MAX_FIELDS];
+};
+
+/* reserve zero-filled space and return the (aligned) position */
+static size_t fb_reserve(struct fb_builder *fb, size_t size, size_t align)
+{
+	size_t pos = ALIGN(fb->len, align);
+
+	if (pos + size > fb->alloc) {
+		fb->alloc = ALIGN(pos + size, 4096);
+		fb->buf = xrealloc(fb->buf, fb->alloc);
+	}
+	memset(fb->buf + fb->len, 0, pos + size - fb->len);
+	fb->len = pos + size;
+	return pos;
+}
+
+static void fb_reset(struct fb_builder *fb)
+{
+	fb->len = 0;
+}
+
+/* write the relative offset to the target at the slot */
+static void fb_patch(struct fb_builder *fb, size_t slot, size_t target)
+{
+	uint32_t off = target - slot;
+
+	memcpy(fb->buf + slot, &off, sizeof(off));
+}
+
+static size_t fb_root(struct fb_builder *fb)
+{
+	return fb_reserve(fb, sizeof(uint32_t), sizeof(uint32_t));
+}
+
+static void fb_table_start(struct fb_builder *fb, struct fb_table *t, int nr_fields)
+{
+	ASSERT(nr_fields <= FB_MAX_FIELDS);
+
+	memset(t, 0, sizeof(*t));
+	t->nr_fields = nr_fields;
+	/* soffset to the vtable */
+	t->pos = fb_reserve(fb, sizeof(int32_t), sizeof(int32_t));
+}
+
+static void fb_add_scalar(struct fb_builder *fb, struct fb_table *t, int id, const void *val,
+			  size_t size)
+{
+	size_t pos = fb_reserve(fb, size, size);
+
+	memcpy(fb->buf + pos, val, size);
+	t->field[id] = pos - t->pos;
+}
+
+#define FB_ADD(_type, _name)                                                                       \
+	static void fb_add_##_name(struct fb_builder *fb, struct fb_table *t, int id, _type val)  \
+	{                                                                                          \
+		fb_add_scalar(fb, t, id, &val, sizeof(val));                                       \
+	}
+
+FB_ADD(uint8_t, u8)
+FB_ADD(int16_t, i16)
+FB_ADD(int32_t, i32)
+FB_ADD(int64_t, i64)
+
+#undef FB_ADD
+
+/* add an offset field and return the slot to be patched later */
+static size_t fb_add_offset(struct fb_builder *fb, struct fb_table *t, int id)
+{
+	size_t pos = fb_reserve(fb, sizeof(uint32_t), sizeof(uint32_t));
+
+	t->field[id] = pos - t->pos;
+	return pos;
+}
+
+static size_t fb_table_end(struct fb_builder *fb, struct fb_table *t)
+{
+	uint16_t vt_size = sizeof(uint16_t) * (t->nr_fields + 2);
+	uint16_t tbl_size = fb->len - t->pos;
+	size_t vt = fb_reserve(fb, vt_size, sizeof(uint16_t));
+	int32_t soff = t->pos - vt;
+
+	memcpy(fb->buf + vt, &vt_size, sizeof(vt_size));
+	memcpy(fb->buf + vt + 2, &tbl_size, sizeof(tbl_size));
+	memcpy(fb->buf + vt + 4, t->field, sizeof(uint16_t) * t->nr_fields);
+	memcpy(fb->buf + t->pos, &soff, sizeof(soff));
+
+	return t->pos;
+}
+
+static size_t fb_string(struct fb_builder *fb, const char *str)
+{
+	uint32_t len = strlen(str);
+	/* it includes the NUL at the end */
+	size_t pos = fb_reserve(fb, sizeof(len) + len + 1, sizeof(len));
+
+	memcpy(fb->buf + pos, &len, sizeof(len));
+	memcpy(fb->buf + pos + sizeof(len), str, len);
+	return pos;
+}
+
+/* returns position of the vector length, elements start after it */
+static size_t fb_vector(struct fb_builder *fb, uint32_t count, size_t elem_size, size_t align)
+{
+	size_t pad = ALIGN(fb->len + sizeof(count), align) - sizeof(count) - fb->len;
+	size_t pos = fb_reserve(fb, pad + sizeof(count) + count * elem_size, 1) + pad;
+
+	memcpy(fb->buf + pos, &count, sizeof(count));
+	return pos;
+}
+
+#define fb_vector_elem(fb, vec, idx, size) ((fb)->buf + (vec) + sizeof(uint32_t) + (idx) * (size))
+
+/* struct FieldNode and Buffer in Arrow metadata */
+struct arrow_node {
+	int64_t length;
+	int64_t null_count;
+};
+
+struct arrow_buffer {
+	int64_t offset;
+	int64_t length;
+};
+
+/* struct Block in Arrow file footer */
+struct arrow_block {
+	int64_t offset;
+	int32_t meta_len;
+	int32_t pad;
+	int64_t body_len;
+};
+
+struct arrow_dict {
+	Hashmap *map;
+	char **vals;
+	int nr_vals;
+	int alloc;
+	/* number of values already written to the file */
+	int nr_sent;
+};
+
+struct arrow_column {
+	char *name;
+	enum arrow_type type;
+	/* fixed-size values, utf8 offsets or dictionary indices */
+	char *data;
+	size_t data_len;
+	size_t data_alloc;
+	/* utf8 string data */
+	char *str;
+	size_t str_len;
+	size_t str_alloc;
+	struct arrow_dict dict;
+};
+
+struct arrow_writer {
+	FILE *fp;
+	uint64_t offset;
+	unsigned batch_rows;
+	unsigned nr_rows;
+	int nr_cols;
+	struct arrow_column *cols;
+	struct fb_builder fb;
+	bool dict_written;
+	bool error;
+	/* blocks are saved in separate arrays for the footer */
+	struct arrow_block *dicts;
+	int nr_dicts;
+	struct arrow_block *batches;
+	int nr_batches;
+};
+
+#define ARROW_MAX_COLUMNS 16
+
+/* message body to write (up to 3 buffers per column) */
+struct arrow_body {
+	const void *data[3 * ARROW_MAX_COLUMNS];
+	struct arrow_buffer bufs[3 * ARROW_MAX_COLUMNS];
+	struct arrow_node nodes[ARROW_MAX_COLUMNS];
+	int nr_bufs;
+	int nr_nodes;
+	int64_t len;
+};
+
+static void *buf_append(char **buf, size_t *len, size_t *alloc, size_t size)
+{
+	void *p;
+
+	if (*len + size > *alloc) {
+		*alloc = ALIGN(*len + size, 4096) * 2;
+		*buf = xrealloc(*buf, *alloc);
+	}
+	p = *buf + *len;
+	*len += size;
+	return p;
+}
+
+static int type_width(enum arrow_type type)
+{
+	switch (type) {
+	case ARROW_TYPE_INT8:
+		return 1;
+	case ARROW_TYPE_INT32:
+	case ARROW_TYPE_UTF8: /* offset */
+	case ARROW_TYPE_DICT: /* index */
+		return 4;
+	case ARROW_TYPE_INT64:
+	case ARROW_TYPE_UINT64:
+	default:
+		return 8;
+	}
+}
+
+static void reset_column(struct arrow_column *col)
+{
+	col->data_len = 0;
+	col->str_len = 0;
+
+	/* utf8 has (N + 1) offsets */
+	if (col->type == ARROW_TYPE_UTF8) {
+		int32_t *off = buf_append(&col->data, &col->data_len, &col->data_alloc, 4);
+		*off = 0;
+	}
+}
+
+static void write_data(struct arrow_writer *aw, const void *data, size_t len)
+{
+	if (len && fwrite(data, 1, len, aw->fp) != len)
+		aw->error = true;
+	aw->offset += len;
+}
+
+static void write_padding(struct arrow_writer *aw, size_t len)
+{
+	static const char zero[8];
+
+	write_data(aw, zero, ALIGN(len, 8) - len);
+}
+
+static void body_add_node(struct arrow_body *body, int64_t length)
+{
+	body->nodes[body->nr_nodes].length = length;
+	body->nodes[body->nr_nodes].null_count = 0;
+	body->nr_nodes++;
+}
+
+static void body_add_buffer(struct arrow_body *body, const void *data, size_t len)
+{
+	body->data[body->nr_bufs] = data;
+	body->bufs[body->nr_bufs].offset = body->len;
+	body->bufs[body->nr_bufs].length = len;
+	body->nr_bufs++;
+
+	body->len += ALIGN(len, 8);
+}
+
+/* write an encapsulated message using metadata in aw->fb */
+static void write_message(struct arrow_writer *aw, struct arrow_body *body,
+			  struct arrow_block *blk)
+{
+	uint32_t cont = ARROW_CONTINUATION;
+	uint32_t meta_len = ALIGN(aw->fb.len + 8, 8) - 8;
+	int i;
+
+	if (blk) {
+		blk->offset = aw->offset;
+		blk->meta_len = meta_len + 8;
+		blk->pad = 0;
+		blk->body_len = body ? body->len : 0;
+	}
+
+	write_data(aw, &cont, sizeof(cont));
+	write_data(aw, &meta_len, sizeof(meta_len));
+	write_data(aw, aw->fb.buf, aw->fb.len);
+	write_padding(aw, aw->fb.len);
+
+	for (i = 0; body && i < body->nr_bufs; i++) {
+		write_data(aw, body->data[i], body->bufs[i].length);
+		write_padding(aw, body->bufs[i].length);
+	}
+}
+
+/* start a Message table and return the slot for the header */
+static size_t fb_message(struct fb_builder *fb, uint8_t header_type, int64_t body_len)
+{
+	struct fb_table t;
+	size_t root, slot;
+
+	fb_reset(fb);
+	root = fb_root(fb);
+
+	fb_table_start(fb, &t, 4);
+	fb_add_i16(fb, &t, 0, ARROW_METADATA_V5);
+	fb_add_u8(fb, &t, 1, header_type);
+	slot = fb_add_offset(fb, &t, 2);
+	fb_add_i64(fb, &t, 3, body_len);
+	fb_patch(fb, root, fb_table_end(fb, &t));
+
+	return slot;
+}
+
+static size_t fb_record_batch(struct fb_builder *fb, int64_t length, struct arrow_body *body)
+{
+	struct fb_table t;
+	size_t pos, nodes, bufs, vec;
+
+	fb_table_start(fb, &t, 3);
+	fb_add_i64(fb, &t, 0, length);
+	nodes = fb_add_offset(fb, &t, 1);
+	bufs = fb_add_offset(fb, &t, 2);
+	pos = fb_table_end(fb, &t);
+
+	vec = fb_vector(fb, body->nr_nodes, sizeof(*body->nodes), 8);
+	memcpy(fb_vector_elem(fb, vec, 0, 0), body->nodes, body->nr_nodes * sizeof(*body->nodes));
+	fb_patch(fb, nodes, vec);
+
+	vec = fb_vector(fb, body->nr_bufs, sizeof(*body->bufs), 8);
+	memcpy(fb_vector_elem(fb, vec, 0, 0), body->bufs, body->nr_bufs * sizeof(*body->bufs));
+	fb_patch(fb, bufs, vec);
+
+	return pos;
+}
+
+static size_t fb_int_type(struct fb_builder *fb, int bits, bool is_signed)
+{
+	struct fb_table t;
+
+	fb_table_start(fb, &t, 2);
+	fb_add_i32(fb, &t, 0, bits);
+	fb_add_u8(fb, &t, 1, is_signed);
+	return fb_table_end(fb, &t);
+}
+
+static size_t fb_field(struct fb_builder *fb, struct arrow_column *col, int id)
+{
+	struct fb_table t;
+	size_t pos, name, type, dict = 0, children;
+
+	fb_table_start(fb, &t, 6);
+	name = fb_add_offset(fb, &t, 0);
+	fb_add_u8(fb, &t, 1, false); /* nullable */
+	if (col->type == ARROW_TYPE_UTF8 || col->type == ARROW_TYPE_DICT)
+		fb_add_u8(fb, &t, 2, ARROW_TYPE_ID_UTF8);
+	else
+		fb_add_u8(fb, &t, 2, ARROW_TYPE_ID_INT);
+	type = fb_add_offset(fb, &t, 3);
+	if (col->type == ARROW_TYPE_DICT)
+		dict = fb_add_offset(fb, &t, 4);
+	/* some readers require children even if it's empty */
+	children = fb_add_offset(fb, &t, 5);
+	pos = fb_table_end(fb, &t);
+
+	fb_patch(fb, name, fb_string(fb, col->name));
+
+	switch (col->type) {
+	case ARROW_TYPE_INT8:
+		fb_patch(fb, type, fb_int_type(fb, 8, true));
+		break;
+	case ARROW_TYPE_INT32:
+		fb_patch(fb, type, fb_int_type(fb, 32, true));
+		break;
+	case ARROW_TYPE_INT64:
+		fb_patch(fb, type, fb_int_type(fb, 64, true));
+		break;
+	case ARROW_TYPE_UINT64:
+		fb_patch(fb, type, fb_int_type(fb, 64, false));
+		break;
+	case ARROW_TYPE_UTF8:
+	case ARROW_TYPE_DICT:
+		/* Utf8 is an empty table */
+		fb_table_start(fb, &t, 0);
+		fb_patch(fb, type, fb_table_end(fb, &t));
+		break;
+	}
+
+	if (col->type == ARROW_TYPE_DICT) {
+		size_t index;
+
+		/* DictionaryEncoding */
+		fb_table_start(fb, &t, 3);
+		fb_add_i64(fb, &t, 0, id);
+		index = fb_add_offset(fb, &t, 1);
+		fb_patch(fb, dict, fb_table_end(fb, &t));
+		fb_patch(fb, index, fb_int_type(fb, 32, true));
+	}
+
+	fb_patch(fb, children, fb_vector(fb, 0, sizeof(uint32_t), sizeof(uint32_t)));
+	return pos;
+}
+
+static size_t fb_schema(struct fb_builder *fb, struct arrow_writer *aw)
+{
+	struct fb_table t;
+	size_t pos, fields, vec;
+	int i;
+
+	fb_table_start(fb, &t, 2);
+	fb_add_i16(fb, &t, 0, 0); /* little endian */
+	fields = fb_add_offset(fb, &t, 1);
+	pos = fb_table_end(fb, &t);
+
+	vec = fb_vector(fb, aw->nr_cols, sizeof(uint32_t), sizeof(uint32_t));
+	fb_patch(fb, fields, vec);
+
+	for (i = 0; i < aw->nr_cols; i++) {
+		size_t slot = vec + sizeof(uint32_t) * (i + 1);
+
+		fb_patch(fb, slot, fb_field(fb, &aw->cols[i], i));
+	}
+	return pos;
+}
+
+static struct arrow_block *add_block(struct arrow_block **blocks, int *nr)
+{
+	*blocks = xrealloc(*blocks, (*nr + 1) * sizeof(**blocks));
+	return &(*blocks)[(*nr)++];
+}
+
+struct arrow_writer *arrow_writer_open(const char *filename, unsigned batch_rows)
+{
+	struct arrow_writer *aw;
+	FILE *fp;
+	static const char magic[8] = ARROW_MAGIC;
+
+	if (!strcmp(filename, "-"))
+		fp = outfp;
+	else
+		fp = fopen(filename, "w");
+
+	if (fp == NULL) {
+		pr_warn("cannot open %s: %m\n", filename);
+		return NULL;
+	}
+
+	aw = xzalloc(sizeof(*aw));
+	aw->fp = fp;
+	aw->batch_rows = batch_rows ?: ARROW_BATCH_ROWS;
+
+	/* magic followed by 2 byte padding */
+	write_data(aw, magic, sizeof(magic));
+	return aw;
+}
+
+int arrow_add_column(struct arrow_writer *aw, const char *name, enum arrow_type type)
+{
+	struct arrow_column *col;
+
+	if (aw->nr_cols == ARROW_MAX_COLUMNS)
+		return -1;
+
+	aw->cols = xrealloc(aw->cols, (aw->nr_cols + 1) * sizeof(*aw->cols));
+	col = &aw->cols[aw->nr_cols];
+	memset(col, 0, sizeof(*col));
+
+	col->name = xstrdup(name);
+	col->type = type;
+	if (type == ARROW_TYPE_DICT)
+		col->dict.map = hashmap_create(1024, hashmap_string_hash, hashmap_string_equals);
+
+	reset_column(col);
+	return aw->nr_cols++;
+}
+
+int arrow_write_schema(struct arrow_writer *aw)
+{
+	struct fb_builder *fb = &aw->fb;
+	size_t slot;
+
+	slot = fb_message(fb, ARROW_HEADER_SCHEMA, 0);
+	fb_patch(fb, slot, fb_schema(fb, aw));
+
+	write_message(aw, NULL, NULL);
+	return aw->error ? -1 : 0;
+}
+
+void arrow_set_int(struct arrow_writer *aw, int col, int64_t val)
+{
+	struct arrow_column *c = &aw->cols[col];
+	int width = type_width(c->type);
+	void *p = buf_append(&c->data, &c->data_len, &c->data_alloc, width);
+
+	switch (width) {
+	case 1:
+		*(int8_t *)p = val;
+		break;
+	case 4:
+		*(int32_t *)p = val;
+		break;
+	default:
+		*(int64_t *)p = val;
+		break;
+	}
+}
+
+static int dict_index(struct arrow_dict *dict, const char *str)
+{
+	void *idx = hashmap_get(dict->map, (void *)str);
+	char *val;
+
+	/* the index is saved as (index + 1) to distinguish it from NULL */
+	if (idx)
+		return (long)idx - 1;
+
+	if (dict->nr_vals == dict->alloc) {
+		dict->alloc = dict->alloc ? dict->alloc * 2 : 1024;
+		dict->vals = xrealloc(dict->vals, dict->alloc * sizeof(*dict->vals));
+	}
+
+	val = xstrdup(str);
+	dict->vals[dict->nr_vals++] = val;
+	hashmap_put(dict->map, val, (void *)(long)dict->nr_vals);
+
+	return dict->nr_vals - 1;
+}
+
+void arrow_set_str(struct arrow_writer *aw, int col, const char *str)
+{
+	struct arrow_column *c = &aw->cols[col];
+	size_t len;
+	int32_t *p;
+
+	if (str == NULL)
+		str = "";
+
+	if (c->type == ARROW_TYPE_DICT) {
+		p = buf_append(&c->data, &c->data_len, &c->data_alloc, sizeof(*p));
+		*p = dict_index(&c->dict, str);
+		return;
+	}
+
+	len = strlen(str);
+	memcpy(buf_append(&c->str, &c->str_len, &c->str_alloc, len), str, len);
+
+	p = buf_append(&c->data, &c->data_len, &c->data_alloc, sizeof(*p));
+	*p = c->str_len;
+}
+
+static void write_dictionary(struct arrow_writer *aw, int id, bool delta)
+{
+	struct arrow_dict *dict = &aw->cols[id].dict;
+	struct fb_builder *fb = &aw->fb;
+	struct fb_table t;
+	struct arrow_body body = {};
+	int nr = dict->nr_vals - dict->nr_sent;
+	int32_t *offsets = xmalloc((nr + 1) * sizeof(*offsets));
+	char *data = NULL;
+	size_t len = 0, alloc = 0;
+	size_t slot, pos, batch;
+	int i;
+
+	offsets[0] = 0;
+	for (i = 0; i < nr; i++) {
+		char *val = dict->vals[dict->nr_sent + i];
+		size_t vlen = strlen(val);
+
+		memcpy(buf_append(&data, &len, &alloc, vlen), val, vlen);
+		offsets[i + 1] = len;
+	}
+
+	body_add_node(&body, nr);
+	body_add_buffer(&body, NULL, 0); /* validity */
+	body_add_buffer(&body, offsets, (nr + 1) * sizeof(*offsets));
+	body_add_buffer(&body, data, len);
+
+	slot = fb_message(fb, ARROW_HEADER_DICTIONARY_BATCH, body.len);
+
+	fb_table_start(fb, &t, 3);
+	fb_add_i64(fb, &t, 0, id);
+	batch = fb_add_offset(fb, &t, 1);
+	fb_add_u8(fb, &t, 2, delta);
+	pos = fb_table_end(fb, &t);
+	fb_patch(fb, slot, pos);
+	fb_patch(fb, batch, fb_record_batch(fb, nr, &body));
+
+	write_message(aw, &body, add_block(&aw->dicts, &aw->nr_dicts));
+
+	dict->nr_sent = dict->nr_vals;
+	free(offsets);
+	free(data);
+}
+
+static int flush_batch(struct arrow_writer *aw)
+{
+	struct fb_builder *fb = &aw->fb;
+	struct arrow_body body = {};
+	size_t slot;
+	int i;
+
+	/* send new strings in dictionaries before the record batch */
+	for (i = 0; i < aw->nr_cols; i++) {
+		struct arrow_column *col = &aw->cols[i];
+
+		if (col->type != ARROW_TYPE_DICT)
+			continue;
+
+		/* the first one should be written even if it's empty */
+		if (!aw->dict_written || col->dict.nr_sent < col->dict.nr_vals)
+			write_dictionary(aw, i, aw->dict_written);
+	}
+	aw->dict_written = true;
+
+	if (aw->nr_rows == 0)
+		return aw->error ? -1 : 0;
+
+	for (i = 0; i < aw->nr_cols; i++) {
+		struct arrow_column *col = &aw->cols[i];
+
+		body_add_node(&body, aw->nr_rows);
+		body_add_buffer(&body, NULL, 0); /* validity */
+		body_add_buffer(&body, col->data, col->data_len);
+		if (col->type == ARROW_TYPE_UTF8)
+			body_add_buffer(&body, col->str, col->str_len);
+	}
+
+	slot = fb_message(fb, ARROW_HEADER_RECORD_BATCH, body.len);
+	fb_patch(fb, slot, fb_record_batch(fb, aw->nr_rows, &body));
+
+	write_message(aw, &body, add_block(&aw->batches, &aw->nr_batches));
+
+	for (i = 0; i < aw->nr_cols; i++)
+		reset_column(&aw->cols[i]);
+	aw->nr_rows = 0;
+
+	return aw->error ? -1 : 0;
+}
+
+int arrow_next_row(struct arrow_writer *aw)
+{
+	if (++aw->nr_rows < aw->batch_rows)
+		return 0;
+
+	return flush_batch(aw);
+}
+
+static void write_footer(struct arrow_writer *aw)
+{
+	struct fb_builder *fb = &aw->fb;
+	struct fb_table t;
+	size_t root, schema, dicts, batches, vec;
+	uint32_t eos[2] = { ARROW_CONTINUATION, 0 };
+	int32_t footer_len;
+	static const char magic[6] = ARROW_MAGIC;
+
+	/* end-of-stream marker */
+	write_data(aw, eos, sizeof(eos));
+
+	fb_reset(fb);
+	root = fb_root(fb);
+
+	fb_table_start(fb, &t, 4);
+	fb_add_i16(fb, &t, 0, ARROW_METADATA_V5);
+	schema = fb_add_offset(fb, &t, 1);
+	dicts = fb_add_offset(fb, &t, 2);
+	batches = fb_add_offset(fb, &t, 3);
+	fb_patch(fb, root, fb_table_end(fb, &t));
+
+	fb_patch(fb, schema, fb_schema(fb, aw));
+
+	vec = fb_vector(fb, aw->nr_dicts, sizeof(struct arrow_block), 8);
+	if (aw->nr_dicts)
+		memcpy(fb_vector_elem(fb, vec, 0, 0), aw->dicts, aw->nr_dicts * sizeof(*aw->dicts));
+	fb_patch(fb, dicts, vec);
+
+	vec = fb_vector(fb, aw->nr_batches, sizeof(struct arrow_block), 8);
+	if (aw->nr_batches) {
+		memcpy(fb_vector_elem(fb, vec, 0, 0), aw->batches,
+		       aw->nr_batches * sizeof(*aw->batches));
+	}
+	fb_patch(fb, batches, vec);
+
+	footer_len = fb->len;
+	write_data(aw, fb->buf, fb->len);
+	write_data(aw, &footer_len, sizeof(footer_len));
+	write_data(aw, magic, sizeof(magic));
+}
+
+int arrow_writer_close(struct arrow_writer *aw)
+{
+	int ret;
+	int i;
+
+	flush_batch(aw);
+	write_footer(aw);
+
+	if (fflush(aw->fp) < 0)
+		aw->error = true;
+	if (aw->fp != outfp)
+		fclose(aw->fp);
+
+	ret = aw->error ? -1 : 0;
+
+	for (i = 0; i < aw->nr_cols; i++) {
+		struct arrow_column *col = &aw->cols[i];
+
+		if (col->type == ARROW_TYPE_DICT) {
+			while (col->dict.nr_vals > 0)
+				free(col->dict.vals[--col->dict.nr_vals]);
+			free(col->dict.vals);
+			hashmap_free(col->dict.map);
+		}
+		free(col->name);
+		free(col->data);
+		free(col->str);
+	}
+	free(aw->cols);
+	free(aw->dicts);
+	free(aw->batches);
+	free(aw->fb.buf);
+	free(aw);
+
+	return ret;
+}
+
+#ifdef UNIT_TEST
+
+/* read a field in the table, returns NULL if it's not present */
+static void *fb_test_field(char *buf, size_t table, int id)
+{
+	int32_t soff;
+	uint16_t *vt;
+
+	memcpy(&soff, buf + table, sizeof(soff));
+	vt = (void *)(buf + table - soff);
+
+	if (vt[0] <= 4 + id * 2 || vt[2 + id] == 0)
+		return NULL;
+	return buf + table + vt[2 + id];
+}
+
+static size_t fb_test_deref(char *buf, void *slot)
+{
+	uint32_t off;
+
+	memcpy(&off, slot, sizeof(off));
+	return (char *)slot - buf + off;
+}
+
+TEST_CASE(arrow_flatbuffer)
+{
+	struct fb_builder fb = {};
+	struct fb_table t;
+	size_t root, name, sub, tbl;
+	int64_t i64;
+	int32_t i32;
+
+	pr_dbg("build a table with a string and a sub-table\n");
+	root = fb_root(&fb);
+	fb_table_start(&fb, &t, 4);
+	fb_add_u8(&fb, &t, 0, 1);
+	name = fb_add_offset(&fb, &t, 1);
+	fb_add_i64(&fb, &t, 3, 0x123456789LL);
+	sub = fb_add_offset(&fb, &t, 2);
+	fb_patch(&fb, root, fb_table_end(&fb, &t));
+	fb_patch(&fb, name, fb_string(&fb, "uftrace"));
+	fb_patch(&fb, sub, fb_int_type(&fb, 32, true));
+
+	pr_dbg("check the fields from the root table\n");
+	tbl = fb_test_deref(fb.buf, fb.buf + root);
+	TEST_EQ(tbl % 4, 0);
+	TEST_EQ(*(uint8_t *)fb_test_field(fb.buf, tbl, 0), 1);
+
+	memcpy(&i64, fb_test_field(fb.buf, tbl, 3), sizeof(i64));
+	TEST_EQ(i64, 0x123456789LL);
+	TEST_EQ((uintptr_t)fb_test_field(fb.buf, tbl, 3) % 8, 0);
+
+	name = fb_test_deref(fb.buf, fb_test_field(fb.buf, tbl, 1));
+	memcpy(&i32, fb.buf + name, sizeof(i32));
+	TEST_EQ(i32, 7);
+	TEST_STREQ(fb.buf + name + 4, "uftrace");
+
+	pr_dbg("check the sub-table\n");
+	sub = fb_test_deref(fb.buf, fb_test_field(fb.buf, tbl, 2));
+	memcpy(&i32, fb_test_field(fb.buf, sub, 0), sizeof(i32));
+	TEST_EQ(i32, 32);
+	TEST_EQ(*(uint8_t *)fb_test_field(fb.buf, sub, 1), 1);
+
+	pr_dbg("vector elements should be aligned\n");
+	fb_reserve(&fb, 1, 1);
+	sub = fb_vector(&fb, 2, sizeof(struct arrow_block), 8);
+	TEST_EQ((sub + 4) % 8, 0);
+
+	free(fb.buf);
+	return TEST_OK;
+}
+
+TEST_CASE(arrow_writer)
+{
+	struct arrow_writer *aw;
+	const char *filename = "arrow-test.arrow";
+	const char *names[] = { "main", "foo", "bar" };
+	char buf[8];
+	int32_t footer_len;
+	long size;
+	FILE *fp;
+	int i;
+
+	pr_dbg("write small record batches\n");
+	aw = arrow_writer_open(filename, 4);
+	TEST_NE(aw, NULL);
+
+	TEST_EQ(arrow_add_column(aw, "tid", ARROW_TYPE_INT32), 0);
+	TEST_EQ(arrow_add_column(aw, "timestamp", ARROW_TYPE_UINT64), 1);
+	TEST_EQ(arrow_add_column(aw, "function", ARROW_TYPE_DICT), 2);
+	TEST_EQ(arrow_add_column(aw, "args", ARROW_TYPE_UTF8), 3);
+	TEST_EQ(arrow_write_schema(aw), 0);
+
+	for (i = 0; i < 10; i++) {
+		arrow_set_int(aw, 0, 1234);
+		arrow_set_int(aw, 1, 1000 + i);
+		arrow_set_str(aw, 2, names[i % 3]);
+		arrow_set_str(aw, 3, i % 2 ? "" : "arg");
+		TEST_EQ(arrow_next_row(aw), 0);
+	}
+
+	pr_dbg("check the dictionary has unique values\n");
+	TEST_EQ(aw->cols[2].dict.nr_vals, 3);
+	TEST_EQ(aw->nr_batches, 2);
+	/* the first dictionary and no delta for the second batch */
+	TEST_EQ(aw->nr_dicts, 1);
+	TEST_EQ(aw->nr_rows, 2);
+
+	TEST_EQ(arrow_writer_close(aw), 0);
+
+	pr_dbg("check the file has the magic at both ends\n");
+	fp = fopen(filename, "r");
+	TEST_NE(fp, NULL);
+
+	TEST_EQ(fread(buf, 1, 8, fp), 8);
+	TEST_EQ(memcmp(buf, ARROW_MAGIC "\0\0", 8), 0);
+
+	fseek(fp, -10, SEEK_END);
+	size = ftell(fp) + 10;
+	TEST_EQ(fread(&footer_len, 1, 4, fp), 4);
+	TEST_EQ(fread(buf, 1, 6, fp), 6);
+	TEST_EQ(memcmp(buf, ARROW_MAGIC, 6), 0);
+	TEST_GT(footer_len, 0);
+	TEST_LT(footer_len, size);
+
+	fclose(fp);
+	unlink(filename);
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
@@ -0,0 +1,35 @@
+#ifndef UFTRACE_ARROW_H
+#define UFTRACE_ARROW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* default number of rows in a record batch */
+#define ARROW_BATCH_ROWS 65536
+
+/* column types supported by the writer */
+enum arrow_type {
+	ARROW_TYPE_INT8,
+	ARROW_TYPE_INT32,
+	ARROW_TYPE_INT64,
+	ARROW_TYPE_UINT64,
+	ARROW_TYPE_UTF8,
+	/* utf8 strings encoded with int32 dictionary indices */
+	ARROW_TYPE_DICT,
+};
+
+struct arrow_writer;
+
+struct arrow_writer *arrow_writer_open(const char *filename, unsigned batch_rows);
+int arrow_add_column(struct arrow_writer *aw, const char *name, enum arrow_type type);
+int arrow_write_schema(struct arrow_writer *aw);
+
+/* values should be set for every column before calling arrow_next_row() */
+void arrow_set_int(struct arrow_writer *aw, int col, int64_t val);
+void arrow_set_str(struct arrow_writer *aw, int col, const char *str);
+int arrow_next_row(struct arrow_writer *aw);
+
+int arrow_writer_close(struct arrow_writer *aw);
+
+#endif /* UFTRACE_ARROW_H */
@@ -15,6 +15,7 @@
 #include "utils/fstack.h"
 #include "utils/kernel.h"
 #include "utils/perf.h"
+#include "utils/selfstat.h"
 #include "utils/symbol.h"
 #include "utils/utils.h"
 
@@ -401,6 +402,7 @@ ok:
 	handle->depth = opts->depth;
 	handle->time_filter = opts->threshold;
 	handle->size_filter = opts->size_filter;
+	handle->low_memory = opts->low_memory;
 	handle->time_range = opts->range;
 	handle->sessions.root = RB_ROOT;
 	handle->sessions.tasks = RB_ROOT;
@@ -429,6 +431,13 @@ ok:
 	if (read_uftrace_info(handle->hdr.info_mask, handle) < 0)
 		pr_err_ns("cannot read uftrace header info!\n");
 
+	if (opts->compensate) {
+		if (handle->hdr.info_mask & OVERHEAD)
+			handle->compensate = true;
+		else
+			pr_warn("no trace overhead info, cannot compensate time\n");
+	}
+
 	if (opts->exename == NULL)
 		opts->exename = handle->info.exename;
 
@@ -436,7 +445,7 @@ ok:
 	return 0;
 }
 
-int open_data_file(struct uftrace_opts *opts, struct uftrace_data *handle)
+static int __open_data_file(struct uftrace_opts *opts, struct uftrace_data *handle)
 {
 	int ret;
 	char buf[PATH_MAX];
@@ -580,6 +589,17 @@ out:
 	return ret;
 }
 
+int open_data_file(struct uftrace_opts *opts, struct uftrace_data *handle)
+{
+	int ret;
+
+	selfstat_begin(SELFSTAT_OPEN_DATA);
+	ret = __open_data_file(opts, handle);
+	selfstat_end(SELFSTAT_OPEN_DATA);
+
+	return ret;
+}
+
 void __close_data_file(struct uftrace_opts *opts, struct uftrace_data *handle, bool unload_modules)
 {
 	if (opts->exename == handle->info.exename)
@@ -303,7 +303,7 @@ static void __print_time_unit(int64_t delta_nsec, bool needs_sign)
 	if (delta_nsec == 0UL) {
 		if (needs_sign)
 			pr_out(" ");
-		pr_out("%7s %2s", "", "");
+		fputs("          ", outfp); /* "%7s %2s" */
 		return;
 	}
 
@@ -372,8 +372,22 @@ static void __print_time_unit(int64_t delta_nsec, bool needs_sign)
 		pr_out("%*s%s%" PRId64 ".%03" PRIu64 "%s %s", indent, "", sign, delta, delta_small,
 		       ends, unit);
 	}
-	else
-		pr_out("%3" PRIu64 ".%03" PRIu64 " %s", delta, delta_small, unit);
+	else {
+		/* same as "%3lu.%03lu %s" but it's used for every record */
+		char buf[8] = {
+			delta >= 100 ? '0' + delta / 100 : ' ',
+			delta >= 10 ? '0' + delta / 10 % 10 : ' ',
+			'0' + delta % 10,
+			'.',
+			'0' + delta_small / 100,
+			'0' + delta_small / 10 % 10,
+			'0' + delta_small % 10,
+			' ',
+		};
+
+		fwrite(buf, sizeof(buf), 1, outfp);
+		fputs(unit, outfp);
+	}
 }
 
 void print_time_unit(uint64_t delta_nsec)
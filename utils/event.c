@@ -118,6 +118,12 @@ char *event_get_name(struct uftrace_data *handle, unsigned evt_id)
 		case EVENT_ID_WATCH_CPU:
 			xasprintf(&evt_name, "watch:cpu");
 			break;
+		case EVENT_ID_ALLOC_SAMPLE:
+			xasprintf(&evt_name, "alloc:sample");
+			break;
+		case EVENT_ID_LOCK_WAIT:
+			xasprintf(&evt_name, "lock:wait");
+			break;
 		default:
 			xasprintf(&evt_name, "builtin_event:%u", evt_id);
 			break;
@@ -135,6 +141,21 @@ out:
 	return evt_name;
 }
 
+/**
+ * event_get_lock_type - get a name of the lock type in lock:wait event
+ * @type - enum uftrace_lock_type
+ */
+const char *event_get_lock_type(unsigned type)
+{
+	static const char *const lock_types[] = {
+		"mutex", "rdlock", "wrlock", "cond", "sem",
+	};
+
+	if (type >= UFTRACE_LOCK_MAX)
+		return "unknown";
+	return lock_types[type];
+}
+
 /**
  * event_get_data_str - convert event data to a string
  * @evt_id - event id
@@ -155,6 +176,8 @@ char *event_get_data_str(unsigned evt_id, void *data, bool verbose)
 		struct uftrace_pmu_cycle cycle;
 		struct uftrace_pmu_cache cache;
 		struct uftrace_pmu_branch branch;
+		struct uftrace_alloc_sample alloc;
+		struct uftrace_lock_wait lock;
 		int cpu;
 	} u;
 
@@ -238,6 +261,17 @@ char *event_get_data_str(unsigned evt_id, void *data, bool verbose)
 		xasprintf(&str, "cpu=%d", u.cpu);
 		break;
 
+	case EVENT_ID_ALLOC_SAMPLE:
+		memcpy(&u.alloc, data, sizeof(u.alloc));
+		xasprintf(&str, "size=%" PRIu64 " addr=%#" PRIx64, u.alloc.size, u.alloc.addr);
+		break;
+
+	case EVENT_ID_LOCK_WAIT:
+		memcpy(&u.lock, data, sizeof(u.lock));
+		xasprintf(&str, "type=%s lock=%#" PRIx64 " wait=%" PRIu64,
+			  event_get_lock_type(u.lock.type), u.lock.lock, u.lock.wait);
+		break;
+
 	default:
 		/* kernel tracepoints */
 		if (evt_id < EVENT_ID_BUILTIN)
@@ -335,6 +369,8 @@ TEST_CASE(event_name)
 		{ EVENT_ID_READ_PMU_CACHE, "read:pmu-cache" },
 		{ EVENT_ID_DIFF_PMU_CACHE, "diff:pmu-cache" },
 		{ EVENT_ID_WATCH_CPU, "watch:cpu" },
+		{ EVENT_ID_ALLOC_SAMPLE, "alloc:sample" },
+		{ EVENT_ID_LOCK_WAIT, "lock:wait" },
 	};
 
 	pr_dbg("testing event name strings\n");
@@ -353,6 +389,8 @@ TEST_CASE(event_data)
 	char comm[] = "taskname";
 	struct uftrace_page_fault pgfault = { 1977, 1102 };
 	struct uftrace_pmu_cycle cycle = { 1024, 2048 };
+	struct uftrace_alloc_sample alloc = { 48, 0x1234560 };
+	struct uftrace_lock_wait lock = { 0x601040, 0x400500, 12345, UFTRACE_LOCK_MUTEX };
 	int cpu = 123;
 
 	struct {
@@ -365,6 +403,8 @@ TEST_CASE(event_data)
 		{ EVENT_ID_READ_PAGE_FAULT, &pgfault, "major=1977 minor=1102" },
 		{ EVENT_ID_DIFF_PMU_CYCLE, &cycle, "cycles=+1024 instructions=+2048 IPC=2.00" },
 		{ EVENT_ID_WATCH_CPU, &cpu, "cpu=123" },
+		{ EVENT_ID_ALLOC_SAMPLE, &alloc, "size=48 addr=0x1234560" },
+		{ EVENT_ID_LOCK_WAIT, &lock, "type=mutex lock=0x601040 wait=12345" },
 	};
 
 	pr_dbg("testing event data strings\n");
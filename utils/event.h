@@ -33,8 +33,31 @@ struct uftrace_pmu_branch {
 	uint64_t misses; /* branch misses */
 };
 
+struct uftrace_alloc_sample {
+	uint64_t size; /* requested size */
+	uint64_t addr; /* address of the allocated memory */
+};
+
+enum uftrace_lock_type {
+	UFTRACE_LOCK_MUTEX,
+	UFTRACE_LOCK_RDLOCK,
+	UFTRACE_LOCK_WRLOCK,
+	UFTRACE_LOCK_COND,
+	UFTRACE_LOCK_SEM,
+	UFTRACE_LOCK_MAX,
+};
+
+struct uftrace_lock_wait {
+	uint64_t lock; /* address of the lock */
+	uint64_t caller; /* address of the calling function */
+	uint64_t wait; /* waiting time in nsec */
+	uint32_t type; /* enum uftrace_lock_type */
+	uint32_t unused;
+};
+
 char *event_get_name(struct uftrace_data *handle, unsigned evt_id);
 char *event_get_data_str(unsigned evt_id, void *data, bool verbose);
+const char *event_get_lock_type(unsigned type);
 
 void finish_events_file(struct uftrace_data *handle);
 int read_events_file(struct uftrace_data *handle);
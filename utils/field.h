@@ -31,6 +31,9 @@ enum display_field_id {
 	GRAPH_F_TOTAL_TIME = 0,
 	GRAPH_F_SELF_TIME,
 	GRAPH_F_ADDR,
+	GRAPH_F_ONCPU_TIME,
+	GRAPH_F_OFFCPU_TIME,
+	GRAPH_F_WAITS,
 
 	GRAPH_F_TASK_TOTAL_TIME = 0,
 	GRAPH_F_TASK_SELF_TIME,
@@ -46,6 +49,21 @@ enum display_field_id {
 	REPORT_F_SELF_TIME_MAX,
 	REPORT_F_CALL,
 	REPORT_F_SIZE,
+	REPORT_F_TOTAL_TIME_STDDEV,
+	REPORT_F_TOTAL_TIME_P50,
+	REPORT_F_TOTAL_TIME_P90,
+	REPORT_F_TOTAL_TIME_P99,
+	REPORT_F_TOTAL_TIME_P999,
+	REPORT_F_SELF_TIME_STDDEV,
+	REPORT_F_SELF_TIME_P50,
+	REPORT_F_SELF_TIME_P90,
+	REPORT_F_SELF_TIME_P99,
+	REPORT_F_SELF_TIME_P999,
+	REPORT_F_ONCPU_TIME,
+	REPORT_F_OFFCPU_TIME,
+	REPORT_F_BLOCKED_TIME,
+	REPORT_F_PREEMPT_TIME,
+	REPORT_F_WAITS,
 
 	REPORT_F_TASK_TOTAL_TIME = 0,
 	REPORT_F_TASK_SELF_TIME,
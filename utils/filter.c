@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <fnmatch.h>
 #include <regex.h>
 #include <stdio.h>
@@ -96,6 +97,8 @@ static void print_trigger(struct uftrace_trigger *tr)
 		pr_dbg("\ttrigger: caller filter\n");
 	if (tr->flags & TRIGGER_FL_SIZE_FILTER)
 		pr_dbg("\ttrigger: size filter %u\n", tr->size);
+	if (tr->flags & TRIGGER_FL_COND)
+		pr_dbg("\ttrigger: condition (%d)\n", tr->cond->nr_insn);
 
 	if (tr->flags & TRIGGER_FL_READ) {
 		char buf[1024];
@@ -241,6 +244,18 @@ static void add_arg_spec(struct list_head *arg_list, struct uftrace_arg_spec *ar
 	}
 }
 
+static void put_trigger_cond(struct uftrace_trigger_cond *cond)
+{
+	int i;
+
+	if (cond == NULL || --cond->refcnt > 0)
+		return;
+
+	for (i = 0; i < cond->nr_insn; i++)
+		free(cond->insn[i].str);
+	free(cond);
+}
+
 void add_trigger(struct uftrace_filter *filter, struct uftrace_trigger *tr, bool exact_match)
 {
 	filter->trigger.flags |= tr->flags;
@@ -272,6 +287,11 @@ void add_trigger(struct uftrace_filter *filter, struct uftrace_trigger *tr, bool
 		filter->trigger.read |= tr->read;
 	if (tr->flags & TRIGGER_FL_SIZE_FILTER)
 		filter->trigger.size = tr->size;
+	if (tr->flags & TRIGGER_FL_COND) {
+		put_trigger_cond(filter->trigger.cond);
+		filter->trigger.cond = tr->cond;
+		tr->cond->refcnt++;
+	}
 }
 
 static int add_filter(struct rb_root *root, struct uftrace_filter *filter,
@@ -345,6 +365,7 @@ static int add_filter(struct rb_root *root, struct uftrace_filter *filter,
 	memcpy(new, filter, sizeof(*new));
 	new->trigger.flags = 0;
 	new->trigger.read = 0;
+	new->trigger.cond = NULL;
 	INIT_LIST_HEAD(&new->args);
 	new->trigger.pargs = &new->args;
 
@@ -369,6 +390,68 @@ struct {
 	{ PATT_GLOB, "glob" },
 };
 
+/* special characters (in the extended regex) which are not literal */
+#define REGEX_META_CHARS ".[]()*+?{}|^$\\"
+#define GLOB_META_CHARS "*?[]\\"
+
+/*
+ * Find literal prefix and suffix of the pattern so that it can reject
+ * non-matching names quickly before calling regexec() or fnmatch().
+ * It's conservative and leaves them empty for complex patterns.
+ */
+static void setup_literal_parts(struct uftrace_pattern *p)
+{
+	char *patt = p->patt;
+	size_t len = strlen(patt);
+	size_t i;
+
+	p->prefix = p->suffix = NULL;
+	p->prefix_len = p->suffix_len = 0;
+
+	if (p->type == PATT_GLOB) {
+		p->prefix = patt;
+		p->prefix_len = strcspn(patt, GLOB_META_CHARS);
+
+		/* escape and bracket can be anywhere, don't bother */
+		if (strpbrk(patt, "[\\") == NULL) {
+			i = len;
+			while (i > 0 && patt[i - 1] != '*' && patt[i - 1] != '?')
+				i--;
+
+			p->suffix = patt + i;
+			p->suffix_len = len - i;
+		}
+	}
+	else if (p->type == PATT_REGEX) {
+		/* alternation makes the literals optional */
+		if (strchr(patt, '|'))
+			return;
+
+		if (patt[0] == '^') {
+			p->prefix = patt + 1;
+			p->prefix_len = strcspn(patt + 1, REGEX_META_CHARS);
+
+			/* the last char might be repeated zero times (e.g. "^ab*") */
+			i = p->prefix_len + 1;
+			if (p->prefix_len && patt[i] && strchr("*?{", patt[i]))
+				p->prefix_len--;
+		}
+
+		if (len > 1 && patt[len - 1] == '$' && patt[len - 2] != '\\') {
+			i = len - 1;
+			while (i > 0 && strchr(REGEX_META_CHARS, patt[i - 1]) == NULL)
+				i--;
+
+			/* the first char was escaped (e.g. "\\bar$") */
+			if (i > 0 && patt[i - 1] == '\\' && i < len - 1)
+				i++;
+
+			p->suffix = patt + i;
+			p->suffix_len = len - 1 - i;
+		}
+	}
+}
+
 void init_locfilter_pattern(enum uftrace_pattern_type type, struct uftrace_pattern *p, char *str)
 {
 	char *converted;
@@ -404,6 +487,8 @@ void init_locfilter_pattern(enum uftrace_pattern_type type, struct uftrace_patte
 			p->type = PATT_SIMPLE;
 		}
 	}
+
+	setup_literal_parts(p);
 }
 
 void init_filter_pattern(enum uftrace_pattern_type type, struct uftrace_pattern *p, char *str)
@@ -425,10 +510,22 @@ void init_filter_pattern(enum uftrace_pattern_type type, struct uftrace_pattern
 			p->type = PATT_SIMPLE;
 		}
 	}
+
+	setup_literal_parts(p);
 }
 
 bool match_filter_pattern(struct uftrace_pattern *p, char *name)
 {
+	if (p->prefix_len && strncmp(name, p->prefix, p->prefix_len))
+		return false;
+
+	if (p->suffix_len) {
+		size_t len = strlen(name);
+
+		if (len < p->suffix_len || memcmp(name + len - p->suffix_len, p->suffix, p->suffix_len))
+			return false;
+	}
+
 	switch (p->type) {
 	case PATT_SIMPLE:
 		return !strcmp(p->patt, name);
@@ -441,6 +538,26 @@ bool match_filter_pattern(struct uftrace_pattern *p, char *name)
 	}
 }
 
+/**
+ * get_pattern_prefix - return literal prefix of the pattern
+ * @p   - filter pattern
+ * @len - pointer to save the prefix length
+ *
+ * This function returns the literal string that all matching names should
+ * start with, or %NULL if it's empty.  For simple patterns, the @len
+ * includes the terminating NUL so that it can only match the same name.
+ */
+const char *get_pattern_prefix(struct uftrace_pattern *p, size_t *len)
+{
+	if (p->type == PATT_SIMPLE) {
+		*len = strlen(p->patt) + 1;
+		return p->patt;
+	}
+
+	*len = p->prefix_len;
+	return p->prefix_len ? p->prefix : NULL;
+}
+
 bool match_location_filter(struct uftrace_pattern *p, struct uftrace_dbg_info *dinfo,
 			   size_t loc_idx)
 {
@@ -463,6 +580,8 @@ void free_filter_pattern(struct uftrace_pattern *p)
 		regfree(&p->re);
 
 	p->type = PATT_NONE;
+	p->prefix = p->suffix = NULL;
+	p->prefix_len = p->suffix_len = 0;
 }
 
 enum uftrace_pattern_type parse_filter_pattern(const char *str)
@@ -705,6 +824,133 @@ static int parse_hide_action(char *action, struct uftrace_trigger *tr,
 	return 0;
 }
 
+static const struct {
+	const char *name;
+	enum trigger_cond_op op;
+} cond_ops[] = {
+	/* longer names should come first */
+	{ "==", COND_OP_EQ }, { "!=", COND_OP_NE }, { "<=", COND_OP_LE }, { ">=", COND_OP_GE },
+	{ "<", COND_OP_LT },  { ">", COND_OP_GT },  { "&", COND_OP_AND }, { "~", COND_OP_MATCH },
+	{ "=", COND_OP_EQ },
+};
+
+/* cond = [str:]argN[/fmt][%loc] OP value, value can be quoted for strings */
+static int parse_cond_insn(char *str, struct uftrace_cond_insn *insn,
+			   struct uftrace_filter_setting *setting)
+{
+	struct uftrace_arg_spec *arg;
+	bool is_str = false;
+	char *lhs, *rhs, *end;
+	size_t i, len;
+
+	if (!strncmp(str, "str:", 4)) {
+		is_str = true;
+		str += 4;
+	}
+
+	rhs = strpbrk(str, "=!<>&~");
+	if (rhs == NULL || rhs == str)
+		return -1;
+
+	for (i = 0; i < ARRAY_SIZE(cond_ops); i++) {
+		if (!strncmp(rhs, cond_ops[i].name, strlen(cond_ops[i].name)))
+			break;
+	}
+	if (i == ARRAY_SIZE(cond_ops))
+		return -1;
+
+	lhs = xstrndup(str, rhs - str);
+	arg = parse_argspec(lhs, setting);
+	free(lhs);
+
+	if (arg == NULL)
+		return -1;
+
+	/* only integer and string arguments at function entry */
+	if (arg->idx == RETVAL_IDX || arg->type == ARG_TYPE_FLOAT ||
+	    (arg->fmt != ARG_FMT_AUTO && arg->fmt != ARG_FMT_SINT && arg->fmt != ARG_FMT_UINT &&
+	     arg->fmt != ARG_FMT_HEX && arg->fmt != ARG_FMT_PTR && arg->fmt != ARG_FMT_CHAR &&
+	     arg->fmt != ARG_FMT_STR)) {
+		free_arg_spec(arg);
+		return -1;
+	}
+
+	if (is_str)
+		arg->fmt = ARG_FMT_STR;
+
+	insn->spec = *arg;
+	insn->spec.type_name = NULL;
+	insn->op = cond_ops[i].op;
+	insn->is_signed = arg->fmt == ARG_FMT_AUTO || arg->fmt == ARG_FMT_SINT;
+	free_arg_spec(arg);
+
+	rhs += strlen(cond_ops[i].name);
+
+	if (insn->spec.fmt == ARG_FMT_STR) {
+		if (insn->op != COND_OP_EQ && insn->op != COND_OP_NE && insn->op != COND_OP_MATCH)
+			return -1;
+
+		len = strlen(rhs);
+		if (len >= 2 && (rhs[0] == '"' || rhs[0] == '\'') && rhs[len - 1] == rhs[0]) {
+			rhs++;
+			len -= 2;
+		}
+		insn->str = xstrndup(rhs, len);
+		return 0;
+	}
+
+	/* the value is masked by its size in bits */
+	if (insn->op == COND_OP_MATCH || *rhs == '\0' || insn->spec.size == 0 ||
+	    insn->spec.size > (int)sizeof(insn->val))
+		return -1;
+
+	errno = 0;
+	if (insn->is_signed)
+		insn->val = strtoll(rhs, &end, 0);
+	else
+		insn->val = strtoull(rhs, &end, 0);
+
+	if (errno || *end != '\0')
+		return -1;
+	return 0;
+}
+
+static int parse_cond_action(char *action, struct uftrace_trigger *tr,
+			     struct uftrace_filter_setting *setting)
+{
+	struct uftrace_trigger_cond *cond = tr->cond;
+	int nr = cond ? cond->nr_insn : 0;
+
+	/* the condition was already applied to the recorded data (live) */
+	if (setting->skip_cond) {
+		pr_dbg("skipping condition: %s\n", action);
+		return 0;
+	}
+
+	/* arguments are not available when analyzing recorded data */
+	if (!setting->allow_cond) {
+		pr_warn("'if' condition is only supported in record and live, skipping: %s\n",
+			action);
+		return -1;
+	}
+
+	/* multiple conditions are ANDed */
+	cond = xrealloc(cond, sizeof(*cond) + (nr + 1) * sizeof(*cond->insn));
+	cond->refcnt = 1;
+	cond->nr_insn = nr;
+	tr->cond = cond;
+
+	memset(&cond->insn[nr], 0, sizeof(*cond->insn));
+	if (parse_cond_insn(action + 3, &cond->insn[nr], setting) < 0) {
+		pr_use("skipping invalid condition: %s\n", action);
+		return -1;
+	}
+
+	cond->nr_insn++;
+	tr->flags |= TRIGGER_FL_COND;
+	return 0;
+}
+
 struct trigger_action_parser {
 	const char *name;
 	int (*parse)(char *action, struct uftrace_trigger *tr,
@@ -773,6 +1019,11 @@ static const struct trigger_action_parser actions[] = {
 		parse_finish_action,
 		TRIGGER_FL_SIGNAL,
 	},
+	{
+		"if=",
+		parse_cond_action,
+		TRIGGER_FL_FILTER,
+	},
 	{
 		"read=",
 		parse_read_action,
@@ -847,38 +1098,81 @@ out:
 	return ret;
 }
 
+static int add_trigger_sym(struct rb_root *root, struct uftrace_symbol *sym,
+			   struct uftrace_pattern *patt, struct uftrace_trigger *tr,
+			   struct uftrace_mmap *map, struct uftrace_filter_setting *setting)
+{
+	struct uftrace_filter filter;
+
+	if (setting->plt_only && sym->type != ST_PLT_FUNC)
+		return 0;
+
+	filter.name = sym->name;
+	filter.start = sym->addr;
+	filter.end = sym->addr + sym->size;
+
+	return add_filter(root, &filter, tr, map, patt->type == PATT_SIMPLE, &map->mod->dinfo,
+			  setting);
+}
+
+/* find the first index of (name-sorted) symbols which is not less than the prefix */
+static size_t find_prefix_index(struct uftrace_symtab *symtab, const char *prefix, size_t len)
+{
+	size_t lo = 0;
+	size_t hi = symtab->nr_sym;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (strncmp(symtab->sym_names[mid]->name, prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
 static int add_trigger_entry(struct rb_root *root, struct uftrace_pattern *patt,
 			     struct uftrace_trigger *tr, struct uftrace_mmap *map,
 			     struct uftrace_filter_setting *setting)
 {
-	struct uftrace_filter filter;
 	struct uftrace_symtab *symtab = &map->mod->symtab;
 	struct uftrace_dbg_info *dinfo = &map->mod->dinfo;
 	struct uftrace_symbol *sym;
-	size_t i;
+	const char *prefix;
+	size_t i, len;
 	int ret = 0;
 
-	for (i = 0; i < symtab->nr_sym; i++) {
-		sym = &symtab->sym[i];
+	if (tr->flags == TRIGGER_FL_LOC) {
+		for (i = 0; i < symtab->nr_sym; i++) {
+			sym = &symtab->sym[i];
 
-		if (tr->flags == TRIGGER_FL_LOC) {
-			if (!match_location_filter(patt, dinfo, i))
-				continue;
-		}
-		else {
-			if (!match_filter_pattern(patt, sym->name))
-				continue;
+			if (match_location_filter(patt, dinfo, i))
+				ret += add_trigger_sym(root, sym, patt, tr, map, setting);
 		}
+		return ret;
+	}
 
-		if (setting->plt_only && sym->type != ST_PLT_FUNC)
-			continue;
+	/* check the symbols having the literal prefix only, using the name index */
+	prefix = get_pattern_prefix(patt, &len);
+	if (prefix && symtab->name_sorted) {
+		for (i = find_prefix_index(symtab, prefix, len); i < symtab->nr_sym; i++) {
+			sym = symtab->sym_names[i];
 
-		filter.name = sym->name;
-		filter.start = sym->addr;
-		filter.end = sym->addr + sym->size;
+			if (strncmp(sym->name, prefix, len))
+				break;
 
-		ret += add_filter(root, &filter, tr, map, patt->type == PATT_SIMPLE, dinfo,
-				  setting);
+			if (match_filter_pattern(patt, sym->name))
+				ret += add_trigger_sym(root, sym, patt, tr, map, setting);
+		}
+		return ret;
+	}
+
+	for (i = 0; i < symtab->nr_sym; i++) {
+		sym = &symtab->sym[i];
+
+		if (match_filter_pattern(patt, sym->name))
+			ret += add_trigger_sym(root, sym, patt, tr, map, setting);
 	}
 
 	return ret;
@@ -992,6 +1286,7 @@ static void setup_trigger(char *filter_str, struct uftrace_sym_info *sinfo, stru
 next:
 		free_filter_pattern(&patt);
 		free(module);
+		put_trigger_cond(tr.cond);
 
 		while (!list_empty(&args)) {
 			arg = list_first_entry(&args, typeof(*arg), list);
@@ -1128,6 +1423,8 @@ void uftrace_cleanup_filter(struct rb_root *root)
 			list_del(&arg->list);
 			free_arg_spec(arg);
 		}
+		if (filter->trigger.flags & TRIGGER_FL_COND)
+			put_trigger_cond(filter->trigger.cond);
 		free(filter);
 	}
 }
@@ -1175,6 +1472,57 @@ char *uftrace_clear_kernel(char *filter_str)
 	return ret;
 }
 
+static bool is_arg_action(const char *action)
+{
+	return !strncmp(action, "arg", 3) || !strncmp(action, "fparg", 5) ||
+	       !strncmp(action, "retval", 6);
+}
+
+/* remove argument and return value actions from the trigger string */
+char *uftrace_clear_trigger_args(char *trigger_str)
+{
+	struct strv triggers = STRV_INIT;
+	char *pos, *ret = NULL;
+	int j;
+
+	if (trigger_str == NULL)
+		return NULL;
+
+	strv_split(&triggers, trigger_str, ";");
+
+	strv_for_each(&triggers, pos, j) {
+		struct strv actions = STRV_INIT;
+		char *name, *act, *new_actions = NULL;
+		int k;
+
+		act = strchr(pos, '@');
+		if (act == NULL) {
+			ret = strjoin(ret, pos, ";");
+			continue;
+		}
+		*act = '\0';
+
+		strv_split(&actions, act + 1, ",");
+		strv_for_each(&actions, act, k) {
+			if (!is_arg_action(act))
+				new_actions = strjoin(new_actions, act, ",");
+		}
+		strv_free(&actions);
+
+		/* drop the function if it has no other actions */
+		if (new_actions == NULL)
+			continue;
+
+		name = strjoin(xstrdup(pos), new_actions, "@");
+		ret = strjoin(ret, name, ";");
+		free(name);
+		free(new_actions);
+	}
+	strv_free(&triggers);
+
+	return ret;
+}
+
 #ifdef UNIT_TEST
 
 static void filter_test_load_symtabs(struct uftrace_sym_info *sinfo)
@@ -1447,6 +1795,100 @@ TEST_CASE(filter_match)
 	return TEST_OK;
 }
 
+TEST_CASE(filter_pattern_literal)
+{
+	struct uftrace_pattern patt;
+	struct uftrace_sym_info sinfo = {
+		.loaded = false,
+	};
+	struct uftrace_symtab *symtab;
+	struct rb_root root = RB_ROOT;
+	struct rb_node *node;
+	struct uftrace_filter *filter;
+	struct uftrace_filter_setting setting = {
+		.ptype = PATT_REGEX,
+	};
+	/* sorted index of the symbols in filter_test_load_symtabs() */
+	int name_order[] = { 1, 2, 3, 4, 0, 5, 7, 6 };
+	const char *prefix;
+	size_t i, len;
+	int count;
+
+	pr_dbg("check literal prefix and suffix of patterns\n");
+	init_filter_pattern(PATT_REGEX, &patt, "^foo::b");
+	prefix = get_pattern_prefix(&patt, &len);
+	TEST_EQ(len, 6UL);
+	TEST_EQ(strncmp(prefix, "foo::b", len), 0);
+	TEST_EQ(match_filter_pattern(&patt, "foo::bar"), true);
+	TEST_EQ(match_filter_pattern(&patt, "foo::foo"), false);
+	free_filter_pattern(&patt);
+
+	init_filter_pattern(PATT_REGEX, &patt, "^ab*");
+	prefix = get_pattern_prefix(&patt, &len);
+	TEST_EQ(len, 1UL);
+	TEST_EQ(match_filter_pattern(&patt, "a"), true);
+	free_filter_pattern(&patt);
+
+	init_filter_pattern(PATT_REGEX, &patt, "\\bbar$");
+	TEST_EQ(patt.suffix_len, 3UL);
+	TEST_EQ(match_filter_pattern(&patt, "foo::bar"), true);
+	TEST_EQ(match_filter_pattern(&patt, "foo::baz1"), false);
+	free_filter_pattern(&patt);
+
+	init_filter_pattern(PATT_REGEX, &patt, "^x|y");
+	TEST_EQ(get_pattern_prefix(&patt, &len), NULL);
+	TEST_EQ(patt.suffix_len, 0UL);
+	TEST_EQ(match_filter_pattern(&patt, "y"), true);
+	free_filter_pattern(&patt);
+
+	init_filter_pattern(PATT_GLOB, &patt, "foo*z?");
+	TEST_EQ(patt.prefix_len, 3UL);
+	TEST_EQ(patt.suffix_len, 0UL);
+	TEST_EQ(match_filter_pattern(&patt, "foo::baz1"), true);
+	free_filter_pattern(&patt);
+
+	init_filter_pattern(PATT_GLOB, &patt, "foo*bar");
+	TEST_EQ(patt.prefix_len, 3UL);
+	TEST_EQ(patt.suffix_len, 3UL);
+	TEST_EQ(match_filter_pattern(&patt, "foo::bar"), true);
+	TEST_EQ(match_filter_pattern(&patt, "foo::baz1"), false);
+	free_filter_pattern(&patt);
+
+	pr_dbg("check filter setup using the name index\n");
+	filter_test_load_symtabs(&sinfo);
+	symtab = &sinfo.maps->mod->symtab;
+	symtab->sym_names = xmalloc(sizeof(*symtab->sym_names) * symtab->nr_sym);
+	for (i = 0; i < symtab->nr_sym; i++)
+		symtab->sym_names[i] = &symtab->sym[name_order[i]];
+	symtab->name_sorted = true;
+
+	uftrace_setup_filter("^foo::baz", &sinfo, &root, NULL, &setting);
+	count = 0;
+	node = rb_first(&root);
+	while (node) {
+		filter = rb_entry(node, struct uftrace_filter, node);
+		TEST_EQ(strncmp(filter->name, "foo::baz", 8), 0);
+		node = rb_next(node);
+		count++;
+	}
+	TEST_EQ(count, 3);
+	uftrace_cleanup_filter(&root);
+
+	setting.ptype = PATT_SIMPLE;
+	uftrace_setup_filter("foo::foo", &sinfo, &root, NULL, &setting);
+	node = rb_first(&root);
+	filter = rb_entry(node, struct uftrace_filter, node);
+	TEST_STREQ(filter->name, "foo::foo");
+	TEST_EQ(rb_next(node), NULL);
+	uftrace_cleanup_filter(&root);
+
+	free(symtab->sym_names);
+	symtab->sym_names = NULL;
+	symtab->name_sorted = false;
+
+	return TEST_OK;
+}
+
 TEST_CASE(trigger_setup_actions)
 {
 	struct uftrace_sym_info sinfo = {
@@ -1556,6 +1998,86 @@ TEST_CASE(trigger_setup_filters)
 	return TEST_OK;
 }
 
+TEST_CASE(trigger_setup_cond)
+{
+	struct uftrace_sym_info sinfo = {
+		.loaded = false,
+	};
+	struct rb_root root = RB_ROOT;
+	struct uftrace_trigger tr;
+	struct uftrace_cond_insn *insn;
+	enum filter_mode fmode = FILTER_MODE_NONE;
+	struct uftrace_filter_setting setting = {
+		.ptype = PATT_REGEX,
+		.lp64 = host_is_lp64(),
+		.allow_cond = true,
+	};
+
+	filter_test_load_symtabs(&sinfo);
+
+	pr_dbg("setup filter with an integer condition\n");
+	uftrace_setup_filter("foo::bar@if=arg1>1048576", &sinfo, &root, &fmode, &setting);
+	TEST_EQ(fmode, FILTER_MODE_IN);
+
+	memset(&tr, 0, sizeof(tr));
+	TEST_NE(uftrace_match_filter(0x2500, &root, &tr), NULL);
+	TEST_EQ(tr.flags, TRIGGER_FL_FILTER | TRIGGER_FL_COND);
+	TEST_EQ(tr.cond->nr_insn, 1);
+
+	insn = &tr.cond->insn[0];
+	TEST_EQ(insn->spec.idx, 1);
+	TEST_EQ(insn->op, COND_OP_GT);
+	TEST_EQ(insn->is_signed, true);
+	TEST_EQ(insn->val, 1048576ULL);
+
+	pr_dbg("setup trigger with multiple conditions\n");
+	uftrace_setup_trigger("foo::baz1@if=str:arg1~\"user:*\",if=arg2/u16!=0x10,depth=1", &sinfo,
+			      &root, NULL, &setting);
+
+	memset(&tr, 0, sizeof(tr));
+	TEST_NE(uftrace_match_filter(0x3000, &root, &tr), NULL);
+	TEST_EQ(tr.flags, TRIGGER_FL_COND | TRIGGER_FL_DEPTH);
+	TEST_EQ(tr.cond->nr_insn, 2);
+
+	insn = &tr.cond->insn[0];
+	TEST_EQ(insn->spec.fmt, ARG_FMT_STR);
+	TEST_EQ(insn->op, COND_OP_MATCH);
+	TEST_STREQ(insn->str, "user:*");
+
+	insn = &tr.cond->insn[1];
+	TEST_EQ(insn->spec.idx, 2);
+	TEST_EQ(insn->spec.size, 2);
+	TEST_EQ(insn->op, COND_OP_NE);
+	TEST_EQ(insn->is_signed, false);
+	TEST_EQ(insn->val, 16ULL);
+
+	pr_dbg("invalid conditions should be ignored\n");
+	uftrace_setup_trigger("foo::baz2@if=retval>0;foo::baz3@if=str:arg1<1", &sinfo, &root, NULL,
+			      &setting);
+	memset(&tr, 0, sizeof(tr));
+	TEST_EQ(uftrace_match_filter(0x4100, &root, &tr), NULL);
+	TEST_EQ(uftrace_match_filter(0x5000, &root, &tr), NULL);
+
+	pr_dbg("conditions are not allowed when analyzing data\n");
+	setting.allow_cond = false;
+	uftrace_setup_trigger("foo::baz3@if=arg1>0,depth=2", &sinfo, &root, NULL, &setting);
+	memset(&tr, 0, sizeof(tr));
+	TEST_EQ(uftrace_match_filter(0x5000, &root, &tr), NULL);
+
+	pr_dbg("conditions are skipped silently after live recording\n");
+	setting.skip_cond = true;
+	uftrace_setup_trigger("foo::baz3@if=arg1>0,depth=2", &sinfo, &root, NULL, &setting);
+	memset(&tr, 0, sizeof(tr));
+	TEST_NE(uftrace_match_filter(0x5000, &root, &tr), NULL);
+	TEST_EQ(tr.flags, TRIGGER_FL_DEPTH);
+	TEST_EQ(tr.depth, 2);
+
+	uftrace_cleanup_filter(&root);
+	TEST_EQ(RB_EMPTY_ROOT(&root), true);
+
+	return TEST_OK;
+}
+
 TEST_CASE(trigger_setup_args)
 {
 	struct uftrace_sym_info sinfo = {
@@ -1705,6 +2227,27 @@ TEST_CASE(trigger_setup_args)
 	return TEST_OK;
 }
 
+TEST_CASE(trigger_clear_args)
+{
+	char *str;
+
+	pr_dbg("remove argument and return value actions\n");
+	str = uftrace_clear_trigger_args("a@arg1,depth=2;b@retval;c@fparg1/64,arg2/s,trace");
+	TEST_STREQ("a@depth=2;c@trace", str);
+	free(str);
+
+	pr_dbg("keep conditions using arguments\n");
+	str = uftrace_clear_trigger_args("a@if=arg1==1,arg2");
+	TEST_STREQ("a@if=arg1==1", str);
+	free(str);
+
+	pr_dbg("nothing is left\n");
+	str = uftrace_clear_trigger_args("b@arg1");
+	TEST_EQ(str, NULL);
+
+	return TEST_OK;
+}
+
 static struct uftrace_mmap *locfilter_test_load_mmap()
 {
 	static struct uftrace_symbol syms[] = {
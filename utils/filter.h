@@ -38,6 +38,7 @@ enum trigger_flag {
 	TRIGGER_FL_HIDE = (1U << 17),
 	TRIGGER_FL_LOC = (1U << 18),
 	TRIGGER_FL_SIZE_FILTER = (1U << 19),
+	TRIGGER_FL_COND = (1U << 20),
 };
 
 enum filter_mode {
@@ -55,6 +56,33 @@ enum trigger_read_type {
 	TRIGGER_READ_PMU_BRANCH = 16,
 };
 
+enum trigger_cond_op {
+	COND_OP_EQ,
+	COND_OP_NE,
+	COND_OP_LT,
+	COND_OP_LE,
+	COND_OP_GT,
+	COND_OP_GE,
+	COND_OP_AND, /* some bits are set */
+	COND_OP_MATCH, /* glob pattern match of a string */
+};
+
+/* a comparison in the 'if=' action, the argument is read using @spec */
+struct uftrace_cond_insn {
+	struct uftrace_arg_spec spec;
+	enum trigger_cond_op op;
+	bool is_signed;
+	uint64_t val;
+	char *str;
+};
+
+/* all instructions should be true to apply the trigger */
+struct uftrace_trigger_cond {
+	int refcnt;
+	int nr_insn;
+	struct uftrace_cond_insn insn[];
+};
+
 struct uftrace_trigger {
 	enum trigger_flag flags;
 	int depth;
@@ -65,6 +93,7 @@ struct uftrace_trigger {
 	enum filter_mode lmode;
 	enum trigger_read_type read;
 	struct list_head *pargs;
+	struct uftrace_trigger_cond *cond;
 };
 
 struct uftrace_filter {
@@ -87,6 +116,11 @@ struct uftrace_pattern {
 	enum uftrace_pattern_type type;
 	char *patt;
 	regex_t re;
+	/* literal parts (in patt) that every matching name should have */
+	size_t prefix_len;
+	size_t suffix_len;
+	const char *prefix;
+	const char *suffix;
 };
 
 struct uftrace_filter_setting {
@@ -96,6 +130,10 @@ struct uftrace_filter_setting {
 	bool allow_kernel;
 	bool lp64;
 	bool plt_only;
+	/* conditions (if=) can be checked only when recording */
+	bool allow_cond;
+	/* ignore conditions silently as they were checked when recording */
+	bool skip_cond;
 	/* caller-defined data */
 	void *info_str;
 };
@@ -128,11 +166,13 @@ int uftrace_count_filter(struct rb_root *root, unsigned long flag);
 
 void init_filter_pattern(enum uftrace_pattern_type type, struct uftrace_pattern *p, char *str);
 bool match_filter_pattern(struct uftrace_pattern *p, char *name);
+const char *get_pattern_prefix(struct uftrace_pattern *p, size_t *len);
 void free_filter_pattern(struct uftrace_pattern *p);
 enum uftrace_pattern_type parse_filter_pattern(const char *str);
 const char *get_filter_pattern(enum uftrace_pattern_type ptype);
 
 char *uftrace_clear_kernel(char *filter_str);
+char *uftrace_clear_trigger_args(char *trigger_str);
 
 void add_trigger(struct uftrace_filter *filter, struct uftrace_trigger *tr, bool exact_match);
 int setup_trigger_action(char *str, struct uftrace_trigger *tr, char **module,
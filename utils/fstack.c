@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 /* This should be defined before #include "utils.h" */
 #define PR_FMT "fstack"
@@ -16,6 +18,7 @@
 #include "utils/fstack.h"
 #include "utils/kernel.h"
 #include "utils/rbtree.h"
+#include "utils/selfstat.h"
 #include "utils/utils.h"
 
 bool fstack_enabled = true;
@@ -61,32 +64,140 @@ static void setup_task_handle(struct uftrace_data *handle, struct uftrace_task_r
 	/* FIXME: save filter depth at fork() and restore */
 	for (i = 0; i < max_stack; i++)
 		task->func_stack[i].orig_depth = handle->depth;
+
+	task->ready = !task->done;
 }
 
-void reset_task_handle(struct uftrace_data *handle)
+/* keep some file descriptors for other data files */
+#define TASK_FILE_RESERVED 64
+#define TASK_FILE_MAX 1024
+
+static int get_max_task_files(void)
 {
-	int i;
-	struct uftrace_task_reader *task;
+	struct rlimit rlim;
+	int max = TASK_FILE_MAX;
 
-	for (i = 0; i < handle->nr_tasks; i++) {
-		task = &handle->tasks[i];
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0 || rlim.rlim_cur == RLIM_INFINITY)
+		return max;
 
-		task->done = true;
+	if (rlim.rlim_cur < TASK_FILE_RESERVED * 2)
+		max = rlim.rlim_cur / 2;
+	else if (rlim.rlim_cur - TASK_FILE_RESERVED < (rlim_t)max)
+		max = rlim.rlim_cur - TASK_FILE_RESERVED;
 
-		if (task->fp) {
-			fclose(task->fp);
-			task->fp = NULL;
-		}
+	return max > 0 ? max : 1;
+}
 
-		free(task->args.data);
-		task->args.data = NULL;
+/* read more data at once for tasks which have more records */
+static size_t get_task_bufsize(struct uftrace_task_reader *task)
+{
+	if (task->nr_reads < 256)
+		return 4096;
+	if (task->nr_reads < 16384)
+		return 16384;
+	return 65536;
+}
+
+static void close_task_file(struct uftrace_task_reader *task)
+{
+	if (task->fp == NULL)
+		return;
+
+	/* save the offset to continue reading after reopen */
+	task->offset = ftello(task->fp);
+	fclose(task->fp);
+	task->fp = NULL;
+
+	free(task->iobuf);
+	task->iobuf = NULL;
+
+	list_del_init(&task->lru);
+	task->h->nr_task_files--;
+}
+
+/**
+ * get_task_file - make sure the data file of @task is open
+ * @handle: file handle
+ * @task: task handle
+ *
+ * This function opens the data file of @task if it's not open already.
+ * The number of open files is limited so that it can read data having
+ * a lot of tasks.  When it reaches the limit, the least recently used
+ * file is closed and it'll be reopened at the saved offset later.
+ *
+ * It returns 0 if the file is ready to read, -1 otherwise.
+ */
+static int get_task_file(struct uftrace_data *handle, struct uftrace_task_reader *task)
+{
+	struct uftrace_task_reader *lru;
+	char *filename;
+	size_t bufsize;
 
-		free(task->func_stack);
-		task->func_stack = NULL;
+	if (task->fp) {
+		list_move(&task->lru, &handle->task_files);
+		return 0;
+	}
 
-		reset_rstack_list(&task->rstack_list);
-		reset_rstack_list(&task->event_list);
+	if (handle->nr_task_files >= handle->max_task_files) {
+		lru = list_last_entry(&handle->task_files, typeof(*lru), lru);
+		close_task_file(lru);
+	}
+
+	xasprintf(&filename, "%s/%d.dat", handle->dirname, task->tid);
+	task->fp = fopen(filename, "rb");
+	if (task->fp == NULL) {
+		pr_dbg("cannot open task data file: %s: %m\n", filename);
+		task->done = true;
+		free(filename);
+		return -1;
 	}
+	pr_dbg3("opening %s (offset: %lld)\n", filename, (long long)task->offset);
+	free(filename);
+
+	bufsize = get_task_bufsize(task);
+	task->iobuf = xmalloc(bufsize);
+	setvbuf(task->fp, task->iobuf, _IOFBF, bufsize);
+
+	if (task->offset && fseeko(task->fp, task->offset, SEEK_SET) < 0)
+		pr_warn("cannot seek task data file: %d.dat: %m\n", task->tid);
+
+	list_add(&task->lru, &handle->task_files);
+	handle->nr_task_files++;
+	return 0;
+}
+
+/**
+ * release_task_handle - release resources of a task
+ * @task: task handle
+ *
+ * This function closes the data file and frees the function stack of
+ * @task.  It's called for each task after reading all records when
+ * --low-memory is given.  The task cannot be read anymore.
+ */
+void release_task_handle(struct uftrace_task_reader *task)
+{
+	task->done = true;
+	task->ready = false;
+
+	close_task_file(task);
+
+	free(task->args.data);
+	task->args.data = NULL;
+
+	free(task->func_stack);
+	task->func_stack = NULL;
+
+	reset_rstack_list(&task->rstack_list);
+	reset_rstack_list(&task->event_list);
+	release_task_perf_event(task);
+}
+
+void reset_task_handle(struct uftrace_data *handle)
+{
+	int i;
+
+	for (i = 0; i < handle->nr_tasks; i++)
+		release_task_handle(&handle->tasks[i]);
 
 	free(handle->tasks);
 	handle->tasks = NULL;
@@ -104,15 +215,14 @@ static void prepare_task_handle(struct uftrace_data *handle, struct uftrace_task
 	task->h = handle;
 	task->t = find_task(&handle->sessions, tid);
 
+	INIT_LIST_HEAD(&task->lru);
+
+	/* it'll be opened when it's read */
 	xasprintf(&filename, "%s/%d.dat", handle->dirname, tid);
-	task->fp = fopen(filename, "rb");
-	if (task->fp == NULL) {
+	if (access(filename, R_OK) < 0) {
 		pr_dbg("cannot open task data file: %s: %m\n", filename);
 		task->done = true;
 	}
-	else
-		pr_dbg2("opening %s\n", filename);
-
 	free(filename);
 
 	setup_rstack_list(&task->rstack_list);
@@ -170,6 +280,10 @@ void fstack_setup_task(char *tid_filter, struct uftrace_data *handle)
 	pr_dbg("setup filters for %d task(s)\n", nr_filters);
 
 setup:
+	INIT_LIST_HEAD(&handle->task_files);
+	handle->nr_task_files = 0;
+	handle->max_task_files = get_max_task_files();
+
 	handle->nr_tasks = handle->info.nr_tid;
 	handle->tasks = xmalloc(sizeof(*handle->tasks) * handle->nr_tasks);
 
@@ -195,19 +309,21 @@ setup:
 		}
 
 		if (!found) {
-			task->done = true;
-
 			/* need to read the data to check elapsed time */
-			if (task->fp) {
+			if (!task->done && get_task_file(handle, task) == 0) {
 				if (!__read_task_ustack(task)) {
 					update_first_timestamp(handle, task, &task->ustack);
 				}
-				fclose(task->fp);
-				task->fp = NULL;
+				close_task_file(task);
 			}
+			task->done = true;
 			continue;
 		}
 
+		/* it'll be set up when it's read */
+		if (handle->low_memory && !task->done)
+			continue;
+
 		setup_task_handle(handle, task, tid);
 	}
 
@@ -479,12 +595,15 @@ void setup_fstack_args(char *argspec, char *retspec, struct uftrace_data *handle
  */
 int fstack_setup_filters(struct uftrace_opts *opts, struct uftrace_data *handle)
 {
+	selfstat_begin(SELFSTAT_SETUP_FILTER);
+
 	if (opts->filter || opts->trigger || opts->caller || opts->hide || opts->loc_filter) {
 		struct uftrace_filter_setting setting = {
 			.ptype = opts->patt_type,
 			.allow_kernel = true,
 			.lp64 = data_is_lp64(handle),
 			.arch = handle->arch,
+			.skip_cond = opts->skip_cond,
 		};
 
 		if (setup_fstack_filters(handle, opts->filter, opts->trigger, opts->caller,
@@ -521,6 +640,8 @@ int fstack_setup_filters(struct uftrace_opts *opts, struct uftrace_data *handle)
 	fstack_setup_task(opts->tid, handle);
 
 	fstack_prepare_fixup(handle);
+
+	selfstat_end(SELFSTAT_SETUP_FILTER);
 	return 0;
 }
 
@@ -1384,6 +1505,8 @@ int read_task_event(struct uftrace_task_reader *task, struct uftrace_record *rec
 		struct uftrace_pmu_cycle cycle;
 		struct uftrace_pmu_cache cache;
 		struct uftrace_pmu_branch branch;
+		struct uftrace_alloc_sample alloc;
+		struct uftrace_lock_wait lock;
 		int cpu;
 	} u;
 
@@ -1463,6 +1586,32 @@ int read_task_event(struct uftrace_task_reader *task, struct uftrace_record *rec
 		save_task_event(task, &u.cpu, sizeof(u.cpu));
 		break;
 
+	case EVENT_ID_ALLOC_SAMPLE:
+		if (read_task_event_size(task, &u.alloc, sizeof(u.alloc)) < 0)
+			return -1;
+
+		if (task->h->needs_byte_swap) {
+			u.alloc.size = bswap_64(u.alloc.size);
+			u.alloc.addr = bswap_64(u.alloc.addr);
+		}
+
+		save_task_event(task, &u.alloc, sizeof(u.alloc));
+		break;
+
+	case EVENT_ID_LOCK_WAIT:
+		if (read_task_event_size(task, &u.lock, sizeof(u.lock)) < 0)
+			return -1;
+
+		if (task->h->needs_byte_swap) {
+			u.lock.lock = bswap_64(u.lock.lock);
+			u.lock.caller = bswap_64(u.lock.caller);
+			u.lock.wait = bswap_64(u.lock.wait);
+			u.lock.type = bswap_32(u.lock.type);
+		}
+
+		save_task_event(task, &u.lock, sizeof(u.lock));
+		break;
+
 	default:
 		pr_err_ns("unknown event has data: %u\n", rec->addr);
 		break;
@@ -1477,7 +1626,7 @@ int read_task_event(struct uftrace_task_reader *task, struct uftrace_record *rec
  * @task: tracee task
  *
  * This function reads current ftrace record and save it to @task->ustack.
- * Data file it accesses should be opened already.  When @task->valid is
+ * The data file is opened (or reopened) if needed.  When @task->valid is
  * set, it just returns @task->ustack already read, so if you want to force
  * read from file, the @task->valid should be reset before calling this
  * function.
@@ -1489,9 +1638,18 @@ int read_task_ustack(struct uftrace_data *handle, struct uftrace_task_reader *ta
 	if (task->valid)
 		return 0;
 
-	if (task->done || task->fp == NULL)
+	if (task->done)
+		return -1;
+
+	if (get_task_file(handle, task) < 0)
 		return -1;
 
+	/* --low-memory sets up the task lazily */
+	if (!task->ready)
+		setup_task_handle(handle, task, task->tid);
+
+	task->nr_reads++;
+
 	if (__read_task_ustack(task) < 0) {
 		task->done = true;
 		return -1;
@@ -1858,6 +2016,10 @@ static void fstack_account_time(struct uftrace_task_reader *task)
 			if (fstack != NULL) {
 				fstack->total_time = rstack->time; /* start time */
 				fstack->child_time = 0;
+				fstack->nr_calls = 0;
+				fstack->blocked_time = 0;
+				fstack->preempt_time = 0;
+				fstack->nr_waits = 0;
 				fstack->valid = true;
 			}
 		}
@@ -1889,6 +2051,9 @@ static void fstack_account_time(struct uftrace_task_reader *task)
 			if (fstack != NULL) {
 				fstack->total_time = timestamp_after_lost;
 				fstack->child_time = 0;
+				fstack->blocked_time = 0;
+				fstack->preempt_time = 0;
+				fstack->nr_waits = 0;
 			}
 		}
 	}
@@ -1913,6 +2078,10 @@ static void fstack_account_time(struct uftrace_task_reader *task)
 		fstack->addr = rstack->addr;
 		fstack->total_time = rstack->time; /* start time */
 		fstack->child_time = 0;
+		fstack->nr_calls = 0;
+		fstack->blocked_time = 0;
+		fstack->preempt_time = 0;
+		fstack->nr_waits = 0;
 		fstack->valid = true;
 
 		if (is_kernel_func) {
@@ -1936,13 +2105,38 @@ static void fstack_account_time(struct uftrace_task_reader *task)
 			delta = 0UL;
 		fstack->valid = false;
 
+		if (task->h->compensate && !is_kernel_func) {
+			struct uftrace_info *info = &task->h->info;
+			uint64_t overhead;
+
+			/* tracing cost of the children and part of its own */
+			overhead = fstack->nr_calls * info->overhead_total + info->overhead_inner;
+			delta = delta > overhead ? delta - overhead : 0;
+		}
+
 		fstack->total_time = delta;
 		if (fstack->child_time > fstack->total_time)
 			fstack->child_time = fstack->total_time;
 
+		/* the virtual schedule function is the time spent off-cpu */
+		if (fstack->addr == EVENT_ID_PERF_SCHED_OUT) {
+			fstack->blocked_time = delta;
+			fstack->nr_waits = 1;
+		}
+		else if (fstack->addr == EVENT_ID_PERF_SCHED_OUT_PREEMPT) {
+			fstack->preempt_time = delta;
+			fstack->nr_waits = 1;
+		}
+
 		/* add current time to parent's child time */
-		if (task->stack_count > 1)
+		if (task->stack_count > 1) {
 			fstack[-1].child_time += delta;
+			fstack[-1].blocked_time += fstack->blocked_time;
+			fstack[-1].preempt_time += fstack->preempt_time;
+			fstack[-1].nr_waits += fstack->nr_waits;
+			if (!is_kernel_func)
+				fstack[-1].nr_calls += fstack->nr_calls + 1;
+		}
 	}
 	else if (rstack->type == UFTRACE_LOST) {
 		uint64_t delta;
@@ -1966,8 +2160,12 @@ static void fstack_account_time(struct uftrace_task_reader *task)
 			if (fstack->child_time > fstack->total_time)
 				fstack->child_time = fstack->total_time;
 
-			if (i > 0)
+			if (i > 0) {
 				fstack[-1].child_time += delta;
+				fstack[-1].blocked_time += fstack->blocked_time;
+				fstack[-1].preempt_time += fstack->preempt_time;
+				fstack[-1].nr_waits += fstack->nr_waits;
+			}
 		}
 	}
 }
@@ -2227,6 +2425,25 @@ static void adjust_rstack_after_schedule(struct uftrace_data *handle,
 	pr_dbg3("task[%6d] estimate next record after schedule\n", task->tid);
 }
 
+static void adjust_user_rstack(struct uftrace_data *handle, struct uftrace_task_reader *task)
+{
+	/* subsequent EXIT records might have inverted timestamp */
+	if (handle->hdr.feat_mask & ESTIMATE_RETURN && task->timestamp_estimate != 0) {
+		if (task->rstack->type == UFTRACE_EXIT &&
+		    task->rstack->time <= task->timestamp_estimate) {
+			task->rstack->time = ++task->timestamp_estimate;
+		}
+		else {
+			/*
+			 * ENTRY records are always fine since
+			 * they have real timestamps.
+			 */
+			task->timestamp_estimate = 0;
+			task->timestamp_next = 0;
+		}
+	}
+}
+
 static int __read_rstack(struct uftrace_data *handle, struct uftrace_task_reader **taskp,
 			 bool consume)
 {
@@ -2309,21 +2526,7 @@ static int __read_rstack(struct uftrace_data *handle, struct uftrace_task_reader
 		utask->rstack = &utask->ustack;
 		task = utask;
 
-		/* subsequent EXIT records might have inverted timestamp */
-		if (handle->hdr.feat_mask & ESTIMATE_RETURN && task->timestamp_estimate != 0) {
-			if (task->rstack->type == UFTRACE_EXIT &&
-			    task->rstack->time <= task->timestamp_estimate) {
-				task->rstack->time = ++task->timestamp_estimate;
-			}
-			else {
-				/*
-				 * ENTRY records are always fine since
-				 * they have real timestamps.
-				 */
-				task->timestamp_estimate = 0;
-				task->timestamp_next = 0;
-			}
-		}
+		adjust_user_rstack(handle, task);
 		break;
 	case KERNEL:
 		ktask->rstack = get_kernel_record(kernel, ktask, k);
@@ -2417,6 +2620,61 @@ int read_rstack(struct uftrace_data *handle, struct uftrace_task_reader **task)
 	return __read_rstack(handle, task, true);
 }
 
+/**
+ * can_read_task_rstack - check if each task can be read separately
+ * @handle: file handle
+ *
+ * This function returns true if read_task_rstack() can be used for
+ * the data.  Kernel and external data are not saved per task so they
+ * should be read in time order with read_rstack().
+ */
+bool can_read_task_rstack(struct uftrace_data *handle)
+{
+	return !has_kernel_data(handle->kernel) && !has_extern_data(handle);
+}
+
+/**
+ * read_task_rstack - read and consume the next record of a task
+ * @handle: file handle
+ * @task: task to read
+ *
+ * This function is similar to read_rstack() but it only reads records
+ * of the given @task so that tasks can be processed one by one (for
+ * --low-memory).  The perf events are read for each task when it starts.
+ *
+ * This function returns 0 if it reads a rstack, -1 if it's done.
+ */
+int read_task_rstack(struct uftrace_data *handle, struct uftrace_task_reader *task)
+{
+	struct uftrace_record *urec;
+	struct uftrace_record *erec = NULL;
+
+	/* read perf events of the task only when it starts */
+	if (has_perf_data(handle) && !task->perf_read) {
+		process_task_perf_event(handle, task);
+		task->perf_read = true;
+	}
+
+	urec = get_task_ustack(handle, task - handle->tasks);
+	if (task->event_list.count)
+		erec = get_first_rstack_list(&task->event_list);
+
+	if (urec && (erec == NULL || urec->time <= erec->time)) {
+		task->rstack = &task->ustack;
+		adjust_user_rstack(handle, task);
+	}
+	else if (erec) {
+		memcpy(&task->estack, erec, sizeof(*erec));
+		task->rstack = &task->estack;
+	}
+	else {
+		return -1;
+	}
+
+	__fstack_consume(task, handle->kernel, 0);
+	return 0;
+}
+
 /**
  * peek_rstack - read the oldest ftrace stack
  * @handle: file handle
@@ -2648,6 +2906,32 @@ TEST_CASE(fstack_read)
 	return TEST_OK;
 }
 
+TEST_CASE(fstack_read_reopen)
+{
+	struct uftrace_data *handle = &fstack_test_handle;
+	struct uftrace_task_reader *task;
+	int i, k;
+
+	TEST_EQ(fstack_test_setup_normal(handle), 0);
+
+	pr_dbg("allow a single open file to reopen the task files\n");
+	handle->max_task_files = 1;
+
+	for (i = 0; i < NUM_RECORD; i++) {
+		for (k = 0; k < NUM_TASK; k++) {
+			pr_dbg("[%d] read rstack from task %d\n", i, test_tids[k]);
+			TEST_EQ(read_rstack(handle, &task), 0);
+			TEST_EQ(task->tid, test_tids[k]);
+			TEST_EQ((uint64_t)task->rstack->type, (uint64_t)test_record[k][i].type);
+			TEST_EQ((uint64_t)task->rstack->depth, (uint64_t)test_record[k][i].depth);
+			TEST_EQ((uint64_t)task->rstack->addr, (uint64_t)test_record[k][i].addr);
+			TEST_EQ(handle->nr_task_files, 1);
+		}
+	}
+
+	return TEST_OK;
+}
+
 TEST_CASE(fstack_skip)
 {
 	struct uftrace_data *handle = &fstack_test_handle;
@@ -2715,6 +2999,41 @@ TEST_CASE(fstack_time)
 	return TEST_OK;
 }
 
+TEST_CASE(fstack_compensate)
+{
+	struct uftrace_data *handle = &fstack_test_handle;
+	struct uftrace_task_reader *task;
+	uint64_t expected[NUM_RECORD] = { 0, 0, 90, 270 };
+	int i;
+
+	TEST_EQ(fstack_test_setup_single(handle), 0);
+
+	pr_dbg("compensate overhead: 20 nsec per call, 10 nsec inside\n");
+	handle->compensate = true;
+	handle->info.overhead_total = 20;
+	handle->info.overhead_inner = 10;
+
+	for (i = 0; i < NUM_RECORD; i++) {
+		struct uftrace_fstack *fstack;
+
+		TEST_EQ(read_rstack(handle, &task), 0);
+		TEST_EQ((uint64_t)task->rstack->addr, (uint64_t)test_record[0][i].addr);
+
+		if (task->rstack->type != UFTRACE_EXIT)
+			continue;
+
+		/* stack count was already decreased */
+		fstack = fstack_get(task, task->stack_count);
+		pr_dbg("[%d] check total time of depth %d\n", i, task->rstack->depth);
+		TEST_EQ(fstack->total_time, expected[i]);
+		if (task->rstack->depth == 0)
+			TEST_EQ(fstack->child_time, expected[2]);
+	}
+
+	handle->compensate = false;
+	return TEST_OK;
+}
+
 TEST_CASE(fstack_fixup)
 {
 	struct uftrace_data *handle = &fstack_test_handle;
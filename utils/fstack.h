@@ -9,6 +9,7 @@
 #include "utils/filter.h"
 
 struct uftrace_symbol;
+struct uftrace_perf_task_event;
 
 enum uftrace_fstack_flag {
 	FSTACK_FL_FILTERED = (1U << 0),
@@ -42,7 +43,16 @@ struct uftrace_task_reader {
 	bool fstack_set;
 	bool display_depth_set;
 	bool fstack_warned;
+	/* data file is available and the task is set up */
+	bool ready;
+	/* perf events are added to event_list (for --low-memory) */
+	bool perf_read;
+	/* opened lazily, and closed when other tasks need it (see get_task_file) */
 	FILE *fp;
+	char *iobuf;
+	off_t offset;
+	struct list_head lru;
+	uint64_t nr_reads;
 	struct uftrace_symbol *func;
 	struct uftrace_task *t;
 	struct uftrace_data *h;
@@ -53,6 +63,10 @@ struct uftrace_task_reader {
 	struct uftrace_record *rstack;
 	struct uftrace_rstack_list rstack_list;
 	struct uftrace_rstack_list event_list;
+	/* perf events not added to event_list yet (for --low-memory) */
+	struct uftrace_perf_task_event *perf_events;
+	int nr_perf_events;
+	int max_perf_events;
 	int stack_count;
 	int lost_count;
 	int user_stack_count;
@@ -80,6 +94,12 @@ struct uftrace_task_reader {
 		unsigned long flags;
 		uint64_t total_time;
 		uint64_t child_time;
+		/* number of (user) functions called inside */
+		uint64_t nr_calls;
+		/* off-cpu time (by context switches) and number of waits inside */
+		uint64_t blocked_time;
+		uint64_t preempt_time;
+		uint64_t nr_waits;
 	} * func_stack;
 	struct uftrace_fstack_args args;
 	bool sched_preempt_seen;
@@ -108,11 +128,14 @@ extern bool live_disabled;
 
 struct uftrace_task_reader *get_task_handle(struct uftrace_data *handle, int tid);
 void reset_task_handle(struct uftrace_data *handle);
+void release_task_handle(struct uftrace_task_reader *task);
 
 void fstack_setup_task(char *tid_filter, struct uftrace_data *handle);
 
 int read_rstack(struct uftrace_data *handle, struct uftrace_task_reader **task);
 int peek_rstack(struct uftrace_data *handle, struct uftrace_task_reader **task);
+bool can_read_task_rstack(struct uftrace_data *handle);
+int read_task_rstack(struct uftrace_data *handle, struct uftrace_task_reader *task);
 void fstack_consume(struct uftrace_data *handle, struct uftrace_task_reader *task);
 
 int read_task_ustack(struct uftrace_data *handle, struct uftrace_task_reader *task);
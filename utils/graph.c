@@ -174,6 +174,8 @@ static int add_graph_exit(struct uftrace_task_graph *tg)
 out:
 	node->time += fstack->total_time;
 	node->child_time += fstack->child_time;
+	node->offcpu_time += fstack->blocked_time + fstack->preempt_time;
+	node->nr_waits += fstack->nr_waits;
 
 	if (exit_cb)
 		exit_cb(tg, cb_arg);
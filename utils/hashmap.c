@@ -386,6 +386,22 @@ bool hashmap_ptr_equals(void *keyA, void *keyB)
 	return a == b;
 }
 
+hash_t hashmap_string_hash(void *key)
+{
+	const unsigned char *s = key;
+	hash_t h = 5381;
+
+	/* djb2 */
+	while (*s)
+		h = h * 33 + *s++;
+	return h;
+}
+
+bool hashmap_string_equals(void *keyA, void *keyB)
+{
+	return !strcmp(keyA, keyB);
+}
+
 #ifdef UNIT_TEST
 #include "utils/utils.h"
 
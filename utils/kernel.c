@@ -1659,7 +1659,7 @@ retry:
 		return -1;
 
 	*taskp = get_task_handle(handle, first_tid);
-	if (*taskp == NULL || (*taskp)->fp == NULL) {
+	if (*taskp == NULL || !(*taskp)->ready) {
 		/* force re-read on that cpu */
 		kernel->rstack_valid[first_cpu] = false;
 
@@ -1999,7 +1999,7 @@ static int kernel_test_setup_handle(struct uftrace_kernel_reader *kernel,
 
 	for (i = 0; i < NUM_TASK; i++) {
 		handle->tasks[i].tid = test_tids[i];
-		handle->tasks[i].fp = (void *)1; /* prevent retry */
+		handle->tasks[i].ready = true; /* prevent retry */
 	}
 
 	test_sess.sym_info.kernel_base = 0xffff0000UL;
@@ -410,7 +410,7 @@ again:
 	}
 
 	task = get_task_handle(handle, perf->tid);
-	if (unlikely(task == NULL || task->fp == NULL))
+	if (unlikely(task == NULL || (!task->ready && task->done)))
 		goto again;
 
 	if (!check_time_range(&handle->time_range, perf->time))
@@ -567,12 +567,52 @@ static void remove_event_rstack(struct uftrace_task_reader *task)
 		 last_addr != EVENT_ID_PERF_SCHED_OUT_PREEMPT);
 }
 
+/* add a perf event to the event list of the task (unless it's filtered by time) */
+static void add_perf_event(struct uftrace_data *handle, struct uftrace_task_reader *task,
+			   struct uftrace_record *rec, const char *comm)
+{
+	struct uftrace_fstack_args args = {};
+
+	if (rec->addr == EVENT_ID_PERF_COMM) {
+		rec->more = 1;
+		args.args = NULL;
+		args.data = xstrdup(comm);
+		args.len = strlen(comm) + 1;
+	}
+	else if (rec->addr == EVENT_ID_PERF_SCHED_IN) {
+		struct uftrace_rstack_list_node *last;
+		uint64_t delta;
+
+		if (task->event_list.count == 0)
+			goto add_it;
+
+		last = list_last_entry(&task->event_list.read, typeof(*last), list);
+
+		/* time filter is meaningful only for schedule events */
+		while (last->rstack.addr != EVENT_ID_PERF_SCHED_OUT &&
+		       last->rstack.addr != EVENT_ID_PERF_SCHED_OUT_PREEMPT) {
+			if (last->list.prev == &task->event_list.read)
+				goto add_it;
+
+			last = list_prev_entry(last, list);
+		}
+
+		delta = rec->time - last->rstack.time;
+		if (delta < handle->time_filter) {
+			remove_event_rstack(task);
+			return;
+		}
+	}
+
+add_it:
+	add_to_rstack_list(&task->event_list, rec, &args);
+	free(args.data);
+}
+
 void process_perf_event(struct uftrace_data *handle)
 {
 	struct uftrace_perf_reader *perf;
 	struct uftrace_task_reader *task;
-	struct uftrace_record *rec;
-	struct uftrace_fstack_args args = {};
 	int p;
 
 	if (handle->perf_event_processed)
@@ -584,53 +624,107 @@ void process_perf_event(struct uftrace_data *handle)
 			break;
 
 		perf = &handle->perf[p];
-		rec = get_perf_record(handle, perf);
 		task = get_task_handle(handle, perf->tid);
 
-		if (unlikely(task == NULL || task->fp == NULL))
+		if (unlikely(task == NULL || (!task->ready && task->done))) {
+			perf->valid = false;
 			continue;
-
-		if (perf->type == PERF_RECORD_COMM) {
-			rec->more = 1;
-			args.args = NULL;
-			args.data = xstrdup(perf->u.comm.comm);
-			args.len = strlen(perf->u.comm.comm) + 1;
 		}
-		else if (perf->type == PERF_RECORD_SWITCH && !perf->u.ctxsw.out) {
-			struct uftrace_rstack_list_node *last;
-			uint64_t delta;
 
-			if (task->event_list.count == 0)
-				goto add_it;
+		add_perf_event(handle, task, get_perf_record(handle, perf), perf->u.comm.comm);
+		perf->valid = false;
+	}
 
-			last = list_last_entry(&task->event_list.read, typeof(*last), list);
+	handle->perf_event_processed = true;
+}
+
+/* read all perf events once and save them in each task in a compact form */
+static void split_perf_event(struct uftrace_data *handle)
+{
+	struct uftrace_perf_reader *perf;
+	struct uftrace_task_reader *task;
+	struct uftrace_perf_task_event *ev;
+	struct uftrace_record *rec;
+	int p;
 
-			/* time filter is meaningful only for schedule events */
-			while (last->rstack.addr != EVENT_ID_PERF_SCHED_OUT &&
-			       last->rstack.addr != EVENT_ID_PERF_SCHED_OUT_PREEMPT) {
-				if (last->list.prev == &task->event_list.read)
-					goto add_it;
+	while (1) {
+		p = read_perf_data(handle);
+		if (p < 0)
+			break;
 
-				last = list_prev_entry(last, list);
-			}
+		perf = &handle->perf[p];
+		task = get_task_handle(handle, perf->tid);
 
-			delta = perf->time - last->rstack.time;
-			if (delta < handle->time_filter) {
-				remove_event_rstack(task);
-				perf->valid = false;
-				continue;
-			}
+		if (unlikely(task == NULL || (!task->ready && task->done))) {
+			perf->valid = false;
+			continue;
 		}
 
-add_it:
-		add_to_rstack_list(&task->event_list, rec, &args);
-		if (args.len) {
-			free(args.data);
-			args.data = NULL;
-			args.len = 0;
+		if (task->nr_perf_events == task->max_perf_events) {
+			task->max_perf_events = task->max_perf_events ? task->max_perf_events * 2 : 64;
+			task->perf_events = xrealloc(task->perf_events, task->max_perf_events *
+									       sizeof(*ev));
 		}
+
+		rec = get_perf_record(handle, perf);
+		ev = &task->perf_events[task->nr_perf_events++];
+		ev->time = rec->time;
+		ev->addr = rec->addr;
+		ev->comm = NULL;
+		if (perf->type == PERF_RECORD_COMM)
+			ev->comm = xstrdup(perf->u.comm.comm);
+
 		perf->valid = false;
 	}
 
 	handle->perf_event_processed = true;
 }
+
+/**
+ * process_task_perf_event - add perf events of a task
+ * @handle: uftrace data file handle
+ * @task: task to read
+ *
+ * This function adds the perf events of @task to the event list.  The
+ * perf data is read only once when it's called first, and the events are
+ * saved in each task in a compact form so that the event list of a task
+ * is built only when the task is read (for --low-memory).
+ */
+void process_task_perf_event(struct uftrace_data *handle, struct uftrace_task_reader *task)
+{
+	int i;
+
+	if (!handle->perf_event_processed)
+		split_perf_event(handle);
+
+	for (i = 0; i < task->nr_perf_events; i++) {
+		struct uftrace_perf_task_event *ev = &task->perf_events[i];
+		struct uftrace_record rec = {
+			.time = ev->time,
+			.type = UFTRACE_EVENT,
+			.magic = RECORD_MAGIC,
+			.addr = ev->addr,
+		};
+
+		add_perf_event(handle, task, &rec, ev->comm);
+	}
+
+	release_task_perf_event(task);
+}
+
+/**
+ * release_task_perf_event - free perf events saved in a task
+ * @task: task handle
+ */
+void release_task_perf_event(struct uftrace_task_reader *task)
+{
+	int i;
+
+	for (i = 0; i < task->nr_perf_events; i++)
+		free(task->perf_events[i].comm);
+
+	free(task->perf_events);
+	task->perf_events = NULL;
+	task->nr_perf_events = 0;
+	task->max_perf_events = 0;
+}
@@ -126,8 +126,16 @@ struct uftrace_perf_reader {
 	} u;
 };
 
+/* perf event saved in a task until it's read (for --low-memory) */
+struct uftrace_perf_task_event {
+	uint64_t time;
+	uint64_t addr; /* EVENT_ID_PERF_* */
+	char *comm;
+};
+
 struct uftrace_data;
 struct uftrace_record;
+struct uftrace_task_reader;
 
 int setup_perf_data(struct uftrace_data *handle);
 void finish_perf_data(struct uftrace_data *handle);
@@ -136,5 +144,7 @@ struct uftrace_record *get_perf_record(struct uftrace_data *handle,
 				       struct uftrace_perf_reader *perf);
 void update_perf_task_comm(struct uftrace_data *handle);
 void process_perf_event(struct uftrace_data *handle);
+void process_task_perf_event(struct uftrace_data *handle, struct uftrace_task_reader *task);
+void release_task_perf_event(struct uftrace_task_reader *task);
 
 #endif /* UFTRACE_PERF_H */
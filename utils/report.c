@@ -8,13 +8,149 @@
 #include "utils/report.h"
 #include "utils/utils.h"
 
+/* whether to keep latency histogram for percentiles */
+static bool use_hist;
+
+void report_enable_hist(bool enable)
+{
+	use_hist = enable;
+}
+
+/* check if given sort keys or fields need latency histogram */
+bool report_check_hist(const char *keys)
+{
+	const char *percentiles[] = { "p50", "p90", "p99", "p999" };
+	struct strv strv = STRV_INIT;
+	bool found = false;
+	char *k, *p;
+	unsigned i;
+	int j;
+
+	if (keys == NULL)
+		return false;
+
+	strv_split(&strv, keys, ",");
+
+	strv_for_each(&strv, k, j) {
+		/* appended to the default fields */
+		if (*k == '+')
+			k++;
+
+		if (!strcmp(k, "all")) {
+			found = true;
+			break;
+		}
+
+		/* it can be "total-p50", "self_p99" or just "p90" (with --avg-*) */
+		p = strrchr(k, '-') ?: strrchr(k, '_');
+		if (p)
+			k = p + 1;
+
+		for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+			if (!strcmp(k, percentiles[i]))
+				found = true;
+		}
+		if (found)
+			break;
+	}
+	strv_free(&strv);
+
+	return found;
+}
+
+static unsigned hist_index(uint64_t time_ns)
+{
+	unsigned shift;
+
+	if (time_ns < REPORT_HIST_SUB_COUNT)
+		return time_ns;
+	if (time_ns >= (1ULL << REPORT_HIST_MAX_BITS))
+		return REPORT_HIST_BUCKETS - 1;
+
+	/* position of the MSB determines the (log) range */
+	shift = 63 - __builtin_clzll(time_ns) - REPORT_HIST_SUB_BITS;
+	return (shift + 1) * REPORT_HIST_SUB_COUNT + (time_ns >> shift) - REPORT_HIST_SUB_COUNT;
+}
+
+/* returns the highest value in the bucket */
+static uint64_t hist_value(unsigned idx)
+{
+	unsigned shift;
+	uint64_t base;
+
+	if (idx < REPORT_HIST_SUB_COUNT)
+		return idx;
+
+	shift = idx / REPORT_HIST_SUB_COUNT - 1;
+	base = (uint64_t)(idx % REPORT_HIST_SUB_COUNT + REPORT_HIST_SUB_COUNT) << shift;
+	return base + (1ULL << shift) - 1;
+}
+
+void report_hist_add(struct report_hist *hist, uint64_t time_ns)
+{
+	hist->bucket[hist_index(time_ns)]++;
+	hist->count++;
+}
+
+void report_hist_merge(struct report_hist *dst, struct report_hist *src)
+{
+	int i;
+
+	for (i = 0; i < REPORT_HIST_BUCKETS; i++)
+		dst->bucket[i] += src->bucket[i];
+	dst->count += src->count;
+}
+
+uint64_t report_hist_percentile(struct report_hist *hist, unsigned permil)
+{
+	uint64_t rank;
+	uint64_t seen = 0;
+	int i;
+
+	if (hist == NULL || hist->count == 0)
+		return 0;
+
+	rank = (hist->count * permil + 999) / 1000;
+	if (rank == 0)
+		rank = 1;
+
+	for (i = 0; i < REPORT_HIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= rank)
+			break;
+	}
+	return hist_value(i);
+}
+
+/* libm is not linked, just use the Newton's method */
+static uint64_t calc_sqrt(double val)
+{
+	double r = val > 1 ? val : 1;
+	double n;
+	int i;
+
+	if (val <= 0)
+		return 0;
+
+	for (i = 0; i < 128; i++) {
+		n = (r + val / r) / 2;
+		if (n >= r)
+			break;
+		r = n;
+	}
+	return r + 0.5;
+}
+
 static void init_time_stat(struct report_time_stat *ts)
 {
 	ts->min = -1ULL;
 }
 
-static void update_time_stat(struct report_time_stat *ts, uint64_t time_ns, bool recursive)
+static void update_time_stat(struct report_time_stat *ts, uint64_t time_ns, bool recursive,
+			     uint64_t call)
 {
+	double delta;
+
 	if (recursive)
 		ts->rec += time_ns;
 	else
@@ -24,11 +160,66 @@ static void update_time_stat(struct report_time_stat *ts, uint64_t time_ns, bool
 		ts->min = time_ns;
 	if (ts->max < time_ns)
 		ts->max = time_ns;
+
+	/* Welford's online algorithm */
+	delta = time_ns - ts->mean;
+	ts->mean += delta / call;
+	ts->m2 += delta * (time_ns - ts->mean);
+
+	if (use_hist) {
+		if (ts->hist == NULL)
+			ts->hist = xzalloc(sizeof(*ts->hist));
+		report_hist_add(ts->hist, time_ns);
+	}
+}
+
+static uint64_t clamp_time_stat(struct report_time_stat *ts, uint64_t val)
+{
+	if (val < ts->min)
+		return ts->min;
+	if (val > ts->max)
+		return ts->max;
+	return val;
 }
 
 static void finish_time_stat(struct report_time_stat *ts, unsigned long call)
 {
 	ts->avg = (ts->sum + ts->rec) / call;
+	ts->stddev = calc_sqrt(ts->m2 / call);
+
+	if (ts->hist == NULL)
+		return;
+
+	ts->p50 = clamp_time_stat(ts, report_hist_percentile(ts->hist, 500));
+	ts->p90 = clamp_time_stat(ts, report_hist_percentile(ts->hist, 900));
+	ts->p99 = clamp_time_stat(ts, report_hist_percentile(ts->hist, 990));
+	ts->p999 = clamp_time_stat(ts, report_hist_percentile(ts->hist, 999));
+}
+
+static void merge_time_stat(struct report_time_stat *dst, uint64_t dst_call,
+			    struct report_time_stat *src, uint64_t src_call)
+{
+	double delta = src->mean - dst->mean;
+	double total = dst_call + src_call;
+
+	dst->sum += src->sum;
+	dst->rec += src->rec;
+	if (dst->min > src->min)
+		dst->min = src->min;
+	if (dst->max < src->max)
+		dst->max = src->max;
+
+	/* parallel variant of the Welford's algorithm */
+	if (total) {
+		dst->m2 += src->m2 + delta * delta * dst_call * src_call / total;
+		dst->mean += delta * src_call / total;
+	}
+
+	if (src->hist) {
+		if (dst->hist == NULL)
+			dst->hist = xzalloc(sizeof(*dst->hist));
+		report_hist_merge(dst->hist, src->hist);
+	}
 }
 
 static struct uftrace_report_node *find_or_create_node(struct rb_root *root, const char *name,
@@ -79,13 +270,41 @@ void report_add_node(struct rb_root *root, const char *name, struct uftrace_repo
 	find_or_create_node(root, name, node);
 }
 
+void report_free_hist(struct uftrace_report_node *node)
+{
+	free(node->total.hist);
+	free(node->self.hist);
+	node->total.hist = NULL;
+	node->self.hist = NULL;
+}
+
 void report_delete_node(struct rb_root *root, struct uftrace_report_node *node)
 {
 	rb_erase(&node->name_link, root);
+	report_free_hist(node);
 	free(node->name);
 	free(node);
 }
 
+/* merge the stat of the same function from other tasks or sessions */
+void report_merge_node(struct uftrace_report_node *dst, struct uftrace_report_node *src)
+{
+	merge_time_stat(&dst->total, dst->call, &src->total, src->call);
+	merge_time_stat(&dst->self, dst->call, &src->self, src->call);
+	dst->call += src->call;
+
+	dst->oncpu += src->oncpu;
+	dst->offcpu += src->offcpu;
+	dst->blocked += src->blocked;
+	dst->preempt += src->preempt;
+	dst->waits += src->waits;
+
+	if (dst->loc == NULL)
+		dst->loc = src->loc;
+	if (dst->size == 0)
+		dst->size = src->size;
+}
+
 void report_update_node(struct uftrace_report_node *node, struct uftrace_task_reader *task,
 			struct uftrace_dbg_loc *loc)
 {
@@ -113,9 +332,21 @@ void report_update_node(struct uftrace_report_node *node, struct uftrace_task_re
 	total_time = fstack->total_time;
 	self_time = fstack->total_time - fstack->child_time;
 
-	update_time_stat(&node->total, total_time, recursive);
-	update_time_stat(&node->self, self_time, false);
 	node->call++;
+	update_time_stat(&node->total, total_time, recursive, node->call);
+	update_time_stat(&node->self, self_time, false, node->call);
+
+	/* it's already counted in the outer call */
+	if (!recursive) {
+		uint64_t offcpu = fstack->blocked_time + fstack->preempt_time;
+
+		node->oncpu += total_time > offcpu ? total_time - offcpu : 0;
+		node->offcpu += offcpu;
+		node->blocked += fstack->blocked_time;
+		node->preempt += fstack->preempt_time;
+		node->waits += fstack->nr_waits;
+	}
+
 	node->loc = loc;
 	if (task->func != NULL)
 		node->size = task->func->size;
@@ -166,6 +397,21 @@ SORT_KEY(self_min, self.min);
 SORT_KEY(self_max, self.max);
 SORT_KEY(call, call);
 SORT_KEY(size, size);
+SORT_KEY(total_stddev, total.stddev);
+SORT_KEY(total_p50, total.p50);
+SORT_KEY(total_p90, total.p90);
+SORT_KEY(total_p99, total.p99);
+SORT_KEY(total_p999, total.p999);
+SORT_KEY(self_stddev, self.stddev);
+SORT_KEY(self_p50, self.p50);
+SORT_KEY(self_p90, self.p90);
+SORT_KEY(self_p99, self.p99);
+SORT_KEY(self_p999, self.p999);
+SORT_KEY(oncpu, oncpu);
+SORT_KEY(offcpu, offcpu);
+SORT_KEY(blocked, blocked);
+SORT_KEY(preempt, preempt);
+SORT_KEY(waits, waits);
 
 static int cmp_func(struct uftrace_report_node *a, struct uftrace_report_node *b)
 {
@@ -179,9 +425,12 @@ static struct sort_key sort_func = {
 };
 
 static struct sort_key *all_sort_keys[] = {
-	&sort_total, &sort_total_avg, &sort_total_min, &sort_total_max,
-	&sort_self,  &sort_self_avg,  &sort_self_min,  &sort_self_max,
-	&sort_call,  &sort_func,      &sort_size,
+	&sort_total,	    &sort_total_avg,   &sort_total_min, &sort_total_max, &sort_self,
+	&sort_self_avg,	    &sort_self_min,    &sort_self_max,	&sort_call,	 &sort_func,
+	&sort_size,	    &sort_total_stddev, &sort_total_p50, &sort_total_p90, &sort_total_p99,
+	&sort_total_p999,   &sort_self_stddev, &sort_self_p50,	&sort_self_p90,	 &sort_self_p99,
+	&sort_self_p999,   &sort_oncpu,	       &sort_offcpu,	&sort_blocked,	 &sort_preempt,
+	&sort_waits,
 };
 
 /* list of used sort keys */
@@ -190,9 +439,11 @@ static LIST_HEAD(sort_keys);
 char *convert_sort_keys(char *sort_keys, enum avg_mode avg_mode)
 {
 	const char *default_sort_key[] = { OPT_SORT_KEYS, "total_avg", "self_avg" };
+	const char *avg_keys[] = { "avg", "min", "max", "stddev", "p50", "p90", "p99", "p999" };
 	struct strv keys = STRV_INIT;
 	char *new_keys;
 	char *k;
+	unsigned j;
 	int i;
 
 	if (sort_keys == NULL)
@@ -214,14 +465,16 @@ char *convert_sort_keys(char *sort_keys, enum avg_mode avg_mode)
 	strv_split(&keys, sort_keys, ",");
 
 	strv_for_each(&keys, k, i) {
-		if (!strcmp(k, "avg")) {
-			strv_replace(&keys, i, avg_mode == AVG_TOTAL ? "total_avg" : "self_avg");
-		}
-		else if (!strcmp(k, "min")) {
-			strv_replace(&keys, i, avg_mode == AVG_TOTAL ? "total_min" : "self_min");
-		}
-		else if (!strcmp(k, "max")) {
-			strv_replace(&keys, i, avg_mode == AVG_TOTAL ? "total_max" : "self_max");
+		for (j = 0; j < ARRAY_SIZE(avg_keys); j++) {
+			char *new_key;
+
+			if (strcmp(k, avg_keys[j]))
+				continue;
+
+			xasprintf(&new_key, "%s_%s", avg_mode == AVG_TOTAL ? "total" : "self", k);
+			strv_replace(&keys, i, new_key);
+			free(new_key);
+			break;
 		}
 	}
 
@@ -397,6 +650,21 @@ DIFF_KEY(self_min, self.min);
 DIFF_KEY(self_max, self.max);
 DIFF_KEY(call, call);
 DIFF_KEY(size, size);
+DIFF_KEY(total_stddev, total.stddev);
+DIFF_KEY(total_p50, total.p50);
+DIFF_KEY(total_p90, total.p90);
+DIFF_KEY(total_p99, total.p99);
+DIFF_KEY(total_p999, total.p999);
+DIFF_KEY(self_stddev, self.stddev);
+DIFF_KEY(self_p50, self.p50);
+DIFF_KEY(self_p90, self.p90);
+DIFF_KEY(self_p99, self.p99);
+DIFF_KEY(self_p999, self.p999);
+DIFF_KEY(oncpu, oncpu);
+DIFF_KEY(offcpu, offcpu);
+DIFF_KEY(blocked, blocked);
+DIFF_KEY(preempt, preempt);
+DIFF_KEY(waits, waits);
 
 static int cmp_diff_func(struct uftrace_report_node *a, struct uftrace_report_node *b, int column)
 {
@@ -410,9 +678,13 @@ static struct diff_key sort_diff_func = {
 };
 
 static struct diff_key *all_diff_keys[] = {
-	&sort_diff_total, &sort_diff_total_avg, &sort_diff_total_min, &sort_diff_total_max,
-	&sort_diff_self,  &sort_diff_self_avg,	&sort_diff_self_min,  &sort_diff_self_max,
-	&sort_diff_call,  &sort_diff_func,	&sort_diff_size
+	&sort_diff_total,	 &sort_diff_total_avg,	&sort_diff_total_min, &sort_diff_total_max,
+	&sort_diff_self,	 &sort_diff_self_avg,	&sort_diff_self_min,  &sort_diff_self_max,
+	&sort_diff_call,	 &sort_diff_func,	&sort_diff_size,      &sort_diff_total_stddev,
+	&sort_diff_total_p50,	 &sort_diff_total_p90,	&sort_diff_total_p99, &sort_diff_total_p999,
+	&sort_diff_self_stddev,	 &sort_diff_self_p50,	&sort_diff_self_p90,  &sort_diff_self_p99,
+	&sort_diff_self_p999,	 &sort_diff_oncpu,	&sort_diff_offcpu,    &sort_diff_blocked,
+	&sort_diff_preempt,	 &sort_diff_waits,
 };
 
 /* list of used sort keys for diff */
@@ -543,7 +815,7 @@ void destroy_diff_nodes(struct rb_root *orig_root, struct rb_root *pair_root)
 		iter = rb_entry(n, typeof(*iter), name_link);
 		n = rb_next(n);
 
-		/* name is already freed in print_and_delete */
+		/* name (and histogram) is already freed in print_and_delete */
 		rb_erase(&iter->name_link, orig_root);
 		free(iter);
 	}
@@ -554,6 +826,7 @@ void destroy_diff_nodes(struct rb_root *orig_root, struct rb_root *pair_root)
 		n = rb_next(n);
 
 		rb_erase(&iter->name_link, pair_root);
+		report_free_hist(iter);
 		/* if it has a pair, only base name was freed */
 		if (iter->pair)
 			free(iter->name);
@@ -856,6 +1129,21 @@ FIELD_TIME(REPORT_F_SELF_TIME_MIN, self-min, self.min, self_min, "Self min");
 FIELD_TIME(REPORT_F_SELF_TIME_MAX, self-max, self.max, self_max, "Self max");
 FIELD_UINT(REPORT_F_CALL, call, call, call, "Calls");
 FIELD_UINT(REPORT_F_SIZE, size, size, size, "Size");
+FIELD_TIME(REPORT_F_TOTAL_TIME_STDDEV, total-stddev, total.stddev, total_stddev, "Total std");
+FIELD_TIME(REPORT_F_TOTAL_TIME_P50, total-p50, total.p50, total_p50, "Total p50");
+FIELD_TIME(REPORT_F_TOTAL_TIME_P90, total-p90, total.p90, total_p90, "Total p90");
+FIELD_TIME(REPORT_F_TOTAL_TIME_P99, total-p99, total.p99, total_p99, "Total p99");
+FIELD_TIME(REPORT_F_TOTAL_TIME_P999, total-p999, total.p999, total_p999, "Total p999");
+FIELD_TIME(REPORT_F_SELF_TIME_STDDEV, self-stddev, self.stddev, self_stddev, "Self std");
+FIELD_TIME(REPORT_F_SELF_TIME_P50, self-p50, self.p50, self_p50, "Self p50");
+FIELD_TIME(REPORT_F_SELF_TIME_P90, self-p90, self.p90, self_p90, "Self p90");
+FIELD_TIME(REPORT_F_SELF_TIME_P99, self-p99, self.p99, self_p99, "Self p99");
+FIELD_TIME(REPORT_F_SELF_TIME_P999, self-p999, self.p999, self_p999, "Self p999");
+FIELD_TIME(REPORT_F_ONCPU_TIME, oncpu, oncpu, oncpu, "On-CPU");
+FIELD_TIME(REPORT_F_OFFCPU_TIME, offcpu, offcpu, offcpu, "Off-CPU");
+FIELD_TIME(REPORT_F_BLOCKED_TIME, blocked, blocked, blocked, "Blocked");
+FIELD_TIME(REPORT_F_PREEMPT_TIME, preempt, preempt, preempt, "Preempted");
+FIELD_UINT(REPORT_F_WAITS, waits, waits, waits, "Waits");
 
 FIELD_TIME_DIFF(REPORT_F_TOTAL_TIME, total, total.sum, total, "Total time");
 FIELD_TIME_DIFF(REPORT_F_TOTAL_TIME_AVG, total-avg, total.avg, total_avg, "Total avg");
@@ -867,6 +1155,21 @@ FIELD_TIME_DIFF(REPORT_F_SELF_TIME_MIN, self-min, self.min, self_min, "Self min"
 FIELD_TIME_DIFF(REPORT_F_SELF_TIME_MAX, self-max, self.max, self_max, "Self max");
 FIELD_UINT_DIFF(REPORT_F_CALL, call, call, call, "Calls");
 FIELD_UINT_DIFF(REPORT_F_SIZE, size, size, size, "Size");
+FIELD_TIME_DIFF(REPORT_F_TOTAL_TIME_STDDEV, total-stddev, total.stddev, total_stddev, "Total std");
+FIELD_TIME_DIFF(REPORT_F_TOTAL_TIME_P50, total-p50, total.p50, total_p50, "Total p50");
+FIELD_TIME_DIFF(REPORT_F_TOTAL_TIME_P90, total-p90, total.p90, total_p90, "Total p90");
+FIELD_TIME_DIFF(REPORT_F_TOTAL_TIME_P99, total-p99, total.p99, total_p99, "Total p99");
+FIELD_TIME_DIFF(REPORT_F_TOTAL_TIME_P999, total-p999, total.p999, total_p999, "Total p999");
+FIELD_TIME_DIFF(REPORT_F_SELF_TIME_STDDEV, self-stddev, self.stddev, self_stddev, "Self std");
+FIELD_TIME_DIFF(REPORT_F_SELF_TIME_P50, self-p50, self.p50, self_p50, "Self p50");
+FIELD_TIME_DIFF(REPORT_F_SELF_TIME_P90, self-p90, self.p90, self_p90, "Self p90");
+FIELD_TIME_DIFF(REPORT_F_SELF_TIME_P99, self-p99, self.p99, self_p99, "Self p99");
+FIELD_TIME_DIFF(REPORT_F_SELF_TIME_P999, self-p999, self.p999, self_p999, "Self p999");
+FIELD_TIME_DIFF(REPORT_F_ONCPU_TIME, oncpu, oncpu, oncpu, "On-CPU");
+FIELD_TIME_DIFF(REPORT_F_OFFCPU_TIME, offcpu, offcpu, offcpu, "Off-CPU");
+FIELD_TIME_DIFF(REPORT_F_BLOCKED_TIME, blocked, blocked, blocked, "Blocked");
+FIELD_TIME_DIFF(REPORT_F_PREEMPT_TIME, preempt, preempt, preempt, "Preempted");
+FIELD_UINT_DIFF(REPORT_F_WAITS, waits, waits, waits, "Waits");
 
 FIELD_TIME_DIFF_FULL(REPORT_F_TOTAL_TIME, total, total.sum, total, "Total time (diff)");
 FIELD_TIME_DIFF_FULL(REPORT_F_TOTAL_TIME_AVG, total-avg, total.avg, total_avg, "Total avg (diff)");
@@ -878,6 +1181,21 @@ FIELD_TIME_DIFF_FULL(REPORT_F_SELF_TIME_MIN, self-min, self.min, self_min, "Self
 FIELD_TIME_DIFF_FULL(REPORT_F_SELF_TIME_MAX, self-max, self.max, self_max, "Self min (diff)");
 FIELD_UINT_DIFF_FULL(REPORT_F_CALL, call, call, call_diff_full, "Calls (diff)");
 FIELD_UINT_DIFF_FULL(REPORT_F_SIZE, size, size, size_diff_full, "Size (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_TOTAL_TIME_STDDEV, total-stddev, total.stddev, total_stddev, "Total std (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_TOTAL_TIME_P50, total-p50, total.p50, total_p50, "Total p50 (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_TOTAL_TIME_P90, total-p90, total.p90, total_p90, "Total p90 (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_TOTAL_TIME_P99, total-p99, total.p99, total_p99, "Total p99 (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_TOTAL_TIME_P999, total-p999, total.p999, total_p999, "Total p999 (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_SELF_TIME_STDDEV, self-stddev, self.stddev, self_stddev, "Self std (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_SELF_TIME_P50, self-p50, self.p50, self_p50, "Self p50 (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_SELF_TIME_P90, self-p90, self.p90, self_p90, "Self p90 (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_SELF_TIME_P99, self-p99, self.p99, self_p99, "Self p99 (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_SELF_TIME_P999, self-p999, self.p999, self_p999, "Self p999 (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_ONCPU_TIME, oncpu, oncpu, oncpu, "On-CPU (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_OFFCPU_TIME, offcpu, offcpu, offcpu, "Off-CPU (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_BLOCKED_TIME, blocked, blocked, blocked, "Blocked (diff)");
+FIELD_TIME_DIFF_FULL(REPORT_F_PREEMPT_TIME, preempt, preempt, preempt, "Preempted (diff)");
+FIELD_UINT_DIFF_FULL(REPORT_F_WAITS, waits, waits, waits_diff_full, "Waits (diff)");
 
 FIELD_TIME_DIFF_FULL_PCT(REPORT_F_TOTAL_TIME, total, total.sum, total, "Total time (diff)");
 FIELD_TIME_DIFF_FULL_PCT(REPORT_F_TOTAL_TIME_AVG, total-avg, total.avg, total_avg, "Total avg (diff)");
@@ -889,6 +1207,21 @@ FIELD_TIME_DIFF_FULL_PCT(REPORT_F_SELF_TIME_MIN, self-min, self.min, self_min, "
 FIELD_TIME_DIFF_FULL_PCT(REPORT_F_SELF_TIME_MAX, self-max, self.max, self_max, "Self min (diff)");
 FIELD_UINT_DIFF_FULL(REPORT_F_CALL, call, call, call_diff_full_percent, "Calls (diff)");
 FIELD_UINT_DIFF_FULL(REPORT_F_SIZE, size, size, size_diff_full_percent, "Size (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_TOTAL_TIME_STDDEV, total-stddev, total.stddev, total_stddev, "Total std (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_TOTAL_TIME_P50, total-p50, total.p50, total_p50, "Total p50 (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_TOTAL_TIME_P90, total-p90, total.p90, total_p90, "Total p90 (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_TOTAL_TIME_P99, total-p99, total.p99, total_p99, "Total p99 (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_TOTAL_TIME_P999, total-p999, total.p999, total_p999, "Total p999 (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_SELF_TIME_STDDEV, self-stddev, self.stddev, self_stddev, "Self std (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_SELF_TIME_P50, self-p50, self.p50, self_p50, "Self p50 (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_SELF_TIME_P90, self-p90, self.p90, self_p90, "Self p90 (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_SELF_TIME_P99, self-p99, self.p99, self_p99, "Self p99 (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_SELF_TIME_P999, self-p999, self.p999, self_p999, "Self p999 (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_ONCPU_TIME, oncpu, oncpu, oncpu, "On-CPU (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_OFFCPU_TIME, offcpu, offcpu, offcpu, "Off-CPU (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_BLOCKED_TIME, blocked, blocked, blocked, "Blocked (diff)");
+FIELD_TIME_DIFF_FULL_PCT(REPORT_F_PREEMPT_TIME, preempt, preempt, preempt, "Preempted (diff)");
+FIELD_UINT_DIFF_FULL(REPORT_F_WAITS, waits, waits, waits_diff_full_percent, "Waits (diff)");
 
 FIELD_TIME(REPORT_F_TASK_TOTAL_TIME, total, total.sum, task_total, "Total time");
 FIELD_TIME(REPORT_F_TASK_SELF_TIME, self, self.sum, task_self, "Self time");
@@ -900,6 +1233,9 @@ FIELD_UINT(REPORT_F_TASK_NR_FUNC, func, call, task_nr_func, "Num funcs");
 static struct display_field *field_table[] = {
 	&field_total,	 &field_total_avg, &field_total_min, &field_total_max, &field_self,
 	&field_self_avg, &field_self_min,  &field_self_max,  &field_call,      &field_size,
+	&field_total_stddev, &field_total_p50, &field_total_p90, &field_total_p99, &field_total_p999,
+	&field_self_stddev, &field_self_p50, &field_self_p90, &field_self_p99, &field_self_p999,
+	&field_oncpu, &field_offcpu, &field_blocked, &field_preempt, &field_waits,
 };
 
 /* index of this table should be matched to display_field_id */
@@ -907,6 +1243,10 @@ static struct display_field *field_diff_table[] = {
 	&field_total_diff, &field_total_avg_diff, &field_total_min_diff, &field_total_max_diff,
 	&field_self_diff,  &field_self_avg_diff,  &field_self_min_diff,	 &field_self_max_diff,
 	&field_call_diff,  &field_size_diff,
+	&field_total_stddev_diff, &field_total_p50_diff, &field_total_p90_diff, &field_total_p99_diff,
+	&field_total_p999_diff, &field_self_stddev_diff, &field_self_p50_diff, &field_self_p90_diff,
+	&field_self_p99_diff, &field_self_p999_diff, &field_oncpu_diff, &field_offcpu_diff,
+	&field_blocked_diff, &field_preempt_diff, &field_waits_diff,
 };
 
 /* index of this table should be matched to display_field_id */
@@ -915,6 +1255,11 @@ static struct display_field *field_diff_full_table[] = {
 	&field_total_max_diff_full, &field_self_diff_full,	&field_self_avg_diff_full,
 	&field_self_min_diff_full,  &field_self_max_diff_full,	&field_call_diff_full,
 	&field_size_diff_full,
+	&field_total_stddev_diff_full, &field_total_p50_diff_full, &field_total_p90_diff_full,
+	&field_total_p99_diff_full, &field_total_p999_diff_full, &field_self_stddev_diff_full,
+	&field_self_p50_diff_full, &field_self_p90_diff_full, &field_self_p99_diff_full,
+	&field_self_p999_diff_full, &field_oncpu_diff_full, &field_offcpu_diff_full,
+	&field_blocked_diff_full, &field_preempt_diff_full, &field_waits_diff_full,
 };
 
 /* index of this table should be matched to display_field_id */
@@ -924,6 +1269,14 @@ static struct display_field *field_diff_full_percent_table[] = {
 	&field_self_diff_full_percent,	    &field_self_avg_diff_full_percent,
 	&field_self_min_diff_full_percent,  &field_self_max_diff_full_percent,
 	&field_call_diff_full_percent,	    &field_size_diff_full_percent,
+	&field_total_stddev_diff_full_percent, &field_total_p50_diff_full_percent,
+	&field_total_p90_diff_full_percent, &field_total_p99_diff_full_percent,
+	&field_total_p999_diff_full_percent, &field_self_stddev_diff_full_percent,
+	&field_self_p50_diff_full_percent, &field_self_p90_diff_full_percent,
+	&field_self_p99_diff_full_percent, &field_self_p999_diff_full_percent,
+	&field_oncpu_diff_full_percent, &field_offcpu_diff_full_percent,
+	&field_blocked_diff_full_percent, &field_preempt_diff_full_percent,
+	&field_waits_diff_full_percent,
 };
 
 /* index of this table should be matched to display_field_id */
@@ -1269,4 +1622,197 @@ TEST_CASE(report_diff)
 	return TEST_OK;
 }
 
+TEST_CASE(report_hist)
+{
+	struct report_hist *hist = xzalloc(sizeof(*hist));
+	struct report_hist *other = xzalloc(sizeof(*other));
+	uint64_t val;
+	int i;
+
+	pr_dbg("check keys which need the histogram\n");
+	TEST_EQ(report_check_hist("total,self_p50"), true);
+	TEST_EQ(report_check_hist("+total-p999"), true);
+	TEST_EQ(report_check_hist("p90,call"), true);
+	TEST_EQ(report_check_hist("all"), true);
+	TEST_EQ(report_check_hist("call"), false);
+	TEST_EQ(report_check_hist("total,self,call"), false);
+	TEST_EQ(report_check_hist(NULL), false);
+
+	pr_dbg("small values should be counted exactly\n");
+	for (i = 0; i < REPORT_HIST_SUB_COUNT; i++)
+		TEST_EQ(hist_value(hist_index(i)), (uint64_t)i);
+
+	pr_dbg("bucket index should be monotonic and cover the whole range\n");
+	for (i = 1; i < REPORT_HIST_MAX_BITS; i++) {
+		val = 1ULL << i;
+		TEST_LT(hist_index(val - 1), hist_index(val));
+		TEST_GE(hist_value(hist_index(val)), val);
+		TEST_LE(hist_value(hist_index(val)), val + (val >> REPORT_HIST_SUB_BITS));
+	}
+	TEST_EQ(hist_index(-1ULL), REPORT_HIST_BUCKETS - 1);
+
+	pr_dbg("add 1000 values: 1us .. 1000us\n");
+	for (i = 1; i <= 1000; i++)
+		report_hist_add(hist, i * 1000);
+	TEST_EQ(hist->count, 1000);
+
+	val = report_hist_percentile(hist, 500);
+	TEST_GE(val, 500000);
+	TEST_LE(val, 500000 + 500000 / REPORT_HIST_SUB_COUNT);
+	val = report_hist_percentile(hist, 990);
+	TEST_GE(val, 990000);
+	TEST_LE(val, 990000 + 990000 / REPORT_HIST_SUB_COUNT);
+
+	pr_dbg("merge another histogram with 1000 large values\n");
+	for (i = 1; i <= 1000; i++)
+		report_hist_add(other, 1000000000);
+	report_hist_merge(hist, other);
+	TEST_EQ(hist->count, 2000);
+
+	val = report_hist_percentile(hist, 400);
+	TEST_LE(val, 1000000);
+	val = report_hist_percentile(hist, 600);
+	TEST_GE(val, 1000000000);
+
+	free(hist);
+	free(other);
+	return TEST_OK;
+}
+
+TEST_CASE(report_merge)
+{
+	struct uftrace_report_node *node[2];
+	uint64_t times[2][4] = {
+		{ 100, 200, 300, 400 },
+		{ 500, 600, 700, 800 },
+	};
+	int i, k;
+
+	report_enable_hist(true);
+
+	pr_dbg("build two nodes with 4 samples each\n");
+	for (k = 0; k < 2; k++) {
+		node[k] = xzalloc(sizeof(*node[k]));
+		init_time_stat(&node[k]->total);
+		init_time_stat(&node[k]->self);
+
+		for (i = 0; i < 4; i++) {
+			node[k]->call++;
+			update_time_stat(&node[k]->total, times[k][i], false, node[k]->call);
+			update_time_stat(&node[k]->self, times[k][i] / 2, false, node[k]->call);
+		}
+	}
+
+	pr_dbg("merge them and check the stat\n");
+	report_merge_node(node[0], node[1]);
+	finish_time_stat(&node[0]->total, node[0]->call);
+	finish_time_stat(&node[0]->self, node[0]->call);
+
+	TEST_EQ(node[0]->call, 8);
+	TEST_EQ(node[0]->total.sum, 3600);
+	TEST_EQ(node[0]->total.avg, 450);
+	TEST_EQ(node[0]->total.min, 100);
+	TEST_EQ(node[0]->total.max, 800);
+	/* population stddev of 100..800 = 229.13 */
+	TEST_EQ(node[0]->total.stddev, 229);
+	TEST_EQ(node[0]->total.hist->count, 8);
+	TEST_GE(node[0]->total.p50, 400);
+	TEST_LE(node[0]->total.p50, 450);
+	TEST_EQ(node[0]->total.p999, 800);
+	TEST_EQ(node[0]->self.sum, 1800);
+
+	report_enable_hist(false);
+	for (k = 0; k < 2; k++) {
+		report_free_hist(node[k]);
+		free(node[k]);
+	}
+	return TEST_OK;
+}
+
+TEST_CASE(report_offcpu)
+{
+	struct rb_root name_tree = RB_ROOT;
+	struct rb_root sort_tree = RB_ROOT;
+	struct rb_node *rbnode;
+	struct uftrace_report_node *node;
+	static struct uftrace_fstack fstack[TEST_NODES];
+	struct uftrace_data handle = {
+		.hdr = {
+			.max_stack = TEST_NODES,
+		},
+		.nr_tasks = 1,
+	};
+	struct uftrace_task_reader task = {
+		.h = &handle,
+		.func_stack = fstack,
+	};
+	const char *test_name[] = { "foo", "foo", "bar" };
+	uint64_t test_addr[TEST_NODES] = { 1, 1, 2 };
+	uint64_t total_times[TEST_NODES] = { 1000, 600, 500 };
+	uint64_t blocked_times[TEST_NODES] = { 300, 200, 0 };
+	uint64_t preempt_times[TEST_NODES] = { 100, 0, 450 };
+	uint64_t nr_waits[TEST_NODES] = { 3, 1, 2 };
+	int i;
+
+	pr_dbg("setup fstack manually: foo -> foo (recursive) -> bar\n");
+	for (i = 0; i < TEST_NODES; i++) {
+		fstack[i].addr = test_addr[i];
+		fstack[i].total_time = total_times[i];
+		fstack[i].blocked_time = blocked_times[i];
+		fstack[i].preempt_time = preempt_times[i];
+		fstack[i].nr_waits = nr_waits[i];
+	}
+
+	for (i = 0; i < TEST_NODES; i++) {
+		node = report_find_node(&name_tree, test_name[i]);
+		if (node == NULL) {
+			node = xzalloc(sizeof(*node));
+			report_add_node(&name_tree, test_name[i], node);
+		}
+		report_update_node(node, &task, NULL);
+		task.stack_count++;
+	}
+
+	pr_dbg("recursive call should not be counted again\n");
+	node = report_find_node(&name_tree, "foo");
+	TEST_EQ(node->call, 2);
+	TEST_EQ(node->blocked, 300);
+	TEST_EQ(node->preempt, 100);
+	TEST_EQ(node->offcpu, 400);
+	TEST_EQ(node->oncpu, 600);
+	TEST_EQ(node->waits, 3);
+
+	node = report_find_node(&name_tree, "bar");
+	TEST_EQ(node->offcpu, 450);
+	TEST_EQ(node->oncpu, 50);
+	TEST_EQ(node->waits, 2);
+
+	TEST_EQ(report_setup_sort("offcpu"), 1);
+	report_sort_nodes(&name_tree, &sort_tree);
+	pr_dbg("sort report result with: offcpu\n");
+
+	rbnode = rb_first(&sort_tree);
+	node = rb_entry(rbnode, typeof(*node), sort_link);
+	TEST_STREQ(node->name, "bar");
+
+	TEST_EQ(report_setup_sort("oncpu"), 1);
+	report_sort_nodes(&name_tree, &sort_tree);
+	pr_dbg("sort report result with: oncpu\n");
+
+	rbnode = rb_first(&sort_tree);
+	node = rb_entry(rbnode, typeof(*node), sort_link);
+	TEST_STREQ(node->name, "foo");
+
+	while (!RB_EMPTY_ROOT(&name_tree)) {
+		rbnode = rb_first(&name_tree);
+		node = rb_entry(rbnode, typeof(*node), name_link);
+
+		rb_erase(&node->sort_link, &sort_tree);
+		report_delete_node(&name_tree, node);
+	}
+	TEST_EQ(RB_EMPTY_ROOT(&sort_tree), true);
+
+	return TEST_OK;
+}
+
 #endif /* UNIT_TEST */
@@ -14,12 +14,42 @@ enum avg_mode {
 	AVG_ANY,
 };
 
+/*
+ * Log-linear (HDR-style) histogram of durations.  Values below
+ * REPORT_HIST_SUB_COUNT are counted exactly and larger values are
+ * split into REPORT_HIST_SUB_COUNT sub-buckets per power of 2 so that
+ * the relative error is bounded (12.5%) regardless of magnitude.
+ * Durations longer than 2^REPORT_HIST_MAX_BITS nsec go to the last bucket.
+ */
+#define REPORT_HIST_SUB_BITS 3
+#define REPORT_HIST_SUB_COUNT (1 << REPORT_HIST_SUB_BITS)
+#define REPORT_HIST_MAX_BITS 40
+#define REPORT_HIST_BUCKETS                                                                        \
+	((REPORT_HIST_MAX_BITS - REPORT_HIST_SUB_BITS + 1) * REPORT_HIST_SUB_COUNT)
+
+struct report_hist {
+	uint64_t count;
+	uint64_t bucket[REPORT_HIST_BUCKETS];
+};
+
 struct report_time_stat {
 	uint64_t sum;
 	uint64_t rec; /* time in recursive call */
 	uint64_t avg;
 	uint64_t min;
 	uint64_t max;
+	uint64_t stddev;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t p999;
+
+	/* running mean and sum of squared differences (for stddev) */
+	double mean;
+	double m2;
+
+	/* allocated only if percentile is requested (see report_enable_hist) */
+	struct report_hist *hist;
 };
 
 struct uftrace_report_node {
@@ -28,6 +58,14 @@ struct uftrace_report_node {
 	struct report_time_stat self;
 	struct uftrace_dbg_loc *loc;
 	uint64_t call;
+
+	/* on/off-cpu time (including children) from context switches */
+	uint64_t oncpu;
+	uint64_t offcpu;
+	uint64_t blocked;
+	uint64_t preempt;
+	uint64_t waits;
+
 	struct rb_node name_link;
 	struct rb_node sort_link;
 	unsigned size;
@@ -55,6 +93,14 @@ void report_update_node(struct uftrace_report_node *node, struct uftrace_task_re
 			struct uftrace_dbg_loc *loc);
 void report_calc_avg(struct rb_root *root);
 void report_delete_node(struct rb_root *root, struct uftrace_report_node *node);
+void report_free_hist(struct uftrace_report_node *node);
+void report_merge_node(struct uftrace_report_node *dst, struct uftrace_report_node *src);
+
+void report_enable_hist(bool enable);
+bool report_check_hist(const char *keys);
+void report_hist_add(struct report_hist *hist, uint64_t time_ns);
+void report_hist_merge(struct report_hist *dst, struct report_hist *src);
+uint64_t report_hist_percentile(struct report_hist *hist, unsigned permil);
 
 char *convert_sort_keys(char *sort_keys, enum avg_mode avg_mode);
 int report_setup_sort(const char *sort_keys);
@@ -21,6 +21,7 @@ static lua_State *L;
 static lua_State *(*dlluaL_newstate)(void);
 static void (*dlluaL_openlibs)(lua_State *L);
 static int (*dlluaL_loadfile)(lua_State *L, const char *filename);
+static int (*dlluaL_loadstring)(lua_State *L, const char *s);
 static void (*dllua_close)(lua_State *L);
 static int (*dllua_pcall)(lua_State *L, int nargs, int nresults, int errfunc);
 static int (*dllua_next)(lua_State *L, int index);
@@ -33,6 +34,7 @@ static void (*dllua_pushinteger)(lua_State *L, lua_Integer n);
 static void (*dllua_pushnumber)(lua_State *L, lua_Number n);
 static void (*dllua_pushboolean)(lua_State *L, int b);
 static void (*dllua_pushnil)(lua_State *L);
+static void (*dllua_pushlightuserdata)(lua_State *L, void *p);
 static void (*dllua_remove)(lua_State *L, int index);
 
 static void (*dllua_getfield)(lua_State *L, int index, const char *k);
@@ -45,6 +47,30 @@ static void (*dllua_settop)(lua_State *L, int index);
 #define dllua_isnil(L, n) (dllua_type(L, (n)) == LUA_TNIL)
 #define dllua_getglobal(L, s) dllua_getfield(L, LUA_GLOBALSINDEX, (s))
 
+/*
+ * Wrapper for uftrace_batch() to pass records as a FFI cdata array.
+ * The struct should be matched to struct script_batch_record.
+ */
+static const char luajit_batch_helper[] =
+	"local ffi = require('ffi')\n"
+	"ffi.cdef[[\n"
+	"struct uftrace_batch_record {\n"
+	"	uint64_t timestamp;\n"
+	"	uint64_t duration;\n"
+	"	uint64_t address;\n"
+	"	int32_t tid;\n"
+	"	int32_t depth;\n"
+	"	int32_t type;\n"
+	"	int32_t name_id;\n"
+	"};\n"
+	"]]\n"
+	"local rectype = ffi.typeof('const struct uftrace_batch_record *')\n"
+	"__uftrace_batch_names = {}\n"
+	"function __uftrace_batch(ptr, count)\n"
+	"	uftrace_batch({ records = ffi.cast(rectype, ptr), count = count,\n"
+	"			names = __uftrace_batch_names })\n"
+	"end\n";
+
 static void setup_common_context(struct script_context *sc_ctx)
 {
 	dllua_newtable(L);
@@ -320,6 +346,45 @@ static int luajit_uftrace_event(struct script_context *sc_ctx)
 	return 0;
 }
 
+static int luajit_uftrace_batch(struct script_batch *batch)
+{
+	int i;
+
+	/* the name table is shared across calls, add new names only */
+	dllua_getglobal(L, "__uftrace_batch_names");
+	for (i = batch->nr_names_sent; i < batch->names.nr; i++) {
+		dllua_pushinteger(L, i);
+		dllua_pushstring(L, batch->names.p[i]);
+		dllua_settable(L, -3);
+	}
+	dllua_pop(L, 1);
+
+	dllua_getglobal(L, "__uftrace_batch");
+	/* records are not copied, the array is valid only during the call */
+	dllua_pushlightuserdata(L, batch->recs);
+	dllua_pushinteger(L, batch->nr_recs);
+
+	if (dllua_pcall(L, 2, 0, 0) != 0) {
+		pr_dbg("uftrace_batch failed: %s\n", dllua_tostring(L, -1));
+		dllua_pop(L, 1);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int luajit_setup_batch(void)
+{
+	if (dlluaL_loadstring(L, luajit_batch_helper) != 0 || dllua_pcall(L, 0, 0, 0) != 0) {
+		pr_warn("luajit batch setup failed: %s\n", dllua_tostring(L, -1));
+		dllua_pop(L, 1);
+		return -1;
+	}
+
+	script_uftrace_batch = luajit_uftrace_batch;
+	return 0;
+}
+
 static int luajit_uftrace_end(void)
 {
 	dllua_getglobal(L, "uftrace_end");
@@ -361,6 +426,7 @@ static int load_luajit_api_funcs(void)
 	INIT_LUAJIT_API_FUNC(luaL_newstate);
 	INIT_LUAJIT_API_FUNC(luaL_openlibs);
 	INIT_LUAJIT_API_FUNC(luaL_loadfile);
+	INIT_LUAJIT_API_FUNC(luaL_loadstring);
 	INIT_LUAJIT_API_FUNC(lua_close);
 
 	INIT_LUAJIT_API_FUNC(lua_pcall);
@@ -375,6 +441,7 @@ static int load_luajit_api_funcs(void)
 
 	INIT_LUAJIT_API_FUNC(lua_pushboolean);
 	INIT_LUAJIT_API_FUNC(lua_pushnil);
+	INIT_LUAJIT_API_FUNC(lua_pushlightuserdata);
 
 	INIT_LUAJIT_API_FUNC(lua_remove);
 
@@ -421,6 +488,12 @@ int script_init_for_luajit(struct script_info *info, enum uftrace_pattern_type p
 	}
 	dllua_pop(L, 1);
 
+	/* uftrace_batch() replaces the per-record callbacks in script command */
+	dllua_getglobal(L, "uftrace_batch");
+	if (!dllua_isnil(L, -1) && !info->record)
+		luajit_setup_batch();
+	dllua_pop(L, 1);
+
 	luajit_uftrace_begin(info);
 	return 0;
 }
@@ -65,8 +65,12 @@ static PyObject *(*__PyTuple_New)(Py_ssize_t size);
 static int (*__PyTuple_SetItem)(PyObject *, Py_ssize_t, PyObject *);
 static PyObject *(*__PyTuple_GetItem)(PyObject *, Py_ssize_t);
 
+static PyObject *(*__PyList_New)(Py_ssize_t size);
 static Py_ssize_t (*__PyList_Size)(PyObject *);
 static PyObject *(*__PyList_GetItem)(PyObject *, Py_ssize_t);
+static int (*__PyList_Append)(PyObject *, PyObject *);
+
+static PyObject *(*__PyBytes_FromStringAndSize)(const char *str, Py_ssize_t size);
 
 static PyObject *(*__PyDict_New)(void);
 static int (*__PyDict_SetItem)(PyObject *mp, PyObject *key, PyObject *item);
@@ -99,6 +103,10 @@ static inline void __Py_XDECREF(PyObject *obj)
 #endif /* PY_VERSION_HEX >= 0x03080000 */
 
 static PyObject *pModule, *pFuncBegin, *pFuncEntry, *pFuncExit, *pFuncEvent, *pFuncEnd;
+static PyObject *pFuncBatch, *pBatchNames;
+
+/* struct module format of struct script_batch_record */
+static const char py_batch_format[] = "=QQQiiii";
 
 enum py_context_idx {
 	PY_CTX_TID = 0,
@@ -152,6 +160,7 @@ static int load_python_api_funcs(void)
 	INIT_PY_API_FUNC(PyString_FromString);
 	INIT_PY_API_FUNC(PyInt_FromLong);
 	INIT_PY_API_FUNC(PyString_AsString);
+	INIT_PY_API_FUNC2(PyBytes_FromStringAndSize, PyString_FromStringAndSize);
 	/* just to suppress compiler warning */
 	__Py_Dealloc = NULL;
 #else
@@ -160,6 +169,7 @@ static int load_python_api_funcs(void)
 	INIT_PY_API_FUNC2(PyInt_FromLong, PyLong_FromLong);
 	INIT_PY_API_FUNC2(PyString_AsString, PyUnicode_AsUTF8);
 	INIT_PY_API_FUNC2(Py_Dealloc, _Py_Dealloc);
+	INIT_PY_API_FUNC(PyBytes_FromStringAndSize);
 #endif
 
 	INIT_PY_API_FUNC(PyErr_Occurred);
@@ -183,8 +193,10 @@ static int load_python_api_funcs(void)
 	INIT_PY_API_FUNC(PyTuple_SetItem);
 	INIT_PY_API_FUNC(PyTuple_GetItem);
 
+	INIT_PY_API_FUNC(PyList_New);
 	INIT_PY_API_FUNC(PyList_Size);
 	INIT_PY_API_FUNC(PyList_GetItem);
+	INIT_PY_API_FUNC(PyList_Append);
 
 	INIT_PY_API_FUNC(PyDict_New);
 	INIT_PY_API_FUNC(PyDict_SetItem);
@@ -732,6 +744,65 @@ int python_uftrace_event(struct script_context *sc_ctx)
 	return 0;
 }
 
+int python_uftrace_batch(struct script_batch *batch)
+{
+	PyObject *pDict;
+	PyObject *pythonContext;
+	PyObject *records;
+	int i;
+
+	if (unlikely(!pFuncBatch))
+		return -1;
+
+	pthread_mutex_lock(&python_interpreter_lock);
+
+	/* the name table is shared across calls, add new names only */
+	for (i = batch->nr_names_sent; i < batch->names.nr; i++) {
+		PyObject *name = __PyString_FromString(batch->names.p[i]);
+
+		if (__PyErr_Occurred()) {
+			Py_XDECREF(name);
+			name = __PyString_FromString("<invalid value>");
+			__PyErr_Clear();
+		}
+		__PyList_Append(pBatchNames, name);
+		Py_XDECREF(name);
+	}
+
+	/* the buffer will be reused, copy it as the script might keep it */
+	records = __PyBytes_FromStringAndSize((char *)batch->recs,
+					      batch->nr_recs * sizeof(*batch->recs));
+
+	pDict = __PyDict_New();
+	__PyDict_SetItemString(pDict, "records", records);
+	__PyDict_SetItemString(pDict, "names", pBatchNames);
+	insert_dict_long(pDict, "count", batch->nr_recs);
+	insert_dict_string(pDict, "format", (char *)py_batch_format);
+	Py_XDECREF(records);
+
+	/* Python function arguments must be passed in a tuple. */
+	pythonContext = __PyTuple_New(1);
+	__PyTuple_SetItem(pythonContext, 0, pDict);
+
+	/* Call python function "uftrace_batch". */
+	__PyObject_CallObject(pFuncBatch, pythonContext);
+	if (debug) {
+		if (__PyErr_Occurred() && !python_error_reported) {
+			pr_dbg("uftrace_batch failed:\n");
+			__PyErr_Print();
+
+			python_error_reported = true;
+		}
+	}
+
+	/* Free PyTuple. */
+	Py_XDECREF(pythonContext);
+
+	pthread_mutex_unlock(&python_interpreter_lock);
+
+	return 0;
+}
+
 int python_uftrace_end(void)
 {
 	if (unlikely(!pFuncEnd))
@@ -839,6 +910,13 @@ int script_init_for_python(struct script_info *info, enum uftrace_pattern_type p
 	pFuncEvent = get_python_callback("uftrace_event");
 	pFuncEnd = get_python_callback("uftrace_end");
 
+	/* uftrace_batch() replaces the per-record callbacks in script command */
+	pFuncBatch = get_python_callback("uftrace_batch");
+	if (pFuncBatch && !info->record) {
+		pBatchNames = __PyList_New(0);
+		script_uftrace_batch = python_uftrace_batch;
+	}
+
 	/* Call python function "uftrace_begin" immediately if possible. */
 	python_uftrace_begin(info);
 
@@ -12,9 +12,11 @@
 
 #include "utils/script.h"
 #include "utils/filter.h"
+#include "utils/hashmap.h"
 #include "utils/list.h"
 #include "utils/script-luajit.h"
 #include "utils/script-python.h"
+#include "utils/symbol.h"
 #include "utils/utils.h"
 #include <unistd.h>
 
@@ -29,6 +31,7 @@ script_uftrace_exit_t script_uftrace_exit;
 script_uftrace_event_t script_uftrace_event;
 script_uftrace_end_t script_uftrace_end;
 script_atfork_prepare_t script_atfork_prepare;
+script_uftrace_batch_t script_uftrace_batch;
 
 struct script_filter_item {
 	struct list_head list;
@@ -37,6 +40,20 @@ struct script_filter_item {
 
 static LIST_HEAD(filters);
 
+/* filter results of every symbol in a module (symtab) */
+struct script_filter_cache {
+	struct list_head list;
+	struct uftrace_symtab *symtab;
+	struct uftrace_symbol *sym;
+	size_t nr_sym;
+	uint64_t bitmap[];
+};
+
+/* it's not changed after setup so can be read without lock */
+static LIST_HEAD(filter_caches);
+
+static struct script_batch batch;
+
 enum script_type_t get_script_type(const char *str)
 {
 	char *ext = strrchr(str, '.');
@@ -90,10 +107,96 @@ int script_match_filter(char *func)
 	return 0;
 }
 
+static void add_filter_cache(struct uftrace_symtab *symtab)
+{
+	struct script_filter_cache *cache;
+	size_t i;
+
+	if (symtab->nr_sym == 0)
+		return;
+
+	list_for_each_entry(cache, &filter_caches, list) {
+		if (cache->symtab == symtab)
+			return;
+	}
+
+	cache = xzalloc(sizeof(*cache) + ALIGN(symtab->nr_sym, 64) / 8);
+	cache->symtab = symtab;
+	cache->sym = symtab->sym;
+	cache->nr_sym = symtab->nr_sym;
+
+	for (i = 0; i < symtab->nr_sym; i++) {
+		if (script_match_filter(symtab->sym[i].name))
+			cache->bitmap[i / 64] |= 1ULL << (i % 64);
+	}
+
+	list_add_tail(&cache->list, &filter_caches);
+}
+
+/*
+ * Check the filters for all symbols in the modules at once so that
+ * script_match_symbol() can avoid pattern matching for each record.
+ * Modules should be loaded before and this should not be called
+ * concurrently with script_match_symbol().
+ */
+void script_setup_filter_cache(struct uftrace_sym_info *sinfo)
+{
+	struct uftrace_mmap *map;
+
+	/* nothing to cache if there's no filter */
+	if (list_empty(&filters))
+		return;
+
+	for_each_map(sinfo, map) {
+		if (map->mod)
+			add_filter_cache(&map->mod->symtab);
+	}
+}
+
+/* same as script_match_filter() but use the cached result if possible */
+int script_match_symbol(struct uftrace_symbol *sym, char *name)
+{
+	struct script_filter_cache *cache;
+
+	if (list_empty(&filters))
+		return 1;
+
+	if (sym == NULL)
+		return script_match_filter(name);
+
+	list_for_each_entry(cache, &filter_caches, list) {
+		size_t idx;
+
+		if (sym < cache->sym || sym >= cache->sym + cache->nr_sym)
+			continue;
+
+		/* the symbol table might be reallocated */
+		if (cache->symtab->sym != cache->sym)
+			break;
+
+		idx = sym - cache->sym;
+		return !!(cache->bitmap[idx / 64] & (1ULL << (idx % 64)));
+	}
+
+	return script_match_filter(name);
+}
+
+static void script_finish_filter_cache(void)
+{
+	struct script_filter_cache *cache, *tmp;
+
+	list_for_each_entry_safe(cache, tmp, &filter_caches, list) {
+		list_del(&cache->list);
+		free(cache);
+	}
+}
+
 void script_finish_filter(void)
 {
 	struct script_filter_item *item, *tmp;
 
+	script_finish_filter_cache();
+
 	list_for_each_entry_safe(item, tmp, &filters, list) {
 		list_del(&item->list);
 		free_filter_pattern(&item->patt);
@@ -101,6 +204,74 @@ void script_finish_filter(void)
 	}
 }
 
+static int batch_name_id(char *name)
+{
+	void *id;
+
+	if (name == NULL)
+		name = "";
+
+	if (batch.name_map == NULL)
+		batch.name_map = hashmap_create(1024, hashmap_string_hash, hashmap_string_equals);
+
+	/* the value is saved as (index + 1) to distinguish it from NULL */
+	id = hashmap_get(batch.name_map, name);
+	if (id)
+		return (long)id - 1;
+
+	strv_append(&batch.names, name);
+	hashmap_put(batch.name_map, batch.names.p[batch.names.nr - 1], (void *)(long)batch.names.nr);
+	return batch.names.nr - 1;
+}
+
+/* pass accumulated records to uftrace_batch() in the script */
+int script_batch_flush(void)
+{
+	int ret;
+
+	if (batch.nr_recs == 0 || script_uftrace_batch == NULL)
+		return 0;
+
+	ret = script_uftrace_batch(&batch);
+
+	batch.nr_recs = 0;
+	batch.nr_names_sent = batch.names.nr;
+	return ret;
+}
+
+/* add a record to the batch instead of calling the per-record hooks */
+int script_batch_add(struct script_context *sc_ctx, enum script_batch_type type)
+{
+	struct script_batch_record *rec;
+
+	if (batch.recs == NULL)
+		batch.recs = xmalloc(SCRIPT_BATCH_SIZE * sizeof(*batch.recs));
+
+	rec = &batch.recs[batch.nr_recs++];
+	rec->timestamp = sc_ctx->timestamp;
+	rec->duration = sc_ctx->duration;
+	rec->address = sc_ctx->address;
+	rec->tid = sc_ctx->tid;
+	rec->depth = sc_ctx->depth;
+	rec->type = type;
+	rec->name_id = batch_name_id(sc_ctx->name);
+
+	if (batch.nr_recs == SCRIPT_BATCH_SIZE)
+		return script_batch_flush();
+	return 0;
+}
+
+static void script_finish_batch(void)
+{
+	free(batch.recs);
+	strv_free(&batch.names);
+	if (batch.name_map)
+		hashmap_free(batch.name_map);
+
+	memset(&batch, 0, sizeof(batch));
+	script_uftrace_batch = NULL;
+}
+
 static int script_init_for_testing(struct script_info *info, enum uftrace_pattern_type ptype)
 {
 	int i;
@@ -175,6 +346,7 @@ void script_finish(void)
 	}
 
 	script_finish_filter();
+	script_finish_batch();
 }
 
 #ifdef UNIT_TEST
@@ -229,4 +401,115 @@ TEST_CASE(script_init)
 
 	return TEST_OK;
 }
+
+TEST_CASE(script_filter_cache)
+{
+	struct uftrace_symbol syms[] = {
+		{ 0x1000, 0x10, ST_LOCAL_FUNC, "abc" },
+		{ 0x1010, 0x10, ST_LOCAL_FUNC, "xyz" },
+		{ 0x1020, 0x10, ST_LOCAL_FUNC, "foo" },
+	};
+	struct uftrace_module *mod;
+	struct uftrace_mmap *map;
+	struct uftrace_sym_info sinfo = {
+		.loaded = true,
+	};
+	struct uftrace_symbol other = { 0x2000, 0x10, ST_LOCAL_FUNC, "xz" };
+	struct script_filter_cache *cache;
+
+	mod = xzalloc(sizeof(*mod) + 8);
+	mod->symtab.sym = syms;
+	mod->symtab.nr_sym = ARRAY_SIZE(syms);
+	map = xzalloc(sizeof(*map) + 8);
+	map->mod = mod;
+	sinfo.maps = map;
+
+	pr_dbg("no cache should be made without filters\n");
+	script_setup_filter_cache(&sinfo);
+	TEST_EQ(list_empty(&filter_caches), true);
+	TEST_EQ(script_match_symbol(&syms[2], "foo"), 1);
+
+	script_add_filter("abc", PATT_GLOB);
+	script_add_filter("x*z", PATT_GLOB);
+
+	pr_dbg("check symbols with the filter cache\n");
+	script_setup_filter_cache(&sinfo);
+	TEST_EQ(list_empty(&filter_caches), false);
+
+	cache = list_first_entry(&filter_caches, struct script_filter_cache, list);
+	TEST_EQ(cache->bitmap[0], 3ULL);
+
+	TEST_EQ(script_match_symbol(&syms[0], "abc"), 1);
+	TEST_EQ(script_match_symbol(&syms[1], "xyz"), 1);
+	TEST_EQ(script_match_symbol(&syms[2], "foo"), 0);
+
+	pr_dbg("fallback to pattern match for unknown symbols\n");
+	TEST_EQ(script_match_symbol(&other, other.name), 1);
+	TEST_EQ(script_match_symbol(NULL, "<1234>"), 0);
+
+	script_finish_filter();
+	TEST_EQ(list_empty(&filter_caches), true);
+
+	free(map);
+	free(mod);
+	return TEST_OK;
+}
+
+static int test_batch_calls;
+static int test_batch_recs;
+
+static int test_uftrace_batch(struct script_batch *b)
+{
+	int i;
+
+	test_batch_calls++;
+	test_batch_recs += b->nr_recs;
+
+	/* all names should be sent before records refer them */
+	for (i = 0; i < b->nr_recs; i++) {
+		if (b->recs[i].name_id >= b->names.nr)
+			return -1;
+	}
+	return 0;
+}
+
+TEST_CASE(script_batch)
+{
+	struct script_context sc_ctx = {
+		.tid = 1234,
+		.depth = 1,
+	};
+	char *names[] = { "main", "foo", "bar" };
+	int i;
+
+	script_uftrace_batch = test_uftrace_batch;
+
+	pr_dbg("add records more than a single batch\n");
+	for (i = 0; i < SCRIPT_BATCH_SIZE + 10; i++) {
+		sc_ctx.timestamp = i;
+		sc_ctx.name = names[i % ARRAY_SIZE(names)];
+		TEST_EQ(script_batch_add(&sc_ctx, SCRIPT_BATCH_ENTRY), 0);
+	}
+	TEST_EQ(test_batch_calls, 1);
+	TEST_EQ(batch.nr_recs, 10);
+	TEST_EQ(batch.nr_names_sent, (int)ARRAY_SIZE(names));
+
+	pr_dbg("check the name table has no duplicates\n");
+	TEST_EQ(batch.names.nr, (int)ARRAY_SIZE(names));
+	TEST_EQ(batch.recs[0].name_id, SCRIPT_BATCH_SIZE % (int)ARRAY_SIZE(names));
+	TEST_STREQ(batch.names.p[batch.recs[1].name_id], names[(SCRIPT_BATCH_SIZE + 1) % ARRAY_SIZE(names)]);
+	TEST_EQ(batch.recs[9].timestamp, (uint64_t)SCRIPT_BATCH_SIZE + 9);
+
+	pr_dbg("flush remaining records\n");
+	TEST_EQ(script_batch_flush(), 0);
+	TEST_EQ(test_batch_calls, 2);
+	TEST_EQ(test_batch_recs, SCRIPT_BATCH_SIZE + 10);
+	TEST_EQ(batch.nr_recs, 0);
+
+	script_finish_batch();
+	TEST_EQ(script_uftrace_batch == NULL, true);
+	TEST_EQ(batch.names.nr, 0);
+
+	return TEST_OK;
+}
 #endif /* UNIT_TEST */
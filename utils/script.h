@@ -58,6 +58,40 @@ union script_arg_val {
 	unsigned char v[16];
 };
 
+/* record type in the batch */
+enum script_batch_type {
+	SCRIPT_BATCH_ENTRY = 0,
+	SCRIPT_BATCH_EXIT,
+	SCRIPT_BATCH_EVENT,
+};
+
+/*
+ * packed record passed to uftrace_batch() in a script.
+ * The layout is a part of the script ABI, see doc/uftrace-script.md.
+ */
+struct script_batch_record {
+	uint64_t timestamp;
+	uint64_t duration; /* exit only */
+	uint64_t address;
+	int32_t tid;
+	int32_t depth;
+	int32_t type;
+	int32_t name_id; /* index to the name table */
+};
+
+#define SCRIPT_BATCH_SIZE 4096
+
+/* records accumulated for uftrace_batch() */
+struct script_batch {
+	struct script_batch_record *recs;
+	int nr_recs;
+	/* symbol name table indexed by name_id, it only grows */
+	struct strv names;
+	/* number of names already passed to the script */
+	int nr_names_sent;
+	struct Hashmap *name_map;
+};
+
 extern char *script_str;
 
 typedef int (*script_uftrace_entry_t)(struct script_context *sc_ctx);
@@ -65,6 +99,7 @@ typedef int (*script_uftrace_exit_t)(struct script_context *sc_ctx);
 typedef int (*script_uftrace_event_t)(struct script_context *sc_ctx);
 typedef int (*script_uftrace_end_t)(void);
 typedef int (*script_atfork_prepare_t)(void);
+typedef int (*script_uftrace_batch_t)(struct script_batch *batch);
 
 /* The below functions are used both in record time and script command. */
 extern script_uftrace_entry_t script_uftrace_entry;
@@ -73,6 +108,9 @@ extern script_uftrace_event_t script_uftrace_event;
 extern script_uftrace_end_t script_uftrace_end;
 extern script_atfork_prepare_t script_atfork_prepare;
 
+/* This is set only if the script has uftrace_batch(). */
+extern script_uftrace_batch_t script_uftrace_batch;
+
 int script_init(struct script_info *info, enum uftrace_pattern_type ptype);
 void script_finish(void);
 
@@ -80,6 +118,14 @@ void script_add_filter(char *func, enum uftrace_pattern_type ptype);
 int script_match_filter(char *func);
 void script_finish_filter(void);
 
+struct uftrace_sym_info;
+struct uftrace_symbol;
+void script_setup_filter_cache(struct uftrace_sym_info *sinfo);
+int script_match_symbol(struct uftrace_symbol *sym, char *name);
+
+int script_batch_add(struct script_context *sc_ctx, enum script_batch_type type);
+int script_batch_flush(void);
+
 enum script_type_t get_script_type(const char *str);
 
 #endif /* UFTRACE_SCRIPT_H */
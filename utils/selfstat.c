@@ -0,0 +1,190 @@
+/*
+ * Self-profiling of uftrace commands (--self-stat)
+ *
+ * It measures wall and CPU time of the major phases of a command and
+ * change of the heap usage during them.  Phases can be nested (e.g.
+ * symbol loading is done in the open_data_file phase) and the outer phase
+ * includes the inner ones.  Only the main thread should call it.
+ *
+ * Released under the GPL v2.
+ */
+#include <inttypes.h>
+#include <malloc.h>
+#include <string.h>
+#include <time.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT "selfstat"
+#define PR_DOMAIN DBG_UFTRACE
+
+#include "utils/selfstat.h"
+#include "utils/utils.h"
+
+enum selfstat_format selfstat_format = SELFSTAT_FMT_NONE;
+
+struct selfstat_data {
+	unsigned calls;
+	int depth;
+	uint64_t wall;
+	uint64_t cpu;
+	int64_t heap;
+	/* values at the beginning */
+	uint64_t wall_start;
+	uint64_t cpu_start;
+	int64_t heap_start;
+};
+
+static const char *selfstat_names[SELFSTAT_PHASE_MAX] = {
+	"open_data_file", "load_module_symtabs", "load_debug_info", "fstack_setup_filters",
+	"read_rstack",	  "output",		 "record",	    "save_symtabs",
+};
+
+static struct selfstat_data selfstat[SELFSTAT_PHASE_MAX];
+static struct selfstat_data selfstat_total;
+
+static uint64_t get_clock(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int64_t get_heap_usage(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2();
+
+	return mi.uordblks + mi.hblkhd;
+#elif defined(__GLIBC__)
+	struct mallinfo mi = mallinfo();
+
+	return (unsigned)mi.uordblks + (unsigned)mi.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+static void start_data(struct selfstat_data *sd)
+{
+	sd->wall_start = get_clock(CLOCK_MONOTONIC);
+	sd->cpu_start = get_clock(CLOCK_PROCESS_CPUTIME_ID);
+	sd->heap_start = get_heap_usage();
+}
+
+static void stop_data(struct selfstat_data *sd)
+{
+	sd->calls++;
+	sd->wall += get_clock(CLOCK_MONOTONIC) - sd->wall_start;
+	sd->cpu += get_clock(CLOCK_PROCESS_CPUTIME_ID) - sd->cpu_start;
+	sd->heap += get_heap_usage() - sd->heap_start;
+}
+
+void __selfstat_begin(enum selfstat_phase phase)
+{
+	struct selfstat_data *sd = &selfstat[phase];
+
+	/* only the outermost one counts if it's called recursively */
+	if (sd->depth++ == 0)
+		start_data(sd);
+}
+
+void __selfstat_end(enum selfstat_phase phase)
+{
+	struct selfstat_data *sd = &selfstat[phase];
+
+	if (sd->depth == 0 || --sd->depth > 0)
+		return;
+
+	stop_data(sd);
+}
+
+int selfstat_setup(const char *format)
+{
+	if (format == NULL || !strcmp(format, "text"))
+		selfstat_format = SELFSTAT_FMT_TEXT;
+	else if (!strcmp(format, "json"))
+		selfstat_format = SELFSTAT_FMT_JSON;
+	else
+		return -1;
+
+	memset(selfstat, 0, sizeof(selfstat));
+	memset(&selfstat_total, 0, sizeof(selfstat_total));
+	start_data(&selfstat_total);
+	return 0;
+}
+
+static void print_text(FILE *fp, const char *name, struct selfstat_data *sd)
+{
+	fprintf(fp, "  %-22s %7u %11.3f ms %11.3f ms %11.1f KB\n", name, sd->calls,
+		(double)sd->wall / NSEC_PER_MSEC, (double)sd->cpu / NSEC_PER_MSEC,
+		(double)sd->heap / 1024);
+}
+
+static void print_json(FILE *fp, const char *name, struct selfstat_data *sd, bool last)
+{
+	fprintf(fp,
+		"    { \"name\": \"%s\", \"calls\": %u, \"wall_ns\": %" PRIu64
+		", \"cpu_ns\": %" PRIu64 ", \"heap_bytes\": %" PRId64 " }%s\n",
+		name, sd->calls, sd->wall, sd->cpu, sd->heap, last ? "" : ",");
+}
+
+void selfstat_print(FILE *fp)
+{
+	int i;
+
+	if (selfstat_format == SELFSTAT_FMT_NONE)
+		return;
+
+	stop_data(&selfstat_total);
+
+	if (selfstat_format == SELFSTAT_FMT_JSON) {
+		fprintf(fp, "{\n  \"phases\": [\n");
+		for (i = 0; i < SELFSTAT_PHASE_MAX; i++) {
+			if (selfstat[i].calls)
+				print_json(fp, selfstat_names[i], &selfstat[i], false);
+		}
+		print_json(fp, "total", &selfstat_total, true);
+		fprintf(fp, "  ]\n}\n");
+		return;
+	}
+
+	fprintf(fp, "\nuftrace self-stat (nested phases are included in the outer):\n");
+	fprintf(fp, "  %-22s %7s %14s %14s %14s\n", "PHASE", "CALLS", "WALL TIME", "CPU TIME",
+		"HEAP DIFF");
+	fprintf(fp, "  %-22s %7s %14s %14s %14s\n", "======================", "=======",
+		"==============", "==============", "==============");
+	for (i = 0; i < SELFSTAT_PHASE_MAX; i++) {
+		if (selfstat[i].calls)
+			print_text(fp, selfstat_names[i], &selfstat[i]);
+	}
+	print_text(fp, "total", &selfstat_total);
+}
+
+#ifdef UNIT_TEST
+TEST_CASE(selfstat_phase)
+{
+	TEST_EQ(selfstat_setup("yaml"), -1);
+	TEST_EQ(selfstat_setup("json"), 0);
+	TEST_EQ(selfstat_format, SELFSTAT_FMT_JSON);
+
+	pr_dbg("nested calls of the same phase are counted once\n");
+	selfstat_begin(SELFSTAT_LOAD_SYMTAB);
+	selfstat_begin(SELFSTAT_LOAD_SYMTAB);
+	selfstat_end(SELFSTAT_LOAD_SYMTAB);
+	TEST_EQ(selfstat[SELFSTAT_LOAD_SYMTAB].calls, 0U);
+	selfstat_end(SELFSTAT_LOAD_SYMTAB);
+	TEST_EQ(selfstat[SELFSTAT_LOAD_SYMTAB].calls, 1U);
+
+	pr_dbg("unbalanced end should be ignored\n");
+	selfstat_end(SELFSTAT_OUTPUT);
+	TEST_EQ(selfstat[SELFSTAT_OUTPUT].calls, 0U);
+
+	selfstat_format = SELFSTAT_FMT_NONE;
+	selfstat_begin(SELFSTAT_OUTPUT);
+	selfstat_end(SELFSTAT_OUTPUT);
+	TEST_EQ(selfstat[SELFSTAT_OUTPUT].calls, 0U);
+
+	return TEST_OK;
+}
+#endif /* UNIT_TEST */
@@ -0,0 +1,49 @@
+#ifndef UFTRACE_SELFSTAT_H
+#define UFTRACE_SELFSTAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* phases of uftrace itself, measured by --self-stat */
+enum selfstat_phase {
+	SELFSTAT_OPEN_DATA,
+	SELFSTAT_LOAD_SYMTAB,
+	SELFSTAT_LOAD_DEBUG,
+	SELFSTAT_SETUP_FILTER,
+	SELFSTAT_READ_RSTACK,
+	SELFSTAT_OUTPUT,
+	SELFSTAT_RECORD,
+	SELFSTAT_SAVE_SYMTAB,
+
+	SELFSTAT_PHASE_MAX,
+};
+
+enum selfstat_format {
+	SELFSTAT_FMT_NONE,
+	SELFSTAT_FMT_TEXT,
+	SELFSTAT_FMT_JSON,
+};
+
+extern enum selfstat_format selfstat_format;
+
+void __selfstat_begin(enum selfstat_phase phase);
+void __selfstat_end(enum selfstat_phase phase);
+
+/* these are called in the normal code paths, keep them cheap when disabled */
+static inline void selfstat_begin(enum selfstat_phase phase)
+{
+	if (selfstat_format != SELFSTAT_FMT_NONE)
+		__selfstat_begin(phase);
+}
+
+static inline void selfstat_end(enum selfstat_phase phase)
+{
+	if (selfstat_format != SELFSTAT_FMT_NONE)
+		__selfstat_end(phase);
+}
+
+int selfstat_setup(const char *format);
+void selfstat_print(FILE *fp);
+
+#endif /* UFTRACE_SELFSTAT_H */
@@ -1,3 +1,5 @@
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -9,6 +11,7 @@
 #include "uftrace.h"
 #include "utils/fstack.h"
 #include "utils/rbtree.h"
+#include "utils/selfstat.h"
 #include "utils/symbol.h"
 #include "utils/utils.h"
 
@@ -178,6 +181,81 @@ next:
 		pr_err("cannot rename map file: %s", filename);
 }
 
+struct record_session {
+	struct list_head list;
+	uint64_t sid;
+	struct uftrace_sym_info sinfo;
+};
+
+static LIST_HEAD(record_sessions);
+static pthread_mutex_t record_session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * get_record_symtabs - get symbol tables of a session during recording
+ * @dirname: uftrace data directory name
+ * @sid: session id
+ *
+ * This function is for the recorder to resolve symbols while the trace
+ * data is being recorded (e.g. 'uftrace top').  It reads the session map
+ * and loads the module symbol tables when it sees @sid for the first
+ * time.  The symbol tables are kept until release_record_symtabs().
+ */
+struct uftrace_sym_info *get_record_symtabs(const char *dirname, uint64_t sid)
+{
+	struct record_session *s;
+	char sid_str[SESSION_ID_LEN + 1];
+	char *map_file = NULL;
+
+	pthread_mutex_lock(&record_session_lock);
+
+	list_for_each_entry(s, &record_sessions, list) {
+		if (s->sid == sid)
+			goto out;
+	}
+
+	s = xzalloc(sizeof(*s));
+	s->sid = sid;
+	s->sinfo.dirname = xstrdup(dirname);
+	s->sinfo.flags = SYMTAB_FL_ADJ_OFFSET;
+
+	snprintf(sid_str, sizeof(sid_str), "%016" PRIx64, sid);
+	xasprintf(&map_file, "%s/sid-%s.map", dirname, sid_str);
+
+	/* the map file is written when the session starts */
+	if (access(map_file, F_OK) == 0) {
+		read_session_map((char *)s->sinfo.dirname, &s->sinfo, sid_str);
+		load_module_symtabs(&s->sinfo);
+	}
+	else {
+		pr_dbg("cannot find map file for session %s\n", sid_str);
+	}
+	free(map_file);
+
+	list_add(&s->list, &record_sessions);
+out:
+	pthread_mutex_unlock(&record_session_lock);
+	return &s->sinfo;
+}
+
+/**
+ * release_record_symtabs - free symbol tables loaded during recording
+ *
+ * This function releases all session info loaded by get_record_symtabs().
+ */
+void release_record_symtabs(void)
+{
+	struct record_session *s, *tmp;
+
+	pthread_mutex_lock(&record_session_lock);
+	list_for_each_entry_safe(s, tmp, &record_sessions, list) {
+		list_del(&s->list);
+		delete_session_map(&s->sinfo);
+		free((char *)s->sinfo.dirname);
+		free(s);
+	}
+	pthread_mutex_unlock(&record_session_lock);
+}
+
 /**
  * create_session - create a new task session from session message
  * @sessions: session link to manage sessions and tasks
@@ -242,8 +320,14 @@ void create_session(struct uftrace_session_link *sessions, struct uftrace_msg_se
 
 		read_session_map(dirname, &s->sym_info, s->sid);
 
+		selfstat_begin(SELFSTAT_LOAD_SYMTAB);
 		load_module_symtabs(&s->sym_info);
+		selfstat_end(SELFSTAT_LOAD_SYMTAB);
+
+		selfstat_begin(SELFSTAT_LOAD_DEBUG);
 		load_debug_info(&s->sym_info, needs_srcline);
+		selfstat_end(SELFSTAT_LOAD_DEBUG);
+
 		load_python_symtab(&s->sym_info);
 	}
 
@@ -17,8 +17,7 @@ void socket_unlink(struct sockaddr_un *addr)
 	}
 }
 
-/* Create socket for communication between the client and the agent */
-int socket_create(struct sockaddr_un *addr, pid_t pid)
+static int __socket_create(struct sockaddr_un *addr, pid_t pid, const char *ext)
 {
 	int fd;
 	char *channel = NULL;
@@ -29,13 +28,25 @@ int socket_create(struct sockaddr_un *addr, pid_t pid)
 		return fd;
 	}
 	memset(addr, 0, sizeof(struct sockaddr_un));
-	xasprintf(&channel, "%s/%d.socket", MCOUNT_AGENT_SOCKET_DIR, pid);
+	xasprintf(&channel, "%s/%d.%s", MCOUNT_AGENT_SOCKET_DIR, pid, ext);
 	addr->sun_family = AF_UNIX;
 	strncpy(addr->sun_path, channel, sizeof(addr->sun_path) - 1);
 	free(channel);
 	return fd;
 }
 
+/* Create socket for communication between the client and the agent */
+int socket_create(struct sockaddr_un *addr, pid_t pid)
+{
+	return __socket_create(addr, pid, "socket");
+}
+
+/* Create socket for 'uftrace top' to get stats from the recorder of @pid */
+int socket_create_top(struct sockaddr_un *addr, pid_t pid)
+{
+	return __socket_create(addr, pid, "top");
+}
+
 /* Setup socket on agent side so it can accept client connection */
 int socket_listen(int fd, struct sockaddr_un *addr)
 {
@@ -62,6 +73,16 @@ int socket_send_option(int fd, enum uftrace_dopt opt, void *value, size_t size)
 	return 0;
 }
 
+/* Send an option with a string value (and its length) to the agent */
+int socket_send_string(int fd, enum uftrace_dopt opt, char *str)
+{
+	int len = strlen(str) + 1;
+
+	if (socket_send_option(fd, opt, &len, sizeof(len)) < 0)
+		return -1;
+	return write_all(fd, str, len);
+}
+
 int socket_connect(int fd, struct sockaddr_un *addr)
 {
 	if (connect(fd, (struct sockaddr *)addr, sizeof(struct sockaddr_un)) == -1) {
@@ -9,9 +9,11 @@ enum uftrace_dopt;
 
 void socket_unlink(struct sockaddr_un *addr);
 int socket_create(struct sockaddr_un *addr, pid_t pid);
+int socket_create_top(struct sockaddr_un *addr, pid_t pid);
 int socket_listen(int fd, struct sockaddr_un *addr);
 int socket_connect(int fd, struct sockaddr_un *addr);
 int socket_accept(int fd);
 int socket_send_option(int fd, enum uftrace_dopt opt, void *value, size_t size);
+int socket_send_string(int fd, enum uftrace_dopt opt, char *str);
 
 #endif // UFTRACE_SOCKET_H
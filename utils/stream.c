@@ -0,0 +1,611 @@
+/*
+ * Streaming output for 'uftrace live --stream'
+ *
+ * The recorder passes each shmem buffer to stream_add_buffer() when it's
+ * handed off from the target.  Records are queued per task and a printer
+ * thread merges them by timestamp.  Records older than the reorder window
+ * (from the latest timestamp seen) are printed in the replay format, so
+ * the output is delayed by the window plus the buffer flush time.  The
+ * recorder also passes new records in the buffers still being written to
+ * stream_peek_buffer() periodically, so that idle tasks are not delayed.
+ *
+ * Released under the GPL v2.
+ */
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT "stream"
+#define PR_DOMAIN DBG_UFTRACE
+
+#include "uftrace.h"
+#include "utils/hashmap.h"
+#include "utils/stream.h"
+#include "utils/symbol.h"
+#include "utils/utils.h"
+
+struct stream_frame {
+	uint64_t addr;
+	uint64_t time;
+};
+
+struct stream_task {
+	int tid;
+	uint64_t sid;
+	/* pending records in a ring buffer */
+	struct uftrace_record *recs;
+	unsigned head;
+	unsigned nr_recs;
+	unsigned max_recs;
+	/* shadow stack to get the duration of non-leaf functions */
+	int nr_frames;
+	int max_frames;
+	struct stream_frame *frames;
+	/* buffers handed off but not added yet */
+	int nr_queued;
+	/* length of the current buffer added by stream_peek_buffer() */
+	size_t peeked;
+};
+
+volatile bool stream_enabled;
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_t thread;
+	char *dirname;
+	Hashmap *names;
+	struct stream_task **tasks;
+	int nr_tasks;
+	struct strv tids;
+	uint64_t window;
+	uint64_t last_time; /* latest timestamp seen */
+	bool updated; /* new records since last release */
+	bool comment;
+	bool running;
+	volatile bool done;
+} stream = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.tids = STRV_INIT,
+};
+
+static bool check_tid(int tid)
+{
+	char *s;
+	int i;
+
+	if (stream.tids.nr == 0)
+		return true;
+
+	strv_for_each(&stream.tids, s, i) {
+		if (strtol(s, NULL, 0) == tid)
+			return true;
+	}
+	return false;
+}
+
+static struct stream_task *get_task(int tid, uint64_t sid)
+{
+	struct stream_task *task;
+	int i;
+
+	for (i = 0; i < stream.nr_tasks; i++) {
+		task = stream.tasks[i];
+		if (task->tid == tid) {
+			/* exec starts a new session with the same tid */
+			task->sid = sid;
+			return task;
+		}
+	}
+
+	task = xzalloc(sizeof(*task));
+	task->tid = tid;
+	task->sid = sid;
+
+	stream.tasks = xrealloc(stream.tasks, (stream.nr_tasks + 1) * sizeof(*stream.tasks));
+	stream.tasks[stream.nr_tasks++] = task;
+	return task;
+}
+
+static struct uftrace_record *task_rec(struct stream_task *task, unsigned idx)
+{
+	return &task->recs[(task->head + idx) & (task->max_recs - 1)];
+}
+
+static void push_rec(struct stream_task *task, struct uftrace_record *rec)
+{
+	if (task->nr_recs == task->max_recs) {
+		unsigned new_max = task->max_recs ? task->max_recs * 2 : 256;
+		struct uftrace_record *recs = xmalloc(new_max * sizeof(*recs));
+		unsigned i;
+
+		for (i = 0; i < task->nr_recs; i++)
+			recs[i] = *task_rec(task, i);
+
+		free(task->recs);
+		task->recs = recs;
+		task->head = 0;
+		task->max_recs = new_max;
+	}
+
+	*task_rec(task, task->nr_recs++) = *rec;
+}
+
+static void pop_rec(struct stream_task *task)
+{
+	task->head = (task->head + 1) & (task->max_recs - 1);
+	task->nr_recs--;
+}
+
+static const char *get_name(uint64_t sid, uint64_t addr)
+{
+	struct uftrace_sym_info *sinfo;
+	struct uftrace_symbol *sym;
+	char *name;
+	char *copy;
+
+	copy = hashmap_get(stream.names, (void *)(uintptr_t)addr);
+	if (copy)
+		return copy;
+
+	sinfo = get_record_symtabs(stream.dirname, sid);
+	sym = find_symtabs(sinfo, addr);
+	name = symbol_getname(sym, addr);
+	copy = xstrdup(name);
+	symbol_putname(sym, name);
+
+	hashmap_put(stream.names, (void *)(uintptr_t)addr, copy);
+	return copy;
+}
+
+/* same as the default output fields of replay: duration and tid */
+static void print_fields(struct stream_task *task, uint64_t duration)
+{
+	pr_out(" ");
+	if (duration)
+		print_time_unit(duration);
+	else
+		pr_out("%10s", "");
+
+	pr_out(" [%6d] | ", task->tid);
+}
+
+static void print_entry(struct stream_task *task, struct uftrace_record *rec)
+{
+	struct uftrace_record *next = NULL;
+	const char *name = get_name(task->sid, rec->addr);
+	int depth = rec->depth;
+	int i;
+
+	if (task->nr_recs > 1)
+		next = task_rec(task, 1);
+
+	/* merge a leaf function into a line */
+	if (next && next->type == UFTRACE_EXIT && next->depth == rec->depth &&
+	    next->addr == rec->addr) {
+		print_fields(task, next->time - rec->time ?: 1);
+		pr_out("%*s%s();\n", depth * 2, "", name);
+		pop_rec(task);
+		return;
+	}
+
+	if (depth >= task->max_frames) {
+		task->max_frames = ALIGN(depth + 1, 64);
+		task->frames = xrealloc(task->frames, task->max_frames * sizeof(*task->frames));
+	}
+
+	/* fill the hole (due to lost records or filters) not to match */
+	for (i = task->nr_frames; i < depth; i++)
+		memset(&task->frames[i], 0, sizeof(*task->frames));
+
+	task->frames[depth].addr = rec->addr;
+	task->frames[depth].time = rec->time;
+	task->nr_frames = depth + 1;
+
+	print_fields(task, 0);
+	pr_out("%*s%s() {\n", depth * 2, "", name);
+}
+
+static void print_exit(struct stream_task *task, struct uftrace_record *rec)
+{
+	const char *name = get_name(task->sid, rec->addr);
+	struct stream_frame *frame;
+	int depth = rec->depth;
+	uint64_t duration = 0;
+
+	if (depth < task->nr_frames) {
+		frame = &task->frames[depth];
+		if (frame->addr == rec->addr && frame->time <= rec->time)
+			duration = rec->time - frame->time ?: 1;
+		task->nr_frames = depth;
+	}
+
+	print_fields(task, duration);
+	pr_out("%*s}", depth * 2, "");
+	if (stream.comment)
+		pr_gray(" /* %s */", name);
+	pr_out("\n");
+}
+
+static void print_lost(struct stream_task *task, struct uftrace_record *rec)
+{
+	int depth = task->nr_frames;
+
+	print_fields(task, 0);
+	pr_red("%*s/* LOST %d records!! */\n", depth * 2, "", (int)rec->addr);
+	task->nr_frames = 0;
+}
+
+static struct stream_task *first_task(void)
+{
+	struct stream_task *task = NULL;
+	struct stream_task *t;
+	int i;
+
+	for (i = 0; i < stream.nr_tasks; i++) {
+		t = stream.tasks[i];
+		if (t->nr_recs == 0)
+			continue;
+		if (task == NULL || task_rec(t, 0)->time < task_rec(task, 0)->time)
+			task = t;
+	}
+	return task;
+}
+
+/*
+ * print records until @limit in timestamp order.  if @wait is true, it
+ * waits for the exit of the last entry of a task to be merged as a leaf
+ * unless it's older than the window.
+ */
+static void release_records(uint64_t limit, bool wait)
+{
+	struct stream_task *task;
+	struct uftrace_record *rec;
+
+	while ((task = first_task()) != NULL) {
+		rec = task_rec(task, 0);
+		if (rec->time > limit)
+			break;
+
+		if (wait && rec->type == UFTRACE_ENTRY && task->nr_recs == 1 &&
+		    rec->time + stream.window > limit)
+			break;
+
+		switch (rec->type) {
+		case UFTRACE_ENTRY:
+			print_entry(task, rec);
+			break;
+		case UFTRACE_EXIT:
+			print_exit(task, rec);
+			break;
+		case UFTRACE_LOST:
+			print_lost(task, rec);
+			break;
+		default:
+			break;
+		}
+		pop_rec(task);
+	}
+}
+
+/* queue records in @data from @pos and return the position of the next record */
+static size_t add_records(struct stream_task *task, void *data, size_t pos, size_t size)
+{
+	while (pos + sizeof(struct uftrace_record) <= size) {
+		struct uftrace_record *rec = data + pos;
+		size_t next = pos + sizeof(*rec);
+
+		if (rec->magic != RECORD_MAGIC) {
+			pr_dbg("invalid record magic at %zu of task %d\n", pos, task->tid);
+			break;
+		}
+
+		if (rec->more) {
+			/* only events have the size of extra data */
+			if (rec->type != UFTRACE_EVENT) {
+				pr_dbg("cannot handle argument data of task %d\n", task->tid);
+				break;
+			}
+			if (next + 2 > size)
+				break;
+			next += ALIGN(*(uint16_t *)(data + next) + 2, 8);
+		}
+		if (next > size)
+			break;
+		pos = next;
+
+		/* events are not shown */
+		if (rec->type == UFTRACE_EVENT)
+			continue;
+
+		push_rec(task, rec);
+		if (stream.last_time < rec->time)
+			stream.last_time = rec->time;
+		stream.updated = true;
+	}
+	return pos;
+}
+
+/**
+ * stream_queue_buffer - note that a buffer of a task is handed off
+ * @sid: session id of the buffer
+ * @tid: task id of the buffer
+ *
+ * This should be called when a buffer is passed to the writers so that
+ * stream_peek_buffer() doesn't read the next buffer before it's added.
+ */
+void stream_queue_buffer(uint64_t sid, int tid)
+{
+	if (!check_tid(tid))
+		return;
+
+	pthread_mutex_lock(&stream.lock);
+	get_task(tid, sid)->nr_queued++;
+	pthread_mutex_unlock(&stream.lock);
+}
+
+/**
+ * stream_add_buffer - queue records in a buffer to print
+ * @sid: session id of the buffer
+ * @tid: task id of the buffer
+ * @data: record data
+ * @size: length of @data
+ *
+ * This function should be called for each buffer of a task in order.
+ * It cannot handle argument data as their size is unknown here.
+ */
+void stream_add_buffer(uint64_t sid, int tid, void *data, size_t size)
+{
+	struct stream_task *task;
+
+	if (!check_tid(tid))
+		return;
+
+	pthread_mutex_lock(&stream.lock);
+
+	task = get_task(tid, sid);
+
+	/* skip the records added by stream_peek_buffer() already */
+	add_records(task, data, task->peeked, size);
+	task->peeked = 0;
+	if (task->nr_queued)
+		task->nr_queued--;
+
+	pthread_mutex_unlock(&stream.lock);
+}
+
+/**
+ * stream_peek_buffer - queue new records in a buffer still being written
+ * @sid: session id of the buffer
+ * @tid: task id of the buffer
+ * @data: record data
+ * @size: length of @data written so far
+ *
+ * This function is called periodically for the current buffer of each
+ * task so that records of an idle task are shown without waiting for the
+ * buffer to be handed off.  It does nothing if previous buffers of the
+ * task are not added yet, so that the records are queued in order.
+ */
+void stream_peek_buffer(uint64_t sid, int tid, void *data, size_t size)
+{
+	struct stream_task *task;
+
+	if (!check_tid(tid))
+		return;
+
+	pthread_mutex_lock(&stream.lock);
+
+	task = get_task(tid, sid);
+	if (task->nr_queued == 0 && task->peeked < size)
+		task->peeked = add_records(task, data, task->peeked, size);
+
+	pthread_mutex_unlock(&stream.lock);
+}
+
+static void *printer_thread(void *arg)
+{
+	unsigned msec = stream.window / NSEC_PER_MSEC;
+	sigset_t sigset;
+	uint64_t limit;
+	bool wait;
+
+	pthread_setname_np(pthread_self(), "StreamPrinter");
+
+	/* let the main thread handle signals */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+	while (!stream.done) {
+		usleep(msec * 1000);
+
+		pthread_mutex_lock(&stream.lock);
+
+		/* print everything if no more records were added */
+		if (stream.updated && stream.last_time > stream.window) {
+			limit = stream.last_time - stream.window;
+			wait = true;
+		}
+		else {
+			limit = stream.updated ? 0 : -1ULL;
+			wait = false;
+		}
+		stream.updated = false;
+
+		release_records(limit, wait);
+		pthread_mutex_unlock(&stream.lock);
+
+		pr_flush();
+	}
+	return NULL;
+}
+
+static void stream_setup(const char *dirname, const char *tid_filter, uint64_t window,
+			 bool comment)
+{
+	stream.dirname = xstrdup(dirname);
+	stream.names = hashmap_create(1024, hashmap_ptr_hash, hashmap_ptr_equals);
+	stream.window = window;
+	stream.comment = comment;
+
+	if (tid_filter)
+		strv_split(&stream.tids, tid_filter, ",");
+}
+
+/**
+ * stream_init - start printing trace records as they are recorded
+ * @opts: uftrace options
+ *
+ * This function prints the header and starts a thread to print the
+ * records passed by stream_add_buffer() periodically.
+ */
+void stream_init(struct uftrace_opts *opts)
+{
+	stream_setup(opts->dirname, opts->tid, opts->interval, opts->comment);
+
+	pr_out("# DURATION     TID     FUNCTION\n");
+
+	stream.running = true;
+	pthread_create(&stream.thread, NULL, printer_thread, NULL);
+}
+
+/**
+ * stream_flush - stop the printer and print all remaining records
+ *
+ * This should be called after all buffers are added and before the
+ * symbol tables are released by the recorder.
+ */
+void stream_flush(void)
+{
+	if (stream.running) {
+		stream.done = true;
+		pthread_join(stream.thread, NULL);
+		stream.running = false;
+	}
+
+	pthread_mutex_lock(&stream.lock);
+	release_records(-1ULL, false);
+	pthread_mutex_unlock(&stream.lock);
+
+	pr_flush();
+}
+
+static bool free_name(void *key, void *value, void *arg)
+{
+	free(value);
+	return true;
+}
+
+void stream_finish(void)
+{
+	int i;
+
+	if (stream.names == NULL)
+		return;
+
+	for (i = 0; i < stream.nr_tasks; i++) {
+		free(stream.tasks[i]->recs);
+		free(stream.tasks[i]->frames);
+		free(stream.tasks[i]);
+	}
+	free(stream.tasks);
+	stream.tasks = NULL;
+	stream.nr_tasks = 0;
+
+	hashmap_for_each(stream.names, free_name, NULL);
+	hashmap_free(stream.names);
+	stream.names = NULL;
+
+	strv_free(&stream.tids);
+	free(stream.dirname);
+	stream.dirname = NULL;
+	stream.last_time = 0;
+	stream.done = false;
+}
+
+#ifdef UNIT_TEST
+
+static void *make_buffer(size_t *size, const int *types, const int *depths, const uint64_t *times,
+			 const uint64_t *addrs, int nr)
+{
+	struct uftrace_record *recs = xcalloc(nr, sizeof(*recs));
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		recs[i].time = times[i];
+		recs[i].type = types[i];
+		recs[i].magic = RECORD_MAGIC;
+		recs[i].depth = depths[i];
+		recs[i].addr = addrs[i];
+	}
+	*size = nr * sizeof(*recs);
+	return recs;
+}
+
+TEST_CASE(stream_reorder)
+{
+	/* task 1: a() { b(); }   task 2: c() { d() */
+	int types1[] = { UFTRACE_ENTRY, UFTRACE_ENTRY, UFTRACE_EXIT, UFTRACE_EXIT };
+	int depths1[] = { 0, 1, 1, 0 };
+	uint64_t times1[] = { 100, 300, 400, 600 };
+	uint64_t addrs1[] = { 0x1000, 0x2000, 0x2000, 0x1000 };
+	int types2[] = { UFTRACE_ENTRY, UFTRACE_ENTRY };
+	int depths2[] = { 0, 1 };
+	uint64_t times2[] = { 200, 500 };
+	uint64_t addrs2[] = { 0x3000, 0x4000 };
+	const char expected1[] = "            [     1] | <1000>() {\n"
+				 "            [     2] | <3000>() {\n"
+				 "   0.100 us [     1] |   <2000>();\n";
+	const char expected2[] = "            [     2] |   <4000>() {\n"
+				 "   0.500 us [     1] | } /* <1000> */\n";
+	FILE *saved_outfp = outfp;
+	char *out = NULL;
+	size_t len = 0;
+	void *buf1, *buf2;
+	size_t size1, size2;
+
+	stream_setup("/nonexistent", NULL, 100, true);
+
+	buf1 = make_buffer(&size1, types1, depths1, times1, addrs1, ARRAY_SIZE(types1));
+	buf2 = make_buffer(&size2, types2, depths2, times2, addrs2, ARRAY_SIZE(types2));
+
+	pr_dbg("add buffers of task 2 and task 1\n");
+	stream_add_buffer(1, 2, buf2, size2);
+	stream_add_buffer(1, 1, buf1, size1);
+	TEST_EQ(stream.last_time, 600);
+
+	outfp = open_memstream(&out, &len);
+
+	pr_dbg("release records within the window in time order\n");
+	release_records(stream.last_time - stream.window, true);
+	fflush(outfp);
+	TEST_STREQ(out, expected1);
+
+	pr_dbg("the last entry waits for the exit\n");
+	TEST_EQ(stream.tasks[0]->nr_recs, 1);
+	TEST_EQ(stream.tasks[1]->nr_recs, 1);
+
+	fclose(outfp);
+	free(out);
+	out = NULL;
+	outfp = open_memstream(&out, &len);
+
+	pr_dbg("release all records\n");
+	release_records(-1ULL, false);
+	fflush(outfp);
+	TEST_STREQ(out, expected2);
+
+	fclose(outfp);
+	outfp = saved_outfp;
+
+	free(out);
+	free(buf1);
+	free(buf2);
+	stream_finish();
+	release_record_symtabs();
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
@@ -0,0 +1,23 @@
+#ifndef UFTRACE_STREAM_H
+#define UFTRACE_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct uftrace_opts;
+
+/* default reorder window (in msec) */
+#define STREAM_DEFAULT_WINDOW 100
+
+/* writers feed buffers only when it's set */
+extern volatile bool stream_enabled;
+
+void stream_init(struct uftrace_opts *opts);
+void stream_queue_buffer(uint64_t sid, int tid);
+void stream_add_buffer(uint64_t sid, int tid, void *data, size_t size);
+void stream_peek_buffer(uint64_t sid, int tid, void *data, size_t size);
+void stream_flush(void);
+void stream_finish(void);
+
+#endif /* UFTRACE_STREAM_H */
@@ -0,0 +1,326 @@
+/*
+ * shared symbol table cache for uftrace
+ *
+ * Loading symbols from ELF files (and demangling them) is done in every
+ * traced process for all modules.  The symbol cache saves the loaded
+ * symbol table of a module in a binary file identified by the build-id
+ * so that other processes (and uftrace commands) can just mmap it.  The
+ * symbol names are used from the mapped file directly so the pages are
+ * shared in the page cache.
+ *
+ * Released under the GPL v2.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT "symbol"
+#define PR_DOMAIN DBG_SYMBOL
+
+#include "utils/symbol.h"
+#include "utils/utils.h"
+
+#define SYMTAB_CACHE_MAGIC "UFTSYMC"
+#define SYMTAB_CACHE_VERSION 1
+
+/* flags which change the content of symbol table */
+#define SYMTAB_CACHE_FLAGS                                                                         \
+	(SYMTAB_FL_DEMANGLE | SYMTAB_FL_ADJ_OFFSET | SYMTAB_FL_SKIP_NORMAL | SYMTAB_FL_SKIP_DYNAMIC)
+
+struct symtab_cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	int32_t demangler;
+	uint32_t nr_sym;
+	uint64_t str_size;
+};
+
+struct symtab_cache_entry {
+	uint64_t addr;
+	uint32_t size;
+	uint32_t type;
+	uint32_t name;
+	uint32_t unused;
+};
+
+/* directory to save the symbol tables, NULL if disabled */
+static char *symtab_cache_dir;
+
+void set_symtab_cache_dir(const char *dirname)
+{
+	free(symtab_cache_dir);
+	symtab_cache_dir = dirname ? xstrdup(dirname) : NULL;
+}
+
+static char *get_symtab_cache_name(const char *build_id, unsigned long flags)
+{
+	char *filename = NULL;
+
+	if (symtab_cache_dir == NULL || build_id == NULL || build_id[0] == '\0')
+		return NULL;
+
+	flags &= SYMTAB_CACHE_FLAGS;
+	xasprintf(&filename, "%s/%s-%lx%s.symtab", symtab_cache_dir, build_id, flags,
+		  (flags & SYMTAB_FL_DEMANGLE) ? (demangler == DEMANGLE_FULL ? "f" : "s") : "");
+	return filename;
+}
+
+/* returns 0 if it loaded the symbol table from the cache */
+int load_symtab_cache(struct uftrace_symtab *symtab, const char *build_id, unsigned long flags)
+{
+	struct symtab_cache_header *hdr;
+	struct symtab_cache_entry *entry;
+	uint32_t *names;
+	char *strtab;
+	char *filename;
+	struct stat stbuf;
+	void *map = MAP_FAILED;
+	size_t size = 0;
+	size_t i;
+	int fd;
+	int ret = -1;
+
+	filename = get_symtab_cache_name(build_id, flags);
+	if (filename == NULL)
+		return -1;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		goto out;
+
+	if (fstat(fd, &stbuf) < 0 || (size_t)stbuf.st_size < sizeof(*hdr))
+		goto out;
+
+	size = stbuf.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto out;
+
+	hdr = map;
+	if (memcmp(hdr->magic, SYMTAB_CACHE_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != SYMTAB_CACHE_VERSION || hdr->flags != (flags & SYMTAB_CACHE_FLAGS) ||
+	    ((flags & SYMTAB_FL_DEMANGLE) && hdr->demangler != demangler) || hdr->nr_sym == 0 ||
+	    size != sizeof(*hdr) + hdr->nr_sym * (sizeof(*entry) + sizeof(*names)) + hdr->str_size) {
+		pr_dbg("invalid symbol cache: %s\n", filename);
+		goto out;
+	}
+
+	entry = map + sizeof(*hdr);
+	names = (void *)(entry + hdr->nr_sym);
+	strtab = (void *)(names + hdr->nr_sym);
+
+	/* the last name should be terminated */
+	if (hdr->str_size == 0 || strtab[hdr->str_size - 1] != '\0')
+		goto out;
+
+	for (i = 0; i < hdr->nr_sym; i++) {
+		if (entry[i].name >= hdr->str_size || names[i] >= hdr->nr_sym)
+			goto out;
+	}
+
+	symtab->nr_sym = symtab->nr_alloc = hdr->nr_sym;
+	symtab->sym = xmalloc(symtab->nr_sym * sizeof(*symtab->sym));
+	symtab->sym_names = xmalloc(symtab->nr_sym * sizeof(*symtab->sym_names));
+
+	for (i = 0; i < symtab->nr_sym; i++) {
+		struct uftrace_symbol *sym = &symtab->sym[i];
+
+		sym->addr = entry[i].addr;
+		sym->size = entry[i].size;
+		sym->type = entry[i].type;
+		sym->name = strtab + entry[i].name;
+	}
+	for (i = 0; i < symtab->nr_sym; i++)
+		symtab->sym_names[i] = &symtab->sym[names[i]];
+
+	symtab->name_sorted = true;
+	symtab->cache = map;
+	symtab->cache_size = size;
+
+	pr_dbg2("loaded %zd symbols from cache: %s\n", symtab->nr_sym, filename);
+	ret = 0;
+
+out:
+	if (ret < 0 && map != MAP_FAILED)
+		munmap(map, size);
+	if (fd >= 0)
+		close(fd);
+	free(filename);
+	return ret;
+}
+
+void save_symtab_cache(struct uftrace_symtab *symtab, const char *build_id, unsigned long flags)
+{
+	struct symtab_cache_header hdr = {
+		.magic = SYMTAB_CACHE_MAGIC,
+		.version = SYMTAB_CACHE_VERSION,
+		.flags = flags & SYMTAB_CACHE_FLAGS,
+		.demangler = demangler,
+		.nr_sym = symtab->nr_sym,
+	};
+	struct symtab_cache_entry *entry = NULL;
+	uint32_t *names = NULL;
+	char *filename;
+	char *tmpname = NULL;
+	size_t i;
+	int fd;
+
+	/* symbol table without names sorted cannot be used */
+	if (symtab->nr_sym == 0 || symtab->cache || !symtab->name_sorted)
+		return;
+
+	filename = get_symtab_cache_name(build_id, flags);
+	if (filename == NULL)
+		return;
+
+	/* it's already saved by other process */
+	if (access(filename, F_OK) == 0)
+		goto out;
+
+	entry = xcalloc(symtab->nr_sym, sizeof(*entry));
+	names = xmalloc(symtab->nr_sym * sizeof(*names));
+
+	for (i = 0; i < symtab->nr_sym; i++) {
+		struct uftrace_symbol *sym = &symtab->sym[i];
+
+		entry[i].addr = sym->addr;
+		entry[i].size = sym->size;
+		entry[i].type = sym->type;
+		entry[i].name = hdr.str_size;
+
+		hdr.str_size += strlen(sym->name) + 1;
+	}
+	for (i = 0; i < symtab->nr_sym; i++)
+		names[i] = symtab->sym_names[i] - symtab->sym;
+
+	/* other processes might use the same cache, replace it atomically */
+	xasprintf(&tmpname, "%s.%d", filename, getpid());
+
+	fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		pr_dbg("cannot create symbol cache: %s: %m\n", tmpname);
+		goto out;
+	}
+
+	if (write_all(fd, &hdr, sizeof(hdr)) < 0 ||
+	    write_all(fd, entry, symtab->nr_sym * sizeof(*entry)) < 0 ||
+	    write_all(fd, names, symtab->nr_sym * sizeof(*names)) < 0)
+		goto err;
+
+	for (i = 0; i < symtab->nr_sym; i++) {
+		char *name = symtab->sym[i].name;
+
+		if (write_all(fd, name, strlen(name) + 1) < 0)
+			goto err;
+	}
+
+	close(fd);
+
+	if (rename(tmpname, filename) < 0) {
+		pr_dbg("cannot rename symbol cache: %s: %m\n", filename);
+		unlink(tmpname);
+	}
+	else {
+		pr_dbg2("saved %zd symbols to cache: %s\n", symtab->nr_sym, filename);
+	}
+	goto out;
+
+err:
+	pr_dbg("cannot write symbol cache: %s: %m\n", tmpname);
+	close(fd);
+	unlink(tmpname);
+
+out:
+	free(entry);
+	free(names);
+	free(tmpname);
+	free(filename);
+}
+
+void unload_symtab_cache(struct uftrace_symtab *symtab)
+{
+	if (symtab->cache == NULL)
+		return;
+
+	munmap(symtab->cache, symtab->cache_size);
+	symtab->cache = NULL;
+	symtab->cache_size = 0;
+}
+
+#ifdef UNIT_TEST
+
+TEST_CASE(symbol_cache_load)
+{
+	struct uftrace_symbol syms[] = {
+		{ 0x100, 256, ST_PLT_FUNC, "plt1" },
+		{ 0x1100, 256, ST_GLOBAL_FUNC, "foo" },
+		{ 0x1200, 256, ST_LOCAL_FUNC, "bar" },
+	};
+	struct uftrace_symbol *names[] = {
+		&syms[2],
+		&syms[1],
+		&syms[0],
+	};
+	struct uftrace_symtab stab = {
+		.sym = syms,
+		.sym_names = names,
+		.nr_sym = ARRAY_SIZE(syms),
+		.name_sorted = true,
+	};
+	struct uftrace_symtab test = {};
+	char build_id[] = "0123456789abcdef0123456789abcdef01234567";
+	char dirname[] = "/tmp/uftrace-symcache-XXXXXX";
+	enum symbol_demangler saved_demangler = demangler;
+	char *filename;
+	size_t i;
+
+	TEST_NE(mkdtemp(dirname), NULL);
+	set_symtab_cache_dir(dirname);
+	filename = get_symtab_cache_name(build_id, SYMTAB_FL_ADJ_OFFSET);
+
+	pr_dbg("save symbol cache and load symbols\n");
+	save_symtab_cache(&stab, build_id, SYMTAB_FL_ADJ_OFFSET);
+	TEST_EQ(load_symtab_cache(&test, build_id, SYMTAB_FL_DEMANGLE), -1);
+	TEST_EQ(load_symtab_cache(&test, build_id, SYMTAB_FL_ADJ_OFFSET), 0);
+
+	pr_dbg("check symbols and name index\n");
+	TEST_EQ(test.nr_sym, ARRAY_SIZE(syms));
+	TEST_EQ(test.name_sorted, true);
+	for (i = 0; i < test.nr_sym; i++) {
+		TEST_EQ(test.sym[i].addr, syms[i].addr);
+		TEST_EQ(test.sym[i].size, syms[i].size);
+		TEST_EQ(test.sym[i].type, syms[i].type);
+		TEST_STREQ(test.sym[i].name, syms[i].name);
+		TEST_STREQ(test.sym_names[i]->name, names[i]->name);
+	}
+
+	unload_symtab_cache(&test);
+	free(test.sym);
+	free(test.sym_names);
+	unlink(filename);
+	free(filename);
+
+	pr_dbg("cache saved with other demangler should be rejected\n");
+	demangler = DEMANGLE_SIMPLE;
+	filename = get_symtab_cache_name(build_id, SYMTAB_FL_DEMANGLE);
+	save_symtab_cache(&stab, build_id, SYMTAB_FL_DEMANGLE);
+	demangler = DEMANGLE_NONE;
+	TEST_EQ(load_symtab_cache(&test, build_id, SYMTAB_FL_DEMANGLE), -1);
+	demangler = saved_demangler;
+
+	unlink(filename);
+	free(filename);
+	rmdir(dirname);
+	set_symtab_cache_dir(NULL);
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
@@ -0,0 +1,290 @@
+/*
+ * shared symbol file store for uftrace
+ *
+ * The symbol (.sym) and debug info (.dbg) files of the same binaries are
+ * saved again and again in every data directory.  The symbol store keeps
+ * a single copy of them and the data directory has symlinks to the files
+ * in the store.  Symbol files are named by the build-id and the path name
+ * of the module, and debug files are named by the hash of the contents.
+ * As symlinks are followed transparently, other parts don't need to know
+ * about the store.  The files can be copied back to the data directory
+ * (for export) using pack_data_files().
+ *
+ * Released under the GPL v2.
+ */
+
+#include <errno.h>
+#include <glob.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT "symbol"
+#define PR_DOMAIN DBG_SYMBOL
+
+#include "utils/symbol.h"
+#include "utils/utils.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/* directory to save the symbol files, NULL if disabled */
+static char *symbol_store_dir;
+
+void set_symbol_store_dir(const char *dirname)
+{
+	char path[PATH_MAX];
+
+	free(symbol_store_dir);
+	symbol_store_dir = NULL;
+
+	if (dirname == NULL)
+		return;
+
+	/* symlinks in data directories need an absolute path */
+	if (realpath(dirname, path) == NULL) {
+		pr_dbg("cannot find symbol store: %s: %m\n", dirname);
+		return;
+	}
+	symbol_store_dir = xstrdup(path);
+}
+
+static uint64_t hash_buf(uint64_t hash, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static int hash_file(const char *filename, uint64_t *hash)
+{
+	char buf[4096];
+	FILE *fp;
+	size_t n;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+		return -1;
+
+	*hash = FNV_OFFSET_BASIS;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		*hash = hash_buf(*hash, buf, n);
+
+	fclose(fp);
+	return 0;
+}
+
+/* returns the symbol file name in the store, or NULL if it cannot be used */
+char *get_store_symbol_filename(const char *pathname, const char *build_id)
+{
+	char *filename = NULL;
+	uint64_t hash;
+
+	if (symbol_store_dir == NULL || build_id == NULL || build_id[0] == '\0')
+		return NULL;
+
+	/* the path name is saved in the file */
+	hash = hash_buf(FNV_OFFSET_BASIS, pathname, strlen(pathname));
+	xasprintf(&filename, "%s/%s-%016" PRIx64 ".sym", symbol_store_dir, build_id, hash);
+	return filename;
+}
+
+/* add a symlink to the @storefile, or an existing one if it's the same */
+int link_store_symbol_file(const char *storefile, const char *symfile, const char *pathname,
+			   char *build_id)
+{
+	char *newfile = NULL;
+	int ret = 0;
+
+	if (symlink(storefile, symfile) < 0) {
+		char buf[PATH_MAX];
+		char orig_id[BUILD_ID_STR_SIZE];
+
+		if (errno != EEXIST)
+			return -1;
+
+		/* check if same file was already saved */
+		if (check_symbol_file(symfile, buf, sizeof(buf), orig_id, sizeof(orig_id)) > 0 &&
+		    !strcmp(buf, pathname) && !strcmp(orig_id, build_id))
+			return 0;
+
+		newfile = make_new_symbol_filename(symfile, pathname, build_id);
+		if (symlink(storefile, newfile) < 0 && errno != EEXIST)
+			ret = -1;
+	}
+
+	pr_dbg2("link symbol file %s to %s\n", newfile ?: symfile, storefile);
+	free(newfile);
+	return ret;
+}
+
+/* move the files with @ext in @dirname to the store and leave symlinks */
+void store_data_files(const char *dirname, const char *ext)
+{
+	char path[PATH_MAX];
+	struct stat stbuf;
+	glob_t g;
+	size_t i;
+
+	if (symbol_store_dir == NULL)
+		return;
+
+	snprintf(path, sizeof(path), "%s/*%s", dirname, ext);
+	if (glob(path, GLOB_NOSORT, NULL, &g) != 0)
+		return;
+
+	for (i = 0; i < g.gl_pathc; i++) {
+		char *datafile = g.gl_pathv[i];
+		char *storefile = NULL;
+		char *tmpname = NULL;
+		uint64_t hash;
+
+		/* skip symlinks (already in the store) */
+		if (lstat(datafile, &stbuf) < 0 || !S_ISREG(stbuf.st_mode))
+			continue;
+
+		if (hash_file(datafile, &hash) < 0)
+			continue;
+
+		xasprintf(&storefile, "%s/%016" PRIx64 "-%" PRIx64 "%s", symbol_store_dir, hash,
+			  (uint64_t)stbuf.st_size, ext);
+
+		if (access(storefile, F_OK) < 0) {
+			/* other processes might add the same file */
+			xasprintf(&tmpname, "%s.%d", storefile, getpid());
+			if (copy_file(datafile, tmpname) < 0 || rename(tmpname, storefile) < 0) {
+				unlink(tmpname);
+				goto next;
+			}
+		}
+
+		/* replace it atomically */
+		free(tmpname);
+		xasprintf(&tmpname, "%s.%d", datafile, getpid());
+		if (symlink(storefile, tmpname) < 0 || rename(tmpname, datafile) < 0) {
+			pr_dbg("cannot link to symbol store: %s: %m\n", datafile);
+			unlink(tmpname);
+		}
+		else {
+			pr_dbg2("link data file %s to %s\n", datafile, storefile);
+		}
+
+next:
+		free(tmpname);
+		free(storefile);
+	}
+
+	globfree(&g);
+}
+
+/* replace symlinks to the store with the files (returns number of files) */
+int pack_data_files(const char *dirname)
+{
+	static const char *const exts[] = { "sym", "dbg" };
+	char path[PATH_MAX];
+	char *tmpname = NULL;
+	struct stat stbuf;
+	glob_t g;
+	size_t i, k;
+	int count = 0;
+
+	for (k = 0; k < ARRAY_SIZE(exts); k++) {
+		snprintf(path, sizeof(path), "%s/*.%s", dirname, exts[k]);
+		if (glob(path, GLOB_NOSORT, NULL, &g) != 0)
+			continue;
+
+		for (i = 0; i < g.gl_pathc; i++) {
+			char *datafile = g.gl_pathv[i];
+
+			if (lstat(datafile, &stbuf) < 0 || !S_ISLNK(stbuf.st_mode))
+				continue;
+
+			/* copy_file() would write to the store through the link */
+			xasprintf(&tmpname, "%s.%d", datafile, getpid());
+			if (copy_file(datafile, tmpname) < 0 || rename(tmpname, datafile) < 0) {
+				pr_warn("cannot pack %s: %m\n", datafile);
+				unlink(tmpname);
+			}
+			else {
+				count++;
+			}
+
+			free(tmpname);
+			tmpname = NULL;
+		}
+		globfree(&g);
+	}
+
+	return count;
+}
+
+#ifdef UNIT_TEST
+
+TEST_CASE(symbol_store_data_files)
+{
+	char dirname[] = "/tmp/uftrace-symstore-XXXXXX";
+	char *store = NULL;
+	char *data = NULL;
+	char *pattern = NULL;
+	char *dbgfile = NULL;
+	char *copyfile = NULL;
+	struct stat stbuf;
+	FILE *fp;
+	glob_t g;
+
+	TEST_NE(mkdtemp(dirname), NULL);
+	xasprintf(&store, "%s/store", dirname);
+	xasprintf(&data, "%s/data", dirname);
+
+	TEST_EQ(mkdir(store, 0755), 0);
+	TEST_EQ(mkdir(data, 0755), 0);
+	set_symbol_store_dir(store);
+
+	xasprintf(&dbgfile, "%s/a.out.dbg", data);
+	xasprintf(&copyfile, "%s/libfoo.so.dbg", data);
+
+	pr_dbg("save two debug files with same contents\n");
+	fp = fopen(dbgfile, "w");
+	TEST_NE(fp, NULL);
+	fprintf(fp, "# path name: a.out\nF: 1234 main\nL: 10 s-main.c\n");
+	fclose(fp);
+	TEST_EQ(copy_file(dbgfile, copyfile), 0);
+
+	store_data_files(data, ".dbg");
+
+	pr_dbg("data files should be symlinks to a single file in the store\n");
+	TEST_EQ(lstat(dbgfile, &stbuf), 0);
+	TEST_EQ(S_ISLNK(stbuf.st_mode), true);
+	TEST_EQ(lstat(copyfile, &stbuf), 0);
+	TEST_EQ(S_ISLNK(stbuf.st_mode), true);
+
+	xasprintf(&pattern, "%s/*.dbg", store);
+	TEST_EQ(glob(pattern, 0, NULL, &g), 0);
+	TEST_EQ(g.gl_pathc, 1U);
+	globfree(&g);
+
+	pr_dbg("pack the data directory\n");
+	TEST_EQ(pack_data_files(data), 2);
+	TEST_EQ(lstat(dbgfile, &stbuf), 0);
+	TEST_EQ(S_ISREG(stbuf.st_mode), true);
+
+	remove_directory(dirname);
+	free(dbgfile);
+	free(copyfile);
+	free(pattern);
+	free(store);
+	free(data);
+	set_symbol_store_dir(NULL);
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
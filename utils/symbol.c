@@ -221,9 +221,15 @@ static void unload_symtab(struct uftrace_symtab *symtab)
 {
 	size_t i;
 
-	for (i = 0; i < symtab->nr_sym; i++) {
-		struct uftrace_symbol *sym = symtab->sym + i;
-		free(sym->name);
+	/* symbol names are in the cache */
+	if (symtab->cache) {
+		unload_symtab_cache(symtab);
+	}
+	else {
+		for (i = 0; i < symtab->nr_sym; i++) {
+			struct uftrace_symbol *sym = symtab->sym + i;
+			free(sym->name);
+		}
 	}
 
 	free(symtab->sym_names);
@@ -1061,6 +1067,11 @@ static void load_module_symbol(struct uftrace_sym_info *sinfo, struct uftrace_mo
 		char buf[PATH_MAX];
 		char build_id[BUILD_ID_STR_SIZE];
 
+		/* the symbol file was saved from symbols loaded with the offset */
+		if (load_symtab_cache(&m->symtab, m->build_id,
+				      (flags & SYMTAB_FL_DEMANGLE) | SYMTAB_FL_ADJ_OFFSET) == 0)
+			return;
+
 		xasprintf(&symfile, "%s/%s.sym", sinfo->symdir, basename(m->name));
 		if (access(symfile, F_OK) == 0) {
 			if (check_symbol_file(symfile, buf, sizeof(buf), build_id,
@@ -1083,6 +1094,9 @@ static void load_module_symbol(struct uftrace_sym_info *sinfo, struct uftrace_mo
 			return;
 	}
 
+	if (load_symtab_cache(&m->symtab, m->build_id, flags) == 0)
+		return;
+
 	/*
 	 * Currently it uses a single symtab for both normal symbols
 	 * and dynamic symbols.  Maybe it can be changed later to
@@ -1092,6 +1106,8 @@ static void load_module_symbol(struct uftrace_sym_info *sinfo, struct uftrace_mo
 	load_dynsymtab(&dsymtab, m->name, 0, flags);
 	merge_symtabs(&m->symtab, &dsymtab);
 	update_symtab_using_dynsym(&m->symtab, m->name, 0, flags);
+
+	save_symtab_cache(&m->symtab, m->build_id, flags);
 }
 
 struct uftrace_module *load_module_symtab(struct uftrace_sym_info *sinfo, const char *mod_name,
@@ -1326,6 +1342,8 @@ void save_module_symtabs(const char *dirname)
 	struct rb_node *n = rb_first(&modules);
 	struct uftrace_module *mod;
 	char *symfile = NULL;
+	char *storefile;
+	char *tmpfile = NULL;
 	char build_id[BUILD_ID_STR_SIZE];
 
 	while (n != NULL) {
@@ -1334,7 +1352,29 @@ void save_module_symtabs(const char *dirname)
 		xasprintf(&symfile, "%s/%s.sym", dirname, basename(mod->name));
 
 		read_build_id(mod->name, build_id, sizeof(build_id));
-		save_module_symbol_file(&mod->symtab, mod->name, build_id, symfile, 0);
+		storefile = get_store_symbol_filename(mod->name, build_id);
+
+		if (storefile == NULL) {
+			save_module_symbol_file(&mod->symtab, mod->name, build_id, symfile, 0);
+		}
+		else {
+			/* save it to the store only once, and link to it */
+			if (access(storefile, F_OK) < 0) {
+				xasprintf(&tmpfile, "%s.%d", storefile, getpid());
+				unlink(tmpfile);
+				save_module_symbol_file(&mod->symtab, mod->name, build_id, tmpfile, 0);
+				if (rename(tmpfile, storefile) < 0)
+					unlink(tmpfile);
+				free(tmpfile);
+				tmpfile = NULL;
+			}
+
+			if (access(storefile, F_OK) < 0 ||
+			    link_store_symbol_file(storefile, symfile, mod->name, build_id) < 0)
+				save_module_symbol_file(&mod->symtab, mod->name, build_id, symfile, 0);
+
+			free(storefile);
+		}
 
 		free(symfile);
 		symfile = NULL;
@@ -75,6 +75,9 @@ struct uftrace_symtab {
 	size_t nr_alloc;
 	/* indicates whether it's sorted by name */
 	bool name_sorted;
+	/* mmapped symbol cache which has the names (if loaded from it) */
+	void *cache;
+	size_t cache_size;
 };
 
 struct uftrace_module {
@@ -197,6 +200,18 @@ int check_symbol_file(const char *symfile, char *pathname, int pathlen, char *bu
 		      int build_id_len);
 char *make_new_symbol_filename(const char *symfile, const char *pathname, char *build_id);
 
+void set_symtab_cache_dir(const char *dirname);
+int load_symtab_cache(struct uftrace_symtab *symtab, const char *build_id, unsigned long flags);
+void save_symtab_cache(struct uftrace_symtab *symtab, const char *build_id, unsigned long flags);
+void unload_symtab_cache(struct uftrace_symtab *symtab);
+
+void set_symbol_store_dir(const char *dirname);
+char *get_store_symbol_filename(const char *pathname, const char *build_id);
+int link_store_symbol_file(const char *storefile, const char *symfile, const char *pathname,
+			   char *build_id);
+void store_data_files(const char *dirname, const char *ext);
+int pack_data_files(const char *dirname);
+
 char *symbol_getname(struct uftrace_symbol *sym, uint64_t addr);
 void symbol_putname(struct uftrace_symbol *sym, char *name);
 
@@ -0,0 +1,950 @@
+/*
+ * Live function statistics for 'uftrace top'
+ *
+ * The recorder passes each shmem buffer to top_add_buffer() when it's
+ * handed off from the target.  Records of a task are tracked in a shadow
+ * stack to get the total and self time of a function when it returns,
+ * and the stats are kept for the whole run and for each slot of the
+ * sliding window which is advanced by top_rotate().
+ *
+ * Released under the GPL v2.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/* This should be defined before #include "utils.h" */
+#define PR_FMT "top"
+#define PR_DOMAIN DBG_UFTRACE
+
+#include "uftrace.h"
+#include "utils/hashmap.h"
+#include "utils/list.h"
+#include "utils/report.h"
+#include "utils/socket.h"
+#include "utils/symbol.h"
+#include "utils/top.h"
+#include "utils/utils.h"
+
+struct top_time {
+	uint64_t call;
+	uint64_t total;
+	uint64_t self;
+	uint64_t max;
+	/* histogram of total time (only for functions) */
+	struct report_hist *hist;
+};
+
+struct top_entry {
+	uint64_t key; /* function address or tid */
+	char *name;
+	struct top_time whole;
+	struct top_time slot[TOP_WINDOW_SLOTS];
+};
+
+struct top_frame {
+	uint64_t addr;
+	uint64_t time;
+	uint64_t child;
+};
+
+struct top_task {
+	int nr_frames;
+	int max_frames;
+	struct top_frame *frames;
+	struct top_entry *entry;
+};
+
+volatile bool top_enabled;
+
+static struct {
+	pthread_mutex_t lock;
+	char *dirname;
+	Hashmap *funcs;
+	Hashmap *tasks;
+	struct strv tids;
+	int slot;
+	int nr_slots;
+	uint64_t start;
+	uint64_t slot_start[TOP_WINDOW_SLOTS];
+} top = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.tids = STRV_INIT,
+};
+
+static uint64_t top_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void reset_window(void)
+{
+	top.slot = 0;
+	top.nr_slots = 1;
+	top.start = top.slot_start[0] = top_now();
+}
+
+void top_init(const char *dirname, const char *tid_filter)
+{
+	top.dirname = xstrdup(dirname);
+	top.funcs = hashmap_create(1024, hashmap_ptr_hash, hashmap_ptr_equals);
+	top.tasks = hashmap_create(64, hashmap_ptr_hash, hashmap_ptr_equals);
+
+	if (tid_filter)
+		strv_split(&top.tids, tid_filter, ",");
+
+	reset_window();
+}
+
+static void free_time(struct top_time *t)
+{
+	free(t->hist);
+}
+
+static bool free_entry(void *key, void *value, void *arg)
+{
+	struct top_entry *entry = value;
+	int i;
+
+	free_time(&entry->whole);
+	for (i = 0; i < TOP_WINDOW_SLOTS; i++)
+		free_time(&entry->slot[i]);
+	free(entry->name);
+	free(entry);
+	return true;
+}
+
+static bool free_task(void *key, void *value, void *arg)
+{
+	struct top_task *task = value;
+
+	free_entry(key, task->entry, arg);
+	free(task->frames);
+	free(task);
+	return true;
+}
+
+static void free_stats(void)
+{
+	hashmap_for_each(top.funcs, free_entry, NULL);
+	hashmap_free(top.funcs);
+	hashmap_for_each(top.tasks, free_task, NULL);
+	hashmap_free(top.tasks);
+}
+
+/* discard all stats (e.g. when a 'uftrace top -p' client is gone) */
+void top_reset(void)
+{
+	pthread_mutex_lock(&top.lock);
+	free_stats();
+	top.funcs = hashmap_create(1024, hashmap_ptr_hash, hashmap_ptr_equals);
+	top.tasks = hashmap_create(64, hashmap_ptr_hash, hashmap_ptr_equals);
+	reset_window();
+	pthread_mutex_unlock(&top.lock);
+}
+
+void top_finish(void)
+{
+	if (top.funcs == NULL)
+		return;
+
+	free_stats();
+	release_record_symtabs();
+	top.funcs = top.tasks = NULL;
+	strv_free(&top.tids);
+	free(top.dirname);
+	top.dirname = NULL;
+}
+
+static struct top_entry *get_func(uint64_t sid, uint64_t addr)
+{
+	struct top_entry *entry;
+	struct uftrace_sym_info *sinfo;
+	struct uftrace_symbol *sym;
+	char *name;
+
+	entry = hashmap_get(top.funcs, (void *)(uintptr_t)addr);
+	if (entry)
+		return entry;
+
+	/* resolve the name now as symbols will be gone after recording */
+	sinfo = get_record_symtabs(top.dirname, sid);
+	sym = find_symtabs(sinfo, addr);
+	name = symbol_getname(sym, addr);
+
+	entry = xzalloc(sizeof(*entry));
+	entry->key = addr;
+	entry->name = xstrdup(name);
+	symbol_putname(sym, name);
+
+	hashmap_put(top.funcs, (void *)(uintptr_t)entry->key, entry);
+	return entry;
+}
+
+static struct top_task *get_task(int tid, uint64_t sid)
+{
+	struct top_task *task;
+	struct top_entry *entry;
+	struct uftrace_sym_info *sinfo;
+	char buf[32];
+	FILE *fp;
+
+	task = hashmap_get(top.tasks, (void *)(uintptr_t)tid);
+	if (task)
+		return task;
+
+	entry = xzalloc(sizeof(*entry));
+	entry->key = tid;
+
+	/* the task might be gone already */
+	snprintf(buf, sizeof(buf), "/proc/%d/comm", tid);
+	fp = fopen(buf, "r");
+	if (fp && fgets(buf, sizeof(buf), fp)) {
+		entry->name = xstrdup(strtok(buf, "\n") ?: "");
+	}
+	else {
+		/* use the executable name (the first map) instead */
+		sinfo = get_record_symtabs(top.dirname, sid);
+		if (sinfo->maps)
+			xasprintf(&entry->name, "%.*s", TASK_COMM_LAST,
+				  basename(sinfo->maps->libname));
+		else
+			entry->name = xstrdup("");
+	}
+	if (fp)
+		fclose(fp);
+
+	task = xzalloc(sizeof(*task));
+	task->entry = entry;
+
+	hashmap_put(top.tasks, (void *)(uintptr_t)tid, task);
+	return task;
+}
+
+static bool check_tid(int tid)
+{
+	char *s;
+	int i;
+
+	if (top.tids.nr == 0)
+		return true;
+
+	strv_for_each(&top.tids, s, i) {
+		if (strtol(s, NULL, 0) == tid)
+			return true;
+	}
+	return false;
+}
+
+static void update_time(struct top_time *t, uint64_t total, uint64_t self, bool hist)
+{
+	t->call++;
+	t->total += total;
+	t->self += self;
+	if (t->max < total)
+		t->max = total;
+
+	if (!hist)
+		return;
+
+	if (t->hist == NULL)
+		t->hist = xzalloc(sizeof(*t->hist));
+	report_hist_add(t->hist, total);
+}
+
+static void push_frame(struct top_task *task, struct uftrace_record *rec)
+{
+	int depth = rec->depth;
+	int i;
+
+	if (depth >= task->max_frames) {
+		task->max_frames = ALIGN(depth + 1, 64);
+		task->frames = xrealloc(task->frames, task->max_frames * sizeof(*task->frames));
+	}
+
+	/* fill the hole (due to lost records or filters) not to match */
+	for (i = task->nr_frames; i < depth; i++)
+		memset(&task->frames[i], 0, sizeof(*task->frames));
+
+	task->frames[depth].addr = rec->addr;
+	task->frames[depth].time = rec->time;
+	task->frames[depth].child = 0;
+	task->nr_frames = depth + 1;
+}
+
+static void pop_frame(struct top_task *task, struct uftrace_record *rec, uint64_t sid)
+{
+	int depth = rec->depth;
+	struct top_frame *frame = &task->frames[depth];
+	struct top_entry *func;
+	uint64_t total, self;
+
+	if (depth >= task->nr_frames || frame->addr != rec->addr || frame->time > rec->time) {
+		/* entry was not seen, just drop it */
+		if (depth < task->nr_frames)
+			task->nr_frames = depth;
+		return;
+	}
+
+	total = rec->time - frame->time;
+	self = total > frame->child ? total - frame->child : 0;
+
+	if (depth > 0)
+		task->frames[depth - 1].child += total;
+	task->nr_frames = depth;
+
+	func = get_func(sid, rec->addr);
+	update_time(&func->whole, total, self, true);
+	update_time(&func->slot[top.slot], total, self, true);
+
+	/* task time is the sum of outermost functions like report --task */
+	if (depth > 0)
+		total = 0;
+	update_time(&task->entry->whole, total, self, false);
+	update_time(&task->entry->slot[top.slot], total, self, false);
+}
+
+/**
+ * top_add_buffer - update stats using records in a buffer
+ * @sid: session id of the buffer
+ * @tid: task id of the buffer
+ * @data: record data
+ * @size: length of @data
+ *
+ * This function should be called for each buffer of a task in order.
+ * It cannot handle argument data as their size is unknown here.
+ */
+void top_add_buffer(uint64_t sid, int tid, void *data, size_t size)
+{
+	struct top_task *task;
+	size_t pos = 0;
+
+	if (!check_tid(tid))
+		return;
+
+	pthread_mutex_lock(&top.lock);
+
+	task = get_task(tid, sid);
+
+	while (pos + sizeof(struct uftrace_record) <= size) {
+		struct uftrace_record *rec = data + pos;
+
+		if (rec->magic != RECORD_MAGIC) {
+			pr_dbg("invalid record magic at %zu of task %d\n", pos, tid);
+			break;
+		}
+		pos += sizeof(*rec);
+
+		if (rec->more) {
+			/* only events have the size of extra data */
+			if (rec->type != UFTRACE_EVENT) {
+				pr_dbg("cannot handle argument data of task %d\n", tid);
+				break;
+			}
+			pos += ALIGN(*(uint16_t *)(data + pos) + 2, 8);
+		}
+
+		switch (rec->type) {
+		case UFTRACE_ENTRY:
+			push_frame(task, rec);
+			break;
+		case UFTRACE_EXIT:
+			pop_frame(task, rec, sid);
+			break;
+		case UFTRACE_LOST:
+			task->nr_frames = 0;
+			break;
+		default:
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&top.lock);
+}
+
+/* @arg is non-NULL for the task map */
+static bool clear_slot(void *key, void *value, void *arg)
+{
+	struct top_entry *entry = value;
+	struct top_time *t;
+
+	if (arg)
+		entry = ((struct top_task *)value)->entry;
+
+	t = &entry->slot[top.slot];
+	t->call = t->total = t->self = t->max = 0;
+
+	/* histograms are big, allocate it again only if it's called in the slot */
+	free(t->hist);
+	t->hist = NULL;
+	return true;
+}
+
+/* start a new slot in the sliding window (and drop the oldest) */
+void top_rotate(void)
+{
+	pthread_mutex_lock(&top.lock);
+
+	top.slot = (top.slot + 1) % TOP_WINDOW_SLOTS;
+	if (top.nr_slots < TOP_WINDOW_SLOTS)
+		top.nr_slots++;
+	top.slot_start[top.slot] = top_now();
+
+	hashmap_for_each(top.funcs, clear_slot, NULL);
+	hashmap_for_each(top.tasks, clear_slot, top.tasks);
+
+	pthread_mutex_unlock(&top.lock);
+}
+
+struct top_row {
+	struct top_entry *entry;
+	struct top_time time;
+	uint64_t p99;
+};
+
+struct top_rows {
+	struct top_row *rows;
+	int nr_rows;
+	bool task;
+	bool whole;
+	bool need_p99;
+};
+
+static void calc_p99(struct top_row *row, bool whole)
+{
+	struct report_hist hist = {};
+	int i;
+
+	if (whole) {
+		row->p99 = report_hist_percentile(row->entry->whole.hist, 990);
+	}
+	else {
+		for (i = 0; i < TOP_WINDOW_SLOTS; i++) {
+			if (row->entry->slot[i].hist)
+				report_hist_merge(&hist, row->entry->slot[i].hist);
+		}
+		row->p99 = report_hist_percentile(&hist, 990);
+	}
+
+	/* the histogram returns the upper bound of the bucket */
+	if (row->p99 > row->time.max)
+		row->p99 = row->time.max;
+}
+
+static bool add_row(void *key, void *value, void *arg)
+{
+	struct top_rows *r = arg;
+	struct top_row *row = &r->rows[r->nr_rows];
+	struct top_entry *entry = value;
+	int i;
+
+	if (r->task)
+		entry = ((struct top_task *)value)->entry;
+
+	memset(row, 0, sizeof(*row));
+	row->entry = entry;
+
+	if (r->whole) {
+		row->time = entry->whole;
+	}
+	else {
+		for (i = 0; i < TOP_WINDOW_SLOTS; i++) {
+			row->time.call += entry->slot[i].call;
+			row->time.total += entry->slot[i].total;
+			row->time.self += entry->slot[i].self;
+			if (row->time.max < entry->slot[i].max)
+				row->time.max = entry->slot[i].max;
+		}
+	}
+
+	if (row->time.call == 0)
+		return true;
+
+	if (r->need_p99)
+		calc_p99(row, r->whole);
+
+	r->nr_rows++;
+	return true;
+}
+
+static uint32_t top_sort_key;
+
+static int cmp_u64(uint64_t a, uint64_t b)
+{
+	return a > b ? -1 : a < b ? 1 : 0;
+}
+
+static int cmp_row(const void *a, const void *b)
+{
+	const struct top_row *ra = a;
+	const struct top_row *rb = b;
+	int ret = 0;
+
+	switch (top_sort_key) {
+	case TOP_SORT_TOTAL:
+		ret = cmp_u64(ra->time.total, rb->time.total);
+		break;
+	case TOP_SORT_CALL:
+		ret = cmp_u64(ra->time.call, rb->time.call);
+		break;
+	case TOP_SORT_AVG:
+		ret = cmp_u64(ra->time.total / ra->time.call, rb->time.total / rb->time.call);
+		break;
+	case TOP_SORT_P99:
+		ret = cmp_u64(ra->p99, rb->p99);
+		break;
+	default:
+		break;
+	}
+
+	if (ret == 0)
+		ret = cmp_u64(ra->time.self, rb->time.self);
+	if (ret == 0)
+		ret = cmp_u64(rb->entry->key, ra->entry->key);
+	return ret;
+}
+
+/* same as print_time_unit() but without color */
+static void print_time(FILE *fp, uint64_t nsec)
+{
+	const char *units[] = { "us", "ms", " s", " m", " h" };
+	unsigned limit[] = { 1000, 1000, 1000, 60, 24, INT_MAX };
+	uint64_t val = nsec;
+	uint64_t small = 0;
+	unsigned idx;
+
+	if (nsec == 0) {
+		fprintf(fp, "  %10s", "");
+		return;
+	}
+
+	for (idx = 0; idx < ARRAY_SIZE(units); idx++) {
+		small = val % limit[idx];
+		val = val / limit[idx];
+
+		if (val < limit[idx + 1])
+			break;
+	}
+
+	/* for some error cases */
+	if (idx == ARRAY_SIZE(units)) {
+		idx--;
+		val = small = 999;
+	}
+	if (val > 999)
+		val = small = 999;
+
+	fprintf(fp, "  %3" PRIu64 ".%03" PRIu64 " %s", val, small, units[idx]);
+}
+
+/**
+ * top_print - print current stats to the given file
+ * @fp: output file
+ * @view: what and how to print
+ */
+void top_print(FILE *fp, struct top_view *view)
+{
+	struct top_rows r = {
+		.task = view->flags & TOP_VIEW_TASK,
+		.whole = view->flags & TOP_VIEW_WHOLE,
+	};
+	uint64_t now = top_now();
+	uint64_t elapsed;
+	uint64_t nr_calls = 0;
+	int first_slot;
+	int i;
+
+	pthread_mutex_lock(&top.lock);
+
+	if (r.whole) {
+		elapsed = now - top.start;
+	}
+	else {
+		first_slot = (top.slot - top.nr_slots + 1 + TOP_WINDOW_SLOTS) % TOP_WINDOW_SLOTS;
+		elapsed = now - top.slot_start[first_slot];
+	}
+	if (elapsed == 0)
+		elapsed = 1;
+
+	top_sort_key = view->sort;
+	if (r.task && (top_sort_key == TOP_SORT_AVG || top_sort_key == TOP_SORT_P99))
+		top_sort_key = TOP_SORT_SELF;
+	/* calculate p99 for all only if it's used for sorting */
+	r.need_p99 = !r.task && top_sort_key == TOP_SORT_P99;
+
+	if (r.task) {
+		r.rows = xcalloc(hashmap_size(top.tasks) + 1, sizeof(*r.rows));
+		hashmap_for_each(top.tasks, add_row, &r);
+	}
+	else {
+		r.rows = xcalloc(hashmap_size(top.funcs) + 1, sizeof(*r.rows));
+		hashmap_for_each(top.funcs, add_row, &r);
+	}
+
+	qsort(r.rows, r.nr_rows, sizeof(*r.rows), cmp_row);
+
+	for (i = 0; i < r.nr_rows; i++)
+		nr_calls += r.rows[i].time.call;
+
+	fprintf(fp, "# %s: %.1f sec, %zu task(s), %" PRIu64 " call(s), %.1f calls/sec\n",
+		r.whole ? "total" : "window", (double)elapsed / NSEC_PER_SEC,
+		hashmap_size(top.tasks), nr_calls, (double)nr_calls * NSEC_PER_SEC / elapsed);
+
+	if (r.task) {
+		fprintf(fp, "  %10s  %10s  %10s  %10s  %6s  %-16s\n", "Total time", "Self time",
+			"Calls", "Calls/s", "TID", "Task name");
+		fprintf(fp, "  %10s  %10s  %10s  %10s  %6s  %-16s\n", "==========", "==========",
+			"==========", "==========", "======", "================");
+	}
+	else {
+		fprintf(fp, "  %10s  %10s  %10s  %10s  %10s  %10s  %s\n", "Total time",
+			"Self time", "Calls", "Calls/s", "Total avg", "Total p99", "Function");
+		fprintf(fp, "  %10s  %10s  %10s  %10s  %10s  %10s  %s\n", "==========",
+			"==========", "==========", "==========", "==========", "==========",
+			"====================");
+	}
+
+	for (i = 0; i < r.nr_rows; i++) {
+		struct top_row *row = &r.rows[i];
+
+		if (view->rows && i >= (int)view->rows)
+			break;
+
+		print_time(fp, row->time.total);
+		print_time(fp, row->time.self);
+		fprintf(fp, "  %10" PRIu64 "  %10.1f", row->time.call,
+			(double)row->time.call * NSEC_PER_SEC / elapsed);
+
+		if (r.task) {
+			fprintf(fp, "  %6" PRIu64 "  %-16s\n", row->entry->key, row->entry->name);
+			continue;
+		}
+
+		if (!r.need_p99)
+			calc_p99(row, r.whole);
+
+		print_time(fp, row->time.total / row->time.call);
+		print_time(fp, row->p99);
+		fprintf(fp, "  %s\n", row->entry->name);
+	}
+
+	pthread_mutex_unlock(&top.lock);
+
+	free(r.rows);
+}
+
+int top_parse_sort(const char *keys, uint32_t *sort)
+{
+	const struct {
+		const char *name;
+		enum top_sort_key key;
+	} sort_keys[] = {
+		{ "self", TOP_SORT_SELF }, { "total", TOP_SORT_TOTAL }, { "call", TOP_SORT_CALL },
+		{ "avg", TOP_SORT_AVG },   { "p99", TOP_SORT_P99 },
+	};
+	size_t len;
+	unsigned i;
+
+	if (keys == NULL) {
+		*sort = TOP_SORT_SELF;
+		return 0;
+	}
+
+	/* only the first key is used */
+	len = strcspn(keys, ",");
+	for (i = 0; i < ARRAY_SIZE(sort_keys); i++) {
+		if (strlen(sort_keys[i].name) == len && !strncmp(keys, sort_keys[i].name, len)) {
+			*sort = sort_keys[i].key;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static struct {
+	pthread_t thread;
+	struct sockaddr_un addr;
+	int sfd;
+	bool done;
+} server = {
+	.sfd = -1,
+};
+
+static int wait_input(int fd)
+{
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = POLLIN,
+	};
+	int ret;
+
+	do {
+		ret = poll(&pfd, 1, 1000);
+		if (server.done)
+			return -1;
+	} while (ret == 0 || (ret < 0 && errno == EINTR));
+
+	return ret < 0 ? -1 : 0;
+}
+
+/* use send() not to get SIGPIPE when the other side is gone */
+static int send_all(int fd, const void *buf, size_t size)
+{
+	ssize_t ret;
+
+	while (size) {
+		ret = send(fd, buf, size, MSG_NOSIGNAL);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			return -1;
+
+		buf += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
+static void serve_client(int cfd)
+{
+	struct top_view view;
+	char *buf = NULL;
+	size_t len = 0;
+	uint32_t size;
+	FILE *fp;
+
+	top_reset();
+	top_enabled = true;
+
+	while (wait_input(cfd) == 0) {
+		if (read_all(cfd, &view, sizeof(view)) < 0)
+			break;
+
+		fp = open_memstream(&buf, &len);
+		if (fp == NULL)
+			break;
+
+		top_print(fp, &view);
+		fclose(fp);
+		top_rotate();
+
+		size = len;
+		if (send_all(cfd, &size, sizeof(size)) < 0 || send_all(cfd, buf, len) < 0)
+			break;
+
+		free(buf);
+		buf = NULL;
+	}
+
+	free(buf);
+	top_enabled = false;
+}
+
+static void *top_server_thread(void *arg)
+{
+	int cfd;
+
+	pthread_setname_np(pthread_self(), "TopServer");
+
+	while (wait_input(server.sfd) == 0) {
+		cfd = socket_accept(server.sfd);
+		if (cfd < 0)
+			continue;
+
+		pr_dbg("top client connected\n");
+		serve_client(cfd);
+		close(cfd);
+		pr_dbg("top client disconnected\n");
+	}
+	return NULL;
+}
+
+/**
+ * top_server_start - start a thread to serve the stats
+ * @dirname: data directory to find session maps
+ * @pid: process id of the target
+ *
+ * This creates a socket in the agent directory so that 'uftrace top -p'
+ * can attach to the recording of @pid.  It collects the stats only when
+ * a client is connected.
+ */
+void top_server_start(const char *dirname, int pid)
+{
+	if (mkdir(MCOUNT_AGENT_SOCKET_DIR, 0775) < 0 && errno != EEXIST) {
+		pr_dbg("cannot create %s: %m\n", MCOUNT_AGENT_SOCKET_DIR);
+		return;
+	}
+
+	server.sfd = socket_create_top(&server.addr, pid);
+	if (server.sfd < 0)
+		return;
+
+	socket_unlink(&server.addr);
+	if (socket_listen(server.sfd, &server.addr) < 0) {
+		server.sfd = -1;
+		return;
+	}
+
+	top_init(dirname, NULL);
+
+	server.done = false;
+	if (pthread_create(&server.thread, NULL, top_server_thread, NULL) != 0) {
+		pr_dbg("cannot start top server: %m\n");
+		close(server.sfd);
+		socket_unlink(&server.addr);
+		server.sfd = -1;
+		top_finish();
+	}
+}
+
+/**
+ * top_request - get the stats from the recorder
+ * @fd: socket connected to the recorder
+ * @view: what and how to print
+ *
+ * This returns the formatted output of the stats which should be freed
+ * by the caller, or NULL if the recorder is gone.
+ */
+char *top_request(int fd, struct top_view *view)
+{
+	uint32_t size;
+	char *buf;
+
+	if (send_all(fd, view, sizeof(*view)) < 0)
+		return NULL;
+	if (read_all(fd, &size, sizeof(size)) < 0)
+		return NULL;
+
+	buf = xmalloc(size + 1);
+	if (read_all(fd, buf, size) < 0) {
+		free(buf);
+		return NULL;
+	}
+	buf[size] = '\0';
+	return buf;
+}
+
+void top_server_stop(void)
+{
+	if (server.sfd < 0)
+		return;
+
+	server.done = true;
+	pthread_join(server.thread, NULL);
+
+	close(server.sfd);
+	socket_unlink(&server.addr);
+	server.sfd = -1;
+
+	top_finish();
+}
+
+#ifdef UNIT_TEST
+
+static void *make_buffer(size_t *size, const int *types, const int *depths, const uint64_t *times,
+			 const uint64_t *addrs, int nr)
+{
+	struct uftrace_record *recs = xcalloc(nr, sizeof(*recs));
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		recs[i].time = times[i];
+		recs[i].type = types[i];
+		recs[i].magic = RECORD_MAGIC;
+		recs[i].depth = depths[i];
+		recs[i].addr = addrs[i];
+	}
+	*size = nr * sizeof(*recs);
+	return recs;
+}
+
+TEST_CASE(top_stats)
+{
+	/* a() { b(); b(); } */
+	int types[] = { UFTRACE_ENTRY, UFTRACE_ENTRY, UFTRACE_EXIT,
+			UFTRACE_ENTRY, UFTRACE_EXIT,  UFTRACE_EXIT };
+	int depths[] = { 0, 1, 1, 1, 1, 0 };
+	uint64_t times[] = { 100, 200, 300, 400, 600, 1000 };
+	uint64_t addrs[] = { 0x1000, 0x2000, 0x2000, 0x2000, 0x2000, 0x1000 };
+	struct top_entry *a, *b;
+	struct top_task *task;
+	void *buf;
+	size_t size;
+
+	top_init("/nonexistent", NULL);
+
+	pr_dbg("add a buffer (split in the middle)\n");
+	buf = make_buffer(&size, types, depths, times, addrs, ARRAY_SIZE(types));
+	top_add_buffer(1, 42, buf, size / 2);
+	top_add_buffer(1, 42, buf + size / 2, size / 2);
+
+	a = hashmap_get(top.funcs, (void *)0x1000);
+	b = hashmap_get(top.funcs, (void *)0x2000);
+	TEST_NE(a, NULL);
+	TEST_NE(b, NULL);
+	TEST_STREQ(a->name, "<1000>");
+
+	TEST_EQ(a->whole.call, 1);
+	TEST_EQ(a->whole.total, 900);
+	TEST_EQ(a->whole.self, 600);
+	TEST_EQ(b->whole.call, 2);
+	TEST_EQ(b->whole.total, 300);
+	TEST_EQ(b->whole.self, 300);
+	TEST_EQ(b->slot[0].call, 2);
+	TEST_EQ(b->whole.hist->count, 2);
+
+	task = hashmap_get(top.tasks, (void *)42);
+	TEST_NE(task, NULL);
+	TEST_EQ(task->entry->whole.call, 3);
+	TEST_EQ(task->entry->whole.total, 900);
+	TEST_EQ(task->entry->whole.self, 900);
+
+	pr_dbg("rotate the window until the data is gone\n");
+	top_rotate();
+	TEST_EQ(b->slot[0].call, 2);
+	TEST_EQ(top.nr_slots, 2);
+
+	while (top.slot != 0)
+		top_rotate();
+	TEST_EQ(b->slot[0].call, 0);
+	TEST_EQ(b->whole.call, 2);
+	TEST_EQ(top.nr_slots, TOP_WINDOW_SLOTS);
+
+	pr_dbg("exit without entry should be ignored\n");
+	top_add_buffer(1, 42, buf + size - sizeof(struct uftrace_record),
+		       sizeof(struct uftrace_record));
+	TEST_EQ(b->whole.call, 2);
+	TEST_EQ(a->whole.call, 1);
+
+	free(buf);
+	top_finish();
+	return TEST_OK;
+}
+
+TEST_CASE(top_sort_keys)
+{
+	uint32_t sort;
+
+	TEST_EQ(top_parse_sort(NULL, &sort), 0);
+	TEST_EQ(sort, TOP_SORT_SELF);
+	TEST_EQ(top_parse_sort("p99", &sort), 0);
+	TEST_EQ(sort, TOP_SORT_P99);
+	TEST_EQ(top_parse_sort("call,total", &sort), 0);
+	TEST_EQ(sort, TOP_SORT_CALL);
+	TEST_EQ(top_parse_sort("calls", &sort), -1);
+
+	return TEST_OK;
+}
+
+#endif /* UNIT_TEST */
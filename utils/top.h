@@ -0,0 +1,51 @@
+#ifndef UFTRACE_TOP_H
+#define UFTRACE_TOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* number of intervals in the sliding window */
+#define TOP_WINDOW_SLOTS 10
+
+/* default refresh interval (in msec) */
+#define TOP_DEFAULT_INTERVAL 1000
+
+enum top_sort_key {
+	TOP_SORT_SELF,
+	TOP_SORT_TOTAL,
+	TOP_SORT_CALL,
+	TOP_SORT_AVG,
+	TOP_SORT_P99,
+};
+
+#define TOP_VIEW_TASK (1U << 0) /* show tasks instead of functions */
+#define TOP_VIEW_WHOLE (1U << 1) /* show stats of whole run instead of the window */
+
+/* this is sent to the recorder by 'uftrace top -p' as well */
+struct top_view {
+	uint32_t sort;
+	uint32_t flags;
+	uint32_t rows; /* 0 means unlimited */
+	uint32_t interval; /* msec */
+};
+
+/* writers feed buffers only when it's set */
+extern volatile bool top_enabled;
+
+void top_init(const char *dirname, const char *tid_filter);
+void top_finish(void);
+void top_reset(void);
+
+void top_add_buffer(uint64_t sid, int tid, void *data, size_t size);
+void top_rotate(void);
+void top_print(FILE *fp, struct top_view *view);
+
+int top_parse_sort(const char *keys, uint32_t *sort);
+
+/* serve the stats to 'uftrace top -p PID' during recording */
+void top_server_start(const char *dirname, int pid);
+void top_server_stop(void);
+char *top_request(int fd, struct top_view *view);
+
+#endif /* UFTRACE_TOP_H */